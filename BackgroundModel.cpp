@@ -0,0 +1,100 @@
+// Velodyne HDL Background Model
+// Nick Rypkema (rypkema@mit.edu), MIT 2017
+// shared library to learn the static background of a fixed sensor from raw return distances and flag foreground returns
+
+#include <cmath>
+#include <algorithm>
+
+#include "BackgroundModel.h"
+
+namespace
+{
+const unsigned int NUM_LASERS = 64;
+const double DISTANCE_UNIT = 0.002; // metres per raw distance unit
+// returns a cell learns from before it can call anything background - until then every return is foreground
+const unsigned int BACKGROUND_MIN_SAMPLES = 10;
+// a return is foreground when closer than the background by this many deviations (or the threshold, if larger)
+const double BACKGROUND_DEVIATION_SCALE = 3.0;
+// fraction of the adaptation rate foreground returns pull the model with, so an object that stops is absorbed
+const double BACKGROUND_FOREGROUND_RATE = 0.05;
+}
+
+BackgroundModel::BackgroundModel(double adaptation_rate, double threshold, unsigned int azimuth_bin)
+{
+  _azimuth_bin = std::max(1u, std::min(azimuth_bin, 36000u));
+  _num_bins = (36000 + _azimuth_bin - 1)/_azimuth_bin;
+  _cells.resize(NUM_LASERS*_num_bins);
+  SetAdaptationRate(adaptation_rate);
+  SetThreshold(threshold);
+  Clear();
+}
+
+BackgroundModel::~BackgroundModel()
+{
+}
+
+void BackgroundModel::SetAdaptationRate(double adaptation_rate)
+{
+  _adaptation_rate = std::max(0.0, std::min(adaptation_rate, 1.0));
+}
+
+double BackgroundModel::GetAdaptationRate()
+{
+  return _adaptation_rate;
+}
+
+void BackgroundModel::SetThreshold(double threshold)
+{
+  _threshold = std::max(0.0, threshold)/DISTANCE_UNIT;
+}
+
+double BackgroundModel::GetThreshold()
+{
+  return _threshold*DISTANCE_UNIT;
+}
+
+void BackgroundModel::Clear()
+{
+  Cell empty = { 0, 0, 0 };
+  std::fill(_cells.begin(), _cells.end(), empty);
+  _num_foreground = 0;
+  _num_background = 0;
+}
+
+uint64_t BackgroundModel::GetNumberOfForeground()
+{
+  return _num_foreground;
+}
+
+uint64_t BackgroundModel::GetNumberOfBackground()
+{
+  return _num_background;
+}
+
+bool BackgroundModel::IsForeground(unsigned char laser_id, unsigned short azimuth, unsigned short distance)
+{
+  Cell& cell = _cells[(laser_id % NUM_LASERS)*_num_bins + (azimuth % 36000)/_azimuth_bin];
+  float difference = distance - cell.mean;
+
+  if (cell.count < BACKGROUND_MIN_SAMPLES) {
+    // a plain running average until the cell has enough returns to trust
+    cell.count++;
+    cell.mean += difference/cell.count;
+    if (cell.count > 1) {
+      cell.deviation += (std::fabs(difference) - cell.deviation)/(cell.count - 1);
+    }
+    _num_foreground++;
+    return(true);
+  }
+
+  bool foreground = difference < -std::max(_threshold, BACKGROUND_DEVIATION_SCALE*cell.deviation);
+  float rate = foreground ? _adaptation_rate*BACKGROUND_FOREGROUND_RATE : _adaptation_rate;
+  cell.mean += rate*difference;
+  cell.deviation += rate*(std::fabs(difference) - cell.deviation);
+  if (foreground) {
+    _num_foreground++;
+  } else {
+    _num_background++;
+  }
+  return foreground;
+}
@@ -0,0 +1,51 @@
+// Velodyne HDL Background Model
+// Nick Rypkema (rypkema@mit.edu), MIT 2017
+// shared library to learn the static background of a fixed sensor from raw return distances and flag foreground returns
+
+#ifndef BACKGROUND_MODEL_H_INCLUDED
+#define BACKGROUND_MODEL_H_INCLUDED
+
+#include <vector>
+#include <stdint.h>
+
+// azimuth width of one model cell, in hundredths of a degree
+const unsigned int BACKGROUND_AZIMUTH_BIN = 20;
+
+// One cell per (laser_id, azimuth bin), each an exponentially weighted mean and mean absolute deviation of
+// the raw distance (2mm units, as in the packet) of the returns it has seen. A fixed sensor sees its
+// background as the farthest steady return in each cell, so only returns closer than it are foreground -
+// farther ones mean the background itself moved, and are learned at the full rate.
+class BackgroundModel
+{
+public:
+  BackgroundModel(double adaptation_rate, double threshold, unsigned int azimuth_bin = BACKGROUND_AZIMUTH_BIN);
+  virtual ~BackgroundModel();
+  void SetAdaptationRate(double adaptation_rate); // fraction of the difference a cell moves by per return, (0, 1]
+  double GetAdaptationRate();
+  void SetThreshold(double threshold);             // metres
+  double GetThreshold();
+  void Clear();                                    // forget the background and start learning again
+  uint64_t GetNumberOfForeground();
+  uint64_t GetNumberOfBackground();
+
+  // classifies one non-zero return and learns from it
+  bool IsForeground(unsigned char laser_id, unsigned short azimuth, unsigned short distance);
+
+private:
+  struct Cell
+  {
+    float mean;
+    float deviation;
+    uint32_t count;
+  };
+
+  unsigned int _azimuth_bin;
+  unsigned int _num_bins;
+  double _adaptation_rate;
+  double _threshold;     // raw distance units
+  std::vector<Cell> _cells;
+  uint64_t _num_foreground;
+  uint64_t _num_background;
+};
+
+#endif // BACKGROUND_MODEL_H_INCLUDED
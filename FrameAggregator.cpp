@@ -0,0 +1,422 @@
+// Velodyne HDL Frame Aggregator
+// Nick Rypkema (rypkema@mit.edu), MIT 2017
+// shared library to merge the frames of several sensors, each with its own PacketDecoder, into one cloud
+
+#include <cstdlib>
+#include <iostream>
+#include <time.h>
+#include <boost/bind.hpp>
+
+#include "FrameAggregator.h"
+
+namespace
+{
+double MonotonicMicroseconds()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec*1e6 + now.tv_nsec*1e-3;
+}
+
+void ClearMergedFrame(FrameAggregator::MergedFrame* frame)
+{
+  frame->points.x.clear();
+  frame->points.y.clear();
+  frame->points.z.clear();
+  frame->points.intensity.clear();
+  frame->points.laser_id.clear();
+  frame->points.azimuth.clear();
+  frame->points.distance.clear();
+  frame->points.ms_from_top_of_hour.clear();
+  frame->points.label.clear();
+  frame->sensor_id.clear();
+  frame->sensor_mask = 0;
+}
+
+void ReserveMergedFrame(FrameAggregator::MergedFrame* frame, unsigned int max_points)
+{
+  frame->points.x.reserve(max_points);
+  frame->points.y.reserve(max_points);
+  frame->points.z.reserve(max_points);
+  frame->points.intensity.reserve(max_points);
+  frame->points.laser_id.reserve(max_points);
+  frame->points.azimuth.reserve(max_points);
+  frame->points.distance.reserve(max_points);
+  frame->points.ms_from_top_of_hour.reserve(max_points);
+  frame->sensor_id.reserve(max_points);
+}
+
+// swaps buffers rather than copying points
+void SwapMergedFrames(FrameAggregator::MergedFrame* a, FrameAggregator::MergedFrame* b)
+{
+  a->points.x.swap(b->points.x);
+  a->points.y.swap(b->points.y);
+  a->points.z.swap(b->points.z);
+  a->points.intensity.swap(b->points.intensity);
+  a->points.laser_id.swap(b->points.laser_id);
+  a->points.azimuth.swap(b->points.azimuth);
+  a->points.distance.swap(b->points.distance);
+  a->points.ms_from_top_of_hour.swap(b->points.ms_from_top_of_hour);
+  a->points.label.swap(b->points.label);
+  a->sensor_id.swap(b->sensor_id);
+  std::swap(a->index, b->index);
+  std::swap(a->sensor_mask, b->sensor_mask);
+}
+}
+
+FrameAggregator::FrameAggregator(AlignmentMode mode)
+{
+  _mode = mode;
+  _cut_angle = 0;
+  _window = 100000;
+  _max_points = 0;
+  // frame numbers start at zero when aligning by cut angle, time windows start wherever the first packet is
+  _base_set = (mode == ALIGN_CUT_ANGLE);
+  _base = 0;
+  _packet_time = 0;
+  _has_latest = false;
+  _num_completed = 0;
+  _latest.index = 0;
+  _latest.sensor_mask = 0;
+  _slots.resize(AGGREGATOR_NUM_SLOTS);
+  for (unsigned int i = 0; i < _slots.size(); i++) {
+    ClearMergedFrame(&_slots[i].frame);
+    _slots[i].frame.index = 0;
+  }
+}
+
+FrameAggregator::~FrameAggregator()
+{
+  for (unsigned int i = 0; i < _sensors.size(); i++) {
+    _sensors[i].decoder->SetFrameCallback(PacketDecoder::FrameCallback());
+    _sensors[i].decoder->SetOutputFrame(NULL);
+  }
+}
+
+void FrameAggregator::SetCutAngle(unsigned int cut_angle)
+{
+  boost::mutex::scoped_lock lock(_mutex);
+  _cut_angle = cut_angle % 36000;
+  for (unsigned int i = 0; i < _sensors.size(); i++) {
+    _sensors[i].decoder->SetCutAngle(_cut_angle);
+  }
+}
+
+void FrameAggregator::SetTimeWindow(unsigned int window)
+{
+  boost::mutex::scoped_lock lock(_mutex);
+  if (window == 0) {
+    std::cout << "FrameAggregator: Warning, time window must be positive" << std::endl;
+    return;
+  }
+  _window = window;
+}
+
+void FrameAggregator::Reserve(unsigned int max_points)
+{
+  boost::mutex::scoped_lock lock(_mutex);
+  _max_points = max_points;
+  for (unsigned int i = 0; i < _slots.size(); i++) {
+    ReserveMergedFrame(&_slots[i].frame, _max_points);
+  }
+}
+
+int FrameAggregator::AddSensor(PacketDecoder* decoder)
+{
+  boost::mutex::scoped_lock lock(_mutex);
+  if (_sensors.size() >= AGGREGATOR_MAX_SENSORS) {
+    std::cout << "FrameAggregator: Error, at most " << AGGREGATOR_MAX_SENSORS << " sensors can be aggregated" << std::endl;
+    return(-1);
+  }
+  // every decoder appends to the same merged columns, so a column one sensor skips would misalign the rest
+  if (!_sensors.empty() && decoder->GetColumnMask() != _sensors[0].decoder->GetColumnMask()) {
+    std::cout << "FrameAggregator: Error, sensor column mask 0x" << std::hex << decoder->GetColumnMask() << " differs from 0x"
+              << _sensors[0].decoder->GetColumnMask() << std::dec << " of the sensors already added" << std::endl;
+    return(-1);
+  }
+
+  unsigned int id = _sensors.size();
+  Sensor sensor;
+  sensor.decoder = decoder;
+  sensor.started = false;
+  sensor.target = 0;
+  sensor.status.num_frames = 0;
+  sensor.status.num_missed = 0;
+  sensor.status.last_arrival_skew = 0;
+  sensor.status.max_arrival_skew = 0;
+  sensor.status.mean_arrival_skew = 0;
+  sensor.status.last_timestamp_skew = 0;
+  _sensors.push_back(sensor);
+
+  for (unsigned int i = 0; i < _slots.size(); i++) {
+    _slots[i].arrival.resize(_sensors.size(), 0);
+    _slots[i].first_timestamp.resize(_sensors.size(), 0);
+    _slots[i].contributed.resize(_sensors.size(), false);
+  }
+
+  decoder->SetCutAngle(_cut_angle);
+  decoder->SetFrameCallback(boost::bind(&FrameAggregator::SensorFrameCallback, this, id, _1));
+  return(id);
+}
+
+void FrameAggregator::DecodePacket(unsigned int sensor, const char* data, unsigned int data_length)
+{
+  std::vector<MergedFrame> completed;
+  unsigned int num_completed;
+  MergedFrameCallback callback;
+  {
+    boost::mutex::scoped_lock lock(_mutex);
+    if (sensor >= _sensors.size()) {
+      std::cout << "FrameAggregator: Warning, packet for unknown sensor " << sensor << std::endl;
+      return;
+    }
+    if (data_length != 1206) {
+      std::cout << "FrameAggregator: Warning, data packet is not 1206 bytes" << std::endl;
+      return;
+    }
+
+    Sensor& s = _sensors[sensor];
+    _packet_time = PacketTime(s, data);
+    if (!s.started) {
+      s.started = true;
+      StartSensorFrame(sensor, TargetFor(s, false));
+    }
+
+    // the decoder appends straight into the merged frame, only the sensor id column is filled in here
+    s.decoder->DecodePacket(data, data_length);
+    PadSensorIds(SlotFor(s.target), sensor);
+
+    if (_num_completed == 0) {
+      return;
+    }
+    completed.swap(_completed);
+    num_completed = _num_completed;
+    _num_completed = 0;
+    callback = _callback;
+  }
+
+  // outside the lock, so the callback may call back into the aggregator
+  for (unsigned int i = 0; i < num_completed; i++) {
+    callback(completed[i]);
+  }
+
+  // hand the frames' storage back for reuse, unless another thread has completed frames in the meantime
+  boost::mutex::scoped_lock lock(_mutex);
+  if (_num_completed == 0) {
+    _completed.swap(completed);
+  }
+}
+
+void FrameAggregator::SetMergedFrameCallback(const FrameAggregator::MergedFrameCallback& callback)
+{
+  boost::mutex::scoped_lock lock(_mutex);
+  _callback = callback;
+}
+
+bool FrameAggregator::GetLatestFrame(FrameAggregator::MergedFrame* frame)
+{
+  boost::mutex::scoped_lock lock(_mutex);
+  if (!_has_latest) {
+    return(false);
+  }
+  SwapMergedFrames(frame, &_latest);
+  _has_latest = false;
+  return(true);
+}
+
+bool FrameAggregator::GetSensorStatus(unsigned int sensor, FrameAggregator::SensorStatus* status)
+{
+  boost::mutex::scoped_lock lock(_mutex);
+  if (sensor >= _sensors.size()) {
+    return(false);
+  }
+  *status = _sensors[sensor].status;
+  return(true);
+}
+
+void FrameAggregator::SensorFrameCallback(unsigned int sensor, const PacketDecoder::HDLFrame&)
+{
+  // called from inside DecodePacket, so the mutex is already held
+  Sensor& s = _sensors[sensor];
+  Slot& slot = SlotFor(s.target);
+  PadSensorIds(slot, sensor);
+  slot.arrival[sensor] = MonotonicMicroseconds();
+
+  StartSensorFrame(sensor, TargetFor(s, true));
+  CompleteReady();
+}
+
+void FrameAggregator::StartSensorFrame(unsigned int sensor, uint64_t target)
+{
+  if (target >= _base + AGGREGATOR_NUM_SLOTS) {
+    // hand over what is in flight, a jump in gps time skips the empty windows in between
+    uint64_t new_base = target - AGGREGATOR_NUM_SLOTS + 1;
+    for (unsigned int i = 0; i < AGGREGATOR_NUM_SLOTS && _base < new_base; i++) {
+      CompleteOldest();
+    }
+    if (_base < new_base) {
+      _base = new_base;
+      CatchUpSensors();
+    }
+  }
+
+  Sensor& s = _sensors[sensor];
+  s.target = target;
+  Slot& slot = SlotFor(target);
+  if (!slot.contributed[sensor]) {
+    slot.contributed[sensor] = true;
+    slot.first_timestamp[sensor] = _packet_time;
+  }
+  s.decoder->SetOutputFrame(&slot.frame.points);
+}
+
+void FrameAggregator::PadSensorIds(FrameAggregator::Slot& slot, unsigned int sensor)
+{
+  slot.frame.sensor_id.resize(HDLFrameSize(slot.frame.points), static_cast<unsigned char>(sensor));
+}
+
+uint64_t FrameAggregator::PacketTime(FrameAggregator::Sensor& sensor, const char* data)
+{
+  const HDLDataPacket* packet = reinterpret_cast<const HDLDataPacket*>(data);
+  int64_t timestamp = ((packet->gpsTimestamp + static_cast<int64_t>(sensor.decoder->GetTimeOffset())) % HDL_US_PER_HOUR + HDL_US_PER_HOUR) % HDL_US_PER_HOUR;
+
+  // unwrap to whichever hour puts it closest to the previous packet of any sensor
+  int64_t hour = static_cast<int64_t>(_packet_time / HDL_US_PER_HOUR);
+  int64_t best = hour*HDL_US_PER_HOUR + timestamp;
+  int64_t candidates[2] = { (hour - 1)*HDL_US_PER_HOUR + timestamp, (hour + 1)*HDL_US_PER_HOUR + timestamp };
+  for (int i = 0; i < 2; i++) {
+    if (candidates[i] >= 0 && std::abs(candidates[i] - static_cast<int64_t>(_packet_time)) < std::abs(best - static_cast<int64_t>(_packet_time))) {
+      best = candidates[i];
+    }
+  }
+  return static_cast<uint64_t>(best);
+}
+
+uint64_t FrameAggregator::TargetFor(FrameAggregator::Sensor& sensor, bool next)
+{
+  uint64_t target;
+  if (_mode == ALIGN_TIME_WINDOW) {
+    target = _packet_time / _window;
+    if (next && target < sensor.target) {
+      target = sensor.target;
+    }
+  } else {
+    target = next ? sensor.target + 1 : _base;
+  }
+
+  if (!_base_set) {
+    _base = target;
+    _base_set = true;
+  }
+  // a sensor running behind joins the oldest merged frame still open
+  if (target < _base) {
+    target = _base;
+  }
+  return target;
+}
+
+FrameAggregator::Slot& FrameAggregator::SlotFor(uint64_t index)
+{
+  return _slots[index % _slots.size()];
+}
+
+void FrameAggregator::CatchUpSensors()
+{
+  for (unsigned int i = 0; i < _sensors.size(); i++) {
+    if (_sensors[i].started && _sensors[i].target < _base) {
+      // this sensor's partial frame went out with the merged frame, the rest goes into the next one
+      _sensors[i].target = _base;
+      Slot& slot = SlotFor(_base);
+      if (!slot.contributed[i]) {
+        slot.contributed[i] = true;
+        slot.first_timestamp[i] = _packet_time;
+      }
+      _sensors[i].decoder->SetOutputFrame(&slot.frame.points);
+    }
+  }
+}
+
+void FrameAggregator::CompleteReady()
+{
+  while (true) {
+    bool any_started = false;
+    for (unsigned int i = 0; i < _sensors.size(); i++) {
+      if (!_sensors[i].started) {
+        continue;
+      }
+      any_started = true;
+      if (_sensors[i].target <= _base) {
+        return;
+      }
+    }
+    if (!any_started) {
+      return;
+    }
+    CompleteOldest();
+  }
+}
+
+void FrameAggregator::CompleteOldest()
+{
+  Slot& slot = SlotFor(_base);
+  MergedFrame& frame = slot.frame;
+  frame.index = _base;
+  frame.sensor_mask = 0;
+
+  double first_arrival = 0;
+  uint64_t first_timestamp = 0;
+  bool have_arrival = false;
+  bool have_timestamp = false;
+  for (unsigned int i = 0; i < _sensors.size(); i++) {
+    if (slot.arrival[i] > 0 && (!have_arrival || slot.arrival[i] < first_arrival)) {
+      first_arrival = slot.arrival[i];
+      have_arrival = true;
+    }
+    if (slot.contributed[i] && (!have_timestamp || slot.first_timestamp[i] < first_timestamp)) {
+      first_timestamp = slot.first_timestamp[i];
+      have_timestamp = true;
+    }
+  }
+
+  for (unsigned int i = 0; i < _sensors.size(); i++) {
+    SensorStatus& status = _sensors[i].status;
+    if (slot.contributed[i]) {
+      frame.sensor_mask |= (1u << i);
+    }
+    if (slot.arrival[i] > 0) {
+      double skew = slot.arrival[i] - first_arrival;
+      status.num_frames++;
+      status.last_arrival_skew = skew;
+      status.mean_arrival_skew += (skew - status.mean_arrival_skew) / status.num_frames;
+      if (skew > status.max_arrival_skew) {
+        status.max_arrival_skew = skew;
+      }
+      status.last_timestamp_skew = static_cast<double>(slot.first_timestamp[i] - first_timestamp);
+    } else if (_sensors[i].started) {
+      status.num_missed++;
+    }
+  }
+
+  if (_callback) {
+    // delivered by DecodePacket once the mutex is released, the slot takes the queued frame's storage
+    if (_num_completed == _completed.size()) {
+      _completed.resize(_num_completed + 1);
+    }
+    SwapMergedFrames(&_completed[_num_completed], &frame);
+    _num_completed++;
+  } else {
+    SwapMergedFrames(&_latest, &frame);
+    _has_latest = true;
+  }
+
+  ClearMergedFrame(&frame);
+  ReserveMergedFrame(&frame, _max_points);
+  for (unsigned int i = 0; i < _sensors.size(); i++) {
+    slot.arrival[i] = 0;
+    slot.first_timestamp[i] = 0;
+    slot.contributed[i] = false;
+  }
+
+  _base++;
+  CatchUpSensors();
+}
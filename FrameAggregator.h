@@ -0,0 +1,113 @@
+// Velodyne HDL Frame Aggregator
+// Nick Rypkema (rypkema@mit.edu), MIT 2017
+// shared library to merge the frames of several sensors, each with its own PacketDecoder, into one cloud
+
+#ifndef FRAME_AGGREGATOR_H_INCLUDED
+#define FRAME_AGGREGATOR_H_INCLUDED
+
+#include <vector>
+#include <stdint.h>
+#include <boost/function.hpp>
+#include <boost/static_assert.hpp>
+#include <boost/thread/mutex.hpp>
+#include "PacketDecoder.h"
+
+// merged frames in flight at once - how far the fastest sensor may run ahead of the slowest before
+// the oldest merged frame is handed over without it
+const unsigned int AGGREGATOR_NUM_SLOTS = 3;
+// one bit each in MergedFrame::sensor_mask
+const unsigned int AGGREGATOR_MAX_SENSORS = 32;
+
+class FrameAggregator
+{
+public:
+  enum AlignmentMode
+  {
+    ALIGN_CUT_ANGLE = 0,  // the n-th frame of every sensor, each split at the shared cut angle, makes up merged frame n
+    ALIGN_TIME_WINDOW = 1 // sensor frames are grouped by the gps time window they start in
+  };
+
+  struct MergedFrame
+  {
+    PacketDecoder::HDLFrame points;
+    std::vector<unsigned char> sensor_id;
+    uint64_t index;            // merged frame number, or time window number in ALIGN_TIME_WINDOW
+    unsigned int sensor_mask;  // bit per sensor that contributed points
+  };
+
+  struct SensorStatus
+  {
+    uint64_t num_frames;         // merged frames this sensor contributed to
+    uint64_t num_missed;         // merged frames handed over without this sensor
+    double last_arrival_skew;    // microseconds this sensor's frame completed after the first sensor's, for the last merged frame
+    double max_arrival_skew;
+    double mean_arrival_skew;
+    double last_timestamp_skew;  // microseconds between this sensor's first gps timestamp and the earliest one, for the last merged frame
+  };
+
+  typedef boost::function<void (const MergedFrame& frame)> MergedFrameCallback;
+
+public:
+  FrameAggregator(AlignmentMode mode = ALIGN_CUT_ANGLE);
+  virtual ~FrameAggregator();
+  void SetCutAngle(unsigned int cut_angle);   // hundredths of a degree, applied to every sensor added
+  void SetTimeWindow(unsigned int window);    // microseconds, ALIGN_TIME_WINDOW only
+  void Reserve(unsigned int max_points);      // preallocate every merged frame for this many points
+  // takes over the decoder's output frame and frame callback, returns the sensor id or -1. Every decoder must
+  // have the same column mask, set before adding it and left alone afterwards, or the merged columns misalign
+  int AddSensor(PacketDecoder* decoder);
+  void DecodePacket(unsigned int sensor, const char* data, unsigned int data_length);
+  // called from DecodePacket once the aggregator is unlocked, so it may call GetSensorStatus - with several threads
+  // decoding, it may run on more than one of them at once
+  void SetMergedFrameCallback(const MergedFrameCallback& callback);
+  bool GetLatestFrame(MergedFrame* frame);
+  bool GetSensorStatus(unsigned int sensor, SensorStatus* status);
+
+protected:
+  struct Sensor
+  {
+    PacketDecoder* decoder;
+    bool started;
+    uint64_t target;         // merged frame the decoder is currently writing into
+    SensorStatus status;
+  };
+
+  struct Slot
+  {
+    MergedFrame frame;
+    std::vector<double> arrival;    // monotonic microseconds at which each sensor finished its frame
+    std::vector<uint64_t> first_timestamp;
+    std::vector<bool> contributed;
+  };
+
+  void SensorFrameCallback(unsigned int sensor, const PacketDecoder::HDLFrame& frame);
+  void StartSensorFrame(unsigned int sensor, uint64_t target);
+  void PadSensorIds(Slot& slot, unsigned int sensor);
+  uint64_t PacketTime(Sensor& sensor, const char* data);
+  uint64_t TargetFor(Sensor& sensor, bool next);
+  Slot& SlotFor(uint64_t index);
+  void CatchUpSensors();
+  void CompleteOldest();
+  void CompleteReady();
+
+private:
+  AlignmentMode _mode;
+  unsigned int _cut_angle;
+  unsigned int _window;
+  unsigned int _max_points;
+  bool _base_set;
+  uint64_t _base;          // oldest merged frame still being filled
+  uint64_t _packet_time;   // gps time of the packet being decoded, unwrapped past the hour
+  std::vector<Sensor> _sensors;
+  std::vector<Slot> _slots;
+  MergedFrame _latest;
+  bool _has_latest;
+  std::vector<MergedFrame> _completed;  // merged frames waiting for the callback
+  unsigned int _num_completed;
+  MergedFrameCallback _callback;
+  boost::mutex _mutex;
+};
+
+BOOST_STATIC_ASSERT(AGGREGATOR_MAX_SENSORS <= 8*sizeof(static_cast<FrameAggregator::MergedFrame*>(0)->sensor_mask));
+
+#endif // FRAME_AGGREGATOR_H_INCLUDED
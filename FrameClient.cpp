@@ -0,0 +1,239 @@
+// Velodyne HDL Frame Client
+// Nick Rypkema (rypkema@mit.edu), MIT 2017
+// shared library to subscribe to a FrameServer over TCP and decode the frames it sends
+
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <zlib.h>
+
+#include "FrameClient.h"
+
+namespace
+{
+template <typename T, typename U>
+void ReadColumn(const char** data, unsigned int num_points, std::vector<U>* column)
+{
+  column->resize(num_points);
+  for (unsigned int i = 0; i < num_points; i++) {
+    T value;
+    memcpy(&value, *data + i*sizeof(T), sizeof(T));
+    (*column)[i] = value;
+  }
+  *data += num_points*sizeof(T);
+}
+
+template <typename T>
+void ReadScaledColumn(const char** data, unsigned int num_points, double resolution, std::vector<double>* column)
+{
+  column->resize(num_points);
+  for (unsigned int i = 0; i < num_points; i++) {
+    T value;
+    memcpy(&value, *data + i*sizeof(T), sizeof(T));
+    (*column)[i] = value*resolution;
+  }
+  *data += num_points*sizeof(T);
+}
+}
+
+FrameClient::FrameClient()
+{
+  memset(&_subscription, 0, sizeof(_subscription));
+  _subscription.magic = FRAME_SUBSCRIPTION_MAGIC;
+  _subscription.version = FRAME_STREAM_VERSION;
+  _subscription.columns = HDL_COLUMN_ALL;
+  _subscription.compression = FRAME_COMPRESSION_NONE;
+  memset(&_header, 0, sizeof(_header));
+  _first = true;
+  _next_sequence = 0;
+  _num_received = 0;
+  _num_missed = 0;
+  _num_bytes_received = 0;
+}
+
+FrameClient::~FrameClient()
+{
+  Disconnect();
+}
+
+void FrameClient::SetColumns(unsigned int columns)
+{
+  _subscription.columns = columns & HDL_COLUMN_ALL;
+}
+
+void FrameClient::SetRegionOfInterest(double min_x, double min_y, double min_z, double max_x, double max_y, double max_z)
+{
+  _subscription.use_roi = 1;
+  _subscription.roi_min[0] = min_x;
+  _subscription.roi_min[1] = min_y;
+  _subscription.roi_min[2] = min_z;
+  _subscription.roi_max[0] = max_x;
+  _subscription.roi_max[1] = max_y;
+  _subscription.roi_max[2] = max_z;
+}
+
+void FrameClient::ClearRegionOfInterest()
+{
+  _subscription.use_roi = 0;
+}
+
+void FrameClient::SetCompression(bool compression)
+{
+  _subscription.compression = compression ? FRAME_COMPRESSION_ZLIB : FRAME_COMPRESSION_NONE;
+}
+
+void FrameClient::SetQueueDepth(unsigned int depth)
+{
+  _subscription.queue_depth = depth;
+}
+
+bool FrameClient::Connect(const std::string& host, unsigned short port)
+{
+  Disconnect();
+  try {
+    std::ostringstream service;
+    service << port;
+    boost::asio::ip::tcp::resolver resolver(_io_service);
+    boost::asio::ip::tcp::resolver::query query(host, service.str());
+    _socket.reset(new boost::asio::ip::tcp::socket(_io_service));
+    boost::asio::connect(*_socket, resolver.resolve(query));
+    _socket->set_option(boost::asio::ip::tcp::no_delay(true));
+    boost::asio::write(*_socket, boost::asio::buffer(&_subscription, sizeof(_subscription)));
+  } catch(std::exception & e) {
+    std::cout << "FrameClient: Error connecting to " << host << ":" << port << " - " << e.what() << std::endl;
+    _socket.reset();
+    return(false);
+  }
+  _first = true;
+  std::cout << "FrameClient: Success connecting to " << host << ":" << port << std::endl;
+  return(true);
+}
+
+void FrameClient::Disconnect()
+{
+  if (_socket) {
+    boost::system::error_code error;
+    _socket->shutdown(boost::asio::ip::tcp::socket::shutdown_both, error);
+    _socket->close(error);
+  }
+}
+
+bool FrameClient::IsConnected()
+{
+  return _socket && _socket->is_open();
+}
+
+uint64_t FrameClient::GetNumberOfReceived()
+{
+  return _num_received;
+}
+
+uint64_t FrameClient::GetNumberOfMissed()
+{
+  return _num_missed;
+}
+
+uint64_t FrameClient::GetNumberOfBytesReceived()
+{
+  return _num_bytes_received;
+}
+
+bool FrameClient::ReceiveFrame(uint64_t* sequence)
+{
+  if (!IsConnected()) {
+    return(false);
+  }
+
+  boost::system::error_code error;
+  boost::asio::read(*_socket, boost::asio::buffer(&_header, sizeof(_header)), error);
+  if (!error && (_header.magic != FRAME_MESSAGE_MAGIC || _header.payload_length > FRAME_STREAM_MAX_PAYLOAD ||
+                 _header.raw_length > FRAME_STREAM_MAX_PAYLOAD ||
+                 _header.raw_length != static_cast<uint64_t>(_header.num_points)*FrameStreamBytesPerPoint(_header.columns))) {
+    std::cout << "FrameClient: Error, invalid frame header" << std::endl;
+    Disconnect();
+    return(false);
+  }
+  if (!error) {
+    _payload.resize(_header.payload_length);
+    boost::asio::read(*_socket, boost::asio::buffer(_payload), error);
+  }
+  if (error) {
+    Disconnect();
+    return(false);
+  }
+
+  if (_header.compression == FRAME_COMPRESSION_ZLIB) {
+    _raw.resize(_header.raw_length);
+    uLongf length = _header.raw_length;
+    if (uncompress(reinterpret_cast<Bytef*>(_raw.empty() ? NULL : &_raw[0]), &length,
+                   reinterpret_cast<const Bytef*>(_payload.empty() ? NULL : &_payload[0]), _payload.size()) != Z_OK ||
+        length != _header.raw_length) {
+      std::cout << "FrameClient: Error, corrupt compressed frame" << std::endl;
+      Disconnect();
+      return(false);
+    }
+  } else if (_header.payload_length != _header.raw_length) {
+    std::cout << "FrameClient: Error, invalid frame header" << std::endl;
+    Disconnect();
+    return(false);
+  } else {
+    _raw.swap(_payload);
+  }
+
+  if (!_first && _header.sequence > _next_sequence) {
+    _num_missed += _header.sequence - _next_sequence;
+  }
+  _first = false;
+  _next_sequence = _header.sequence + 1;
+  _num_received++;
+  _num_bytes_received += sizeof(_header) + _header.payload_length;
+  if (sequence) {
+    *sequence = _header.sequence;
+  }
+  return(true);
+}
+
+void FrameClient::DecodeColumns(std::vector<double>* x, std::vector<double>* y, std::vector<double>* z,
+                                std::vector<unsigned char>* intensity, std::vector<unsigned char>* laser_id,
+                                std::vector<unsigned short>* azimuth, std::vector<double>* distance,
+                                std::vector<unsigned int>* ms_from_top_of_hour)
+{
+  const char* data = _raw.empty() ? NULL : &_raw[0];
+  unsigned int n = _header.num_points;
+  double resolution = _header.resolution;
+  x->clear();
+  y->clear();
+  z->clear();
+  intensity->clear();
+  laser_id->clear();
+  azimuth->clear();
+  distance->clear();
+  ms_from_top_of_hour->clear();
+
+  if (_header.columns & HDL_COLUMN_XYZ) {
+    ReadScaledColumn<int16_t>(&data, n, resolution, x);
+    ReadScaledColumn<int16_t>(&data, n, resolution, y);
+    ReadScaledColumn<int16_t>(&data, n, resolution, z);
+  }
+  if (_header.columns & HDL_COLUMN_INTENSITY) {
+    ReadColumn<uint8_t>(&data, n, intensity);
+  }
+  if (_header.columns & HDL_COLUMN_LASER_ID) {
+    ReadColumn<uint8_t>(&data, n, laser_id);
+  }
+  if (_header.columns & HDL_COLUMN_AZIMUTH) {
+    ReadColumn<uint16_t>(&data, n, azimuth);
+  }
+  if (_header.columns & HDL_COLUMN_DISTANCE) {
+    ReadScaledColumn<uint16_t>(&data, n, resolution, distance);
+  }
+  if (_header.columns & HDL_COLUMN_MS_FROM_TOP_OF_HOUR) {
+    ReadColumn<uint32_t>(&data, n, ms_from_top_of_hour);
+    // sent as differences from the previous point
+    unsigned int time = 0;
+    for (unsigned int i = 0; i < n; i++) {
+      time += (*ms_from_top_of_hour)[i];
+      (*ms_from_top_of_hour)[i] = time;
+    }
+  }
+}
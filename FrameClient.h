@@ -0,0 +1,68 @@
+// Velodyne HDL Frame Client
+// Nick Rypkema (rypkema@mit.edu), MIT 2017
+// shared library to subscribe to a FrameServer over TCP and decode the frames it sends
+
+#ifndef FRAME_CLIENT_H_INCLUDED
+#define FRAME_CLIENT_H_INCLUDED
+
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/shared_ptr.hpp>
+#include "FrameStream.h"
+#include "PacketDecoder.h"
+
+// The subscription (columns, region of interest, compression, queue depth) is set before Connect and sent
+// once. GetNextFrame blocks on the socket until a frame arrives or the server goes away. A client is not
+// thread-safe - Connect, GetNextFrame and Disconnect must all be called from the reading thread.
+class FrameClient
+{
+public:
+  FrameClient();
+  virtual ~FrameClient();
+  void SetColumns(unsigned int columns);  // HDLColumn bits, all by default
+  void SetRegionOfInterest(double min_x, double min_y, double min_z, double max_x, double max_y, double max_z);
+  void ClearRegionOfInterest();
+  void SetCompression(bool compression);  // zlib, worth it on links slower than ~1Gb/s
+  void SetQueueDepth(unsigned int depth); // frames the server may hold for this client, 0 for its default
+  bool Connect(const std::string& host, unsigned short port);
+  void Disconnect();
+  bool IsConnected();
+  uint64_t GetNumberOfReceived();
+  uint64_t GetNumberOfMissed();       // frames the server dropped for this client, from sequence gaps
+  uint64_t GetNumberOfBytesReceived();
+
+  // fills any HDLFrame-like struct (PacketDecoder::HDLFrame, PacketBundleDecoder::HDLFrame), columns the
+  // server did not send are left empty. false once the connection is gone.
+  template <typename Frame>
+  bool GetNextFrame(Frame* frame, uint64_t* sequence = NULL)
+  {
+    if (!ReceiveFrame(sequence)) {
+      return(false);
+    }
+    DecodeColumns(&frame->x, &frame->y, &frame->z, &frame->intensity, &frame->laser_id, &frame->azimuth,
+                  &frame->distance, &frame->ms_from_top_of_hour);
+    return(true);
+  }
+
+  bool ReceiveFrame(uint64_t* sequence = NULL); // reads the next message, then DecodeColumns unpacks it
+  void DecodeColumns(std::vector<double>* x, std::vector<double>* y, std::vector<double>* z,
+                     std::vector<unsigned char>* intensity, std::vector<unsigned char>* laser_id,
+                     std::vector<unsigned short>* azimuth, std::vector<double>* distance,
+                     std::vector<unsigned int>* ms_from_top_of_hour);
+
+private:
+  FrameSubscription _subscription;
+  boost::asio::io_service _io_service;
+  boost::shared_ptr<boost::asio::ip::tcp::socket> _socket;
+  FrameMessageHeader _header;
+  std::vector<char> _payload;
+  std::vector<char> _raw;
+  bool _first;
+  uint64_t _next_sequence;
+  uint64_t _num_received;
+  uint64_t _num_missed;
+  uint64_t _num_bytes_received;
+};
+
+#endif // FRAME_CLIENT_H_INCLUDED
@@ -0,0 +1,266 @@
+// Velodyne HDL Frame Queue
+// Nick Rypkema (rypkema@mit.edu), MIT 2017
+// header-only, thread-safe bounded hand-off of decoded frames between a decoder thread and a consumer thread
+
+#ifndef FRAME_QUEUE_H_INCLUDED
+#define FRAME_QUEUE_H_INCLUDED
+
+#include <deque>
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+#include <boost/atomic.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/thread_time.hpp>
+#include "LatencyTrace.h"
+
+enum FrameQueuePolicy
+{
+  FRAME_QUEUE_DROP_OLDEST = 0, // a full queue evicts its oldest frame to make room
+  FRAME_QUEUE_DROP_NEWEST = 1, // a full queue rejects the frame being pushed
+  FRAME_QUEUE_BLOCK = 2        // a full queue blocks the producer, the frame is dropped if the push times out
+};
+
+const unsigned int FRAME_QUEUE_NUM_POLICIES = 3;
+
+// Frame is PacketDecoder::HDLFrame or PacketBundleDecoder::HDLFrame (anything with swappable members works).
+// Hook it to a decoder with SetFrameCallback(boost::bind(&FrameQueue<Frame>::Push, &queue, _1, timeout_ms)).
+template <typename Frame>
+class FrameQueue
+{
+public:
+  FrameQueue(unsigned int capacity = 10, FrameQueuePolicy policy = FRAME_QUEUE_DROP_OLDEST)
+  {
+    _capacity = capacity ? capacity : 1;
+    _policy = policy;
+    _closed = false;
+    for (unsigned int i = 0; i < FRAME_QUEUE_NUM_POLICIES; i++) {
+      _dropped[i] = 0;
+    }
+  }
+
+  void SetCapacity(unsigned int capacity)
+  {
+    boost::mutex::scoped_lock lock(_mutex);
+    _capacity = capacity ? capacity : 1;
+    while (_frames.size() > _capacity) {
+      Recycle(&_frames.front());
+      _frames.pop_front();
+      _dropped[FRAME_QUEUE_DROP_OLDEST]++;
+    }
+    _not_full.notify_all();
+  }
+
+  void SetPolicy(FrameQueuePolicy policy)
+  {
+    boost::mutex::scoped_lock lock(_mutex);
+    _policy = policy;
+  }
+
+  // copies frame in, returns false if it (not an older frame) was dropped - timeout_ms only applies to FRAME_QUEUE_BLOCK,
+  // -1 waits for as long as it takes
+  bool Push(const Frame& frame, int timeout_ms = -1)
+  {
+    boost::mutex::scoped_lock lock(_mutex);
+    if (_closed) {
+      return(false);
+    }
+
+    if (_frames.size() >= _capacity) {
+      if (_policy == FRAME_QUEUE_DROP_NEWEST) {
+        _dropped[FRAME_QUEUE_DROP_NEWEST]++;
+        return(false);
+      } else if (_policy == FRAME_QUEUE_DROP_OLDEST) {
+        Recycle(&_frames.front());
+        _frames.pop_front();
+        _dropped[FRAME_QUEUE_DROP_OLDEST]++;
+      } else {
+        boost::system_time deadline = boost::get_system_time() + boost::posix_time::milliseconds(timeout_ms);
+        while (_frames.size() >= _capacity && !_closed) {
+          if (timeout_ms < 0) {
+            _not_full.wait(lock);
+          } else if (!_not_full.timed_wait(lock, deadline)) {
+            break;
+          }
+        }
+        if (_closed || _frames.size() >= _capacity) {
+          _dropped[FRAME_QUEUE_BLOCK]++;
+          return(false);
+        }
+      }
+    }
+
+    // assign into a recycled frame so the vectors keep the capacity of an earlier frame
+    _frames.push_back(Frame());
+    if (_spare.size()) {
+      std::swap(_frames.back(), _spare.back());
+      _spare.pop_back();
+    }
+    _frames.back() = frame;
+    HDL_TRACE_INSTANT("frame queue push", _frames.size());
+    lock.unlock();
+    _not_empty.notify_one();
+    return(true);
+  }
+
+  // swaps the oldest frame into *frame, timeout_ms of 0 polls and -1 waits until a frame arrives or the queue closes
+  bool Pop(Frame* frame, int timeout_ms = -1)
+  {
+    boost::mutex::scoped_lock lock(_mutex);
+    if (!WaitNotEmpty(lock, timeout_ms)) {
+      return(false);
+    }
+    std::swap(*frame, _frames.front());
+    Recycle(&_frames.front());
+    _frames.pop_front();
+    HDL_TRACE_INSTANT("frame queue pop", _frames.size());
+    lock.unlock();
+    _not_full.notify_one();
+    return(true);
+  }
+
+  // swaps the newest frame into *frame and discards the rest, the queued equivalent of GetLatestFrame
+  bool PopLatest(Frame* frame, int timeout_ms = -1)
+  {
+    boost::mutex::scoped_lock lock(_mutex);
+    if (!WaitNotEmpty(lock, timeout_ms)) {
+      return(false);
+    }
+    std::swap(*frame, _frames.back());
+    HDL_TRACE_INSTANT("frame queue pop", _frames.size() - 1);
+    while (_frames.size()) {
+      Recycle(&_frames.front());
+      _frames.pop_front();
+    }
+    lock.unlock();
+    _not_full.notify_all();
+    return(true);
+  }
+
+  // wakes every waiting producer and consumer, after which Push fails and Pop only drains what is left
+  void Close()
+  {
+    boost::mutex::scoped_lock lock(_mutex);
+    _closed = true;
+    _not_empty.notify_all();
+    _not_full.notify_all();
+  }
+
+  void Clear()
+  {
+    boost::mutex::scoped_lock lock(_mutex);
+    while (_frames.size()) {
+      Recycle(&_frames.front());
+      _frames.pop_front();
+    }
+    _not_full.notify_all();
+  }
+
+  unsigned int GetSize()
+  {
+    boost::mutex::scoped_lock lock(_mutex);
+    return _frames.size();
+  }
+
+  uint64_t GetNumberOfDropped(FrameQueuePolicy policy)
+  {
+    boost::mutex::scoped_lock lock(_mutex);
+    return _dropped[policy];
+  }
+
+  uint64_t GetNumberOfDropped()
+  {
+    boost::mutex::scoped_lock lock(_mutex);
+    return _dropped[FRAME_QUEUE_DROP_OLDEST] + _dropped[FRAME_QUEUE_DROP_NEWEST] + _dropped[FRAME_QUEUE_BLOCK];
+  }
+
+protected:
+  bool WaitNotEmpty(boost::mutex::scoped_lock& lock, int timeout_ms)
+  {
+    boost::system_time deadline = boost::get_system_time() + boost::posix_time::milliseconds(timeout_ms);
+    while (_frames.empty() && !_closed && timeout_ms != 0) {
+      if (timeout_ms < 0) {
+        _not_empty.wait(lock);
+      } else if (!_not_empty.timed_wait(lock, deadline)) {
+        break;
+      }
+    }
+    return !_frames.empty();
+  }
+
+  void Recycle(Frame* frame)
+  {
+    // keep one spare per slot, enough that a steady producer never allocates
+    if (_spare.size() < _capacity) {
+      _spare.push_back(Frame());
+      std::swap(_spare.back(), *frame);
+    }
+  }
+
+private:
+  unsigned int _capacity;
+  FrameQueuePolicy _policy;
+  bool _closed;
+  uint64_t _dropped[FRAME_QUEUE_NUM_POLICIES];
+  std::deque<Frame> _frames;
+  std::vector<Frame> _spare;
+  boost::mutex _mutex;
+  boost::condition_variable _not_empty;
+  boost::condition_variable _not_full;
+};
+
+// single producer, single consumer "latest only" hand-off - a triple buffer, so neither side ever waits on the other.
+// Frames the consumer never got to are counted as overwritten.
+template <typename Frame>
+class LatestFrameSlot
+{
+public:
+  LatestFrameSlot()
+  {
+    _back = 0;
+    _front = 1;
+    _middle.store(2, boost::memory_order_relaxed);
+    _overwritten.store(0, boost::memory_order_relaxed);
+  }
+
+  // producer side
+  void Publish(const Frame& frame)
+  {
+    _buffers[_back] = frame;
+    unsigned int previous = _middle.exchange(_back | FRESH_BIT, boost::memory_order_acq_rel);
+    if (previous & FRESH_BIT) {
+      _overwritten.fetch_add(1, boost::memory_order_relaxed);
+    }
+    _back = previous & INDEX_MASK;
+  }
+
+  // consumer side, returns the newest frame or NULL if nothing was published since the last call -
+  // the frame stays valid until the next call to AcquireLatest
+  const Frame* AcquireLatest()
+  {
+    if (!(_middle.load(boost::memory_order_relaxed) & FRESH_BIT)) {
+      return NULL;
+    }
+    unsigned int previous = _middle.exchange(_front, boost::memory_order_acq_rel);
+    _front = previous & INDEX_MASK;
+    return &_buffers[_front];
+  }
+
+  uint64_t GetNumberOfOverwritten()
+  {
+    return _overwritten.load(boost::memory_order_relaxed);
+  }
+
+private:
+  static const unsigned int FRESH_BIT = 4;
+  static const unsigned int INDEX_MASK = 3;
+
+  Frame _buffers[3];
+  unsigned int _back;  // only touched by the producer
+  unsigned int _front; // only touched by the consumer
+  boost::atomic<unsigned int> _middle;
+  boost::atomic<uint64_t> _overwritten;
+};
+
+#endif // FRAME_QUEUE_H_INCLUDED
@@ -0,0 +1,627 @@
+// Velodyne HDL Frame Server
+// Nick Rypkema (rypkema@mit.edu), MIT 2017
+// shared library to serve decoded frames to TCP subscribers in a compact quantized encoding
+
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <algorithm>
+#include <iostream>
+#include <zlib.h>
+#include <boost/bind.hpp>
+#include <boost/enable_shared_from_this.hpp>
+
+#include "FrameServer.h"
+
+// one published frame, quantized once for every subscriber
+struct FrameServerSnapshot
+{
+  uint64_t sequence;
+  unsigned int num_points;
+  unsigned int columns;
+  float resolution;
+  std::vector<int16_t> x;
+  std::vector<int16_t> y;
+  std::vector<int16_t> z;
+  std::vector<uint8_t> intensity;
+  std::vector<uint8_t> laser_id;
+  std::vector<uint16_t> azimuth;
+  std::vector<uint16_t> distance;
+  std::vector<uint32_t> ms_from_top_of_hour;
+  boost::mutex mutex;
+  std::map<uint32_t, boost::shared_ptr<const std::vector<char> > > encoded; // whole frame encodings by columns and compression
+};
+
+namespace
+{
+int16_t QuantizeCoordinate(double value, double scale)
+{
+  return static_cast<int16_t>(std::max(-32767.0, std::min(std::floor(value*scale + 0.5), 32767.0)));
+}
+
+uint16_t QuantizeDistance(double value, double scale)
+{
+  return static_cast<uint16_t>(std::max(0.0, std::min(std::floor(value*scale + 0.5), 65535.0)));
+}
+
+// the payload is packed, so columns after an odd length uint8 column are not aligned
+template <typename T>
+void AppendColumn(const std::vector<T>& column, const std::vector<uint32_t>* indices, unsigned int num_points, std::vector<char>* out)
+{
+  size_t offset = out->size();
+  out->resize(offset + num_points*sizeof(T));
+  char* data = &(*out)[offset];
+  if (!indices) {
+    memcpy(data, &column[0], num_points*sizeof(T));
+    return;
+  }
+  for (unsigned int i = 0; i < num_points; i++) {
+    memcpy(data + i*sizeof(T), &column[(*indices)[i]], sizeof(T));
+  }
+}
+
+void AppendTimeDifferences(const std::vector<uint32_t>& column, const std::vector<uint32_t>* indices, unsigned int num_points, std::vector<char>* out)
+{
+  size_t offset = out->size();
+  out->resize(offset + num_points*sizeof(uint32_t));
+  char* data = &(*out)[offset];
+  uint32_t previous = 0;
+  for (unsigned int i = 0; i < num_points; i++) {
+    uint32_t time = column[indices ? (*indices)[i] : i];
+    uint32_t difference = time - previous;
+    memcpy(data + i*sizeof(uint32_t), &difference, sizeof(uint32_t));
+    previous = time;
+  }
+}
+
+bool InRegion(const FrameServerSnapshot& snapshot, unsigned int i, const int lower[3], const int upper[3])
+{
+  return snapshot.x[i] >= lower[0] && snapshot.x[i] <= upper[0] &&
+         snapshot.y[i] >= lower[1] && snapshot.y[i] <= upper[1] &&
+         snapshot.z[i] >= lower[2] && snapshot.z[i] <= upper[2];
+}
+
+// header then payload into message, raw and indices are scratch space kept by the caller
+void EncodeFrame(const FrameServerSnapshot& snapshot, const FrameSubscription& subscription,
+                 std::vector<uint32_t>* indices, std::vector<char>* raw, std::vector<char>* message)
+{
+  unsigned int columns = subscription.columns & snapshot.columns;
+  unsigned int num_points = snapshot.num_points;
+  const std::vector<uint32_t>* selected = NULL;
+  if (subscription.use_roi && (snapshot.columns & HDL_COLUMN_XYZ)) {
+    // compare in quantized units, a point is inside when its quantized coordinates are
+    int lower[3], upper[3];
+    for (int k = 0; k < 3; k++) {
+      lower[k] = static_cast<int>(std::max(-32768.0, std::ceil(static_cast<double>(subscription.roi_min[k])/snapshot.resolution)));
+      upper[k] = static_cast<int>(std::min(32768.0, std::floor(static_cast<double>(subscription.roi_max[k])/snapshot.resolution)));
+    }
+    indices->clear();
+    for (unsigned int i = 0; i < snapshot.num_points; i++) {
+      if (InRegion(snapshot, i, lower, upper)) {
+        indices->push_back(i);
+      }
+    }
+    selected = indices;
+    num_points = indices->size();
+  }
+
+  bool compress = (subscription.compression == FRAME_COMPRESSION_ZLIB);
+  std::vector<char>* payload = compress ? raw : message;
+  payload->clear();
+  if (!compress) {
+    payload->resize(sizeof(FrameMessageHeader));
+  }
+  payload->reserve(payload->size() + num_points*FrameStreamBytesPerPoint(columns));
+  if (num_points) {
+    if (columns & HDL_COLUMN_XYZ) {
+      AppendColumn(snapshot.x, selected, num_points, payload);
+      AppendColumn(snapshot.y, selected, num_points, payload);
+      AppendColumn(snapshot.z, selected, num_points, payload);
+    }
+    if (columns & HDL_COLUMN_INTENSITY) {
+      AppendColumn(snapshot.intensity, selected, num_points, payload);
+    }
+    if (columns & HDL_COLUMN_LASER_ID) {
+      AppendColumn(snapshot.laser_id, selected, num_points, payload);
+    }
+    if (columns & HDL_COLUMN_AZIMUTH) {
+      AppendColumn(snapshot.azimuth, selected, num_points, payload);
+    }
+    if (columns & HDL_COLUMN_DISTANCE) {
+      AppendColumn(snapshot.distance, selected, num_points, payload);
+    }
+    if (columns & HDL_COLUMN_MS_FROM_TOP_OF_HOUR) {
+      AppendTimeDifferences(snapshot.ms_from_top_of_hour, selected, num_points, payload);
+    }
+  }
+
+  FrameMessageHeader header;
+  header.magic = FRAME_MESSAGE_MAGIC;
+  header.columns = columns;
+  header.compression = FRAME_COMPRESSION_NONE;
+  header.num_points = num_points;
+  header.sequence = snapshot.sequence;
+  header.resolution = snapshot.resolution;
+  header.raw_length = compress ? raw->size() : message->size() - sizeof(FrameMessageHeader);
+  header.payload_length = header.raw_length;
+  header.reserved = 0;
+
+  if (compress) {
+    uLongf length = compressBound(raw->size());
+    message->resize(sizeof(FrameMessageHeader) + length);
+    if (raw->size() && compress2(reinterpret_cast<Bytef*>(&(*message)[sizeof(FrameMessageHeader)]), &length,
+                                 reinterpret_cast<const Bytef*>(&(*raw)[0]), raw->size(), Z_BEST_SPEED) == Z_OK &&
+        length < raw->size()) {
+      header.compression = FRAME_COMPRESSION_ZLIB;
+      header.payload_length = length;
+      message->resize(sizeof(FrameMessageHeader) + length);
+    } else {
+      // incompressible (or empty), sent as it is
+      message->resize(sizeof(FrameMessageHeader) + raw->size());
+      if (raw->size()) {
+        memcpy(&(*message)[sizeof(FrameMessageHeader)], &(*raw)[0], raw->size());
+      }
+    }
+  }
+  memcpy(&(*message)[0], &header, sizeof(header));
+}
+}
+
+// One TCP subscriber. Every socket operation and the write chain run on the session's strand, the publishing
+// thread only touches the queue.
+class FrameServerSession : public boost::enable_shared_from_this<FrameServerSession>
+{
+public:
+  FrameServerSession(FrameServer* server, boost::asio::io_service& io_service);
+  boost::asio::ip::tcp::socket& GetSocket();
+  void Start();
+  bool Enqueue(const boost::shared_ptr<FrameServerSnapshot>& snapshot); // true if the oldest queued frame was dropped
+  void Close();
+
+protected:
+  void SubscriptionCallback(const boost::system::error_code& error);
+  void HandshakeTimeoutCallback(const boost::system::error_code& error);
+  void MonitorCallback(const boost::system::error_code& error);
+  void WriteNext();
+  void WriteCallback(const boost::system::error_code& error, std::size_t bytes_transferred);
+
+private:
+  FrameServer* _server;
+  boost::asio::ip::tcp::socket _socket;
+  boost::asio::io_service::strand _strand;
+  boost::asio::deadline_timer _handshake_timer;
+  FrameSubscription _subscription;
+  char _monitor_buffer[64];
+  boost::mutex _mutex;
+  std::deque<boost::shared_ptr<FrameServerSnapshot> > _queue;
+  unsigned int _queue_depth;
+  bool _subscribed;
+  bool _writing;
+  bool _closed;
+  boost::shared_ptr<const std::vector<char> > _shared_message; // a whole frame encoding being written
+  std::vector<char> _message;                                   // or this subscriber's own
+  std::vector<char> _raw;
+  std::vector<uint32_t> _indices;
+};
+
+FrameServerSession::FrameServerSession(FrameServer* server, boost::asio::io_service& io_service)
+  : _server(server), _socket(io_service), _strand(io_service), _handshake_timer(io_service)
+{
+  memset(&_subscription, 0, sizeof(_subscription));
+  _queue_depth = FRAME_SERVER_QUEUE_DEPTH;
+  _subscribed = false;
+  _writing = false;
+  _closed = false;
+}
+
+boost::asio::ip::tcp::socket& FrameServerSession::GetSocket()
+{
+  return _socket;
+}
+
+void FrameServerSession::Start()
+{
+  // a connection that never subscribes would otherwise sit in the server's sessions for good
+  _handshake_timer.expires_from_now(boost::posix_time::seconds(FRAME_SERVER_HANDSHAKE_TIMEOUT));
+  _handshake_timer.async_wait(_strand.wrap(boost::bind(&FrameServerSession::HandshakeTimeoutCallback, shared_from_this(), boost::asio::placeholders::error)));
+  boost::asio::async_read(_socket, boost::asio::buffer(&_subscription, sizeof(_subscription)),
+                          _strand.wrap(boost::bind(&FrameServerSession::SubscriptionCallback, shared_from_this(), boost::asio::placeholders::error)));
+}
+
+void FrameServerSession::SubscriptionCallback(const boost::system::error_code& error)
+{
+  boost::system::error_code cancel_error;
+  _handshake_timer.cancel(cancel_error);
+  if (error || _subscription.magic != FRAME_SUBSCRIPTION_MAGIC || _subscription.version != FRAME_STREAM_VERSION) {
+    if (!error) {
+      std::cout << "FrameServer: Warning, closing connection with an invalid subscription" << std::endl;
+    }
+    Close();
+    return;
+  }
+  if (_subscription.compression != FRAME_COMPRESSION_ZLIB) {
+    _subscription.compression = FRAME_COMPRESSION_NONE;
+  }
+  {
+    boost::mutex::scoped_lock lock(_mutex);
+    if (_closed) {
+      return;
+    }
+    if (_subscription.queue_depth) {
+      _queue_depth = std::min(_subscription.queue_depth, FRAME_SERVER_MAX_QUEUE_DEPTH);
+    }
+    _subscribed = true;
+  }
+  _server->AddSubscriber(shared_from_this());
+
+  // subscribers send nothing more, so this read only completes when they disconnect
+  _socket.async_read_some(boost::asio::buffer(_monitor_buffer),
+                          _strand.wrap(boost::bind(&FrameServerSession::MonitorCallback, shared_from_this(), boost::asio::placeholders::error)));
+}
+
+void FrameServerSession::HandshakeTimeoutCallback(const boost::system::error_code& error)
+{
+  if (error == boost::asio::error::operation_aborted) {
+    return;
+  }
+  {
+    // the timer can expire just as the subscription arrives, too late for the cancel
+    boost::mutex::scoped_lock lock(_mutex);
+    if (_subscribed || _closed) {
+      return;
+    }
+  }
+  std::cout << "FrameServer: Warning, closing connection that sent no subscription within " << FRAME_SERVER_HANDSHAKE_TIMEOUT << "s" << std::endl;
+  Close();
+}
+
+void FrameServerSession::MonitorCallback(const boost::system::error_code& error)
+{
+  if (error) {
+    Close();
+    return;
+  }
+  _socket.async_read_some(boost::asio::buffer(_monitor_buffer),
+                          _strand.wrap(boost::bind(&FrameServerSession::MonitorCallback, shared_from_this(), boost::asio::placeholders::error)));
+}
+
+bool FrameServerSession::Enqueue(const boost::shared_ptr<FrameServerSnapshot>& snapshot)
+{
+  boost::mutex::scoped_lock lock(_mutex);
+  if (_closed || !_subscribed) {
+    return(false);
+  }
+  bool dropped = false;
+  if (_queue.size() >= _queue_depth) {
+    _queue.pop_front();
+    dropped = true;
+  }
+  _queue.push_back(snapshot);
+  if (!_writing) {
+    _writing = true;
+    _strand.post(boost::bind(&FrameServerSession::WriteNext, shared_from_this()));
+  }
+  return dropped;
+}
+
+void FrameServerSession::WriteNext()
+{
+  boost::shared_ptr<FrameServerSnapshot> snapshot;
+  {
+    boost::mutex::scoped_lock lock(_mutex);
+    if (_closed || _queue.empty()) {
+      _writing = false;
+      return;
+    }
+    snapshot = _queue.front();
+    _queue.pop_front();
+  }
+
+  const std::vector<char>* message = &_message;
+  if (!_subscription.use_roi) {
+    uint32_t key = (_subscription.columns & snapshot->columns) | (_subscription.compression << 16);
+    boost::mutex::scoped_lock lock(snapshot->mutex);
+    boost::shared_ptr<const std::vector<char> >& encoded = snapshot->encoded[key];
+    if (!encoded) {
+      boost::shared_ptr<std::vector<char> > fresh(new std::vector<char>());
+      EncodeFrame(*snapshot, _subscription, &_indices, &_raw, fresh.get());
+      encoded = fresh;
+    }
+    _shared_message = encoded;
+    message = _shared_message.get();
+  } else {
+    EncodeFrame(*snapshot, _subscription, &_indices, &_raw, &_message);
+  }
+
+  boost::asio::async_write(_socket, boost::asio::buffer(*message),
+                           _strand.wrap(boost::bind(&FrameServerSession::WriteCallback, shared_from_this(),
+                                                    boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred)));
+}
+
+void FrameServerSession::WriteCallback(const boost::system::error_code& error, std::size_t bytes_transferred)
+{
+  _shared_message.reset();
+  if (error) {
+    Close();
+    return;
+  }
+  _server->AddBytesSent(bytes_transferred);
+  WriteNext();
+}
+
+void FrameServerSession::Close()
+{
+  {
+    boost::mutex::scoped_lock lock(_mutex);
+    if (_closed) {
+      return;
+    }
+    _closed = true;
+    _queue.clear();
+  }
+  boost::system::error_code error;
+  _handshake_timer.cancel(error);
+  _socket.close(error);
+  _server->RemoveSubscriber(shared_from_this());
+}
+
+FrameServer::FrameServer()
+{
+  _resolution = FRAME_SERVER_RESOLUTION;
+  _running = false;
+  _port = 0;
+  _num_published = 0;
+  _num_dropped = 0;
+  _num_bytes_sent = 0;
+}
+
+FrameServer::~FrameServer()
+{
+  Stop();
+}
+
+bool FrameServer::Start(unsigned short port, unsigned int num_threads)
+{
+  Stop();
+
+  _io_service.reset(new boost::asio::io_service());
+  try {
+    _acceptor.reset(new boost::asio::ip::tcp::acceptor(*_io_service, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), port)));
+  } catch(std::exception & e) {
+    std::cout << "FrameServer: Error listening on port " << port << " - " << e.what() << std::endl;
+    _acceptor.reset();
+    _io_service.reset();
+    return(false);
+  }
+  _port = _acceptor->local_endpoint().port();
+  _work.reset(new boost::asio::io_service::work(*_io_service));
+  {
+    boost::mutex::scoped_lock lock(_mutex);
+    _running = true;
+  }
+  Accept();
+  for (unsigned int i = 0; i < std::max(1u, num_threads); i++) {
+    _threads.push_back(boost::shared_ptr<boost::thread>(new boost::thread(boost::bind(&FrameServer::RunIOService, this))));
+  }
+
+  std::cout << "FrameServer: Success listening on port " << _port << std::endl;
+  return(true);
+}
+
+void FrameServer::Stop()
+{
+  if (!_io_service) {
+    return;
+  }
+  {
+    boost::mutex::scoped_lock lock(_mutex);
+    _running = false;
+  }
+  // a publish that saw _running before it was cleared may still be queueing onto the sessions' strands
+  {
+    boost::mutex::scoped_lock publish_lock(_publish_mutex);
+  }
+  boost::system::error_code error;
+  _acceptor->close(error);
+  _work.reset();
+  _io_service->stop();
+  for (unsigned int i = 0; i < _threads.size(); i++) {
+    _threads[i]->join();
+  }
+  _threads.clear();
+
+  {
+    boost::mutex::scoped_lock lock(_mutex);
+    _sessions.clear();
+    _subscribers.clear();
+  }
+  _accepting.reset();
+  _acceptor.reset();
+  // destroys the handlers still queued, and with them the last references to their sessions
+  _io_service.reset();
+}
+
+bool FrameServer::IsRunning()
+{
+  boost::mutex::scoped_lock lock(_mutex);
+  return _running;
+}
+
+unsigned short FrameServer::GetPort()
+{
+  return _port;
+}
+
+void FrameServer::SetResolution(double resolution)
+{
+  boost::mutex::scoped_lock lock(_mutex);
+  _resolution = (resolution > 0) ? resolution : FRAME_SERVER_RESOLUTION;
+}
+
+double FrameServer::GetResolution()
+{
+  boost::mutex::scoped_lock lock(_mutex);
+  return _resolution;
+}
+
+unsigned int FrameServer::GetNumberOfSubscribers()
+{
+  boost::mutex::scoped_lock lock(_mutex);
+  return _subscribers.size();
+}
+
+uint64_t FrameServer::GetNumberOfPublished()
+{
+  boost::mutex::scoped_lock lock(_mutex);
+  return _num_published;
+}
+
+uint64_t FrameServer::GetNumberOfDropped()
+{
+  boost::mutex::scoped_lock lock(_mutex);
+  return _num_dropped;
+}
+
+uint64_t FrameServer::GetNumberOfBytesSent()
+{
+  boost::mutex::scoped_lock lock(_mutex);
+  return _num_bytes_sent;
+}
+
+void FrameServer::RunIOService()
+{
+  _io_service->run();
+}
+
+void FrameServer::Accept()
+{
+  _accepting.reset(new FrameServerSession(this, *_io_service));
+  _acceptor->async_accept(_accepting->GetSocket(), boost::bind(&FrameServer::AcceptCallback, this, boost::asio::placeholders::error));
+}
+
+void FrameServer::AcceptCallback(const boost::system::error_code& error)
+{
+  if (error == boost::asio::error::operation_aborted || !_acceptor->is_open()) {
+    return;
+  }
+  if (!error) {
+    boost::system::error_code option_error;
+    _accepting->GetSocket().set_option(boost::asio::ip::tcp::no_delay(true), option_error);
+    {
+      boost::mutex::scoped_lock lock(_mutex);
+      _sessions.insert(_accepting);
+    }
+    _accepting->Start();
+  }
+  Accept();
+}
+
+void FrameServer::AddSubscriber(const boost::shared_ptr<FrameServerSession>& session)
+{
+  boost::mutex::scoped_lock lock(_mutex);
+  if (_sessions.erase(session)) {
+    _subscribers.insert(session);
+  }
+}
+
+void FrameServer::RemoveSubscriber(const boost::shared_ptr<FrameServerSession>& session)
+{
+  boost::mutex::scoped_lock lock(_mutex);
+  _sessions.erase(session);
+  _subscribers.erase(session);
+}
+
+void FrameServer::AddBytesSent(uint64_t num_bytes)
+{
+  boost::mutex::scoped_lock lock(_mutex);
+  _num_bytes_sent += num_bytes;
+}
+
+boost::shared_ptr<FrameServerSnapshot> FrameServer::TakeSnapshot()
+{
+  boost::mutex::scoped_lock lock(_mutex);
+  for (unsigned int i = 0; i < _snapshots.size(); i++) {
+    // only the pool holds it, so no queue or writer can pick it up again
+    if (_snapshots[i].unique()) {
+      _snapshots[i]->encoded.clear();
+      return _snapshots[i];
+    }
+  }
+  boost::shared_ptr<FrameServerSnapshot> snapshot(new FrameServerSnapshot());
+  if (_snapshots.size() < FRAME_SERVER_MAX_QUEUE_DEPTH + 2) {
+    _snapshots.push_back(snapshot);
+  }
+  return snapshot;
+}
+
+bool FrameServer::PublishColumns(unsigned int num_points, const double* x, const double* y, const double* z,
+                                 const unsigned char* intensity, const unsigned char* laser_id, const unsigned short* azimuth,
+                                 const double* distance, const unsigned int* ms_from_top_of_hour)
+{
+  boost::mutex::scoped_lock publish_lock(_publish_mutex);
+  std::vector<boost::shared_ptr<FrameServerSession> > subscribers;
+  double resolution;
+  uint64_t sequence;
+  {
+    boost::mutex::scoped_lock lock(_mutex);
+    if (!_running) {
+      return(false);
+    }
+    sequence = _num_published++;
+    subscribers.assign(_subscribers.begin(), _subscribers.end());
+    resolution = _resolution;
+  }
+  if (subscribers.empty()) {
+    return(true);
+  }
+
+  boost::shared_ptr<FrameServerSnapshot> snapshot = TakeSnapshot();
+  double scale = 1.0/resolution;
+  snapshot->sequence = sequence;
+  snapshot->num_points = num_points;
+  snapshot->resolution = resolution;
+  snapshot->columns = 0;
+  if (x && y && z) {
+    snapshot->columns |= HDL_COLUMN_XYZ;
+    snapshot->x.resize(num_points);
+    snapshot->y.resize(num_points);
+    snapshot->z.resize(num_points);
+    for (unsigned int i = 0; i < num_points; i++) {
+      snapshot->x[i] = QuantizeCoordinate(x[i], scale);
+      snapshot->y[i] = QuantizeCoordinate(y[i], scale);
+      snapshot->z[i] = QuantizeCoordinate(z[i], scale);
+    }
+  }
+  if (intensity) {
+    snapshot->columns |= HDL_COLUMN_INTENSITY;
+    snapshot->intensity.assign(intensity, intensity + num_points);
+  }
+  if (laser_id) {
+    snapshot->columns |= HDL_COLUMN_LASER_ID;
+    snapshot->laser_id.assign(laser_id, laser_id + num_points);
+  }
+  if (azimuth) {
+    snapshot->columns |= HDL_COLUMN_AZIMUTH;
+    snapshot->azimuth.assign(azimuth, azimuth + num_points);
+  }
+  if (distance) {
+    snapshot->columns |= HDL_COLUMN_DISTANCE;
+    snapshot->distance.resize(num_points);
+    for (unsigned int i = 0; i < num_points; i++) {
+      snapshot->distance[i] = QuantizeDistance(distance[i], scale);
+    }
+  }
+  if (ms_from_top_of_hour) {
+    snapshot->columns |= HDL_COLUMN_MS_FROM_TOP_OF_HOUR;
+    snapshot->ms_from_top_of_hour.assign(ms_from_top_of_hour, ms_from_top_of_hour + num_points);
+  }
+
+  uint64_t num_dropped = 0;
+  for (unsigned int i = 0; i < subscribers.size(); i++) {
+    num_dropped += subscribers[i]->Enqueue(snapshot) ? 1 : 0;
+  }
+  boost::mutex::scoped_lock lock(_mutex);
+  _num_dropped += num_dropped;
+  return(true);
+}
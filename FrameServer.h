@@ -0,0 +1,101 @@
+// Velodyne HDL Frame Server
+// Nick Rypkema (rypkema@mit.edu), MIT 2017
+// shared library to serve decoded frames to TCP subscribers in a compact quantized encoding
+
+#ifndef FRAME_SERVER_H_INCLUDED
+#define FRAME_SERVER_H_INCLUDED
+
+#include <set>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include "FrameStream.h"
+#include "PacketDecoder.h"
+
+// metres per xyz and distance unit - 5mm is well inside the sensor's accuracy and int16 still reaches 163m
+const double FRAME_SERVER_RESOLUTION = 0.005;
+// encoded frames held per subscriber when its subscription does not ask for a depth, and the most it may ask for
+const unsigned int FRAME_SERVER_QUEUE_DEPTH = 2;
+const unsigned int FRAME_SERVER_MAX_QUEUE_DEPTH = 32;
+// seconds a new connection has to send its subscription before it is closed
+const unsigned int FRAME_SERVER_HANDSHAKE_TIMEOUT = 5;
+
+class FrameServerSession;
+struct FrameServerSnapshot;
+
+// Publishing quantizes the frame once into a shared snapshot and hands it to every subscriber's bounded queue,
+// so the decoder thread never waits on a socket. Each subscriber's io thread then picks its columns and region
+// of interest, compresses if asked and writes; a subscriber that falls behind loses its oldest queued frames
+// (seen as sequence gaps) without holding up the others. Subscribers wanting the whole frame with the same
+// columns and compression share one encoding.
+class FrameServer
+{
+public:
+  FrameServer();
+  virtual ~FrameServer();
+  bool Start(unsigned short port = FRAME_STREAM_PORT, unsigned int num_threads = 1);
+  void Stop();
+  bool IsRunning();
+  unsigned short GetPort(); // the bound port, useful after Start(0)
+  void SetResolution(double resolution); // metres per xyz and distance unit, from the next published frame
+  double GetResolution();
+  unsigned int GetNumberOfSubscribers();
+  uint64_t GetNumberOfPublished();
+  uint64_t GetNumberOfDropped();   // queued frames dropped for slow subscribers, over all subscribers
+  uint64_t GetNumberOfBytesSent();
+
+  // publishes any HDLFrame-like struct (PacketDecoder::HDLFrame, PacketBundleDecoder::HDLFrame)
+  template <typename Frame>
+  bool PublishFrame(const Frame& frame)
+  {
+    // columns left out by the decoder's column mask are empty and are not offered to subscribers
+    unsigned int n = HDLFrameSize(frame);
+    return PublishColumns(n, ColumnData(frame.x, n), ColumnData(frame.y, n), ColumnData(frame.z, n),
+                          ColumnData(frame.intensity, n), ColumnData(frame.laser_id, n), ColumnData(frame.azimuth, n),
+                          ColumnData(frame.distance, n), ColumnData(frame.ms_from_top_of_hour, n));
+  }
+
+  // NULL columns are not offered to subscribers
+  bool PublishColumns(unsigned int num_points, const double* x, const double* y, const double* z,
+                      const unsigned char* intensity, const unsigned char* laser_id, const unsigned short* azimuth,
+                      const double* distance, const unsigned int* ms_from_top_of_hour);
+
+protected:
+  template <typename T>
+  static const T* ColumnData(const std::vector<T>& column, unsigned int num_points)
+  {
+    return (column.size() < num_points || column.empty()) ? NULL : &column[0];
+  }
+
+  boost::shared_ptr<FrameServerSnapshot> TakeSnapshot();
+  void Accept();
+  void AcceptCallback(const boost::system::error_code& error);
+  void RunIOService();
+
+private:
+  friend class FrameServerSession;
+  void AddSubscriber(const boost::shared_ptr<FrameServerSession>& session);
+  void RemoveSubscriber(const boost::shared_ptr<FrameServerSession>& session);
+  void AddBytesSent(uint64_t num_bytes);
+
+  boost::shared_ptr<boost::asio::io_service> _io_service;
+  boost::shared_ptr<boost::asio::io_service::work> _work;
+  boost::shared_ptr<boost::asio::ip::tcp::acceptor> _acceptor;
+  boost::shared_ptr<FrameServerSession> _accepting;
+  std::vector<boost::shared_ptr<boost::thread> > _threads;
+  boost::mutex _publish_mutex; // held through a publish, so Stop can wait out one in flight before tearing down
+  boost::mutex _mutex;
+  std::set<boost::shared_ptr<FrameServerSession> > _sessions;   // connected, subscription not yet read
+  std::set<boost::shared_ptr<FrameServerSession> > _subscribers;
+  std::vector<boost::shared_ptr<FrameServerSnapshot> > _snapshots; // recycled once no subscriber holds them
+  double _resolution;
+  bool _running;
+  unsigned short _port;
+  uint64_t _num_published;
+  uint64_t _num_dropped;
+  uint64_t _num_bytes_sent;
+};
+
+#endif // FRAME_SERVER_H_INCLUDED
@@ -0,0 +1,185 @@
+// Velodyne HDL Frame Server Benchmark
+// Nick Rypkema (rypkema@mit.edu), MIT 2017
+// executable to measure FrameServer throughput, wire size and accuracy with FrameClient subscribers over loopback
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sys/time.h>
+
+#include "PacketSource.h"
+#include "PacketDecoder.h"
+#include "FrameServer.h"
+#include "FrameClient.h"
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
+
+namespace
+{
+struct Subscriber
+{
+  FrameClient client;
+  bool slow;
+  uint64_t num_points;
+  double max_error; // metres, over xyz, for subscribers that get whole frames
+  double seconds;
+};
+
+double Now()
+{
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  return now.tv_sec + now.tv_usec/1e6;
+}
+
+void OnPacket(PacketDecoder* decoder, const char* data, unsigned int data_length, const struct timespec&)
+{
+  decoder->DecodePacket(data, data_length);
+}
+
+void OnFrame(std::vector<PacketDecoder::HDLFrame>* frames, const PacketDecoder::HDLFrame& frame)
+{
+  frames->push_back(frame);
+}
+
+void Receive(Subscriber* subscriber, const std::vector<PacketDecoder::HDLFrame>* frames, bool whole_frames)
+{
+  PacketDecoder::HDLFrame frame;
+  uint64_t sequence;
+  double start = Now();
+  while (subscriber->client.GetNextFrame(&frame, &sequence)) {
+    subscriber->seconds = Now() - start;
+    subscriber->num_points += frame.x.size();
+    const PacketDecoder::HDLFrame& sent = (*frames)[sequence % frames->size()];
+    if (whole_frames && frame.x.size() == sent.x.size()) {
+      for (unsigned int i = 0; i < frame.x.size(); i++) {
+        double error = std::max(std::fabs(frame.x[i] - sent.x[i]), std::max(std::fabs(frame.y[i] - sent.y[i]), std::fabs(frame.z[i] - sent.z[i])));
+        subscriber->max_error = std::max(subscriber->max_error, error);
+      }
+    }
+    if (subscriber->slow) {
+      boost::this_thread::sleep(boost::posix_time::milliseconds(200));
+    }
+  }
+}
+}
+
+int main(int argc, char* argv[])
+{
+  if (argc < 2) {
+    std::cout << "Usage: " << argv[0] << " <in.pcap> [--clients N] [--frames N] [--rate Hz] [--compress] [--roi metres] [--slow-client] [--corrections file.xml]" << std::endl;
+    std::cout << "Publishes the decoded frames of in.pcap over and over to N loopback FrameClients (as fast as possible" << std::endl;
+    std::cout << "unless a rate is given), with --slow-client adding one more that reads a frame every 200ms" << std::endl;
+    return 1;
+  }
+
+  unsigned int num_clients = 1;
+  unsigned int num_frames = 200;
+  double rate = 0;
+  bool compress = false;
+  double roi = 0;
+  bool slow_client = false;
+  PacketDecoder decoder;
+  for (int i = 2; i < argc; i++) {
+    if (strcmp(argv[i], "--clients") == 0 && i + 1 < argc) {
+      num_clients = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+      num_frames = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc) {
+      rate = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--compress") == 0) {
+      compress = true;
+    } else if (strcmp(argv[i], "--roi") == 0 && i + 1 < argc) {
+      roi = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--slow-client") == 0) {
+      slow_client = true;
+    } else if (strcmp(argv[i], "--corrections") == 0 && i + 1 < argc) {
+      decoder.SetCorrectionsFile(argv[++i]);
+    }
+  }
+
+  // decode everything up front so only the server and clients are measured
+  std::vector<PacketDecoder::HDLFrame> frames;
+  PcapPacketSource source(argv[1]);
+  if (!source.IsOpen()) {
+    return 1;
+  }
+  decoder.SetFrameCallback(boost::bind(&OnFrame, &frames, _1));
+  source.Run(boost::bind(&OnPacket, &decoder, _1, _2, _3));
+  if (frames.empty()) {
+    std::cout << "No frames in " << argv[1] << std::endl;
+    return 1;
+  }
+
+  FrameServer server;
+  if (!server.Start(0)) {
+    return 1;
+  }
+
+  std::vector<boost::shared_ptr<Subscriber> > subscribers;
+  boost::thread_group threads;
+  for (unsigned int i = 0; i < num_clients + (slow_client ? 1 : 0); i++) {
+    boost::shared_ptr<Subscriber> subscriber(new Subscriber());
+    subscriber->slow = (i == num_clients);
+    subscriber->num_points = 0;
+    subscriber->max_error = 0;
+    subscriber->seconds = 0;
+    subscriber->client.SetCompression(compress);
+    if (roi > 0) {
+      subscriber->client.SetRegionOfInterest(-roi, -roi, -roi, roi, roi, roi);
+    }
+    if (!subscriber->client.Connect("127.0.0.1", server.GetPort())) {
+      return 1;
+    }
+    subscribers.push_back(subscriber);
+    threads.create_thread(boost::bind(&Receive, subscriber.get(), &frames, roi <= 0));
+  }
+  while (server.GetNumberOfSubscribers() < subscribers.size()) {
+    boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+  }
+
+  uint64_t num_points = 0;
+  double publish_seconds = 0;
+  double start = Now();
+  for (unsigned int i = 0; i < num_frames; i++) {
+    const PacketDecoder::HDLFrame& frame = frames[i % frames.size()];
+    double begin = Now();
+    server.PublishFrame(frame);
+    publish_seconds += Now() - begin;
+    num_points += frame.x.size();
+    if (rate > 0) {
+      double wait = start + (i + 1)/rate - Now();
+      if (wait > 0) {
+        boost::this_thread::sleep(boost::posix_time::microseconds(static_cast<int64_t>(wait*1e6)));
+      }
+    }
+  }
+  double seconds = Now() - start;
+  // let the queues drain before the connections close
+  boost::this_thread::sleep(boost::posix_time::milliseconds(500));
+  server.Stop();
+  threads.join_all();
+
+  printf("Published %u frames (%.0f points each) in %.3fs, %.3fms per frame on the decoder thread\n",
+         num_frames, static_cast<double>(num_points)/num_frames, seconds, 1e3*publish_seconds/num_frames);
+  printf("%llu bytes sent, %llu queued frames dropped for slow subscribers\n",
+         static_cast<unsigned long long>(server.GetNumberOfBytesSent()), static_cast<unsigned long long>(server.GetNumberOfDropped()));
+  for (unsigned int i = 0; i < subscribers.size(); i++) {
+    Subscriber& subscriber = *subscribers[i];
+    uint64_t received = subscriber.client.GetNumberOfReceived();
+    uint64_t bytes = subscriber.client.GetNumberOfBytesReceived();
+    printf("client %u%s: %llu frames, %llu missed, %.2f bytes per point (42 as doubles), %.1f MB/s",
+           i, subscriber.slow ? " (slow)" : "", static_cast<unsigned long long>(received),
+           static_cast<unsigned long long>(subscriber.client.GetNumberOfMissed()),
+           subscriber.num_points ? static_cast<double>(bytes)/subscriber.num_points : 0.0,
+           subscriber.seconds > 0 ? bytes/subscriber.seconds/1e6 : 0.0);
+    if (roi <= 0) {
+      printf(", max xyz error %.4fm", subscriber.max_error);
+    }
+    printf("\n");
+  }
+  return 0;
+}
@@ -0,0 +1,70 @@
+// Velodyne HDL Frame Stream
+// Nick Rypkema (rypkema@mit.edu), MIT 2017
+// wire format of the TCP frame stream shared by FrameServer and FrameClient
+
+#ifndef FRAME_STREAM_H_INCLUDED
+#define FRAME_STREAM_H_INCLUDED
+
+#include <stdint.h>
+#include <boost/static_assert.hpp>
+
+const unsigned short FRAME_STREAM_PORT = 2370;
+
+const uint32_t FRAME_SUBSCRIPTION_MAGIC = 0x48444c53; // "HDLS"
+const uint32_t FRAME_MESSAGE_MAGIC = 0x48444c46;      // "HDLF"
+const uint32_t FRAME_STREAM_VERSION = 1;
+// larger than any frame can encode to, so a corrupt length is caught before it is allocated
+const uint32_t FRAME_STREAM_MAX_PAYLOAD = 64 << 20;
+
+enum FrameStreamCompression
+{
+  FRAME_COMPRESSION_NONE = 0,
+  FRAME_COMPRESSION_ZLIB = 1
+};
+
+// Sent once by the subscriber after connecting. Everything is little endian, like the packets.
+struct FrameSubscription
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t columns;     // HDLColumn bits wanted, columns the published frames lack are left out
+  uint32_t compression; // FrameStreamCompression
+  uint32_t queue_depth; // frames the server holds for this subscriber before dropping the oldest, 0 for its default
+  uint32_t use_roi;     // only points inside [roi_min, roi_max] are sent (needs xyz in the published frames)
+  float roi_min[3];
+  float roi_max[3];
+};
+BOOST_STATIC_ASSERT(sizeof(FrameSubscription) == 48);
+
+// Precedes every frame. The payload holds the present columns in HDLColumn bit order, each num_points long:
+// x, y, z as int16 and distance as uint16 in units of resolution metres (clamped), intensity and laser_id
+// as uint8, azimuth as uint16 and ms_from_top_of_hour as uint32 differences from the previous point (the
+// first from zero). With compression the whole payload is one zlib stream of raw_length bytes.
+struct FrameMessageHeader
+{
+  uint32_t magic;
+  uint32_t columns;
+  uint32_t compression;
+  uint32_t num_points;
+  uint64_t sequence;       // frames published by the server, so a gap is frames dropped for this subscriber
+  float resolution;
+  uint32_t raw_length;     // payload bytes before compression
+  uint32_t payload_length; // payload bytes that follow
+  uint32_t reserved;
+};
+BOOST_STATIC_ASSERT(sizeof(FrameMessageHeader) == 40);
+
+inline uint32_t FrameStreamBytesPerPoint(uint32_t columns)
+{
+  // matches HDL_COLUMN_XYZ, INTENSITY, LASER_ID, AZIMUTH, DISTANCE and MS_FROM_TOP_OF_HOUR
+  const uint32_t column_bytes[6] = { 3*sizeof(int16_t), sizeof(uint8_t), sizeof(uint8_t), sizeof(uint16_t), sizeof(uint16_t), sizeof(uint32_t) };
+  uint32_t bytes = 0;
+  for (int i = 0; i < 6; i++) {
+    if (columns & (1u << i)) {
+      bytes += column_bytes[i];
+    }
+  }
+  return bytes;
+}
+
+#endif // FRAME_STREAM_H_INCLUDED
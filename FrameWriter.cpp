@@ -0,0 +1,299 @@
+// Velodyne HDL Frame Writer
+// Nick Rypkema (rypkema@mit.edu), MIT 2017
+// shared library to stream decoded frames to binary PCD, binary PLY or LAS 1.4 files
+
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <cmath>
+#include <algorithm>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "FrameWriter.h"
+
+namespace
+{
+const unsigned int PCD_PLY_POINT_SIZE = 24;
+const unsigned int LAS_HEADER_SIZE = 375;
+const unsigned int LAS_POINT_FORMAT = 6;
+const unsigned int LAS_POINT_SIZE = 30;
+const double LAS_SCALE = 0.001;
+const double LAS_SCAN_ANGLE_UNIT = 0.006; // degrees
+
+template <typename T>
+void Put(char* data, size_t offset, T value)
+{
+  memcpy(data + offset, &value, sizeof(value));
+}
+
+bool WriteAll(int fd, const char* data, size_t length, off_t offset, bool positioned)
+{
+  while (length) {
+    ssize_t written = positioned ? pwrite(fd, data, length, offset) : write(fd, data, length);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return(false);
+    }
+    data += written;
+    length -= written;
+    offset += written;
+  }
+  return(true);
+}
+
+std::string Lowercase(const std::string& text)
+{
+  std::string lower(text);
+  for (size_t i = 0; i < lower.size(); i++) {
+    lower[i] = tolower(lower[i]);
+  }
+  return lower;
+}
+}
+
+FrameWriter::FrameWriter()
+{
+  _fd = -1;
+  _format = FRAME_FORMAT_PCD;
+  _buffered = 0;
+  _num_points = 0;
+}
+
+FrameWriter::~FrameWriter()
+{
+  Close();
+}
+
+bool FrameWriter::FormatFromFilename(const std::string& filename, FrameFormat* format)
+{
+  size_t dot = filename.rfind('.');
+  std::string extension = (dot == std::string::npos) ? "" : Lowercase(filename.substr(dot + 1));
+  if (extension == "pcd") {
+    *format = FRAME_FORMAT_PCD;
+  } else if (extension == "ply") {
+    *format = FRAME_FORMAT_PLY;
+  } else if (extension == "las") {
+    *format = FRAME_FORMAT_LAS;
+  } else {
+    return(false);
+  }
+  return(true);
+}
+
+bool FrameWriter::Open(const std::string& filename)
+{
+  FrameFormat format;
+  if (!FormatFromFilename(filename, &format)) {
+    std::cout << "FrameWriter: Error, " << filename << " is not a .pcd, .ply or .las file" << std::endl;
+    return(false);
+  }
+  return Open(filename, format);
+}
+
+bool FrameWriter::Open(const std::string& filename, FrameFormat format)
+{
+  Close();
+  _fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (_fd < 0) {
+    std::cout << "FrameWriter: Error, could not open " << filename << " - " << strerror(errno) << std::endl;
+    return(false);
+  }
+  _filename = filename;
+  _format = format;
+  _buffer.resize(FRAME_WRITER_BUFFER_SIZE);
+  _buffered = 0;
+  _num_points = 0;
+  for (int i = 0; i < 3; i++) {
+    _min[i] = _max[i] = 0;
+  }
+
+  // written again by Close once the counts are known, at the same length
+  std::string header = Header();
+  return Append(header.data(), header.size());
+}
+
+bool FrameWriter::IsOpen()
+{
+  return (_fd >= 0);
+}
+
+uint64_t FrameWriter::GetNumberOfPoints()
+{
+  return _num_points;
+}
+
+unsigned int FrameWriter::PointSize()
+{
+  return (_format == FRAME_FORMAT_LAS) ? LAS_POINT_SIZE : PCD_PLY_POINT_SIZE;
+}
+
+std::string FrameWriter::Header()
+{
+  char text[1024];
+  unsigned long long num_points = _num_points;
+  if (_format == FRAME_FORMAT_PCD) {
+    // zero padded so the header keeps its length when the counts are filled in
+    snprintf(text, sizeof(text),
+             "# .PCD v0.7 - Point Cloud Data file format\n"
+             "VERSION 0.7\n"
+             "FIELDS x y z intensity laser_id azimuth distance timestamp\n"
+             "SIZE 4 4 4 1 1 2 4 4\n"
+             "TYPE F F F U U U F U\n"
+             "COUNT 1 1 1 1 1 1 1 1\n"
+             "WIDTH %012llu\n"
+             "HEIGHT 1\n"
+             "VIEWPOINT 0 0 0 1 0 0 0\n"
+             "POINTS %012llu\n"
+             "DATA binary\n", num_points, num_points);
+    return text;
+  }
+  if (_format == FRAME_FORMAT_PLY) {
+    snprintf(text, sizeof(text),
+             "ply\n"
+             "format binary_little_endian 1.0\n"
+             "comment Velodyne HDL frames\n"
+             "element vertex %012llu\n"
+             "property float x\n"
+             "property float y\n"
+             "property float z\n"
+             "property uchar intensity\n"
+             "property uchar laser_id\n"
+             "property ushort azimuth\n"
+             "property float distance\n"
+             "property uint timestamp\n"
+             "end_header\n", num_points);
+    return text;
+  }
+
+  std::string header(LAS_HEADER_SIZE, '\0');
+  char* data = &header[0];
+  memcpy(data, "LASF", 4);
+  Put<uint16_t>(data, 6, 0x10);              // global encoding: gps week time, WKT (required for format 6)
+  data[24] = 1;                              // version 1.4
+  data[25] = 4;
+  strncpy(data + 26, "VelodyneHDL", 32);
+  strncpy(data + 58, "VelodyneHDL FrameWriter", 32);
+  time_t now = time(NULL);
+  struct tm utc;
+  gmtime_r(&now, &utc);
+  Put<uint16_t>(data, 90, utc.tm_yday + 1);
+  Put<uint16_t>(data, 92, utc.tm_year + 1900);
+  Put<uint16_t>(data, 94, LAS_HEADER_SIZE);
+  Put<uint32_t>(data, 96, LAS_HEADER_SIZE);  // offset to point data, there are no VLRs
+  data[104] = LAS_POINT_FORMAT;
+  Put<uint16_t>(data, 105, LAS_POINT_SIZE);
+  for (int i = 0; i < 3; i++) {
+    Put<double>(data, 131 + 8*i, LAS_SCALE);
+    Put<double>(data, 179 + 16*i, _max[i]);
+    Put<double>(data, 187 + 16*i, _min[i]);
+  }
+  Put<uint64_t>(data, 247, _num_points);
+  Put<uint64_t>(data, 255, _num_points);     // every point is return 1 of 1
+  return header;
+}
+
+bool FrameWriter::Append(const void* data, size_t length)
+{
+  if (_buffered + length > _buffer.size() && !Flush()) {
+    return(false);
+  }
+  if (length > _buffer.size()) {
+    return WriteAll(_fd, static_cast<const char*>(data), length, 0, false);
+  }
+  memcpy(&_buffer[_buffered], data, length);
+  _buffered += length;
+  return(true);
+}
+
+bool FrameWriter::Flush()
+{
+  if (_buffered && !WriteAll(_fd, &_buffer[0], _buffered, 0, false)) {
+    std::cout << "FrameWriter: Error, could not write " << _filename << " - " << strerror(errno) << std::endl;
+    return(false);
+  }
+  _buffered = 0;
+  return(true);
+}
+
+bool FrameWriter::WriteColumns(unsigned int num_points, const double* x, const double* y, const double* z,
+                               const unsigned char* intensity, const unsigned char* laser_id, const unsigned short* azimuth,
+                               const double* distance, const unsigned int* ms_from_top_of_hour)
+{
+  if (!IsOpen()) {
+    return(false);
+  }
+
+  unsigned int point_size = PointSize();
+  unsigned int block_points = _buffer.size()/point_size;
+  for (unsigned int begin = 0; begin < num_points; begin += block_points) {
+    unsigned int end = std::min(num_points, begin + block_points);
+    if (_buffered + static_cast<size_t>(end - begin)*point_size > _buffer.size() && !Flush()) {
+      return(false);
+    }
+
+    char* out = &_buffer[_buffered];
+    if (_format != FRAME_FORMAT_LAS) {
+      for (unsigned int i = begin; i < end; i++, out += PCD_PLY_POINT_SIZE) {
+        Put<float>(out, 0, x ? x[i] : 0);
+        Put<float>(out, 4, y ? y[i] : 0);
+        Put<float>(out, 8, z ? z[i] : 0);
+        out[12] = intensity ? intensity[i] : 0;
+        out[13] = laser_id ? laser_id[i] : 0;
+        Put<uint16_t>(out, 14, azimuth ? azimuth[i] : 0);
+        Put<float>(out, 16, distance ? distance[i] : 0);
+        Put<uint32_t>(out, 20, ms_from_top_of_hour ? ms_from_top_of_hour[i] : 0);
+      }
+    } else {
+      for (unsigned int i = begin; i < end; i++, out += LAS_POINT_SIZE) {
+        double point[3] = { x ? x[i] : 0, y ? y[i] : 0, z ? z[i] : 0 };
+        for (int k = 0; k < 3; k++) {
+          if (_num_points + i == 0 || point[k] < _min[k]) {
+            _min[k] = point[k];
+          }
+          if (_num_points + i == 0 || point[k] > _max[k]) {
+            _max[k] = point[k];
+          }
+          Put<int32_t>(out, 4*k, static_cast<int32_t>(floor(point[k]/LAS_SCALE + 0.5)));
+        }
+        // LAS intensity spans 16 bits, so the 8-bit value is scaled up rather than left in the bottom 1/256th
+        Put<uint16_t>(out, 12, intensity ? static_cast<uint16_t>(intensity[i] << 8) : 0);
+        out[14] = 0x11; // return 1 of 1
+        out[15] = 0;
+        out[16] = 0;    // never classified
+        out[17] = laser_id ? laser_id[i] : 0;
+        double degrees = azimuth ? azimuth[i]/100.0 : 0;
+        if (degrees >= 180) {
+          degrees -= 360;
+        }
+        Put<int16_t>(out, 18, static_cast<int16_t>(floor(degrees/LAS_SCAN_ANGLE_UNIT + 0.5)));
+        Put<uint16_t>(out, 20, 0);
+        Put<double>(out, 22, ms_from_top_of_hour ? ms_from_top_of_hour[i]/1e6 : 0);
+      }
+    }
+    _buffered += static_cast<size_t>(end - begin)*point_size;
+  }
+  _num_points += num_points;
+  return(true);
+}
+
+bool FrameWriter::Close()
+{
+  if (!IsOpen()) {
+    return(true);
+  }
+  bool ok = Flush();
+  std::string header = Header();
+  if (ok && !WriteAll(_fd, header.data(), header.size(), 0, true)) {
+    std::cout << "FrameWriter: Error, could not update the header of " << _filename << " - " << strerror(errno) << std::endl;
+    ok = false;
+  }
+  close(_fd);
+  _fd = -1;
+  std::vector<char>().swap(_buffer);
+  return ok;
+}
@@ -0,0 +1,75 @@
+// Velodyne HDL Frame Writer
+// Nick Rypkema (rypkema@mit.edu), MIT 2017
+// shared library to stream decoded frames to binary PCD, binary PLY or LAS 1.4 files
+
+#ifndef FRAME_WRITER_H_INCLUDED
+#define FRAME_WRITER_H_INCLUDED
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "PacketDecoder.h"
+
+// points are encoded straight into one preallocated buffer that goes to disk in large writes
+static unsigned int FRAME_WRITER_BUFFER_SIZE = 8 << 20;
+
+enum FrameFormat
+{
+  FRAME_FORMAT_PCD = 0, // binary PCD v0.7: x y z intensity laser_id azimuth distance timestamp
+  FRAME_FORMAT_PLY = 1, // binary little endian PLY with the same vertex properties
+  FRAME_FORMAT_LAS = 2  // LAS 1.4 point format 6, mm resolution - intensity scaled to 16 bits, laser id in user data, azimuth
+                        // as the scan angle (wrapped to +-180 degrees) and timestamp as gps seconds past the hour
+};
+
+// Any number of frames can go into one file, the point count (and LAS bounds) in the header are filled
+// in by Close. Columns a decoder's column mask left out are written as zeros.
+class FrameWriter
+{
+public:
+  FrameWriter();
+  virtual ~FrameWriter();
+  bool Open(const std::string& filename, FrameFormat format);
+  bool Open(const std::string& filename); // format from the .pcd, .ply or .las extension
+  bool IsOpen();
+  bool Close();
+  uint64_t GetNumberOfPoints();
+  static bool FormatFromFilename(const std::string& filename, FrameFormat* format);
+
+  template <typename Frame>
+  bool WriteFrame(const Frame& frame)
+  {
+    unsigned int n = HDLFrameSize(frame);
+    return WriteColumns(n, ColumnData(frame.x), ColumnData(frame.y), ColumnData(frame.z),
+                        ColumnData(frame.intensity), ColumnData(frame.laser_id), ColumnData(frame.azimuth),
+                        ColumnData(frame.distance), ColumnData(frame.ms_from_top_of_hour));
+  }
+
+  // any column may be NULL
+  bool WriteColumns(unsigned int num_points, const double* x, const double* y, const double* z,
+                    const unsigned char* intensity, const unsigned char* laser_id, const unsigned short* azimuth,
+                    const double* distance, const unsigned int* ms_from_top_of_hour);
+
+protected:
+  template <typename T>
+  static const T* ColumnData(const std::vector<T>& column)
+  {
+    return column.empty() ? NULL : &column[0];
+  }
+
+  std::string Header();
+  bool Append(const void* data, size_t length);
+  bool Flush();
+  unsigned int PointSize();
+
+private:
+  int _fd;
+  std::string _filename;
+  FrameFormat _format;
+  std::vector<char> _buffer;
+  size_t _buffered;
+  uint64_t _num_points;
+  double _min[3];
+  double _max[3];
+};
+
+#endif // FRAME_WRITER_H_INCLUDED
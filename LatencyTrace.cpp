@@ -0,0 +1,198 @@
+// Velodyne HDL Latency Trace
+// Nick Rypkema (rypkema@mit.edu), MIT 2017
+// shared library to record pipeline trace points into per-thread buffers and export them as Chrome trace JSON
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "LatencyTrace.h"
+#include <boost/atomic.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace
+{
+// an HDL-64E trace with every point enabled writes ~10k events a second per thread, so this keeps the last
+// ~6 seconds in 2.5MB per thread
+const unsigned int TRACE_EVENTS_PER_THREAD = 1 << 16;
+
+struct TraceEvent
+{
+  const char* name;
+  int64_t timestamp; // nanoseconds
+  int64_t duration;  // nanoseconds, complete ('X') events only
+  uint64_t arg;
+  char phase;
+};
+
+struct TraceBuffer
+{
+  long tid;
+  std::string name;
+  std::vector<TraceEvent> events;
+  boost::atomic<uint64_t> written; // only ever advanced, by the owning thread
+  uint64_t cleared;                 // events before this were dropped by Clear, guarded by trace_mutex
+};
+
+// buffers outlive their threads so a trace can be exported after the pipeline has shut down
+boost::mutex trace_mutex;
+std::vector<TraceBuffer*> trace_buffers;
+__thread TraceBuffer* thread_buffer = NULL;
+
+int64_t ToNanoseconds(const struct timespec& time)
+{
+  return static_cast<int64_t>(time.tv_sec)*1000000000LL + time.tv_nsec;
+}
+
+int64_t Now()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  return ToNanoseconds(now);
+}
+
+TraceBuffer* ThreadBuffer()
+{
+  if (thread_buffer == NULL) {
+    TraceBuffer* buffer = new TraceBuffer();
+    buffer->tid = syscall(SYS_gettid);
+    buffer->events.resize(TRACE_EVENTS_PER_THREAD);
+    buffer->written = 0;
+    buffer->cleared = 0;
+    boost::mutex::scoped_lock lock(trace_mutex);
+    trace_buffers.push_back(buffer);
+    thread_buffer = buffer;
+  }
+  return thread_buffer;
+}
+
+void Append(const char* name, char phase, int64_t timestamp, int64_t duration, uint64_t arg)
+{
+  TraceBuffer* buffer = ThreadBuffer();
+  uint64_t index = buffer->written.load(boost::memory_order_relaxed);
+  TraceEvent& event = buffer->events[index % buffer->events.size()];
+  event.name = name;
+  event.phase = phase;
+  event.timestamp = timestamp;
+  event.duration = duration;
+  event.arg = arg;
+  buffer->written.store(index + 1, boost::memory_order_release);
+}
+
+// thread names are free text, event names are literals but may still hold quotes
+std::string JsonEscape(const std::string& text)
+{
+  std::string escaped;
+  for (size_t i = 0; i < text.size(); i++) {
+    unsigned char c = static_cast<unsigned char>(text[i]);
+    if (c == '"' || c == '\\') {
+      escaped += '\\';
+      escaped += c;
+    } else if (c < 0x20) {
+      char code[8];
+      snprintf(code, sizeof(code), "\\u%04x", c);
+      escaped += code;
+    } else {
+      escaped += c;
+    }
+  }
+  return escaped;
+}
+}
+
+void LatencyTrace::Record(const char* name, char phase, uint64_t arg)
+{
+  Append(name, phase, Now(), 0, arg);
+}
+
+void LatencyTrace::RecordSince(const char* name, const struct timespec& start, uint64_t arg)
+{
+  int64_t begin = ToNanoseconds(start);
+  Append(name, 'X', begin, Now() - begin, arg);
+}
+
+void LatencyTrace::SetThreadName(const std::string& name)
+{
+  TraceBuffer* buffer = ThreadBuffer();
+  boost::mutex::scoped_lock lock(trace_mutex);
+  buffer->name = name;
+}
+
+bool LatencyTrace::ExportChromeTrace(const std::string& filename)
+{
+  std::ofstream file(filename.c_str());
+  if (!file) {
+    std::cout << "LatencyTrace: Error, could not open " << filename << std::endl;
+    return(false);
+  }
+
+  boost::mutex::scoped_lock lock(trace_mutex);
+
+  // timestamps relative to the earliest event keep microseconds exact in the viewer's doubles
+  int64_t origin = 0;
+  bool has_origin = false;
+  std::vector<uint64_t> first(trace_buffers.size());
+  std::vector<uint64_t> last(trace_buffers.size());
+  for (size_t b = 0; b < trace_buffers.size(); b++) {
+    TraceBuffer* buffer = trace_buffers[b];
+    last[b] = buffer->written.load(boost::memory_order_acquire);
+    first[b] = (last[b] > buffer->events.size()) ? last[b] - buffer->events.size() : 0;
+    first[b] = std::max(first[b], buffer->cleared);
+    for (uint64_t i = first[b]; i < last[b]; i++) {
+      int64_t timestamp = buffer->events[i % buffer->events.size()].timestamp;
+      if (!has_origin || timestamp < origin) {
+        origin = timestamp;
+        has_origin = true;
+      }
+    }
+  }
+
+  file << "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"origin_ns\":" << origin << "},\"traceEvents\":[\n";
+  bool separator = false;
+  file.setf(std::ios::fixed);
+  file.precision(3);
+  for (size_t b = 0; b < trace_buffers.size(); b++) {
+    TraceBuffer* buffer = trace_buffers[b];
+    if (!buffer->name.empty()) {
+      file << (separator ? ",\n" : "") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->tid
+           << ",\"args\":{\"name\":\"" << JsonEscape(buffer->name) << "\"}}";
+      separator = true;
+    }
+    for (uint64_t i = first[b]; i < last[b]; i++) {
+      const TraceEvent& event = buffer->events[i % buffer->events.size()];
+      file << (separator ? ",\n" : "") << "{\"name\":\"" << JsonEscape(event.name) << "\",\"ph\":\"" << event.phase
+           << "\",\"pid\":1,\"tid\":" << buffer->tid << ",\"ts\":" << (event.timestamp - origin)/1000.0;
+      if (event.phase == 'X') {
+        file << ",\"dur\":" << event.duration/1000.0;
+      } else if (event.phase == 'i') {
+        file << ",\"s\":\"t\"";
+      }
+      file << ",\"args\":{\"value\":" << event.arg << "}}";
+      separator = true;
+    }
+  }
+  file << "\n]}\n";
+  return(true);
+}
+
+void LatencyTrace::Clear()
+{
+  boost::mutex::scoped_lock lock(trace_mutex);
+  // written belongs to the recording thread, so rather than resetting it the events up to now are skipped
+  for (size_t b = 0; b < trace_buffers.size(); b++) {
+    trace_buffers[b]->cleared = trace_buffers[b]->written.load(boost::memory_order_acquire);
+  }
+}
+
+bool LatencyTrace::IsEnabled()
+{
+#ifdef HDL_TRACE_ENABLED
+  return(true);
+#else
+  return(false);
+#endif
+}
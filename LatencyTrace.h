@@ -0,0 +1,42 @@
+// Velodyne HDL Latency Trace
+// Nick Rypkema (rypkema@mit.edu), MIT 2017
+// shared library to record pipeline trace points into per-thread buffers and export them as Chrome trace JSON
+
+#ifndef LATENCY_TRACE_H_INCLUDED
+#define LATENCY_TRACE_H_INCLUDED
+
+#include <string>
+#include <time.h>
+#include <stdint.h>
+
+// trace points compile to nothing unless built with -DHDL_TRACE_ENABLED (cmake -DHDL_TRACE=ON) - names must be
+// string literals, as only the pointer is stored
+#ifdef HDL_TRACE_ENABLED
+#define HDL_TRACE_BEGIN(name, arg) LatencyTrace::Record(name, 'B', arg)
+#define HDL_TRACE_END(name, arg) LatencyTrace::Record(name, 'E', arg)
+#define HDL_TRACE_INSTANT(name, arg) LatencyTrace::Record(name, 'i', arg)
+#define HDL_TRACE_SINCE(name, start, arg) LatencyTrace::RecordSince(name, start, arg)
+#else
+#define HDL_TRACE_BEGIN(name, arg) do {} while (0)
+#define HDL_TRACE_END(name, arg) do {} while (0)
+#define HDL_TRACE_INSTANT(name, arg) do {} while (0)
+#define HDL_TRACE_SINCE(name, start, arg) do {} while (0)
+#endif
+
+// Each thread records into its own preallocated ring (registered on its first event) with no locks or
+// allocation, keeping the newest 64K events - about 6 seconds of an HDL-64E with every point enabled.
+// Timestamps are CLOCK_REALTIME, the clock kernel packet timestamps use, so socket queueing shows up on
+// the same timeline.
+class LatencyTrace
+{
+public:
+  static void Record(const char* name, char phase, uint64_t arg);
+  static void RecordSince(const char* name, const struct timespec& start, uint64_t arg); // a span from start until now
+  static void SetThreadName(const std::string& name);
+  // export while threads are still tracing can catch events mid-write in a ring that is wrapping
+  static bool ExportChromeTrace(const std::string& filename);
+  static void Clear(); // drops the events recorded so far, safe while threads are tracing
+  static bool IsEnabled(); // whether trace points were compiled in
+};
+
+#endif // LATENCY_TRACE_H_INCLUDED
@@ -0,0 +1,258 @@
+// Velodyne HDL Lazy Frame
+// Nick Rypkema (rypkema@mit.edu), MIT 2017
+// shared library to view a raw packet bundle as a frame, decoding each column only when it is first asked for
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+#include "LazyFrame.h"
+#include "PacketDecodeKernels.h"
+
+LazyFrame::LazyFrame()
+{
+  GetAzimuthTable();
+  _decoder = NULL;
+  _bundle = NULL;
+  _num_packets = 0;
+  ClearRange();
+}
+
+LazyFrame::LazyFrame(PacketBundleDecoder* decoder, const char* bundle, unsigned int bundle_length)
+{
+  GetAzimuthTable();
+  ClearRange();
+  Reset(decoder, bundle, bundle_length);
+}
+
+LazyFrame::~LazyFrame()
+{
+}
+
+void LazyFrame::Reset(PacketBundleDecoder* decoder, const char* bundle, unsigned int bundle_length)
+{
+  _decoder = decoder;
+  _bundle = bundle;
+  _num_packets = bundle_length/1206;
+  Invalidate();
+}
+
+void LazyFrame::SetLaserRange(unsigned char first_laser, unsigned char last_laser)
+{
+  _first_laser = first_laser;
+  _last_laser = last_laser;
+  Invalidate();
+}
+
+void LazyFrame::SetAzimuthRange(unsigned short begin, unsigned short end)
+{
+  _azimuth_begin = begin;
+  _azimuth_end = end;
+  _azimuth_range = true;
+  Invalidate();
+}
+
+void LazyFrame::ClearRange()
+{
+  _first_laser = 0;
+  _last_laser = HDL_MAX_NUM_LASERS-1;
+  _azimuth_begin = 0;
+  _azimuth_end = 0;
+  _azimuth_range = false;
+  Invalidate();
+}
+
+void LazyFrame::Invalidate()
+{
+  // the columns keep their capacity, so re-using one LazyFrame across bundles stops allocating
+  _decoded = 0;
+}
+
+unsigned int LazyFrame::GetNumberOfPoints()
+{
+  BuildIndex();
+  return _index.size();
+}
+
+const HDLDataPacket* LazyFrame::Packet(uint32_t point)
+{
+  return reinterpret_cast<const HDLDataPacket*>(_bundle + (point >> 9)*1206);
+}
+
+const HDLFiringData& LazyFrame::Firing(uint32_t point)
+{
+  return Packet(point)->firingData[(point >> 5) & 0xf];
+}
+
+const HDLLaserReturn& LazyFrame::Return(uint32_t point)
+{
+  return Firing(point).laserReturns[point & 0x1f];
+}
+
+unsigned char LazyFrame::LaserId(uint32_t point)
+{
+  return static_cast<unsigned char>((point & 0x1f) + (Firing(point).blockIdentifier == BLOCK_0_TO_31 ? 0 : 32));
+}
+
+bool LazyFrame::InAzimuthRange(unsigned short azimuth)
+{
+  if (!_azimuth_range) {
+    return(true);
+  }
+  if (_azimuth_begin <= _azimuth_end) {
+    return (azimuth >= _azimuth_begin && azimuth < _azimuth_end);
+  }
+  return (azimuth >= _azimuth_begin || azimuth < _azimuth_end);
+}
+
+void LazyFrame::BuildIndex()
+{
+  if (_decoded & LAZY_INDEX) {
+    return;
+  }
+
+  // only the distance, block id and azimuth of each return are read here
+  _index.clear();
+  for (unsigned int p = 0; p < _num_packets; p++) {
+    const HDLDataPacket* packet = reinterpret_cast<const HDLDataPacket*>(_bundle + p*1206);
+    for (unsigned int i = 0; i < HDL_FIRING_PER_PKT; i++) {
+      const HDLFiringData& firing = packet->firingData[i];
+      int offset = (firing.blockIdentifier == BLOCK_0_TO_31) ? 0 : 32;
+      if (!InAzimuthRange(firing.rotationalPosition) || offset + HDL_LASER_PER_FIRING <= _first_laser || offset > _last_laser) {
+        continue;
+      }
+      for (unsigned int j = 0; j < HDL_LASER_PER_FIRING; j++) {
+        if (firing.laserReturns[j].distance != 0 && j + offset >= _first_laser && j + offset <= _last_laser) {
+          _index.push_back((p << 9) | (i << 5) | j);
+        }
+      }
+    }
+  }
+  _decoded = LAZY_INDEX;
+}
+
+void LazyFrame::DecodeXYZ()
+{
+  BuildIndex();
+  if (_decoded & LAZY_XYZ) {
+    return;
+  }
+
+  const HDLLaserCorrection* corrections = _decoder->GetLaserCorrections();
+  bool has_extrinsic = _decoder->HasExtrinsic();
+  unsigned int num_points = _index.size();
+  _x.resize(num_points);
+  _y.resize(num_points);
+  _z.resize(num_points);
+
+  for (unsigned int n = 0; n < num_points; n++) {
+    uint32_t point = _index[n];
+    const HDLFiringData& firing = Firing(point);
+    const HDLLaserCorrection& correction = corrections[LaserId(point)];
+
+    double sinAzimuth, cosAzimuth;
+    AzimuthTrig(correction, firing.rotationalPosition, &sinAzimuth, &cosAzimuth);
+    double distanceM = firing.laserReturns[point & 0x1f].distance * 0.002 + correction.distanceCorrection;
+    ReturnXYZ(correction, distanceM, sinAzimuth, cosAzimuth, has_extrinsic, &_x[n], &_y[n], &_z[n]);
+  }
+  _decoded |= LAZY_XYZ;
+}
+
+const std::vector<double>& LazyFrame::GetX()
+{
+  DecodeXYZ();
+  return _x;
+}
+
+const std::vector<double>& LazyFrame::GetY()
+{
+  DecodeXYZ();
+  return _y;
+}
+
+const std::vector<double>& LazyFrame::GetZ()
+{
+  DecodeXYZ();
+  return _z;
+}
+
+const std::vector<unsigned char>& LazyFrame::GetIntensity()
+{
+  BuildIndex();
+  if (!(_decoded & LAZY_INTENSITY)) {
+    const HDLIntensityTable* intensity_table = _decoder->GetIntensityTable();
+    _intensity.resize(_index.size());
+    for (unsigned int n = 0; n < _index.size(); n++) {
+      _intensity[n] = CalibrateIntensity(intensity_table, LaserId(_index[n]), Return(_index[n]));
+    }
+    _decoded |= LAZY_INTENSITY;
+  }
+  return _intensity;
+}
+
+const std::vector<unsigned char>& LazyFrame::GetLaserId()
+{
+  BuildIndex();
+  if (!(_decoded & LAZY_LASER_ID)) {
+    _laser_id.resize(_index.size());
+    for (unsigned int n = 0; n < _index.size(); n++) {
+      _laser_id[n] = LaserId(_index[n]);
+    }
+    _decoded |= LAZY_LASER_ID;
+  }
+  return _laser_id;
+}
+
+const std::vector<unsigned short>& LazyFrame::GetAzimuth()
+{
+  BuildIndex();
+  if (!(_decoded & LAZY_AZIMUTH)) {
+    _azimuth.resize(_index.size());
+    for (unsigned int n = 0; n < _index.size(); n++) {
+      _azimuth[n] = Firing(_index[n]).rotationalPosition;
+    }
+    _decoded |= LAZY_AZIMUTH;
+  }
+  return _azimuth;
+}
+
+const std::vector<double>& LazyFrame::GetDistance()
+{
+  BuildIndex();
+  if (!(_decoded & LAZY_DISTANCE)) {
+    const HDLLaserCorrection* corrections = _decoder->GetLaserCorrections();
+    _distance.resize(_index.size());
+    for (unsigned int n = 0; n < _index.size(); n++) {
+      _distance[n] = Return(_index[n]).distance * 0.002 + corrections[LaserId(_index[n])].distanceCorrection;
+    }
+    _decoded |= LAZY_DISTANCE;
+  }
+  return _distance;
+}
+
+const std::vector<unsigned int>& LazyFrame::GetMsFromTopOfHour()
+{
+  BuildIndex();
+  if (!(_decoded & LAZY_MS_FROM_TOP_OF_HOUR)) {
+    int64_t time_offset = _decoder->GetTimeOffset();
+    _ms_from_top_of_hour.resize(_index.size());
+    for (unsigned int n = 0; n < _index.size(); n++) {
+      int64_t timestamp = Packet(_index[n])->gpsTimestamp + time_offset;
+      _ms_from_top_of_hour[n] = static_cast<unsigned int>((timestamp % HDL_US_PER_HOUR + HDL_US_PER_HOUR) % HDL_US_PER_HOUR);
+    }
+    _decoded |= LAZY_MS_FROM_TOP_OF_HOUR;
+  }
+  return _ms_from_top_of_hour;
+}
+
+void LazyFrame::Materialize(PacketBundleDecoder::HDLFrame* frame)
+{
+  frame->x = GetX();
+  frame->y = GetY();
+  frame->z = GetZ();
+  frame->intensity = GetIntensity();
+  frame->laser_id = GetLaserId();
+  frame->azimuth = GetAzimuth();
+  frame->distance = GetDistance();
+  frame->ms_from_top_of_hour = GetMsFromTopOfHour();
+}
@@ -0,0 +1,80 @@
+// Velodyne HDL Lazy Frame
+// Nick Rypkema (rypkema@mit.edu), MIT 2017
+// shared library to view a raw packet bundle as a frame, decoding each column only when it is first asked for
+
+#ifndef LAZY_FRAME_H_INCLUDED
+#define LAZY_FRAME_H_INCLUDED
+
+#include <vector>
+#include <stdint.h>
+#include "PacketBundleDecoder.h"
+
+// Points are every non-zero return of the bundle, in the order PacketBundleDecoder::DecodeBundle produces them.
+// The bundle is not copied and must outlive the frame (or the next Reset), as must the decoder whose calibration,
+// extrinsic and time offset are used. The decoder's voxel grid, background model and decimation are not applied,
+// so with any of them enabled the lazy frame also holds the returns its decoded frames would drop or merge -
+// SetLaserRange and SetAzimuthRange are the lazy frame's own way of thinning.
+class LazyFrame
+{
+public:
+  LazyFrame();
+  LazyFrame(PacketBundleDecoder* decoder, const char* bundle, unsigned int bundle_length);
+  virtual ~LazyFrame();
+  void Reset(PacketBundleDecoder* decoder, const char* bundle, unsigned int bundle_length);
+  void SetLaserRange(unsigned char first_laser, unsigned char last_laser); // inclusive
+  void SetAzimuthRange(unsigned short begin, unsigned short end);          // hundredths of a degree, [begin, end), wraps through 0 if begin > end
+  void ClearRange();
+  unsigned int GetNumberOfPoints();
+  const std::vector<double>& GetX(); // x, y and z share their trigonometry so are decoded together
+  const std::vector<double>& GetY();
+  const std::vector<double>& GetZ();
+  const std::vector<unsigned char>& GetIntensity();
+  const std::vector<unsigned char>& GetLaserId();
+  const std::vector<unsigned short>& GetAzimuth();
+  const std::vector<double>& GetDistance();
+  const std::vector<unsigned int>& GetMsFromTopOfHour();
+  void Materialize(PacketBundleDecoder::HDLFrame* frame); // copies every column out, decoding what is still missing
+
+protected:
+  enum LazyColumn
+  {
+    LAZY_INDEX = 1 << 0,
+    LAZY_XYZ = 1 << 1,
+    LAZY_INTENSITY = 1 << 2,
+    LAZY_LASER_ID = 1 << 3,
+    LAZY_AZIMUTH = 1 << 4,
+    LAZY_DISTANCE = 1 << 5,
+    LAZY_MS_FROM_TOP_OF_HOUR = 1 << 6
+  };
+
+  void Invalidate();
+  void BuildIndex();
+  void DecodeXYZ();
+  bool InAzimuthRange(unsigned short azimuth);
+  const HDLDataPacket* Packet(uint32_t point);
+  const HDLFiringData& Firing(uint32_t point);
+  const HDLLaserReturn& Return(uint32_t point);
+  unsigned char LaserId(uint32_t point);
+
+private:
+  PacketBundleDecoder* _decoder;
+  const char* _bundle;
+  unsigned int _num_packets;
+  unsigned int _decoded;     // LazyColumn bits already materialized
+  unsigned char _first_laser;
+  unsigned char _last_laser;
+  unsigned short _azimuth_begin;
+  unsigned short _azimuth_end;
+  bool _azimuth_range;
+  std::vector<uint32_t> _index; // packet << 9 | firing << 5 | return, per point
+  std::vector<double> _x;
+  std::vector<double> _y;
+  std::vector<double> _z;
+  std::vector<unsigned char> _intensity;
+  std::vector<unsigned char> _laser_id;
+  std::vector<unsigned short> _azimuth;
+  std::vector<double> _distance;
+  std::vector<unsigned int> _ms_from_top_of_hour;
+};
+
+#endif // LAZY_FRAME_H_INCLUDED
@@ -0,0 +1,515 @@
+// Velodyne HDL Packet Bundle Codec
+// Nick Rypkema (rypkema@mit.edu), MIT 2017
+// shared library to losslessly compress/decompress a bundle of velodyne packets
+
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+
+#include "PacketDecoder.h"
+#include "PacketBundleCodec.h"
+
+namespace
+{
+const char HDLZ_MAGIC[4] = {'H', 'D', 'L', 'Z'};
+const unsigned char HDLZ_VERSION = 1;
+const unsigned int HDLZ_HEADER_SIZE = 13;
+const unsigned int HDLZ_PACK_BLOCK = 128;
+const unsigned int HDL_FIRING_SIZE = 100;
+const unsigned int HDL_GPS_OFFSET = 1200;
+const unsigned int HDL_FACTORY_OFFSET = 1204;
+// largest bundle DecompressBundle will rebuild, so a corrupt header cannot ask for an absurd allocation
+const uint64_t HDLZ_MAX_BUNDLE_SIZE = 256 << 20;
+
+inline uint32_t ZigZag16(uint16_t delta)
+{
+  int16_t d = static_cast<int16_t>(delta);
+  // the shift is done unsigned, as left shifting a negative value is undefined
+  return static_cast<uint16_t>((static_cast<uint32_t>(delta) << 1) ^ static_cast<uint32_t>(d >> 15));
+}
+
+inline uint16_t UnZigZag16(uint32_t v)
+{
+  return static_cast<uint16_t>((v >> 1) ^ (~(v & 1) + 1));
+}
+
+inline uint32_t ZigZag32(uint32_t delta)
+{
+  int32_t d = static_cast<int32_t>(delta);
+  return (delta << 1) ^ static_cast<uint32_t>(d >> 31);
+}
+
+inline uint32_t UnZigZag32(uint32_t v)
+{
+  return (v >> 1) ^ (~(v & 1) + 1);
+}
+
+void PutVarint(std::string* out, uint32_t v)
+{
+  while (v >= 0x80) {
+    out->push_back(static_cast<char>((v & 0x7f) | 0x80));
+    v >>= 7;
+  }
+  out->push_back(static_cast<char>(v));
+}
+
+bool GetVarint(const unsigned char*& p, const unsigned char* end, uint32_t* v)
+{
+  uint32_t result = 0;
+  for (int shift = 0; shift < 35 && p < end; shift += 7) {
+    unsigned char byte = *p++;
+    result |= static_cast<uint32_t>(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      *v = result;
+      return true;
+    }
+  }
+  return false;
+}
+
+// frame-of-reference style bit packing - each block of 128 values stores one width byte
+void PackBits(const uint32_t* values, unsigned int count, std::string* out)
+{
+  for (unsigned int start = 0; start < count; start += HDLZ_PACK_BLOCK) {
+    unsigned int n = (count - start < HDLZ_PACK_BLOCK) ? count - start : HDLZ_PACK_BLOCK;
+    uint32_t all = 0;
+    for (unsigned int i = 0; i < n; i++) {
+      all |= values[start + i];
+    }
+    unsigned int width = 0;
+    while (width < 32 && (all >> width)) {
+      width++;
+    }
+    out->push_back(static_cast<char>(width));
+    if (width == 0) {
+      continue;
+    }
+
+    uint64_t acc = 0;
+    unsigned int bits = 0;
+    for (unsigned int i = 0; i < n; i++) {
+      acc |= static_cast<uint64_t>(values[start + i]) << bits;
+      bits += width;
+      while (bits >= 8) {
+        out->push_back(static_cast<char>(acc & 0xff));
+        acc >>= 8;
+        bits -= 8;
+      }
+    }
+    if (bits) {
+      out->push_back(static_cast<char>(acc & 0xff));
+    }
+  }
+}
+
+// value Index of a run of 64 values packed Width bits each into Width 64 bit words - Width and Index are compile
+// time constants, so every word index, shift and the straddle test fold away
+template <typename Value, unsigned int Width, unsigned int Index>
+struct UnpackValues
+{
+  static void Unpack(const uint64_t* words, Value* values)
+  {
+    const unsigned int word = (Index*Width) >> 6;
+    const unsigned int shift = (Index*Width) & 63;
+    const uint64_t mask = (Width == 32) ? 0xffffffffULL : ((1ULL << Width) - 1);
+    uint64_t value = words[word] >> shift;
+    if (shift + Width > 64) {
+      value |= words[word + 1] << ((64 - shift) & 63);
+    }
+    values[Index] = static_cast<Value>(value & mask);
+    UnpackValues<Value, Width, Index + 1>::Unpack(words, values);
+  }
+};
+
+template <typename Value, unsigned int Width>
+struct UnpackValues<Value, Width, 64>
+{
+  static void Unpack(const uint64_t*, Value*)
+  {
+  }
+};
+
+// unpacks a whole block of HDLZ_PACK_BLOCK values, Width bits each - the block is two runs of 64 values in
+// Width little endian 64 bit words each, read with word loads rather than value by value
+template <typename Value, unsigned int Width>
+void UnpackBlock(const unsigned char* in, Value* values)
+{
+  uint64_t words[2*Width];
+  memcpy(words, in, sizeof(words));
+  UnpackValues<Value, Width, 0>::Unpack(words, values);
+  UnpackValues<Value, Width, 0>::Unpack(words + Width, values + 64);
+}
+
+// table of UnpackBlock instantiations indexed by width, filled by recursing down from 32
+template <typename Value>
+struct UnpackBlocks
+{
+  typedef void (*Function)(const unsigned char* in, Value* values);
+  Function table[33];
+};
+
+template <typename Value, unsigned int Width>
+struct FillUnpackBlocks
+{
+  static void Fill(UnpackBlocks<Value>* blocks)
+  {
+    blocks->table[Width] = &UnpackBlock<Value, Width>;
+    FillUnpackBlocks<Value, Width - 1>::Fill(blocks);
+  }
+};
+
+template <typename Value>
+struct FillUnpackBlocks<Value, 0>
+{
+  static void Fill(UnpackBlocks<Value>* blocks)
+  {
+    blocks->table[0] = NULL;
+  }
+};
+
+template <typename Value>
+UnpackBlocks<Value> BuildUnpackBlocks()
+{
+  UnpackBlocks<Value> blocks;
+  FillUnpackBlocks<Value, 32>::Fill(&blocks);
+  return blocks;
+}
+
+// built on first use, thread-safely, as in GetFiringKernels
+template <typename Value>
+const UnpackBlocks<Value>& GetUnpackBlocks()
+{
+  static const UnpackBlocks<Value> blocks = BuildUnpackBlocks<Value>();
+  return blocks;
+}
+
+// Value is uint32_t, or unsigned char for streams packed no wider than 8 bits (wider values are truncated)
+template <typename Value>
+bool UnpackBits(const unsigned char*& p, const unsigned char* end, unsigned int count, Value* values)
+{
+  const UnpackBlocks<Value>& blocks = GetUnpackBlocks<Value>();
+  for (unsigned int start = 0; start < count; start += HDLZ_PACK_BLOCK) {
+    unsigned int n = (count - start < HDLZ_PACK_BLOCK) ? count - start : HDLZ_PACK_BLOCK;
+    if (p >= end) {
+      return false;
+    }
+    unsigned int width = *p++;
+    if (width > 32) {
+      return false;
+    }
+    if (width == 0) {
+      memset(values + start, 0, n * sizeof(Value));
+      continue;
+    }
+    unsigned int num_bytes = (n * width + 7) / 8;
+    if (static_cast<unsigned int>(end - p) < num_bytes) {
+      return false;
+    }
+    if (n == HDLZ_PACK_BLOCK) {
+      blocks.table[width](p, values + start);
+      p += num_bytes;
+      continue;
+    }
+
+    // the last, partial block a byte at a time
+    const uint64_t mask = (width == 32) ? 0xffffffffULL : ((1ULL << width) - 1);
+    for (unsigned int i = 0; i < n; i++) {
+      unsigned int pos = i * width;
+      uint64_t word = 0;
+      unsigned int bytes = ((pos & 7) + width + 7) / 8;
+      memcpy(&word, p + (pos >> 3), bytes);
+      values[start + i] = static_cast<Value>((word >> (pos & 7)) & mask);
+    }
+    p += num_bytes;
+  }
+  return true;
+}
+
+void PutRunLength16(const std::vector<uint16_t>& values, std::string* out)
+{
+  unsigned int i = 0;
+  while (i < values.size()) {
+    unsigned int run = 1;
+    while (i + run < values.size() && values[i + run] == values[i]) {
+      run++;
+    }
+    PutVarint(out, run);
+    out->append(reinterpret_cast<const char*>(&values[i]), 2);
+    i += run;
+  }
+}
+
+bool GetRunLength16(const unsigned char*& p, const unsigned char* end, std::vector<uint16_t>* values)
+{
+  unsigned int i = 0;
+  while (i < values->size()) {
+    uint32_t run;
+    if (!GetVarint(p, end, &run) || run == 0 || run > values->size() - i || end - p < 2) {
+      return false;
+    }
+    uint16_t value;
+    memcpy(&value, p, 2);
+    p += 2;
+    std::fill(values->begin() + i, values->begin() + i + run, value);
+    i += run;
+  }
+  return true;
+}
+}
+
+PacketBundleCodec::PacketBundleCodec()
+{
+
+}
+
+PacketBundleCodec::~PacketBundleCodec()
+{
+
+}
+
+void PacketBundleCodec::Transpose(const unsigned char* bundle, unsigned int num_packets)
+{
+  unsigned int num_firings = num_packets*HDL_FIRING_PER_PKT;
+  _block_ids.resize(num_firings);
+  _rotations.resize(num_firings);
+  _distances.resize(num_firings*HDL_LASER_PER_FIRING);
+  _intensities.resize(num_firings*HDL_LASER_PER_FIRING);
+  _gps_timestamps.resize(num_packets);
+  _factory.resize(num_packets);
+
+  for (unsigned int p = 0; p < num_packets; p++) {
+    const unsigned char* packet = bundle + p*1206;
+    for (int i = 0; i < HDL_FIRING_PER_PKT; i++) {
+      const unsigned char* firing = packet + i*HDL_FIRING_SIZE;
+      unsigned int f = p*HDL_FIRING_PER_PKT + i;
+      memcpy(&_block_ids[f], firing, 2);
+      memcpy(&_rotations[f], firing + 2, 2);
+      for (int j = 0; j < HDL_LASER_PER_FIRING; j++) {
+        memcpy(&_distances[j*num_firings + f], firing + 4 + j*3, 2);
+        _intensities[j*num_firings + f] = firing[4 + j*3 + 2];
+      }
+    }
+    memcpy(&_gps_timestamps[p], packet + HDL_GPS_OFFSET, 4);
+    memcpy(&_factory[p], packet + HDL_FACTORY_OFFSET, 2);
+  }
+}
+
+// writes the returns, firing by firing so the packets are written in order as the columns are read in order
+void PacketBundleCodec::Untranspose(unsigned char* bundle, unsigned int num_packets)
+{
+  unsigned int num_firings = num_packets*HDL_FIRING_PER_PKT;
+  for (unsigned int f = 0; f < num_firings; f++) {
+    unsigned char* returns = bundle + _firing_offsets[f] + 4;
+    const uint16_t* distances = &_distances[f];
+    const unsigned char* intensities = &_intensity_bytes[f];
+    for (int j = 0; j < HDL_LASER_PER_FIRING; j++) {
+      memcpy(returns + j*3, distances + j*num_firings, 2);
+      returns[j*3 + 2] = intensities[j*num_firings];
+    }
+  }
+}
+
+bool PacketBundleCodec::CompressBundle(const char* bundle, unsigned int bundle_length, std::string* compressed)
+{
+  unsigned int num_packets = bundle_length/1206;
+  unsigned int tail_length = bundle_length - num_packets*1206;
+  unsigned int num_firings = num_packets*HDL_FIRING_PER_PKT;
+  unsigned int num_returns = num_firings*HDL_LASER_PER_FIRING;
+
+  Transpose(reinterpret_cast<const unsigned char*>(bundle), num_packets);
+
+  compressed->clear();
+  compressed->reserve(bundle_length/2);
+  compressed->append(HDLZ_MAGIC, 4);
+  compressed->push_back(static_cast<char>(HDLZ_VERSION));
+  compressed->append(reinterpret_cast<const char*>(&num_packets), 4);
+  compressed->append(reinterpret_cast<const char*>(&tail_length), 4);
+
+  PutRunLength16(_block_ids, compressed);
+
+  _scratch.resize(num_returns);
+  uint16_t prev_rotation = 0;
+  for (unsigned int f = 0; f < num_firings; f++) {
+    _scratch[f] = ZigZag16(static_cast<uint16_t>(_rotations[f] - prev_rotation));
+    prev_rotation = _rotations[f];
+  }
+  PackBits(num_firings ? &_scratch[0] : NULL, num_firings, compressed);
+
+  // zero returns only cost a run length, non-zero returns are delta coded per laser and block
+  _runs.clear();
+  unsigned int num_nonzero = 0;
+  bool nonzero_run = true;
+  uint32_t run = 0;
+  for (int j = 0; j < HDL_LASER_PER_FIRING; j++) {
+    uint16_t prev_distance[2] = {0, 0};
+    const uint16_t* distances = &_distances[j*num_firings];
+    for (unsigned int f = 0; f < num_firings; f++) {
+      bool nonzero = (distances[f] != 0);
+      if (nonzero != nonzero_run) {
+        _runs.push_back(run);
+        nonzero_run = nonzero;
+        run = 0;
+      }
+      run++;
+      if (nonzero) {
+        int block = (_block_ids[f] == BLOCK_0_TO_31) ? 0 : 1;
+        _scratch[num_nonzero++] = ZigZag16(static_cast<uint16_t>(distances[f] - prev_distance[block]));
+        prev_distance[block] = distances[f];
+      }
+    }
+  }
+  _runs.push_back(run);
+
+  PutVarint(compressed, _runs.size());
+  for (unsigned int i = 0; i < _runs.size(); i++) {
+    PutVarint(compressed, _runs[i]);
+  }
+  PackBits(num_nonzero ? &_scratch[0] : NULL, num_nonzero, compressed);
+  PackBits(num_returns ? &_intensities[0] : NULL, num_returns, compressed);
+
+  uint32_t prev_timestamp = 0;
+  for (unsigned int p = 0; p < num_packets; p++) {
+    PutVarint(compressed, ZigZag32(_gps_timestamps[p] - prev_timestamp));
+    prev_timestamp = _gps_timestamps[p];
+  }
+  PutRunLength16(_factory, compressed);
+
+  compressed->append(bundle + num_packets*1206, tail_length);
+  return(true);
+}
+
+bool PacketBundleCodec::DecompressBundle(const char* compressed, unsigned int compressed_length, std::string* bundle)
+{
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(compressed);
+  const unsigned char* end = p + compressed_length;
+
+  if (compressed_length < HDLZ_HEADER_SIZE || memcmp(p, HDLZ_MAGIC, 4) != 0) {
+    std::cout << "PacketBundleCodec: Error, data is not a compressed bundle" << std::endl;
+    return(false);
+  }
+  if (p[4] != HDLZ_VERSION) {
+    std::cout << "PacketBundleCodec: Error, unsupported compressed bundle version " << (int)p[4] << std::endl;
+    return(false);
+  }
+
+  unsigned int num_packets, tail_length;
+  memcpy(&num_packets, p + 5, 4);
+  memcpy(&tail_length, p + 9, 4);
+  p += HDLZ_HEADER_SIZE;
+  // every packet costs at least its timestamp varint, reject headers that would make us allocate wildly -
+  // in 64 bits, as num_packets*1206 can wrap
+  uint64_t bundle_length = static_cast<uint64_t>(num_packets)*1206 + tail_length;
+  if (num_packets > compressed_length || tail_length > compressed_length || bundle_length > HDLZ_MAX_BUNDLE_SIZE) {
+    std::cout << "PacketBundleCodec: Error, corrupt compressed bundle header" << std::endl;
+    return(false);
+  }
+
+  unsigned int num_firings = num_packets*HDL_FIRING_PER_PKT;
+  unsigned int num_returns = num_firings*HDL_LASER_PER_FIRING;
+  _block_ids.resize(num_firings);
+  _distances.resize(num_returns);
+  _intensity_bytes.resize(num_returns);
+  _factory.resize(num_packets);
+  _scratch.resize(num_returns);
+  // the per firing and per packet streams are decoded straight into their place in the packets, the returns
+  // into columns that Untranspose then interleaves
+  bundle->resize(static_cast<size_t>(bundle_length));
+  unsigned char* out = bundle->size() ? reinterpret_cast<unsigned char*>(&(*bundle)[0]) : NULL;
+  _firing_offsets.resize(num_firings);
+  for (unsigned int f = 0; f < num_firings; f++) {
+    _firing_offsets[f] = (f / HDL_FIRING_PER_PKT)*1206 + (f % HDL_FIRING_PER_PKT)*HDL_FIRING_SIZE;
+  }
+  const unsigned int* offsets = num_firings ? &_firing_offsets[0] : NULL;
+
+  bool ok = GetRunLength16(p, end, &_block_ids);
+
+  ok = ok && UnpackBits(p, end, num_firings, num_firings ? &_scratch[0] : NULL);
+  uint16_t rotation = 0;
+  for (unsigned int f = 0; ok && f < num_firings; f++) {
+    rotation = static_cast<uint16_t>(rotation + UnZigZag16(_scratch[f]));
+    memcpy(out + offsets[f], &_block_ids[f], 2);
+    memcpy(out + offsets[f] + 2, &rotation, 2);
+  }
+
+  uint32_t num_runs = 0;
+  ok = ok && GetVarint(p, end, &num_runs) && num_runs <= num_returns + 1;
+  _runs.resize(num_runs);
+  // 64 bit sums, so run lengths cannot wrap around to a plausible total
+  uint64_t num_nonzero = 0;
+  uint64_t total = 0;
+  for (unsigned int i = 0; ok && i < num_runs; i++) {
+    ok = GetVarint(p, end, &_runs[i]);
+    total += _runs[i];
+    if (i % 2 == 0) {
+      num_nonzero += _runs[i];
+    }
+  }
+  ok = ok && (total == num_returns) && (num_nonzero <= num_returns);
+  ok = ok && UnpackBits(p, end, static_cast<unsigned int>(num_nonzero), num_nonzero ? &_scratch[0] : NULL);
+
+  // run by run - zero runs are a fill, non-zero runs a prefix sum per laser, kept per block as the HDL-64E
+  // alternates upper and lower firings. An HDL-32E only fires the upper block, so it gets the one sum.
+  if (ok) {
+    bool upper_only = (std::count(_block_ids.begin(), _block_ids.end(), BLOCK_0_TO_31) == static_cast<std::ptrdiff_t>(num_firings));
+    const uint32_t* deltas = num_nonzero ? &_scratch[0] : NULL;
+    uint16_t* distances = num_returns ? &_distances[0] : NULL;
+    unsigned int index = 0;
+    unsigned int laser_end = 0;
+    uint16_t prev_upper = 0, prev_lower = 0;
+    for (unsigned int i = 0; i < num_runs; i++) {
+      unsigned int run_end = index + _runs[i];
+      if (i % 2) {
+        for (; index < run_end; index++) {
+          distances[index] = 0;
+        }
+        continue;
+      }
+      while (index < run_end) {
+        if (index >= laser_end) {
+          laser_end = index - index % num_firings + num_firings;
+          prev_upper = prev_lower = 0;
+        }
+        unsigned int stop = std::min(run_end, laser_end);
+        if (upper_only) {
+          for (; index < stop; index++) {
+            prev_upper = static_cast<uint16_t>(prev_upper + UnZigZag16(*deltas++));
+            distances[index] = prev_upper;
+          }
+          continue;
+        }
+        for (unsigned int f = index - (laser_end - num_firings); index < stop; index++, f++) {
+          uint16_t& prev = (_block_ids[f] == BLOCK_0_TO_31) ? prev_upper : prev_lower;
+          prev = static_cast<uint16_t>(prev + UnZigZag16(*deltas++));
+          distances[index] = prev;
+        }
+      }
+    }
+  }
+
+  ok = ok && UnpackBits(p, end, num_returns, num_returns ? &_intensity_bytes[0] : NULL);
+  if (ok) {
+    Untranspose(out, num_packets);
+  }
+
+  uint32_t timestamp = 0;
+  for (unsigned int i = 0; ok && i < num_packets; i++) {
+    uint32_t delta;
+    ok = GetVarint(p, end, &delta);
+    timestamp += UnZigZag32(delta);
+    memcpy(out + i*1206 + HDL_GPS_OFFSET, &timestamp, 4);
+  }
+  ok = ok && GetRunLength16(p, end, &_factory);
+  for (unsigned int i = 0; ok && i < num_packets; i++) {
+    memcpy(out + i*1206 + HDL_FACTORY_OFFSET, &_factory[i], 2);
+  }
+  ok = ok && (static_cast<unsigned int>(end - p) == tail_length);
+
+  if (!ok) {
+    std::cout << "PacketBundleCodec: Error, corrupt compressed bundle" << std::endl;
+    return(false);
+  }
+  if (tail_length) {
+    memcpy(out + num_packets*1206, p, tail_length);
+  }
+  return(true);
+}
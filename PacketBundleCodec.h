@@ -0,0 +1,48 @@
+// Velodyne HDL Packet Bundle Codec
+// Nick Rypkema (rypkema@mit.edu), MIT 2017
+// shared library to losslessly compress/decompress a bundle of velodyne packets
+
+#ifndef PACKET_BUNDLE_CODEC_H_INCLUDED
+#define PACKET_BUNDLE_CODEC_H_INCLUDED
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+// Compressed bundle layout (all integers little endian):
+//   "HDLZ" | version (1) | num_packets (4) | tail_length (4)
+//   block identifiers      - run-length coded u16
+//   rotational positions   - zigzag delta vs previous firing, bit-packed
+//   return mask            - alternating non-zero/zero run lengths, laser-major
+//   distances              - zigzag delta vs the same laser's previous non-zero return
+//                            in the same block (upper/lower), bit-packed, non-zero returns only
+//   intensities            - bit-packed, laser-major
+//   gps timestamps         - zigzag delta varints
+//   factory bytes          - run-length coded u16
+//   tail                   - any bytes past the last whole packet, verbatim
+class PacketBundleCodec
+{
+public:
+  PacketBundleCodec();
+  virtual ~PacketBundleCodec();
+  bool CompressBundle(const char* bundle, unsigned int bundle_length, std::string* compressed);
+  bool DecompressBundle(const char* compressed, unsigned int compressed_length, std::string* bundle); // bundle is unspecified on failure
+
+protected:
+  void Transpose(const unsigned char* bundle, unsigned int num_packets);
+  void Untranspose(unsigned char* bundle, unsigned int num_packets);
+
+private:
+  std::vector<uint16_t> _block_ids;
+  std::vector<uint16_t> _rotations;
+  std::vector<uint16_t> _distances;
+  std::vector<uint32_t> _intensities;
+  std::vector<unsigned char> _intensity_bytes;
+  std::vector<uint32_t> _gps_timestamps;
+  std::vector<uint16_t> _factory;
+  std::vector<uint32_t> _scratch;
+  std::vector<uint32_t> _runs;
+  std::vector<unsigned int> _firing_offsets;
+};
+
+#endif // PACKET_BUNDLE_CODEC_H_INCLUDED
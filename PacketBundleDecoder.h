@@ -8,7 +8,9 @@
 #include <string>
 #include <vector>
 #include <deque>
+#include <boost/function.hpp>
 #include "PacketDecoder.h"
+#include "PacketBundleCodec.h"
 
 class PacketBundleDecoder
 {
@@ -23,31 +25,82 @@ public:
     std::vector<unsigned short> azimuth;
     std::vector<double> distance;
     std::vector<unsigned int> ms_from_top_of_hour;
+    std::vector<int> label; // never filled by the decoder, see Segmentation
   };
 
+  // frame and sector are only valid for the duration of the call, points [begin, end) of frame make up the sector
+  typedef boost::function<void (const HDLFrame& frame)> FrameCallback;
+  typedef boost::function<void (const HDLFrame& frame, unsigned int begin, unsigned int end)> SectorCallback;
+
 public:
   PacketBundleDecoder();
   virtual ~PacketBundleDecoder();
   void SetMaxNumberOfFrames(unsigned int max_num_of_frames);
   void DecodeBundle(std::string* bundle, unsigned int* bundle_length);
+  void DecodeBundle(const char* bundle, unsigned int bundle_length);
+  bool DecodeCompressedBundle(const char* compressed, unsigned int compressed_length);
   void SetCorrectionsFile(const std::string& corrections_file);
+  bool SetExtrinsic(const double rotation[9], const double translation[3]); // row-major, p_vehicle = rotation*p_sensor + translation
+  bool SetExtrinsic(double x, double y, double z, double roll, double pitch, double yaw); // radians, yaw-pitch-roll (z-y-x) order
+  void ClearExtrinsic();
+  void SetTimeOffset(int time_offset); // microseconds added to every ms_from_top_of_hour, wrapping at the hour
+  int GetTimeOffset();
+  bool HasExtrinsic();
+  const HDLLaserCorrection* GetLaserCorrections(); // per-laser table in use, with any extrinsic folded in
+  void SetIntensityCalibration(bool enabled); // HDL-64E corrections files only, on by default
+  const HDLIntensityTable* GetIntensityTable(); // NULL unless intensities are being calibrated
+  void SetColumnMask(unsigned int columns); // HDLColumn bits to compute and store, takes effect from the next frame
+  unsigned int GetColumnMask();
+  void SetVoxelGrid(double leaf_size, VoxelGrid::VoxelPolicy policy = VoxelGrid::VOXEL_CENTROID);
+  void DisableVoxelGrid();
+  void SetBackgroundModel(double adaptation_rate, double threshold = 0.2); // fixed sensors only, frames then hold foreground returns
+  void DisableBackgroundModel();
+  BackgroundModel* GetBackgroundModel(); // NULL unless enabled
+  void SetDecimation(unsigned int firing_step, unsigned int laser_step); // keep every Nth firing and laser id, 1 keeps all
+  void SetAzimuthBinning(unsigned int azimuth_bin, HDLBinSelection selection = HDL_BIN_MIN_RANGE); // hundredths of a degree, 0 off
+  void SetPointBudget(unsigned int max_points); // per frame, 0 off
+  void DisableDecimation();
   std::deque<HDLFrame> GetFrames();
   void ClearFrames();
   bool GetLatestFrame(HDLFrame* frame);
+  void SetFrameCallback(const FrameCallback& callback);
+  void SetSectorCallback(unsigned int sector_size, const SectorCallback& callback); // sector_size in hundredths of a degree
 
 protected:
   void UnloadData();
-  void InitTables();
   void LoadCorrectionsFile(const std::string& correctionsFile);
   void LoadHDL32Corrections();
   void SetCorrectionsCommon();
   void ProcessHDLPacket(unsigned char *data, unsigned int data_length);
-  void PushFiringData(unsigned char laserId, unsigned short azimuth, unsigned int timestamp, HDLLaserReturn laserReturn, HDLLaserCorrection correction);
+  void EmitSector();
+  void ProcessFiring(const HDLFiringData& firingData, unsigned int timestamp);
+  // voxel grid path only, frames are filled by the DecodeFiring kernels
+  void PushFiringData(unsigned char laserId, unsigned short azimuth, unsigned int timestamp, HDLLaserReturn laserReturn, const HDLLaserCorrection& correction);
 
 private:
   std::string _corrections_file;
   unsigned int _max_num_of_frames;
+  HDLLaserCorrection _laser_corrections[HDL_MAX_NUM_LASERS];
+  HDLIntensityTable _intensity_table;
+  const HDLIntensityTable* _intensity_table_in_use; // NULL when calibration is off or there is nothing to apply
+  bool _intensity_calibration;
+  bool _has_extrinsic;
+  double _rotation[9];
+  double _translation[3];
+  int _time_offset;
+  unsigned int _column_mask;
+  unsigned int _active_columns; // mask the frame being assembled was started with
   HDLFrame* _frame;
+  VoxelGrid* _voxel_grid;
+  BackgroundModel* _background_model;
+  PacketDecimator* _decimator;
+  FrameCallback _frame_callback;
+  SectorCallback _sector_callback;
+  unsigned int _sector_size;
+  unsigned int _sector_index;
+  unsigned int _sector_begin;
+  PacketBundleCodec _codec;
+  std::string _decompressed;
   std::deque<HDLFrame> _frames;
 };
 
@@ -3,20 +3,25 @@
 // shared library to bundle velodyne packets into enough for a single frame
 
 #include <cmath>
+#include <cstring>
 #include <stdint.h>
 #include <iostream>
 
 #include "PacketBundler.h"
+#include "LatencyTrace.h"
 
 PacketBundler::PacketBundler()
 {
   _max_num_of_bundles = 10;
+  _bundle_capacity = HDL_MAX_PACKETS_PER_BUNDLE*1206;
+  _write_slot = 0;
+  AllocateSlots(_max_num_of_bundles+1);
   UnloadData();
 }
 
 PacketBundler::~PacketBundler()
 {
-
+  FreeSlots();
 }
 
 void PacketBundler::SetMaxNumberOfBundles(unsigned int max_num_of_bundles)
@@ -28,10 +33,31 @@ void PacketBundler::SetMaxNumberOfBundles(unsigned int max_num_of_bundles)
     _max_num_of_bundles = max_num_of_bundles;
   }
   while (_bundles.size() >= _max_num_of_bundles) {
-    _bundles.pop_front();
+    EvictOldestBundle();
+  }
+  // one slot per retained bundle plus the one being filled
+  if (_slots.size() < _max_num_of_bundles+1) {
+    AllocateSlots(_max_num_of_bundles+1 - _slots.size());
   }
 }
 
+void PacketBundler::SetMaxPacketsPerBundle(unsigned int max_packets_per_bundle)
+{
+  if (max_packets_per_bundle <= 0 || max_packets_per_bundle*1206 == _bundle_capacity) {
+    return;
+  }
+
+  _bundle_capacity = max_packets_per_bundle*1206;
+  for (unsigned int i = 0; i < _slots.size(); i++) {
+    if (_slots[i].leases == 0) {
+      delete[] _slots[i].data;
+      _slots[i].data = new char[_bundle_capacity];
+      _slots[i].capacity = _bundle_capacity;
+    }
+  }
+  UnloadData();
+}
+
 void PacketBundler::BundlePacket(std::string* data, unsigned int* data_length)
 {
   const unsigned char* data_char = reinterpret_cast<const unsigned char*>(data->c_str());
@@ -57,43 +83,148 @@ void PacketBundler::BundleHDLPacket(unsigned char *data, unsigned int data_lengt
     _last_azimuth = firingData.rotationalPosition;
   }
 
-  _bundle->append(reinterpret_cast<const char*>(data), (size_t)data_length);
+  if (_slots[_write_slot].length + data_length > _slots[_write_slot].capacity) {
+    std::cout << "PacketBundler: Warning, bundle exceeds maximum packets per bundle, splitting early" << std::endl;
+    SplitBundle();
+  }
+
+  BundleSlot& slot = _slots[_write_slot];
+  memcpy(slot.data + slot.length, data, data_length);
+  slot.length += data_length;
 }
 
 void PacketBundler::SplitBundle()
 {
-  if (_bundles.size() == _max_num_of_bundles-1) {
-    _bundles.pop_front();
+  if (_bundles.size() && _bundles.size() >= _max_num_of_bundles-1) {
+    EvictOldestBundle();
+  }
+  _slots[_write_slot].state = SLOT_READY;
+  _bundles.push_back(_write_slot);
+  HDL_TRACE_INSTANT("bundle split", _slots[_write_slot].length/1206);
+  NextWriteSlot();
+}
+
+void PacketBundler::EvictOldestBundle()
+{
+  if (_bundles.empty()) {
+    return;
+  }
+  // a leased slot stays untouched until it is released, it just leaves the ring
+  _slots[_bundles.front()].state = SLOT_FREE;
+  _bundles.pop_front();
+}
+
+bool PacketBundler::NextWriteSlot()
+{
+  while (true) {
+    for (unsigned int i = 0; i < _slots.size(); i++) {
+      BundleSlot& slot = _slots[i];
+      if (slot.state == SLOT_FREE && slot.leases == 0) {
+        if (slot.capacity != _bundle_capacity) {
+          delete[] slot.data;
+          slot.data = new char[_bundle_capacity];
+          slot.capacity = _bundle_capacity;
+        }
+        slot.state = SLOT_WRITING;
+        slot.length = 0;
+        _write_slot = i;
+        return(true);
+      }
+    }
+    if (_bundles.empty()) {
+      break;
+    }
+    EvictOldestBundle();
+  }
+
+  // every slot is leased out - grow the ring rather than overwrite a lease
+  std::cout << "PacketBundler: Warning, all bundle slots are leased, allocating another" << std::endl;
+  AllocateSlots(1);
+  _write_slot = _slots.size()-1;
+  _slots[_write_slot].state = SLOT_WRITING;
+  return(false);
+}
+
+void PacketBundler::AllocateSlots(unsigned int num_slots)
+{
+  for (unsigned int i = 0; i < num_slots; i++) {
+    BundleSlot slot;
+    slot.data = new char[_bundle_capacity];
+    slot.capacity = _bundle_capacity;
+    slot.length = 0;
+    slot.leases = 0;
+    slot.state = SLOT_FREE;
+    _slots.push_back(slot);
   }
-  _bundles.push_back(*_bundle);
-  delete _bundle;
-  _bundle = new std::string();
+}
+
+void PacketBundler::FreeSlots()
+{
+  for (unsigned int i = 0; i < _slots.size(); i++) {
+    delete[] _slots[i].data;
+  }
+  _slots.clear();
 }
 
 void PacketBundler::UnloadData()
 {
   _last_azimuth = 0;
-  _bundle = new std::string();
   _bundles.clear();
+  for (unsigned int i = 0; i < _slots.size(); i++) {
+    _slots[i].state = SLOT_FREE;
+  }
+  NextWriteSlot();
 }
 
 std::deque<std::string> PacketBundler::GetBundles()
 {
-  return _bundles;
+  std::deque<std::string> bundles;
+  for (unsigned int i = 0; i < _bundles.size(); i++) {
+    const BundleSlot& slot = _slots[_bundles[i]];
+    bundles.push_back(std::string(slot.data, slot.length));
+  }
+  return bundles;
 }
 
 void PacketBundler::ClearBundles()
 {
-  _bundles.clear();
+  while (_bundles.size()) {
+    EvictOldestBundle();
+  }
 }
 
 bool PacketBundler::GetLatestBundle(std::string* bundle, unsigned int* bundle_length)
 {
   if (_bundles.size()) {
-    *bundle = _bundles.back();
-    *bundle_length = bundle->size();
-    _bundles.clear();
+    const BundleSlot& slot = _slots[_bundles.back()];
+    bundle->assign(slot.data, slot.length);
+    *bundle_length = slot.length;
+    ClearBundles();
     return(true);
   }
   return(false);
 }
+
+bool PacketBundler::AcquireLatestBundle(PacketBundler::BundleView* view)
+{
+  if (_bundles.size()) {
+    unsigned int index = _bundles.back();
+    _slots[index].leases++;
+    view->data = _slots[index].data;
+    view->length = _slots[index].length;
+    view->slot = index;
+    ClearBundles();
+    return(true);
+  }
+  return(false);
+}
+
+void PacketBundler::ReleaseBundle(PacketBundler::BundleView* view)
+{
+  if (view->data == NULL || view->slot >= _slots.size() || _slots[view->slot].leases == 0) {
+    return;
+  }
+  _slots[view->slot].leases--;
+  view->data = NULL;
+  view->length = 0;
+}
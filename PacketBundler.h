@@ -7,29 +7,67 @@
 
 #include <string>
 #include <deque>
+#include <vector>
 #include "PacketDecoder.h"
 
+// an HDL-64E spinning at 5Hz produces ~700 packets per revolution
+static unsigned int HDL_MAX_PACKETS_PER_BUNDLE = 760;
+
 class PacketBundler
 {
+public:
+  // read-only lease on a bundle slot - the slot is not reused until ReleaseBundle is called
+  struct BundleView
+  {
+    const char* data;
+    unsigned int length;
+    unsigned int slot;
+  };
+
 public:
   PacketBundler();
   virtual ~PacketBundler();
   void SetMaxNumberOfBundles(unsigned int max_num_of_bundles);
+  void SetMaxPacketsPerBundle(unsigned int max_packets_per_bundle);
   void BundlePacket(std::string* data, unsigned int* data_length);
   std::deque<std::string> GetBundles();
   void ClearBundles();
   bool GetLatestBundle(std::string* bundle, unsigned int* bundle_length);
+  bool AcquireLatestBundle(BundleView* view);
+  void ReleaseBundle(BundleView* view);
 
 protected:
+  enum SlotState
+  {
+    SLOT_FREE = 0,
+    SLOT_WRITING = 1,
+    SLOT_READY = 2
+  };
+
+  struct BundleSlot
+  {
+    char* data;
+    unsigned int capacity;
+    unsigned int length;
+    unsigned int leases;
+    SlotState state;
+  };
+
   void UnloadData();
+  void AllocateSlots(unsigned int num_slots);
+  void FreeSlots();
   void BundleHDLPacket(unsigned char *data, unsigned int data_length);
   void SplitBundle();
+  void EvictOldestBundle();
+  bool NextWriteSlot();
 
 private:
   unsigned int _last_azimuth;
   unsigned int _max_num_of_bundles;
-  std::string* _bundle;
-  std::deque<std::string> _bundles;
+  unsigned int _bundle_capacity;
+  unsigned int _write_slot;
+  std::vector<BundleSlot> _slots;
+  std::deque<unsigned int> _bundles;
 };
 
 #endif // PACKET_BUNDLER_H_INCLUDED
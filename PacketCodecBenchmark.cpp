@@ -0,0 +1,153 @@
+// Velodyne HDL Packet Codec Benchmark
+// Nick Rypkema (rypkema@mit.edu), MIT 2017
+// executable to measure PacketBundleCodec ratio and speed on the bundles of a pcap file, against zstd when available
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sys/time.h>
+
+#include "PacketSource.h"
+#include "PacketBundler.h"
+#include "PacketBundleCodec.h"
+#ifdef HDL_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace
+{
+double Now()
+{
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  return now.tv_sec + now.tv_usec/1e6;
+}
+
+void PrintResult(const char* name, uint64_t raw_bytes, uint64_t compressed_bytes, double compress_seconds, double decompress_seconds)
+{
+  printf("%-12s ratio %6.3f  %7.1f%%  compress %8.1f MB/s  decompress %8.1f MB/s\n", name,
+         static_cast<double>(raw_bytes)/compressed_bytes, 100.0*compressed_bytes/raw_bytes,
+         raw_bytes/compress_seconds/1e6, raw_bytes/decompress_seconds/1e6);
+}
+}
+
+int main(int argc, char* argv[])
+{
+  if (argc < 2) {
+    std::cout << "Usage: " << argv[0] << " <in.pcap> [--repeat N] [--zstd-level L]..." << std::endl;
+    std::cout << "Bundles in.pcap into frames, then compresses and decompresses every bundle N times (default 20)" << std::endl;
+    std::cout << "with PacketBundleCodec and, if built with zstd, zstd at each level given (default 1, 3 and 19)" << std::endl;
+    return 1;
+  }
+
+  unsigned int repeat = 20;
+  std::vector<int> levels;
+  for (int i = 2; i < argc; i++) {
+    if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+      repeat = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--zstd-level") == 0 && i + 1 < argc) {
+      levels.push_back(atoi(argv[++i]));
+    }
+  }
+  if (levels.empty()) {
+    levels.push_back(1);
+    levels.push_back(3);
+    levels.push_back(19);
+  }
+  if (repeat == 0) {
+    repeat = 1;
+  }
+
+  // bundle everything up front so only the codecs are measured
+  PcapPacketSource source(argv[1]);
+  if (!source.IsOpen()) {
+    return 1;
+  }
+  PacketBundler bundler;
+  std::deque<std::string> bundles;
+  std::string data;
+  unsigned int data_length;
+  std::string bundle;
+  unsigned int bundle_length;
+  while (source.GetPacket(&data, &data_length)) {
+    bundler.BundlePacket(&data, &data_length);
+    if (bundler.GetLatestBundle(&bundle, &bundle_length)) {
+      bundles.push_back(bundle);
+    }
+  }
+  if (bundles.empty()) {
+    std::cout << "No bundles in " << argv[1] << std::endl;
+    return 1;
+  }
+  uint64_t raw_bytes = 0;
+  for (unsigned int i = 0; i < bundles.size(); i++) {
+    raw_bytes += bundles[i].size();
+  }
+  printf("%u bundles, %.1f KB each on average\n", static_cast<unsigned int>(bundles.size()), raw_bytes/1e3/bundles.size());
+
+  PacketBundleCodec codec;
+  std::vector<std::string> compressed(bundles.size());
+  std::string decompressed;
+  uint64_t compressed_bytes = 0;
+  double start = Now();
+  for (unsigned int r = 0; r < repeat; r++) {
+    for (unsigned int i = 0; i < bundles.size(); i++) {
+      codec.CompressBundle(bundles[i].data(), bundles[i].size(), &compressed[i]);
+    }
+  }
+  double compress_seconds = (Now() - start)/repeat;
+  for (unsigned int i = 0; i < bundles.size(); i++) {
+    compressed_bytes += compressed[i].size();
+  }
+  start = Now();
+  for (unsigned int r = 0; r < repeat; r++) {
+    for (unsigned int i = 0; i < bundles.size(); i++) {
+      codec.DecompressBundle(compressed[i].data(), compressed[i].size(), &decompressed);
+    }
+  }
+  double decompress_seconds = (Now() - start)/repeat;
+  for (unsigned int i = 0; i < bundles.size(); i++) {
+    if (!codec.DecompressBundle(compressed[i].data(), compressed[i].size(), &decompressed) || decompressed != bundles[i]) {
+      std::cout << "PacketBundleCodec: Error, bundle " << i << " did not round trip" << std::endl;
+      return 1;
+    }
+  }
+  PrintResult("hdlz", raw_bytes, compressed_bytes, compress_seconds, decompress_seconds);
+
+#ifdef HDL_HAVE_ZSTD
+  for (unsigned int l = 0; l < levels.size(); l++) {
+    compressed_bytes = 0;
+    start = Now();
+    for (unsigned int r = 0; r < repeat; r++) {
+      for (unsigned int i = 0; i < bundles.size(); i++) {
+        compressed[i].resize(ZSTD_compressBound(bundles[i].size()));
+        size_t length = ZSTD_compress(&compressed[i][0], compressed[i].size(), bundles[i].data(), bundles[i].size(), levels[l]);
+        if (ZSTD_isError(length)) {
+          std::cout << "zstd: Error, " << ZSTD_getErrorName(length) << std::endl;
+          return 1;
+        }
+        compressed[i].resize(length);
+      }
+    }
+    compress_seconds = (Now() - start)/repeat;
+    for (unsigned int i = 0; i < bundles.size(); i++) {
+      compressed_bytes += compressed[i].size();
+    }
+    start = Now();
+    for (unsigned int r = 0; r < repeat; r++) {
+      for (unsigned int i = 0; i < bundles.size(); i++) {
+        decompressed.resize(bundles[i].size());
+        ZSTD_decompress(&decompressed[0], decompressed.size(), compressed[i].data(), compressed[i].size());
+      }
+    }
+    decompress_seconds = (Now() - start)/repeat;
+    char name[16];
+    snprintf(name, sizeof(name), "zstd -%d", levels[l]);
+    PrintResult(name, raw_bytes, compressed_bytes, compress_seconds, decompress_seconds);
+  }
+#else
+  std::cout << "Built without zstd, nothing to compare against" << std::endl;
+#endif
+  return 0;
+}
@@ -0,0 +1,278 @@
+// Velodyne HDL Packet Decimator
+// Nick Rypkema (rypkema@mit.edu), MIT 2017
+// header only, thins out raw firings (by firing, laser, azimuth bin or point budget) before they are decoded
+
+#ifndef PACKET_DECIMATOR_H_INCLUDED
+#define PACKET_DECIMATOR_H_INCLUDED
+
+#include <cstring>
+#include <algorithm>
+#include <stdint.h>
+#include "PacketDecoder.h"
+
+// Works on raw firings so dropped returns never cost any trigonometry - a dropped return has its distance
+// zeroed, which every decode path skips, and a firing with nothing left is dropped whole. Applied in order:
+// every Nth firing (counted by azimuth position, so the two blocks of a 64 laser firing stay together),
+// every Nth laser id, azimuth binning and the point budget. Header only, like the decode kernels, because
+// the packet structs are private to each translation unit that includes PacketDecoder.h.
+class PacketDecimator
+{
+public:
+  PacketDecimator();
+  virtual ~PacketDecimator();
+  void SetFiringStep(unsigned int firing_step); // 1 keeps every firing
+  void SetLaserStep(unsigned int laser_step);   // 1 keeps every laser
+  // hundredths of a degree, 0 off - every laser returns at most once per bin, at the bin centre azimuth
+  void SetAzimuthBin(unsigned int azimuth_bin, HDLBinSelection selection = HDL_BIN_MIN_RANGE);
+  // at most max_points returns a frame, 0 off - spread evenly over the frame by the size of the one before,
+  // so the first frame keeps its first max_points
+  void SetPointBudget(unsigned int max_points);
+  unsigned int GetFiringStep();
+  unsigned int GetLaserStep();
+  unsigned int GetAzimuthBin();
+  unsigned int GetPointBudget();
+  bool IsEnabled();
+  void Clear(); // forget the pending bin and budget history
+
+  // With binning on, a firing in a new bin first finishes the pending one - call TakeFinishedBin before the
+  // decoder's frame split checks, so a bin is decoded into the frame it belongs to, then Decimate the firing.
+  unsigned int TakeFinishedBin(const HDLFiringData& next, HDLFiringData finished[2], unsigned int timestamps[2]);
+  unsigned int TakePendingBin(HDLFiringData finished[2], unsigned int timestamps[2]); // at the end of a frame
+  // false when nothing of the firing is to be decoded now (always, with binning on - it joins the pending bin)
+  bool Decimate(const HDLFiringData& firing, unsigned int timestamp, HDLFiringData* kept);
+  void NextFrame(); // once per decoded frame, for the point budget
+
+protected:
+  bool KeepForBudget();
+  unsigned int ApplyBudget(HDLFiringData* firing);
+
+private:
+  unsigned int _firing_step;
+  unsigned int _laser_step;
+  unsigned int _azimuth_bin;
+  HDLBinSelection _selection;
+  unsigned int _point_budget;
+  // every Nth firing
+  int _last_position;
+  unsigned int _position_count;
+  // binning, one best return per laser
+  bool _pending;
+  unsigned int _pending_bin;
+  unsigned int _pending_timestamp;
+  uint16_t _best_distance[64];
+  uint8_t _best_intensity[64];
+  // point budget
+  unsigned int _frame_candidates;
+  unsigned int _frame_kept;
+  unsigned int _last_candidates;
+  uint64_t _budget_accumulator;
+};
+
+inline PacketDecimator::PacketDecimator()
+{
+  _firing_step = 1;
+  _laser_step = 1;
+  _azimuth_bin = 0;
+  _selection = HDL_BIN_MIN_RANGE;
+  _point_budget = 0;
+  Clear();
+}
+
+inline PacketDecimator::~PacketDecimator()
+{
+}
+
+inline void PacketDecimator::SetFiringStep(unsigned int firing_step)
+{
+  _firing_step = std::max(1u, firing_step);
+}
+
+inline void PacketDecimator::SetLaserStep(unsigned int laser_step)
+{
+  _laser_step = std::max(1u, laser_step);
+}
+
+inline void PacketDecimator::SetAzimuthBin(unsigned int azimuth_bin, HDLBinSelection selection)
+{
+  _azimuth_bin = std::min(azimuth_bin, 36000u);
+  _selection = selection;
+  _pending = false;
+}
+
+inline void PacketDecimator::SetPointBudget(unsigned int max_points)
+{
+  _point_budget = max_points;
+  _budget_accumulator = 0;
+}
+
+inline unsigned int PacketDecimator::GetFiringStep()
+{
+  return _firing_step;
+}
+
+inline unsigned int PacketDecimator::GetLaserStep()
+{
+  return _laser_step;
+}
+
+inline unsigned int PacketDecimator::GetAzimuthBin()
+{
+  return _azimuth_bin;
+}
+
+inline unsigned int PacketDecimator::GetPointBudget()
+{
+  return _point_budget;
+}
+
+inline bool PacketDecimator::IsEnabled()
+{
+  return _firing_step > 1 || _laser_step > 1 || _azimuth_bin > 0 || _point_budget > 0;
+}
+
+inline void PacketDecimator::Clear()
+{
+  _last_position = -1;
+  _position_count = 0;
+  _pending = false;
+  _pending_bin = 0;
+  _pending_timestamp = 0;
+  _frame_candidates = 0;
+  _frame_kept = 0;
+  _last_candidates = 0;
+  _budget_accumulator = 0;
+}
+
+inline unsigned int PacketDecimator::TakeFinishedBin(const HDLFiringData& next, HDLFiringData finished[2], unsigned int timestamps[2])
+{
+  if (!_pending || next.rotationalPosition/_azimuth_bin == _pending_bin) {
+    return 0;
+  }
+  return TakePendingBin(finished, timestamps);
+}
+
+inline unsigned int PacketDecimator::TakePendingBin(HDLFiringData finished[2], unsigned int timestamps[2])
+{
+  if (!_pending) {
+    return 0;
+  }
+  _pending = false;
+
+  unsigned short azimuth = std::min(_pending_bin*_azimuth_bin + _azimuth_bin/2, 35999u);
+  unsigned int n = 0;
+  for (int block = 0; block < 2; block++) {
+    HDLFiringData& firing = finished[n];
+    firing.blockIdentifier = block ? BLOCK_32_TO_63 : BLOCK_0_TO_31;
+    firing.rotationalPosition = azimuth;
+    bool any = false;
+    for (int j = 0; j < HDL_LASER_PER_FIRING; j++) {
+      firing.laserReturns[j].distance = _best_distance[j + 32*block];
+      firing.laserReturns[j].intensity = _best_intensity[j + 32*block];
+      any = any || _best_distance[j + 32*block];
+    }
+    if (any && ApplyBudget(&firing)) {
+      timestamps[n] = _pending_timestamp;
+      n++;
+    }
+  }
+  return n;
+}
+
+inline bool PacketDecimator::Decimate(const HDLFiringData& firing, unsigned int timestamp, HDLFiringData* kept)
+{
+  if (_firing_step > 1) {
+    if (firing.rotationalPosition != _last_position) {
+      _last_position = firing.rotationalPosition;
+      _position_count++;
+    }
+    if ((_position_count - 1) % _firing_step) {
+      return(false);
+    }
+  }
+
+  int offset = (firing.blockIdentifier == BLOCK_0_TO_31) ? 0 : 32;
+  if (_azimuth_bin) {
+    unsigned int bin = firing.rotationalPosition/_azimuth_bin;
+    if (!_pending) {
+      _pending = true;
+      _pending_bin = bin;
+      _pending_timestamp = timestamp;
+      memset(_best_distance, 0, sizeof(_best_distance));
+      memset(_best_intensity, 0, sizeof(_best_intensity));
+    }
+    for (int j = 0; j < HDL_LASER_PER_FIRING; j++) {
+      const HDLLaserReturn& laserReturn = firing.laserReturns[j];
+      int laser = j + offset;
+      if (laserReturn.distance == 0 || laser % _laser_step) {
+        continue;
+      }
+      uint16_t best = _best_distance[laser];
+      bool better = !best;
+      if (_selection == HDL_BIN_MIN_RANGE) {
+        better = better || laserReturn.distance < best;
+      } else {
+        better = better || laserReturn.intensity > _best_intensity[laser] ||
+                 (laserReturn.intensity == _best_intensity[laser] && laserReturn.distance < best);
+      }
+      if (better) {
+        _best_distance[laser] = laserReturn.distance;
+        _best_intensity[laser] = laserReturn.intensity;
+      }
+    }
+    return(false);
+  }
+
+  *kept = firing;
+  if (_laser_step > 1) {
+    for (int j = 0; j < HDL_LASER_PER_FIRING; j++) {
+      if ((j + offset) % _laser_step) {
+        kept->laserReturns[j].distance = 0;
+      }
+    }
+  }
+  return ApplyBudget(kept) > 0;
+}
+
+inline void PacketDecimator::NextFrame()
+{
+  _last_candidates = _frame_candidates;
+  _frame_candidates = 0;
+  _frame_kept = 0;
+}
+
+inline bool PacketDecimator::KeepForBudget()
+{
+  _frame_candidates++;
+  if (_frame_kept >= _point_budget) {
+    return(false);
+  }
+  // Bresenham style, keeps budget out of every last_candidates returns as evenly as they come
+  if (_last_candidates > _point_budget) {
+    _budget_accumulator += _point_budget;
+    if (_budget_accumulator < _last_candidates) {
+      return(false);
+    }
+    _budget_accumulator -= _last_candidates;
+  }
+  _frame_kept++;
+  return(true);
+}
+
+inline unsigned int PacketDecimator::ApplyBudget(HDLFiringData* firing)
+{
+  unsigned int num_kept = 0;
+  for (int j = 0; j < HDL_LASER_PER_FIRING; j++) {
+    HDLLaserReturn& laserReturn = firing->laserReturns[j];
+    if (laserReturn.distance == 0) {
+      continue;
+    }
+    if (_point_budget && !KeepForBudget()) {
+      laserReturn.distance = 0;
+      continue;
+    }
+    num_kept++;
+  }
+  return num_kept;
+}
+
+#endif // PACKET_DECIMATOR_H_INCLUDED
@@ -0,0 +1,293 @@
+// Velodyne HDL Packet Decode Kernels
+// Nick Rypkema (rypkema@mit.edu), MIT 2017
+// per-firing decode loops shared by PacketDecoder and PacketBundleDecoder, one instantiation per column mask
+
+#ifndef PACKET_DECODE_KERNELS_H_INCLUDED
+#define PACKET_DECODE_KERNELS_H_INCLUDED
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include "PacketDecoder.h"
+
+// HDL-64E two-point distance correction - the distances x and y are computed from, each corrected along the
+// line fitted through the point's |x| or |y| as it would be without it
+inline void TwoPointDistances(const HDLLaserCorrection& correction, double distanceM, double sinAzimuth, double cosAzimuth,
+                              double* distanceX, double* distanceY)
+{
+  double xyDistance = distanceM * correction.cosVertCorrection - correction.sinVertOffsetCorrection;
+  double absX = std::fabs(xyDistance * sinAzimuth - correction.horizontalOffsetCorrection * cosAzimuth);
+  double absY = std::fabs(xyDistance * cosAzimuth + correction.horizontalOffsetCorrection * sinAzimuth);
+  *distanceX = distanceM + correction.distanceSlopeX * absX + correction.distanceOffsetX;
+  *distanceY = distanceM + correction.distanceSlopeY * absY + correction.distanceOffsetY;
+}
+
+// sine and cosine of every azimuth in hundredths of a degree
+struct AzimuthTable
+{
+  AzimuthTable() : cos(HDL_NUM_ROT_ANGLES), sin(HDL_NUM_ROT_ANGLES)
+  {
+    for (int i = 0; i < HDL_NUM_ROT_ANGLES; i++) {
+      double rad = HDL_Grabber_toRadians(i / 100.0);
+      cos[i] = std::cos(rad);
+      sin[i] = std::sin(rad);
+    }
+  }
+  std::vector<double> cos;
+  std::vector<double> sin;
+};
+
+// one table for the whole process, built on first use - like GetFiringKernels, the initialisation is
+// thread-safe, and every library including this header sees the same table whichever copy the loader binds
+inline const AzimuthTable& GetAzimuthTable()
+{
+  static const AzimuthTable table;
+  return table;
+}
+
+// sine and cosine of a laser's azimuth, from the lookup table unless the laser has an azimuth correction
+inline void AzimuthTrig(const HDLLaserCorrection& correction, unsigned short azimuth, double* sinAzimuth, double* cosAzimuth)
+{
+  if (correction.azimuthCorrection == 0) {
+    const AzimuthTable& table = GetAzimuthTable();
+    *cosAzimuth = table.cos[azimuth];
+    *sinAzimuth = table.sin[azimuth];
+  } else {
+    double azimuthInRadians = HDL_Grabber_toRadians((static_cast<double> (azimuth) / 100.0) - correction.azimuthCorrection);
+    *cosAzimuth = std::cos(azimuthInRadians);
+    *sinAzimuth = std::sin(azimuthInRadians);
+  }
+}
+
+// point of a return distanceM (corrected) metres away - in the vehicle frame when has_extrinsic, as the extrinsic
+// lives in the per-laser constants, otherwise in the sensor frame. Every decode path goes through here.
+inline void ReturnXYZ(const HDLLaserCorrection& correction, double distanceM, double sinAzimuth, double cosAzimuth, bool has_extrinsic,
+                      double* x, double* y, double* z)
+{
+  // the sensor x comes from distanceX, its y and z from distanceY
+  double distanceX = distanceM, distanceY = distanceM;
+  if (correction.twoPointDistance) {
+    TwoPointDistances(correction, distanceM, sinAzimuth, cosAzimuth, &distanceX, &distanceY);
+  }
+  if (has_extrinsic) {
+    *x = (distanceX * correction.vehicleSin[0] + correction.vehicleOffsetSin[0]) * sinAzimuth
+       + (distanceY * correction.vehicleCos[0] + correction.vehicleOffsetCos[0]) * cosAzimuth
+       + distanceY * correction.vehicleVert[0] + correction.vehicleOffset[0];
+    *y = (distanceX * correction.vehicleSin[1] + correction.vehicleOffsetSin[1]) * sinAzimuth
+       + (distanceY * correction.vehicleCos[1] + correction.vehicleOffsetCos[1]) * cosAzimuth
+       + distanceY * correction.vehicleVert[1] + correction.vehicleOffset[1];
+    *z = (distanceX * correction.vehicleSin[2] + correction.vehicleOffsetSin[2]) * sinAzimuth
+       + (distanceY * correction.vehicleCos[2] + correction.vehicleOffsetCos[2]) * cosAzimuth
+       + distanceY * correction.vehicleVert[2] + correction.vehicleOffset[2];
+  } else {
+    *x = (distanceX * correction.cosVertCorrection - correction.sinVertOffsetCorrection) * sinAzimuth
+       - correction.horizontalOffsetCorrection * cosAzimuth;
+    *y = (distanceY * correction.cosVertCorrection - correction.sinVertOffsetCorrection) * cosAzimuth
+       + correction.horizontalOffsetCorrection * sinAzimuth;
+    *z = distanceY * correction.sinVertCorrection + correction.cosVertOffsetCorrection;
+  }
+}
+
+// calibrated intensity of a return from the rows of an HDLIntensityTable
+inline unsigned char CalibrateIntensity(const uint16_t* rangeOffset, const unsigned char* scaled, unsigned char laserId, const HDLLaserReturn& laserReturn)
+{
+  unsigned int offset = rangeOffset[laserId * HDL_INTENSITY_RANGE_BINS + (laserReturn.distance >> HDL_INTENSITY_RANGE_SHIFT)];
+  return scaled[laserId * HDL_INTENSITY_SCALED_SIZE + laserReturn.intensity + offset];
+}
+
+// as above, table may be NULL
+inline unsigned char CalibrateIntensity(const HDLIntensityTable* table, unsigned char laserId, const HDLLaserReturn& laserReturn)
+{
+  if (!table) {
+    return laserReturn.intensity;
+  }
+  return CalibrateIntensity(&table->range_offset[0], &table->scaled[0], laserId, laserReturn);
+}
+
+// Fills table from the focal distance, focal slope and intensity range of each laser, after the HDL-64E manual:
+// intensity + focalSlope*|256*(1 - focalDistance/13100)^2 - 256*(1 - rawDistance/65535)^2|, clamped to
+// [minIntensity, maxIntensity] and rescaled to 0-255. Returns false, leaving the table empty, when no laser
+// has anything but the identity.
+inline bool BuildIntensityTable(const HDLLaserCorrection* corrections, HDLIntensityTable* table)
+{
+  bool calibrated[HDL_MAX_NUM_LASERS];
+  bool any = false;
+  for (int laser = 0; laser < HDL_MAX_NUM_LASERS; laser++) {
+    const HDLLaserCorrection& correction = corrections[laser];
+    double minIntensity = std::max(0.0, correction.minIntensity);
+    double maxIntensity = std::min(255.0, correction.maxIntensity);
+    calibrated[laser] = (minIntensity < maxIntensity) && (correction.focalSlope != 0 || minIntensity > 0 || maxIntensity < 255);
+    any = any || calibrated[laser];
+  }
+  if (!any) {
+    std::vector<uint16_t>().swap(table->range_offset);
+    std::vector<unsigned char>().swap(table->scaled);
+    return(false);
+  }
+
+  table->range_offset.resize(HDL_MAX_NUM_LASERS * HDL_INTENSITY_RANGE_BINS);
+  table->scaled.resize(HDL_MAX_NUM_LASERS * HDL_INTENSITY_SCALED_SIZE);
+  for (int laser = 0; laser < HDL_MAX_NUM_LASERS; laser++) {
+    const HDLLaserCorrection& correction = corrections[laser];
+    // lasers without a calibration get identity rows, so no return needs a test
+    double focalSlope = calibrated[laser] ? correction.focalSlope : 0;
+    double minIntensity = calibrated[laser] ? std::max(0.0, correction.minIntensity) : 0;
+    double maxIntensity = calibrated[laser] ? std::min(255.0, correction.maxIntensity) : 255;
+
+    double focalOffset = 256 * std::pow(1 - correction.focalDistance / 13100, 2);
+    for (unsigned int bin = 0; bin < HDL_INTENSITY_RANGE_BINS; bin++) {
+      // the middle of the bin
+      double rawDistance = (bin << HDL_INTENSITY_RANGE_SHIFT) + (1 << HDL_INTENSITY_RANGE_SHIFT) / 2;
+      double offset = focalSlope * std::fabs(focalOffset - 256 * std::pow(1 - rawDistance / 65535, 2));
+      table->range_offset[laser * HDL_INTENSITY_RANGE_BINS + bin] = static_cast<uint16_t>(std::max(0.0, std::min(std::floor(offset + 0.5) + 256, 511.0)));
+    }
+    for (unsigned int biased = 0; biased < HDL_INTENSITY_SCALED_SIZE; biased++) {
+      double clamped = std::max(minIntensity, std::min(static_cast<double>(biased) - 256, maxIntensity));
+      table->scaled[laser * HDL_INTENSITY_SCALED_SIZE + biased] = static_cast<unsigned char>(std::floor((clamped - minIntensity) / (maxIntensity - minIntensity) * 255 + 0.5));
+    }
+  }
+  return(true);
+}
+
+// decodes the non-zero returns of one firing into frame, computing and storing only the columns in Columns -
+// Columns is a compile time constant so the branches on it fold away
+template <typename Frame, unsigned int Columns>
+void DecodeFiring(const HDLFiringData& firing, unsigned int timestamp, const HDLLaserCorrection* corrections, bool has_extrinsic,
+                  const HDLIntensityTable* intensity_table, Frame* frame)
+{
+  int offset = (firing.blockIdentifier == BLOCK_0_TO_31) ? 0 : 32;
+  unsigned short azimuth = firing.rotationalPosition;
+  // held locally, as the frame's byte stores would otherwise have the table reloaded for every return
+  const uint16_t* rangeOffset = intensity_table ? &intensity_table->range_offset[0] : NULL;
+  const unsigned char* scaled = intensity_table ? &intensity_table->scaled[0] : NULL;
+
+  for (int j = 0; j < HDL_LASER_PER_FIRING; j++) {
+    const HDLLaserReturn& laserReturn = firing.laserReturns[j];
+    if (laserReturn.distance == 0) {
+      continue;
+    }
+    unsigned char laserId = static_cast<unsigned char>(j + offset);
+    const HDLLaserCorrection& correction = corrections[laserId];
+    // looked up first so the table loads overlap the trigonometry below
+    unsigned char intensity = laserReturn.intensity;
+    if ((Columns & HDL_COLUMN_INTENSITY) && rangeOffset) {
+      intensity = CalibrateIntensity(rangeOffset, scaled, laserId, laserReturn);
+    }
+    double distanceM = 0;
+    if (Columns & (HDL_COLUMN_XYZ | HDL_COLUMN_DISTANCE)) {
+      distanceM = laserReturn.distance * 0.002 + correction.distanceCorrection;
+    }
+
+    if (Columns & HDL_COLUMN_XYZ) {
+      double sinAzimuth, cosAzimuth, x, y, z;
+      AzimuthTrig(correction, azimuth, &sinAzimuth, &cosAzimuth);
+      ReturnXYZ(correction, distanceM, sinAzimuth, cosAzimuth, has_extrinsic, &x, &y, &z);
+      frame->x.push_back(x);
+      frame->y.push_back(y);
+      frame->z.push_back(z);
+    }
+    if (Columns & HDL_COLUMN_INTENSITY) {
+      frame->intensity.push_back(intensity);
+    }
+    if (Columns & HDL_COLUMN_LASER_ID) {
+      frame->laser_id.push_back(laserId);
+    }
+    if (Columns & HDL_COLUMN_AZIMUTH) {
+      frame->azimuth.push_back(azimuth);
+    }
+    if (Columns & HDL_COLUMN_DISTANCE) {
+      frame->distance.push_back(distanceM);
+    }
+    if (Columns & HDL_COLUMN_MS_FROM_TOP_OF_HOUR) {
+      frame->ms_from_top_of_hour.push_back(timestamp);
+    }
+  }
+}
+
+// copies firing into foreground with the returns the model calls background zeroed, which every decode path
+// skips - so background costs no trigonometry and never reaches a frame
+inline const HDLFiringData& RemoveBackground(const HDLFiringData& firing, BackgroundModel* model, HDLFiringData* foreground)
+{
+  *foreground = firing;
+  int offset = (firing.blockIdentifier == BLOCK_0_TO_31) ? 0 : 32;
+  for (int j = 0; j < HDL_LASER_PER_FIRING; j++) {
+    HDLLaserReturn& laserReturn = foreground->laserReturns[j];
+    if (laserReturn.distance != 0 && !model->IsForeground(j + offset, firing.rotationalPosition, laserReturn.distance)) {
+      laserReturn.distance = 0;
+    }
+  }
+  return *foreground;
+}
+
+// table of DecodeFiring instantiations indexed by column mask, filled by recursing down from HDL_COLUMN_ALL
+template <typename Frame>
+struct FiringKernels
+{
+  typedef void (*Kernel)(const HDLFiringData& firing, unsigned int timestamp, const HDLLaserCorrection* corrections, bool has_extrinsic,
+                         const HDLIntensityTable* intensity_table, Frame* frame);
+  Kernel kernels[HDL_COLUMN_ALL + 1];
+};
+
+template <typename Frame, unsigned int Columns>
+struct FillFiringKernels
+{
+  static void Fill(FiringKernels<Frame>* table)
+  {
+    table->kernels[Columns] = &DecodeFiring<Frame, Columns>;
+    FillFiringKernels<Frame, Columns - 1>::Fill(table);
+  }
+};
+
+template <typename Frame>
+struct FillFiringKernels<Frame, 0>
+{
+  static void Fill(FiringKernels<Frame>* table)
+  {
+    table->kernels[0] = &DecodeFiring<Frame, 0>;
+  }
+};
+
+template <typename Frame>
+FiringKernels<Frame> BuildFiringKernels()
+{
+  FiringKernels<Frame> table;
+  FillFiringKernels<Frame, HDL_COLUMN_ALL>::Fill(&table);
+  return table;
+}
+
+// built on first use - the initialisation of a function-local static is thread-safe, so decoders on different
+// threads can make the first call at once
+template <typename Frame>
+const FiringKernels<Frame>& GetFiringKernels()
+{
+  static const FiringKernels<Frame> table = BuildFiringKernels<Frame>();
+  return table;
+}
+
+// empties the columns a mask leaves out, for paths (like the voxel grid) that always produce every column
+template <typename Frame>
+void DropUnselectedColumns(Frame* frame, unsigned int columns)
+{
+  if (!(columns & HDL_COLUMN_XYZ)) {
+    frame->x.clear();
+    frame->y.clear();
+    frame->z.clear();
+  }
+  if (!(columns & HDL_COLUMN_INTENSITY)) {
+    frame->intensity.clear();
+  }
+  if (!(columns & HDL_COLUMN_LASER_ID)) {
+    frame->laser_id.clear();
+  }
+  if (!(columns & HDL_COLUMN_AZIMUTH)) {
+    frame->azimuth.clear();
+  }
+  if (!(columns & HDL_COLUMN_DISTANCE)) {
+    frame->distance.clear();
+  }
+  if (!(columns & HDL_COLUMN_MS_FROM_TOP_OF_HOUR)) {
+    frame->ms_from_top_of_hour.clear();
+  }
+}
+
+#endif // PACKET_DECODE_KERNELS_H_INCLUDED
@@ -10,18 +10,67 @@
 #include <boost/foreach.hpp>
 
 #include "PacketDecoder.h"
+#include "PacketDecodeKernels.h"
+#include "PacketDecimator.h"
+#include "LatencyTrace.h"
+
+namespace
+{
+// empties a frame but keeps its capacity, so a callback driven decoder stops reallocating after the first few frames
+template <typename Frame>
+void ClearFrame(Frame* frame)
+{
+  frame->x.clear();
+  frame->y.clear();
+  frame->z.clear();
+  frame->intensity.clear();
+  frame->laser_id.clear();
+  frame->azimuth.clear();
+  frame->distance.clear();
+  frame->ms_from_top_of_hour.clear();
+  frame->label.clear();
+}
+
+void SetIdentityExtrinsic(bool* has_extrinsic, double rotation[9], double translation[3])
+{
+  for (int i = 0; i < 9; i++) {
+    rotation[i] = (i % 4 == 0) ? 1.0 : 0.0;
+  }
+  translation[0] = translation[1] = translation[2] = 0.0;
+  *has_extrinsic = false;
+}
+}
 
 PacketDecoder::PacketDecoder()
 {
   _max_num_of_frames = 10;
+  _voxel_grid = NULL;
+  _background_model = NULL;
+  _decimator = NULL;
+  _sector_size = 0;
+  _time_offset = 0;
+  _column_mask = HDL_COLUMN_ALL;
+  _active_columns = HDL_COLUMN_ALL;
+  GetFiringKernels<HDLFrame>();
+  _intensity_calibration = true;
+  _intensity_table_in_use = NULL;
+  _cut_angle = 0;
+  _frame = NULL;
+  _external_frame = false;
+  SetIdentityExtrinsic(&_has_extrinsic, _rotation, _translation);
   UnloadData();
-  InitTables();
+  GetAzimuthTable();
   LoadHDL32Corrections();
 }
 
 PacketDecoder::~PacketDecoder()
 {
-
+  if (!_external_frame) {
+    delete _frame;
+  }
+  delete _voxel_grid;
+  delete _background_model;
+  delete _decimator;
 }
 
 void PacketDecoder::SetMaxNumberOfFrames(unsigned int max_num_of_frames)
@@ -39,8 +88,13 @@ void PacketDecoder::SetMaxNumberOfFrames(unsigned int max_num_of_frames)
 
 void PacketDecoder::DecodePacket(std::string* data, unsigned int* data_length)
 {
-  const unsigned char* data_char = reinterpret_cast<const unsigned char*>(data->c_str());
-  ProcessHDLPacket(const_cast<unsigned char*>(data_char), *data_length);
+  DecodePacket(data->data(), *data_length);
+}
+
+void PacketDecoder::DecodePacket(const char* data, unsigned int data_length)
+{
+  const unsigned char* data_char = reinterpret_cast<const unsigned char*>(data);
+  ProcessHDLPacket(const_cast<unsigned char*>(data_char), data_length);
 }
 
 void PacketDecoder::ProcessHDLPacket(unsigned char *data, unsigned int data_length)
@@ -51,64 +105,117 @@ void PacketDecoder::ProcessHDLPacket(unsigned char *data, unsigned int data_leng
   }
 
   HDLDataPacket* dataPacket = reinterpret_cast<HDLDataPacket *>(data);
+  unsigned int timestamp = dataPacket->gpsTimestamp;
+  HDL_TRACE_BEGIN("decode packet", dataPacket->gpsTimestamp);
+  if (_time_offset) {
+    timestamp = static_cast<unsigned int>(((timestamp + static_cast<int64_t>(_time_offset)) % HDL_US_PER_HOUR + HDL_US_PER_HOUR) % HDL_US_PER_HOUR);
+  }
+
+  HDLFiringData foreground, kept, finished[2];
+  unsigned int finished_timestamps[2];
 
   for (int i = 0; i < HDL_FIRING_PER_PKT; ++i) {
-    HDLFiringData firingData = dataPacket->firingData[i];
-    int offset = (firingData.blockIdentifier == BLOCK_0_TO_31) ? 0 : 32;
+    const HDLFiringData& firingData = dataPacket->firingData[i];
+    const HDLFiringData& decoded = _background_model ? RemoveBackground(firingData, _background_model, &foreground) : firingData;
+    if (_decimator) {
+      // a finished azimuth bin belongs to the frame and sector before this firing
+      unsigned int num_finished = _decimator->TakeFinishedBin(decoded, finished, finished_timestamps);
+      for (unsigned int k = 0; k < num_finished; k++) {
+        ProcessFiring(finished[k], finished_timestamps[k]);
+      }
+    }
 
-    if (firingData.rotationalPosition < _last_azimuth) {
+    // azimuth measured from the cut angle, so the frame splits where it wraps
+    unsigned int cut_azimuth = (firingData.rotationalPosition + 36000 - _cut_angle) % 36000;
+    if (cut_azimuth < _last_azimuth) {
       SplitFrame();
     }
 
-    _last_azimuth = firingData.rotationalPosition;
+    if (_sector_callback && firingData.rotationalPosition / _sector_size != _sector_index) {
+      EmitSector();
+      _sector_index = firingData.rotationalPosition / _sector_size;
+    }
 
-    for (int j = 0; j < HDL_LASER_PER_FIRING; j++) {
-      unsigned char laserId = static_cast<unsigned char>(j + offset);
-      if (firingData.laserReturns[j].distance != 0.0) {
-        PushFiringData(laserId, firingData.rotationalPosition, dataPacket->gpsTimestamp, firingData.laserReturns[j], laser_corrections_[j + offset]);
-      }
+    _last_azimuth = cut_azimuth;
+
+    if (!_decimator) {
+      ProcessFiring(decoded, timestamp);
+    } else if (_decimator->Decimate(decoded, timestamp, &kept)) {
+      ProcessFiring(kept, timestamp);
     }
   }
+  HDL_TRACE_END("decode packet", dataPacket->gpsTimestamp);
+}
+
+void PacketDecoder::FlushFrame()
+{
+  // the voxel grid only fills the frame as it is split
+  if (_voxel_grid || HDLFrameSize(*_frame) > 0) {
+    SplitFrame();
+  }
 }
 
 void PacketDecoder::SplitFrame()
 {
-  if (_frames.size() == _max_num_of_frames-1) {
-    _frames.pop_front();
+  EmitSector();
+  HDL_TRACE_INSTANT("frame split", HDLFrameSize(*_frame));
+  if (_voxel_grid) {
+    _voxel_grid->Flush(_frame);
+    DropUnselectedColumns(_frame, _active_columns);
+  }
+  if (_frame_callback) {
+    // handed straight to the callback, nothing is queued for GetFrames/GetLatestFrame
+    // (a caller-owned output frame is left for its owner, who may redirect us with SetOutputFrame from the callback)
+    HDL_TRACE_BEGIN("frame delivery", HDLFrameSize(*_frame));
+    _frame_callback(*_frame);
+    HDL_TRACE_END("frame delivery", HDLFrameSize(*_frame));
+    if (!_external_frame) {
+      ClearFrame(_frame);
+    }
+  } else {
+    if (_frames.size() == _max_num_of_frames-1) {
+      _frames.pop_front();
+    }
+    _frames.push_back(*_frame);
+    HDL_TRACE_INSTANT("frame delivery", HDLFrameSize(*_frame));
+    if (_external_frame) {
+      ClearFrame(_frame);
+    } else {
+      delete _frame;
+      _frame = new HDLFrame();
+    }
+  }
+  if (_decimator) {
+    _decimator->NextFrame();
   }
-  _frames.push_back(*_frame);
-  delete _frame;
-  _frame = new HDLFrame();
+  _active_columns = _column_mask;
+  _sector_begin = HDLFrameSize(*_frame);
 }
 
-void PacketDecoder::PushFiringData(unsigned char laserId, unsigned short azimuth, unsigned int timestamp, HDLLaserReturn laserReturn, HDLLaserCorrection correction)
+void PacketDecoder::ProcessFiring(const HDLFiringData& firingData, unsigned int timestamp)
 {
-  double cosAzimuth, sinAzimuth;
-  if (correction.azimuthCorrection == 0) {
-    cosAzimuth = cos_lookup_table_[azimuth];
-    sinAzimuth = sin_lookup_table_[azimuth];
+  if (_voxel_grid) {
+    // the voxel grid needs every column, unselected ones are dropped again when it is flushed
+    int offset = (firingData.blockIdentifier == BLOCK_0_TO_31) ? 0 : 32;
+    for (int j = 0; j < HDL_LASER_PER_FIRING; j++) {
+      unsigned char laserId = static_cast<unsigned char>(j + offset);
+      if (firingData.laserReturns[j].distance != 0.0) {
+        PushFiringData(laserId, firingData.rotationalPosition, timestamp, firingData.laserReturns[j], _laser_corrections[j + offset]);
+      }
+    }
   } else {
-    double azimuthInRadians = HDL_Grabber_toRadians((static_cast<double> (azimuth) / 100.0) - correction.azimuthCorrection);
-    cosAzimuth = std::cos(azimuthInRadians);
-    sinAzimuth = std::sin(azimuthInRadians);
+    GetFiringKernels<HDLFrame>().kernels[_active_columns](firingData, timestamp, _laser_corrections, _has_extrinsic, _intensity_table_in_use, _frame);
   }
+}
 
+void PacketDecoder::PushFiringData(unsigned char laserId, unsigned short azimuth, unsigned int timestamp, HDLLaserReturn laserReturn, const HDLLaserCorrection& correction)
+{
+  double sinAzimuth, cosAzimuth, x, y, z;
+  AzimuthTrig(correction, azimuth, &sinAzimuth, &cosAzimuth);
   double distanceM = laserReturn.distance * 0.002 + correction.distanceCorrection;
-  double xyDistance = distanceM * correction.cosVertCorrection - correction.sinVertOffsetCorrection;
-
-  double x = (xyDistance * sinAzimuth - correction.horizontalOffsetCorrection * cosAzimuth);
-  double y = (xyDistance * cosAzimuth + correction.horizontalOffsetCorrection * sinAzimuth);
-  double z = (distanceM * correction.sinVertCorrection + correction.cosVertOffsetCorrection);
-  unsigned char intensity = laserReturn.intensity;
-
-  _frame->x.push_back(x);
-  _frame->y.push_back(y);
-  _frame->z.push_back(z);
-  _frame->intensity.push_back(intensity);
-  _frame->laser_id.push_back(laserId);
-  _frame->azimuth.push_back(azimuth);
-  _frame->distance.push_back(distanceM);
-  _frame->ms_from_top_of_hour.push_back(timestamp);
+  ReturnXYZ(correction, distanceM, sinAzimuth, cosAzimuth, _has_extrinsic, &x, &y, &z);
+  unsigned char intensity = CalibrateIntensity(_intensity_table_in_use, laserId, laserReturn);
+  _voxel_grid->AddPoint(x, y, z, intensity, laserId, azimuth, distanceM, timestamp);
 }
 
 void PacketDecoder::SetCorrectionsFile(const std::string& corrections_file)
@@ -127,23 +234,224 @@ void PacketDecoder::SetCorrectionsFile(const std::string& corrections_file)
   UnloadData();
 }
 
-void PacketDecoder::UnloadData()
+bool PacketDecoder::SetExtrinsic(const double rotation[9], const double translation[3])
+{
+  // a rigid-body rotation has orthonormal rows and determinant +1
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      double dot = rotation[3*i]*rotation[3*j] + rotation[3*i+1]*rotation[3*j+1] + rotation[3*i+2]*rotation[3*j+2];
+      if (std::fabs(dot - (i == j ? 1.0 : 0.0)) > 1e-6) {
+        std::cout << "PacketDecoder: Warning, extrinsic rotation is not orthonormal, ignoring it" << std::endl;
+        return(false);
+      }
+    }
+  }
+  double determinant = rotation[0]*(rotation[4]*rotation[8] - rotation[5]*rotation[7])
+                     - rotation[1]*(rotation[3]*rotation[8] - rotation[5]*rotation[6])
+                     + rotation[2]*(rotation[3]*rotation[7] - rotation[4]*rotation[6]);
+  if (determinant < 0) {
+    std::cout << "PacketDecoder: Warning, extrinsic rotation is a reflection, ignoring it" << std::endl;
+    return(false);
+  }
+
+  for (int i = 0; i < 9; i++) {
+    _rotation[i] = rotation[i];
+  }
+  for (int i = 0; i < 3; i++) {
+    _translation[i] = translation[i];
+  }
+  _has_extrinsic = true;
+  SetCorrectionsCommon();
+  return(true);
+}
+
+bool PacketDecoder::SetExtrinsic(double x, double y, double z, double roll, double pitch, double yaw)
+{
+  double cr = std::cos(roll), sr = std::sin(roll);
+  double cp = std::cos(pitch), sp = std::sin(pitch);
+  double cy = std::cos(yaw), sy = std::sin(yaw);
+  double rotation[9] = {
+    cy*cp, cy*sp*sr - sy*cr, cy*sp*cr + sy*sr,
+    sy*cp, sy*sp*sr + cy*cr, sy*sp*cr - cy*sr,
+    -sp,   cp*sr,            cp*cr };
+  double translation[3] = { x, y, z };
+  return SetExtrinsic(rotation, translation);
+}
+
+void PacketDecoder::ClearExtrinsic()
 {
+  SetIdentityExtrinsic(&_has_extrinsic, _rotation, _translation);
+  SetCorrectionsCommon();
+}
+
+void PacketDecoder::SetTimeOffset(int time_offset)
+{
+  _time_offset = static_cast<int>(time_offset % HDL_US_PER_HOUR);
+}
+
+int PacketDecoder::GetTimeOffset()
+{
+  return _time_offset;
+}
+
+bool PacketDecoder::HasExtrinsic()
+{
+  return _has_extrinsic;
+}
+
+const HDLLaserCorrection* PacketDecoder::GetLaserCorrections()
+{
+  return _laser_corrections;
+}
+
+void PacketDecoder::SetIntensityCalibration(bool enabled)
+{
+  _intensity_calibration = enabled;
+  _intensity_table_in_use = (_intensity_calibration && _intensity_table.range_offset.size()) ? &_intensity_table : NULL;
+}
+
+const HDLIntensityTable* PacketDecoder::GetIntensityTable()
+{
+  return _intensity_table_in_use;
+}
+
+void PacketDecoder::SetCutAngle(unsigned int cut_angle)
+{
+  _cut_angle = cut_angle % 36000;
   _last_azimuth = 0;
-  _frame = new HDLFrame();
-  _frames.clear();
 }
 
-void PacketDecoder::InitTables()
+void PacketDecoder::SetOutputFrame(PacketDecoder::HDLFrame* frame)
 {
-  if (cos_lookup_table_ == NULL && sin_lookup_table_ == NULL) {
-    cos_lookup_table_ = static_cast<double *> (malloc (HDL_NUM_ROT_ANGLES * sizeof (*cos_lookup_table_)));
-    sin_lookup_table_ = static_cast<double *> (malloc (HDL_NUM_ROT_ANGLES * sizeof (*sin_lookup_table_)));
-    for (unsigned int i = 0; i < HDL_NUM_ROT_ANGLES; i++) {
-      double rad = HDL_Grabber_toRadians(i / 100.0);
-      cos_lookup_table_[i] = std::cos(rad);
-      sin_lookup_table_[i] = std::sin(rad);
-    }
+  if (!_external_frame) {
+    delete _frame;
+  }
+  if (frame) {
+    _frame = frame;
+    _external_frame = true;
+  } else {
+    _frame = new HDLFrame();
+    _external_frame = false;
+  }
+  _sector_begin = HDLFrameSize(*_frame);
+}
+
+void PacketDecoder::SetColumnMask(unsigned int columns)
+{
+  _column_mask = columns & HDL_COLUMN_ALL;
+  // a frame already under way keeps the columns it started with
+  if (HDLFrameSize(*_frame) == 0) {
+    _active_columns = _column_mask;
+  }
+}
+
+unsigned int PacketDecoder::GetColumnMask()
+{
+  return _column_mask;
+}
+
+void PacketDecoder::SetVoxelGrid(double leaf_size, VoxelGrid::VoxelPolicy policy)
+{
+  if (leaf_size <= 0) {
+    DisableVoxelGrid();
+    return;
+  }
+
+  if (_voxel_grid) {
+    _voxel_grid->SetLeafSize(leaf_size);
+    _voxel_grid->SetPolicy(policy);
+  } else {
+    _voxel_grid = new VoxelGrid(leaf_size, policy);
+  }
+}
+
+void PacketDecoder::DisableVoxelGrid()
+{
+  delete _voxel_grid;
+  _voxel_grid = NULL;
+}
+
+void PacketDecoder::SetBackgroundModel(double adaptation_rate, double threshold)
+{
+  if (adaptation_rate <= 0) {
+    DisableBackgroundModel();
+    return;
+  }
+
+  if (_background_model) {
+    _background_model->SetAdaptationRate(adaptation_rate);
+    _background_model->SetThreshold(threshold);
+  } else {
+    _background_model = new BackgroundModel(adaptation_rate, threshold);
+  }
+}
+
+void PacketDecoder::DisableBackgroundModel()
+{
+  delete _background_model;
+  _background_model = NULL;
+}
+
+BackgroundModel* PacketDecoder::GetBackgroundModel()
+{
+  return _background_model;
+}
+
+void PacketDecoder::SetDecimation(unsigned int firing_step, unsigned int laser_step)
+{
+  if (!_decimator) {
+    _decimator = new PacketDecimator();
+  }
+  _decimator->SetFiringStep(firing_step);
+  _decimator->SetLaserStep(laser_step);
+  if (!_decimator->IsEnabled()) {
+    DisableDecimation();
+  }
+}
+
+void PacketDecoder::SetAzimuthBinning(unsigned int azimuth_bin, HDLBinSelection selection)
+{
+  if (!_decimator) {
+    _decimator = new PacketDecimator();
+  }
+  _decimator->SetAzimuthBin(azimuth_bin, selection);
+  if (!_decimator->IsEnabled()) {
+    DisableDecimation();
+  }
+}
+
+void PacketDecoder::SetPointBudget(unsigned int max_points)
+{
+  if (!_decimator) {
+    _decimator = new PacketDecimator();
+  }
+  _decimator->SetPointBudget(max_points);
+  if (!_decimator->IsEnabled()) {
+    DisableDecimation();
+  }
+}
+
+void PacketDecoder::DisableDecimation()
+{
+  delete _decimator;
+  _decimator = NULL;
+}
+
+void PacketDecoder::UnloadData()
+{
+  _sector_index = 0;
+  _last_azimuth = 0;
+  if (!_external_frame) {
+    delete _frame;
+    _frame = new HDLFrame();
+  }
+  _sector_begin = HDLFrameSize(*_frame);
+  _frames.clear();
+  if (_voxel_grid) {
+    _voxel_grid->Clear();
+  }
+  if (_decimator) {
+    _decimator->Clear();
   }
 }
 
@@ -158,6 +466,31 @@ void PacketDecoder::LoadCorrectionsFile(const std::string& correctionsFile)
     return;
   }
 
+  // per-laser intensity range, stored as arrays alongside points_ rather than in each px
+  for (int i = 0; i < HDL_MAX_NUM_LASERS; i++) {
+    _laser_corrections[i].minIntensity = 0;
+    _laser_corrections[i].maxIntensity = 255;
+  }
+  const char* intensityRanges[2] = { "boost_serialization.DB.minIntensity_", "boost_serialization.DB.maxIntensity_" };
+  for (int r = 0; r < 2; r++) {
+    boost::optional<boost::property_tree::ptree&> range = pt.get_child_optional(intensityRanges[r]);
+    if (!range) {
+      continue;
+    }
+    int index = 0;
+    BOOST_FOREACH (boost::property_tree::ptree::value_type &item, *range) {
+      if (item.first == "item" && index < HDL_MAX_NUM_LASERS) {
+        double value = atof(item.second.data().c_str());
+        if (r == 0) {
+          _laser_corrections[index].minIntensity = value;
+        } else {
+          _laser_corrections[index].maxIntensity = value;
+        }
+        index++;
+      }
+    }
+  }
+
   BOOST_FOREACH (boost::property_tree::ptree::value_type &v, pt.get_child("boost_serialization.DB.points_")) {
     if (v.first == "item") {
       boost::property_tree::ptree points = v.second;
@@ -170,6 +503,10 @@ void PacketDecoder::LoadCorrectionsFile(const std::string& correctionsFile)
           double distCorrection = 0;
           double vertOffsetCorrection = 0;
           double horizOffsetCorrection = 0;
+          double distCorrectionX = 0;
+          double distCorrectionY = 0;
+          double focalDistance = 0;
+          double focalSlope = 0;
 
           BOOST_FOREACH (boost::property_tree::ptree::value_type &item, calibrationData) {
             if (item.first == "id_")
@@ -184,16 +521,28 @@ void PacketDecoder::LoadCorrectionsFile(const std::string& correctionsFile)
               vertOffsetCorrection = atof(item.second.data().c_str());
             if (item.first == "horizOffsetCorrection_")
               horizOffsetCorrection = atof(item.second.data().c_str());
+            if (item.first == "distCorrectionX_")
+              distCorrectionX = atof(item.second.data().c_str());
+            if (item.first == "distCorrectionY_")
+              distCorrectionY = atof(item.second.data().c_str());
+            if (item.first == "focalDistance_")
+              focalDistance = atof(item.second.data().c_str());
+            if (item.first == "focalSlope_")
+              focalSlope = atof(item.second.data().c_str());
           }
           if (index != -1) {
-            laser_corrections_[index].azimuthCorrection = azimuth;
-            laser_corrections_[index].verticalCorrection = vertCorrection;
-            laser_corrections_[index].distanceCorrection = distCorrection / 100.0;
-            laser_corrections_[index].verticalOffsetCorrection = vertOffsetCorrection / 100.0;
-            laser_corrections_[index].horizontalOffsetCorrection = horizOffsetCorrection / 100.0;
-
-            laser_corrections_[index].cosVertCorrection = std::cos (HDL_Grabber_toRadians(laser_corrections_[index].verticalCorrection));
-            laser_corrections_[index].sinVertCorrection = std::sin (HDL_Grabber_toRadians(laser_corrections_[index].verticalCorrection));
+            _laser_corrections[index].azimuthCorrection = azimuth;
+            _laser_corrections[index].verticalCorrection = vertCorrection;
+            _laser_corrections[index].distanceCorrection = distCorrection / 100.0;
+            _laser_corrections[index].verticalOffsetCorrection = vertOffsetCorrection / 100.0;
+            _laser_corrections[index].horizontalOffsetCorrection = horizOffsetCorrection / 100.0;
+            _laser_corrections[index].distanceCorrectionX = distCorrectionX / 100.0;
+            _laser_corrections[index].distanceCorrectionY = distCorrectionY / 100.0;
+            _laser_corrections[index].focalDistance = focalDistance;
+            _laser_corrections[index].focalSlope = focalSlope;
+
+            _laser_corrections[index].cosVertCorrection = std::cos (HDL_Grabber_toRadians(_laser_corrections[index].verticalCorrection));
+            _laser_corrections[index].sinVertCorrection = std::sin (HDL_Grabber_toRadians(_laser_corrections[index].verticalCorrection));
           }
         }
       }
@@ -212,23 +561,35 @@ void PacketDecoder::LoadHDL32Corrections()
     -14.67, 6.6700001, -13.33, 8, -12, 9.3299999, -10.67, 10.67 };
 
   for (int i = 0; i < HDL_LASER_PER_FIRING; i++) {
-    laser_corrections_[i].azimuthCorrection = 0.0;
-    laser_corrections_[i].distanceCorrection = 0.0;
-    laser_corrections_[i].horizontalOffsetCorrection = 0.0;
-    laser_corrections_[i].verticalOffsetCorrection = 0.0;
-    laser_corrections_[i].verticalCorrection = hdl32VerticalCorrections[i];
-    laser_corrections_[i].sinVertCorrection = std::sin(HDL_Grabber_toRadians(hdl32VerticalCorrections[i]));
-    laser_corrections_[i].cosVertCorrection = std::cos(HDL_Grabber_toRadians(hdl32VerticalCorrections[i]));
+    _laser_corrections[i].azimuthCorrection = 0.0;
+    _laser_corrections[i].distanceCorrection = 0.0;
+    _laser_corrections[i].horizontalOffsetCorrection = 0.0;
+    _laser_corrections[i].verticalOffsetCorrection = 0.0;
+    _laser_corrections[i].distanceCorrectionX = 0.0;
+    _laser_corrections[i].distanceCorrectionY = 0.0;
+    _laser_corrections[i].focalDistance = 0.0;
+    _laser_corrections[i].focalSlope = 0.0;
+    _laser_corrections[i].minIntensity = 0.0;
+    _laser_corrections[i].maxIntensity = 255.0;
+    _laser_corrections[i].verticalCorrection = hdl32VerticalCorrections[i];
+    _laser_corrections[i].sinVertCorrection = std::sin(HDL_Grabber_toRadians(hdl32VerticalCorrections[i]));
+    _laser_corrections[i].cosVertCorrection = std::cos(HDL_Grabber_toRadians(hdl32VerticalCorrections[i]));
   }
 
   for (int i = HDL_LASER_PER_FIRING; i < HDL_MAX_NUM_LASERS; i++) {
-    laser_corrections_[i].azimuthCorrection = 0.0;
-    laser_corrections_[i].distanceCorrection = 0.0;
-    laser_corrections_[i].horizontalOffsetCorrection = 0.0;
-    laser_corrections_[i].verticalOffsetCorrection = 0.0;
-    laser_corrections_[i].verticalCorrection = 0.0;
-    laser_corrections_[i].sinVertCorrection = 0.0;
-    laser_corrections_[i].cosVertCorrection = 1.0;
+    _laser_corrections[i].azimuthCorrection = 0.0;
+    _laser_corrections[i].distanceCorrection = 0.0;
+    _laser_corrections[i].horizontalOffsetCorrection = 0.0;
+    _laser_corrections[i].verticalOffsetCorrection = 0.0;
+    _laser_corrections[i].distanceCorrectionX = 0.0;
+    _laser_corrections[i].distanceCorrectionY = 0.0;
+    _laser_corrections[i].focalDistance = 0.0;
+    _laser_corrections[i].focalSlope = 0.0;
+    _laser_corrections[i].minIntensity = 0.0;
+    _laser_corrections[i].maxIntensity = 255.0;
+    _laser_corrections[i].verticalCorrection = 0.0;
+    _laser_corrections[i].sinVertCorrection = 0.0;
+    _laser_corrections[i].cosVertCorrection = 1.0;
   }
 
   SetCorrectionsCommon();
@@ -237,12 +598,34 @@ void PacketDecoder::LoadHDL32Corrections()
 void PacketDecoder::SetCorrectionsCommon()
 {
   for (int i = 0; i < HDL_MAX_NUM_LASERS; i++) {
-    HDLLaserCorrection correction = laser_corrections_[i];
-    laser_corrections_[i].sinVertOffsetCorrection = correction.verticalOffsetCorrection
+    HDLLaserCorrection correction = _laser_corrections[i];
+    _laser_corrections[i].sinVertOffsetCorrection = correction.verticalOffsetCorrection
                                        * correction.sinVertCorrection;
-    laser_corrections_[i].cosVertOffsetCorrection = correction.verticalOffsetCorrection
+    _laser_corrections[i].cosVertOffsetCorrection = correction.verticalOffsetCorrection
                                        * correction.cosVertCorrection;
+
+    HDLLaserCorrection& fused = _laser_corrections[i];
+    for (int k = 0; k < 3; k++) {
+      const double* row = _rotation + 3*k;
+      fused.vehicleSin[k] = fused.cosVertCorrection * row[0];
+      fused.vehicleCos[k] = fused.cosVertCorrection * row[1];
+      fused.vehicleVert[k] = fused.sinVertCorrection * row[2];
+      fused.vehicleOffsetSin[k] = -fused.sinVertOffsetCorrection * row[0] + fused.horizontalOffsetCorrection * row[1];
+      fused.vehicleOffsetCos[k] = -fused.horizontalOffsetCorrection * row[0] - fused.sinVertOffsetCorrection * row[1];
+      fused.vehicleOffset[k] = fused.cosVertOffsetCorrection * row[2] + _translation[k];
+    }
+
+    // the HDL-64E manual's two-point correction interpolates linearly between distCorrectionX/Y, measured
+    // at |x| = 2.4m and |y| = 1.93m, and distCorrection, measured at 25.04m
+    fused.twoPointDistance = (fused.distanceCorrectionX != 0 || fused.distanceCorrectionY != 0);
+    fused.distanceSlopeX = (fused.distanceCorrection - fused.distanceCorrectionX) / (25.04 - 2.4);
+    fused.distanceOffsetX = fused.distanceCorrectionX - fused.distanceCorrection - 2.4 * fused.distanceSlopeX;
+    fused.distanceSlopeY = (fused.distanceCorrection - fused.distanceCorrectionY) / (25.04 - 1.93);
+    fused.distanceOffsetY = fused.distanceCorrectionY - fused.distanceCorrection - 1.93 * fused.distanceSlopeY;
   }
+
+  BuildIntensityTable(_laser_corrections, &_intensity_table);
+  SetIntensityCalibration(_intensity_calibration);
 }
 
 std::deque<PacketDecoder::HDLFrame> PacketDecoder::GetFrames()
@@ -264,3 +647,33 @@ bool PacketDecoder::GetLatestFrame(PacketDecoder::HDLFrame* frame)
   }
   return(false);
 }
+
+void PacketDecoder::SetFrameCallback(const PacketDecoder::FrameCallback& callback)
+{
+  _frame_callback = callback;
+}
+
+bool PacketDecoder::HasFrameCallback()
+{
+  return !_frame_callback.empty();
+}
+
+void PacketDecoder::SetSectorCallback(unsigned int sector_size, const PacketDecoder::SectorCallback& callback)
+{
+  if (sector_size == 0 || sector_size > 36000) {
+    std::cout << "PacketDecoder: Warning, sector size must be between 1 and 36000 hundredths of a degree" << std::endl;
+    return;
+  }
+  _sector_size = sector_size;
+  _sector_callback = callback;
+}
+
+void PacketDecoder::EmitSector()
+{
+  unsigned int end = HDLFrameSize(*_frame);
+  // with the voxel grid on, points only reach the frame when it is flushed, so there are no partial sectors to report
+  if (_sector_callback && !_voxel_grid && end > _sector_begin) {
+    _sector_callback(*_frame, _sector_begin, end);
+  }
+  _sector_begin = end;
+}
@@ -7,7 +7,99 @@
 
 #include <string>
 #include <vector>
+#include <stdint.h>
 #include <deque>
+#include <boost/function.hpp>
+#include "VoxelGrid.h"
+#include "BackgroundModel.h"
+
+// per-laser calibration, outside the anonymous namespace so the decoders can each hold their own table
+struct HDLLaserCorrection
+{
+  double azimuthCorrection;
+  double verticalCorrection;
+  double distanceCorrection;
+  double verticalOffsetCorrection;
+  double horizontalOffsetCorrection;
+  double sinVertCorrection;
+  double cosVertCorrection;
+  double sinVertOffsetCorrection;
+  double cosVertOffsetCorrection;
+  // sensor-to-vehicle extrinsic folded in by SetCorrectionsCommon - per output axis, the point is
+  // (d*vehicleSin + vehicleOffsetSin)*sin(azimuth) + (d*vehicleCos + vehicleOffsetCos)*cos(azimuth) + d*vehicleVert + vehicleOffset
+  double vehicleSin[3];
+  double vehicleCos[3];
+  double vehicleVert[3];
+  double vehicleOffsetSin[3];
+  double vehicleOffsetCos[3];
+  double vehicleOffset[3];
+  // HDL-64E two-point distance correction, as read (metres) - x and y then each get their own distance,
+  // distanceM + distanceSlope*|x or y| + distanceOffset, with the lines fitted by SetCorrectionsCommon
+  double distanceCorrectionX;
+  double distanceCorrectionY;
+  bool twoPointDistance;
+  double distanceSlopeX;
+  double distanceOffsetX;
+  double distanceSlopeY;
+  double distanceOffsetY;
+  // HDL-64E intensity calibration, as read - applied through an HDLIntensityTable
+  double focalDistance;
+  double focalSlope;
+  double minIntensity;
+  double maxIntensity;
+};
+
+// raw distance units (2mm) per range bin of an HDLIntensityTable, as a power of two - 64mm bins
+const unsigned int HDL_INTENSITY_RANGE_SHIFT = 5;
+const unsigned int HDL_INTENSITY_RANGE_BINS = 65536 >> HDL_INTENSITY_RANGE_SHIFT;
+// entries per laser of HDLIntensityTable::scaled, every raw intensity plus every biased focal correction
+const unsigned int HDL_INTENSITY_SCALED_SIZE = 768;
+
+// HDL-64E intensity calibration as two lookups per return, built from the corrections by BuildIntensityTable:
+// the focal correction for the laser and raw distance bin is added to the raw intensity, which then indexes
+// the laser's clamp to [minIntensity, maxIntensity] and rescale to 0-255. The corrections are stored biased
+// by 256 and the rows cover every sum, so a return costs no comparisons, which would mispredict.
+struct HDLIntensityTable
+{
+  std::vector<uint16_t> range_offset; // [laser][raw distance >> HDL_INTENSITY_RANGE_SHIFT], correction + 256
+  std::vector<unsigned char> scaled;  // [laser][raw intensity + range_offset]
+};
+
+// columns a decoder fills, see SetColumnMask - x, y and z share their trigonometry so are selected together
+enum HDLColumn
+{
+  HDL_COLUMN_XYZ = 1 << 0,
+  HDL_COLUMN_INTENSITY = 1 << 1,
+  HDL_COLUMN_LASER_ID = 1 << 2,
+  HDL_COLUMN_AZIMUTH = 1 << 3,
+  HDL_COLUMN_DISTANCE = 1 << 4,
+  HDL_COLUMN_MS_FROM_TOP_OF_HOUR = 1 << 5,
+  HDL_COLUMN_ALL = (1 << 6) - 1
+};
+
+// which return of each laser an azimuth bin keeps, see SetAzimuthBinning
+enum HDLBinSelection
+{
+  HDL_BIN_MIN_RANGE = 0,    // the closest
+  HDL_BIN_MAX_INTENSITY = 1 // the strongest, the closest of equals
+};
+
+class PacketDecimator;
+
+// number of points in a frame, whichever columns it was decoded with
+template <typename Frame>
+unsigned int HDLFrameSize(const Frame& frame)
+{
+  size_t sizes[6] = { frame.x.size(), frame.intensity.size(), frame.laser_id.size(),
+                      frame.azimuth.size(), frame.distance.size(), frame.ms_from_top_of_hour.size() };
+  size_t size = 0;
+  for (int i = 0; i < 6; i++) {
+    if (sizes[i] > size) {
+      size = sizes[i];
+    }
+  }
+  return size;
+}
 
 namespace
 {
@@ -17,6 +109,7 @@ const int HDL_NUM_ROT_ANGLES = 36001;
 const int HDL_LASER_PER_FIRING = 32;
 const int HDL_MAX_NUM_LASERS = 64;
 const int HDL_FIRING_PER_PKT = 12;
+const int64_t HDL_US_PER_HOUR = 3600000000LL; // gps timestamps count microseconds past the hour
 
 enum HDLBlock
 {
@@ -47,29 +140,12 @@ struct HDLDataPacket
   unsigned char blank2;
 };
 
-struct HDLLaserCorrection
-{
-  double azimuthCorrection;
-  double verticalCorrection;
-  double distanceCorrection;
-  double verticalOffsetCorrection;
-  double horizontalOffsetCorrection;
-  double sinVertCorrection;
-  double cosVertCorrection;
-  double sinVertOffsetCorrection;
-  double cosVertOffsetCorrection;
-};
-
 struct HDLRGB
 {
   uint8_t r;
   uint8_t g;
   uint8_t b;
 };
-
-double *cos_lookup_table_;
-double *sin_lookup_table_;
-HDLLaserCorrection laser_corrections_[HDL_MAX_NUM_LASERS];
 }
 
 class PacketDecoder
@@ -85,33 +161,92 @@ public:
     std::vector<unsigned short> azimuth;
     std::vector<double> distance;
     std::vector<unsigned int> ms_from_top_of_hour;
+    std::vector<int> label; // never filled by the decoder, see Segmentation
   };
 
+  // frame and sector are only valid for the duration of the call, points [begin, end) of frame make up the sector
+  typedef boost::function<void (const HDLFrame& frame)> FrameCallback;
+  typedef boost::function<void (const HDLFrame& frame, unsigned int begin, unsigned int end)> SectorCallback;
+
 public:
   PacketDecoder();
   virtual ~PacketDecoder();
   void SetMaxNumberOfFrames(unsigned int max_num_of_frames);
   void DecodePacket(std::string* data, unsigned int* data_length);
+  void DecodePacket(const char* data, unsigned int data_length);
   void SetCorrectionsFile(const std::string& corrections_file);
+  // the sensor-to-vehicle extrinsic is folded into the per-laser correction constants, so points come out in the
+  // vehicle frame with no extra pass
+  bool SetExtrinsic(const double rotation[9], const double translation[3]); // row-major, p_vehicle = rotation*p_sensor + translation
+  bool SetExtrinsic(double x, double y, double z, double roll, double pitch, double yaw); // radians, yaw-pitch-roll (z-y-x) order
+  void ClearExtrinsic();
+  void SetTimeOffset(int time_offset); // microseconds added to every ms_from_top_of_hour, wrapping at the hour
+  int GetTimeOffset();
+  bool HasExtrinsic();
+  const HDLLaserCorrection* GetLaserCorrections(); // per-laser table in use, with any extrinsic folded in
+  // HDL-64E corrections files are applied in full - distCorrectionX/Y as per-laser linear terms, focal distance/slope
+  // and min/max intensity through per-laser tables indexed by raw range and raw intensity
+  void SetIntensityCalibration(bool enabled); // HDL-64E corrections files only, on by default
+  const HDLIntensityTable* GetIntensityTable(); // NULL unless intensities are being calibrated
+  void SetCutAngle(unsigned int cut_angle); // hundredths of a degree, frames are split as the azimuth passes it
+  void SetOutputFrame(HDLFrame* frame); // append points to a caller-owned frame instead of an internal one, NULL reverts
+  // each mask has its own compiled decode loop, so unselected columns cost neither compute nor memory
+  void SetColumnMask(unsigned int columns); // HDLColumn bits to compute and store, takes effect from the next frame
+  unsigned int GetColumnMask();
+  void SetVoxelGrid(double leaf_size, VoxelGrid::VoxelPolicy policy = VoxelGrid::VOXEL_CENTROID);
+  void DisableVoxelGrid();
+  void SetBackgroundModel(double adaptation_rate, double threshold = 0.2); // fixed sensors only, frames then hold foreground returns
+  void DisableBackgroundModel();
+  BackgroundModel* GetBackgroundModel(); // NULL unless enabled
+  void SetDecimation(unsigned int firing_step, unsigned int laser_step); // keep every Nth firing and laser id, 1 keeps all
+  void SetAzimuthBinning(unsigned int azimuth_bin, HDLBinSelection selection = HDL_BIN_MIN_RANGE); // hundredths of a degree, 0 off
+  void SetPointBudget(unsigned int max_points); // per frame, 0 off
+  void DisableDecimation();
   std::deque<HDLFrame> GetFrames();
   void ClearFrames();
   bool GetLatestFrame(HDLFrame* frame);
+  void SetFrameCallback(const FrameCallback& callback); // completed frames, instead of polling
+  bool HasFrameCallback(); // frames then go to the callback, never to GetFrames/GetLatestFrame
+  void FlushFrame(); // completes the frame being filled, e.g. at the end of a recording, as if the cut angle was passed
+  void SetSectorCallback(unsigned int sector_size, const SectorCallback& callback); // sector_size in hundredths of a degree
 
 protected:
   void UnloadData();
-  void InitTables();
   void LoadCorrectionsFile(const std::string& correctionsFile);
   void LoadHDL32Corrections();
   void SetCorrectionsCommon();
   void ProcessHDLPacket(unsigned char *data, unsigned int data_length);
   void SplitFrame();
-  void PushFiringData(unsigned char laserId, unsigned short azimuth, unsigned int timestamp, HDLLaserReturn laserReturn, HDLLaserCorrection correction);
+  void EmitSector();
+  void ProcessFiring(const HDLFiringData& firingData, unsigned int timestamp);
+  // voxel grid path only, frames are filled by the DecodeFiring kernels
+  void PushFiringData(unsigned char laserId, unsigned short azimuth, unsigned int timestamp, HDLLaserReturn laserReturn, const HDLLaserCorrection& correction);
 
 private:
   std::string _corrections_file;
   unsigned int _last_azimuth;
   unsigned int _max_num_of_frames;
+  HDLLaserCorrection _laser_corrections[HDL_MAX_NUM_LASERS];
+  HDLIntensityTable _intensity_table;
+  const HDLIntensityTable* _intensity_table_in_use; // NULL when calibration is off or there is nothing to apply
+  bool _intensity_calibration;
+  bool _has_extrinsic;
+  double _rotation[9];
+  double _translation[3];
+  int _time_offset;
+  unsigned int _column_mask;
+  unsigned int _active_columns; // mask the frame being assembled was started with
+  unsigned int _cut_angle;
   HDLFrame* _frame;
+  bool _external_frame;
+  VoxelGrid* _voxel_grid;
+  BackgroundModel* _background_model;
+  PacketDecimator* _decimator;
+  FrameCallback _frame_callback;
+  SectorCallback _sector_callback;
+  unsigned int _sector_size;
+  unsigned int _sector_index;
+  unsigned int _sector_begin;
   std::deque<HDLFrame> _frames;
 };
 
@@ -3,31 +3,103 @@
 // shared library to read a Velodyne HDL packet streaming over UDP
 
 #include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 
 #include "PacketDriver.h"
+#include "LatencyTrace.h"
 #include <boost/bind.hpp>
 
 using boost::asio::ip::udp;
 
+namespace
+{
+// packets read per wake up before yielding the reactor back to other handlers
+const unsigned int ASYNC_PACKETS_PER_WAKEUP = 64;
+}
+
 PacketDriver::PacketDriver()
 {
+  _port = 0;
+  _dropped_packets = 0;
+  _received = false;
+  _receiving = false;
+  _owned_io_service.reset(new boost::asio::io_service());
+  _io_service = _owned_io_service.get();
+}
 
+PacketDriver::PacketDriver(unsigned int port)
+{
+  _port = port;
+  _dropped_packets = 0;
+  _received = false;
+  _receiving = false;
+  _owned_io_service.reset(new boost::asio::io_service());
+  _io_service = _owned_io_service.get();
+  InitPacketDriver(port);
 }
 
-PacketDriver::PacketDriver(unsigned int port) : _port(port)
+PacketDriver::PacketDriver(boost::asio::io_service& io_service)
 {
-  boost::asio::ip::udp::endpoint destination_endpoint(boost::asio::ip::address_v4::any(), _port);
+  _port = 0;
+  _dropped_packets = 0;
+  _received = false;
+  _receiving = false;
+  _io_service = &io_service;
+}
+
+PacketDriver::~PacketDriver()
+{
+  _receiving = false;
+  if (_socket) {
+    _socket->close();
+  }
+  // a shared io_service belongs to the caller, only stop our own
+  if (_owned_io_service) {
+    _owned_io_service->stop();
+  }
+}
+
+void PacketDriver::InitPacketDriver(unsigned int port)
+{
+  InitPacketDriver(port, PacketDriverConfig());
+}
+
+void PacketDriver::InitPacketDriver(unsigned int port, const PacketDriverConfig& config)
+{
+  _port = port;
+  _config = config;
+  _dropped_packets = 0;
+
+  // a multicast consumer binds to its group, so it does not also get the sensor's own broadcast packets
+  boost::asio::ip::address_v4 listen_address = boost::asio::ip::address_v4::any();
+  if (_config.multicast_group.length()) {
+    boost::system::error_code error;
+    listen_address = boost::asio::ip::address_v4::from_string(_config.multicast_group, error);
+    if (error) {
+      std::cout << "PacketDriver: Error, invalid multicast group " << _config.multicast_group << std::endl;
+      return;
+    }
+  }
+  boost::asio::ip::udp::endpoint destination_endpoint(listen_address, _port);
 
   try {
-    _socket = boost::shared_ptr<boost::asio::ip::udp::socket>(new boost::asio::ip::udp::socket(_io_service));
+    _socket = boost::shared_ptr<boost::asio::ip::udp::socket>(new boost::asio::ip::udp::socket(*_io_service));
     _socket->open(destination_endpoint.protocol());
+    ApplySocketOptions();
     _socket->bind(destination_endpoint);
   } catch(std::exception & e) {
     std::cout << "PacketDriver: Error binding to socket - " << e.what() << ". Trying once more..." << std::endl;
     try {
-      destination_endpoint = boost::asio::ip::udp::endpoint(boost::asio::ip::address_v4::any(), _port);
-      _socket = boost::shared_ptr<boost::asio::ip::udp::socket>(new boost::asio::ip::udp::socket(_io_service));
+      destination_endpoint = boost::asio::ip::udp::endpoint(listen_address, _port);
+      _socket = boost::shared_ptr<boost::asio::ip::udp::socket>(new boost::asio::ip::udp::socket(*_io_service));
       _socket->open(destination_endpoint.protocol());
+      ApplySocketOptions();
       _socket->bind(destination_endpoint);
     } catch(std::exception & e) {
       std::cout << "PacketDriver: Error binding to socket - " << e.what() << ". Failed!" << std::endl;
@@ -39,57 +111,262 @@ PacketDriver::PacketDriver(unsigned int port) : _port(port)
   return;
 }
 
-PacketDriver::~PacketDriver()
+bool ApplyReceiveSocketOptions(int fd, const PacketDriverConfig& config)
 {
-  _socket->close();
-  _io_service.stop();
+  bool success = true;
+  int enable = 1;
+
+  if (config.receive_buffer_size > 0) {
+    int size = config.receive_buffer_size;
+    // SO_RCVBUFFORCE ignores net.core.rmem_max but needs CAP_NET_ADMIN
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)) != 0) {
+      setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    }
+    int actual = 0;
+    socklen_t length = sizeof(actual);
+    getsockopt(fd, SOL_SOCKET, SO_RCVBUF, &actual, &length);
+    // the kernel reports double the requested size to account for its bookkeeping
+    if (actual < size) {
+      std::cout << "PacketDriver: Warning, receive buffer is " << actual << " bytes, raise net.core.rmem_max for " << size << std::endl;
+    }
+  }
+
+  if (config.reuse_port) {
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable)) != 0 ||
+        setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) != 0) {
+      std::cout << "PacketDriver: Warning, could not share the port - " << strerror(errno) << std::endl;
+      success = false;
+    }
+  }
+
+  if (config.reuse_port || config.multicast_group.length()) {
+    // otherwise a socket bound to any address also gets every group other sockets on the host join
+    int disable = 0;
+    setsockopt(fd, IPPROTO_IP, IP_MULTICAST_ALL, &disable, sizeof(disable));
+  }
+
+  if (config.multicast_group.length()) {
+    struct ip_mreq membership;
+    memset(&membership, 0, sizeof(membership));
+    membership.imr_interface.s_addr = htonl(INADDR_ANY);
+    if (inet_pton(AF_INET, config.multicast_group.c_str(), &membership.imr_multiaddr) != 1 ||
+        (config.multicast_interface.length() && inet_pton(AF_INET, config.multicast_interface.c_str(), &membership.imr_interface) != 1)) {
+      std::cout << "PacketDriver: Warning, invalid multicast group " << config.multicast_group << " or interface " << config.multicast_interface << std::endl;
+      success = false;
+    } else if (setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership)) != 0) {
+      std::cout << "PacketDriver: Warning, could not join multicast group " << config.multicast_group << " - " << strerror(errno) << std::endl;
+      success = false;
+    }
+  }
+
+  return(success);
 }
 
-void PacketDriver::InitPacketDriver(unsigned int port)
+void PacketDriver::ApplySocketOptions()
 {
-  _port = port;
+  int fd = _socket->native_handle();
+  int enable = 1;
 
-  boost::asio::ip::udp::endpoint destination_endpoint(boost::asio::ip::address_v4::any(), _port);
+  ApplyReceiveSocketOptions(fd, _config);
 
-  try {
-    _socket = boost::shared_ptr<boost::asio::ip::udp::socket>(new boost::asio::ip::udp::socket(_io_service));
-    _socket->open(destination_endpoint.protocol());
-    _socket->bind(destination_endpoint);
-  } catch(std::exception & e) {
-    std::cout << "PacketDriver: Error binding to socket - " << e.what() << ". Trying once more..." << std::endl;
-    try {
-      destination_endpoint = boost::asio::ip::udp::endpoint(boost::asio::ip::address_v4::any(), _port);
-      _socket = boost::shared_ptr<boost::asio::ip::udp::socket>(new boost::asio::ip::udp::socket(_io_service));
-      _socket->open(destination_endpoint.protocol());
-      _socket->bind(destination_endpoint);
-    } catch(std::exception & e) {
-      std::cout << "PacketDriver: Error binding to socket - " << e.what() << ". Failed!" << std::endl;
-      return;
+  if (_config.kernel_timestamps && setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable)) != 0) {
+    std::cout << "PacketDriver: Warning, could not enable kernel timestamps - " << strerror(errno) << std::endl;
+  }
+
+  if (setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, &enable, sizeof(enable)) != 0) {
+    std::cout << "PacketDriver: Warning, could not enable drop counting - " << strerror(errno) << std::endl;
+  }
+
+  if (_config.busy_poll_us > 0) {
+    int busy_poll = _config.busy_poll_us;
+    if (setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &busy_poll, sizeof(busy_poll)) != 0) {
+      std::cout << "PacketDriver: Warning, could not enable busy polling - " << strerror(errno) << std::endl;
     }
   }
+}
 
-  std::cout << "PacketDriver: Success binding to Velodyne socket!" << std::endl;
-  return;
+bool PacketDriver::ConfigureReceiveThread()
+{
+  bool success = true;
+
+  if (_config.cpu_affinity >= 0) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(_config.cpu_affinity, &cpus);
+    int error = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    if (error != 0) {
+      std::cout << "PacketDriver: Warning, could not pin receive thread to cpu " << _config.cpu_affinity << " - " << strerror(error) << std::endl;
+      success = false;
+    }
+  }
+
+  if (_config.realtime_priority > 0) {
+    struct sched_param param;
+    param.sched_priority = _config.realtime_priority;
+    int error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (error != 0) {
+      std::cout << "PacketDriver: Warning, could not set SCHED_FIFO priority " << _config.realtime_priority << " - " << strerror(error) << std::endl;
+      success = false;
+    }
+  }
+
+  return(success);
 }
 
 bool PacketDriver::GetPacket(std::string* data, unsigned int* data_length)
 {
+  struct timespec timestamp;
+  return GetPacket(data, data_length, &timestamp);
+}
+
+bool PacketDriver::GetPacket(std::string* data, unsigned int* data_length, struct timespec* timestamp)
+{
+  if (!_owned_io_service) {
+    std::cout << "PacketDriver: Error, GetPacket would run the shared io_service - use StartReceive instead" << std::endl;
+    return(false);
+  }
+  if (!_socket) {
+    return(false);
+  }
+
   try {
-    _socket->async_receive(boost::asio::buffer(_rx_buffer, 1500),
-    boost::bind(&PacketDriver::GetPacketCallback, this, boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred, data, data_length));
-    _io_service.reset();
-    _io_service.run();
-    return (true);
+    _received = false;
+    _socket->async_wait(boost::asio::ip::udp::socket::wait_read,
+    boost::bind(&PacketDriver::ReceivePacketCallback, this, boost::asio::placeholders::error, data, data_length, timestamp));
+    _io_service->reset();
+    _io_service->run();
+    return (_received);
   } catch(std::exception & e) {
     std::cout << "PacketDriver: Error receiving packet - " << e.what() << "." << std::endl;
     return(false);
   }
 }
 
-void PacketDriver::GetPacketCallback(const boost::system::error_code& error, std::size_t num_bytes, std::string* data, unsigned int* data_length)
+void PacketDriver::ReceivePacketCallback(const boost::system::error_code& error, std::string* data, unsigned int* data_length, struct timespec* timestamp)
 {
+  if (error) {
+    return;
+  }
+
+  ssize_t num_bytes = ReadMessage(timestamp);
+  if (num_bytes < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+      // spurious wake up, keep waiting like a plain receive would
+      _socket->async_wait(boost::asio::ip::udp::socket::wait_read,
+      boost::bind(&PacketDriver::ReceivePacketCallback, this, boost::asio::placeholders::error, data, data_length, timestamp));
+    }
+    return;
+  }
+
   (*data).assign(_rx_buffer, num_bytes);
   *data_length = (unsigned int) num_bytes;
+  _received = true;
   return;
 }
 
+bool PacketDriver::StartReceive(const PacketDriver::PacketCallback& callback)
+{
+  if (!_socket) {
+    std::cout << "PacketDriver: Error, StartReceive called before InitPacketDriver" << std::endl;
+    return(false);
+  }
+  if (_receiving) {
+    _packet_callback = callback;
+    return(true);
+  }
+
+  _packet_callback = callback;
+  _receiving = true;
+  _socket->async_wait(boost::asio::ip::udp::socket::wait_read,
+  boost::bind(&PacketDriver::AsyncReceiveCallback, this, boost::asio::placeholders::error));
+  return(true);
+}
+
+void PacketDriver::StopReceive()
+{
+  if (!_receiving) {
+    return;
+  }
+  _receiving = false;
+  if (_socket) {
+    boost::system::error_code error;
+    _socket->cancel(error);
+  }
+}
+
+void PacketDriver::AsyncReceiveCallback(const boost::system::error_code& error)
+{
+  if (error || !_receiving) {
+    return;
+  }
+
+  // drain what is queued, but only up to a limit so other sockets on the reactor are not starved
+  struct timespec timestamp;
+  for (unsigned int i = 0; i < ASYNC_PACKETS_PER_WAKEUP && _receiving; i++) {
+    ssize_t num_bytes = ReadMessage(&timestamp);
+    if (num_bytes < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        std::cout << "PacketDriver: Error receiving packet - " << strerror(errno) << "." << std::endl;
+        _receiving = false;
+        return;
+      }
+      break;
+    }
+    _packet_callback(_rx_buffer, (unsigned int) num_bytes, timestamp);
+  }
+
+  if (_receiving) {
+    _socket->async_wait(boost::asio::ip::udp::socket::wait_read,
+    boost::bind(&PacketDriver::AsyncReceiveCallback, this, boost::asio::placeholders::error));
+  }
+}
+
+ssize_t PacketDriver::ReadMessage(struct timespec* timestamp)
+{
+  // recvmsg rather than asio's receive so the timestamp and drop counter control messages come along
+  struct iovec iov;
+  iov.iov_base = _rx_buffer;
+  iov.iov_len = sizeof(_rx_buffer);
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = _control_buffer;
+  msg.msg_controllen = sizeof(_control_buffer);
+
+  ssize_t num_bytes = recvmsg(_socket->native_handle(), &msg, MSG_DONTWAIT);
+  if (num_bytes < 0) {
+    return num_bytes;
+  }
+
+  bool stamped = false;
+  for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (cmsg->cmsg_level != SOL_SOCKET) {
+      continue;
+    }
+    if (cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+      memcpy(timestamp, CMSG_DATA(cmsg), sizeof(struct timespec));
+      stamped = true;
+    } else if (cmsg->cmsg_type == SO_RXQ_OVFL) {
+      uint32_t dropped;
+      memcpy(&dropped, CMSG_DATA(cmsg), sizeof(dropped));
+      _dropped_packets = dropped;
+    }
+  }
+  if (!stamped) {
+    clock_gettime(CLOCK_REALTIME, timestamp);
+  }
+  // from the kernel stamping the packet to us reading it out of the socket
+  HDL_TRACE_SINCE("socket receive", *timestamp, num_bytes);
+  return num_bytes;
+}
+
+unsigned int PacketDriver::GetNumberOfDroppedPackets()
+{
+  return _dropped_packets;
+}
+
+boost::asio::io_service& PacketDriver::GetIOService()
+{
+  return *_io_service;
+}
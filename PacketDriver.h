@@ -5,26 +5,77 @@
 #ifndef PACKET_DRIVER_H_INCLUDED
 #define PACKET_DRIVER_H_INCLUDED
 
+#include <time.h>
+#include <string>
 #include <boost/asio.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
 
 static unsigned int DATA_PORT = 2368;
 
+// socket and receive thread tuning - the defaults turn on kernel timestamps and drop counting (SO_RXQ_OVFL)
+// and change nothing else
+struct PacketDriverConfig
+{
+  PacketDriverConfig() : receive_buffer_size(0), kernel_timestamps(true), busy_poll_us(0), cpu_affinity(-1), realtime_priority(0), reuse_port(false) {}
+  int receive_buffer_size; // SO_RCVBUF in bytes, 0 keeps the system default (~4MB absorbs a second of HDL-64E)
+  bool kernel_timestamps;  // SO_TIMESTAMPNS, otherwise packets are stamped when GetPacket reads them
+  int busy_poll_us;        // SO_BUSY_POLL, 0 disables
+  int cpu_affinity;        // cpu to pin the receive thread to, -1 leaves it unpinned
+  int realtime_priority;   // SCHED_FIFO priority (1-99) for the receive thread, 0 leaves the scheduler alone
+  // SO_REUSEADDR and SO_REUSEPORT, so other processes with it set can bind the port too. Each of them gets every
+  // broadcast (the sensor's default) or multicast packet, but unicast packets go to just one - relay those.
+  bool reuse_port;
+  std::string multicast_group;     // joined and bound to, so only the group is received - e.g. a PacketRelay destination
+  std::string multicast_interface; // address of the interface to join on, empty lets the kernel pick
+};
+
+// receive buffer size, port sharing and multicast membership of config, for any socket receiving the sensor
+// stream (PacketDriver, PacketRelay) - set before binding
+bool ApplyReceiveSocketOptions(int fd, const PacketDriverConfig& config);
+
 class PacketDriver
 {
+public:
+  // data is only valid for the duration of the call
+  typedef boost::function<void (const char* data, unsigned int data_length, const struct timespec& timestamp)> PacketCallback;
+
 public:
   PacketDriver();
   PacketDriver(unsigned int port);
+  // shares io_service with other I/O - use StartReceive rather than GetPacket, and StopReceive then let the
+  // io_service run the cancelled handler (or stop it) before destroying the driver
+  PacketDriver(boost::asio::io_service& io_service);
   virtual ~PacketDriver();
   void InitPacketDriver(unsigned int port);
+  void InitPacketDriver(unsigned int port, const PacketDriverConfig& config);
+  // applies the config's cpu affinity and realtime priority to the calling thread - call it from the thread that
+  // will call GetPacket (or run the io_service), which need not be the one that initialised the driver
+  bool ConfigureReceiveThread();
   bool GetPacket(std::string* data, unsigned int* data_length);
+  bool GetPacket(std::string* data, unsigned int* data_length, struct timespec* timestamp);
+  unsigned int GetNumberOfDroppedPackets(); // kernel drop count as of the most recently received packet
+  bool StartReceive(const PacketCallback& callback);
+  void StopReceive();
+  boost::asio::io_service& GetIOService();
 
 protected:
-  void GetPacketCallback(const boost::system::error_code& error, std::size_t num_bytes, std::string* data, unsigned int* data_length);
+  void ApplySocketOptions();
+  void ReceivePacketCallback(const boost::system::error_code& error, std::string* data, unsigned int* data_length, struct timespec* timestamp);
+  void AsyncReceiveCallback(const boost::system::error_code& error);
+  ssize_t ReadMessage(struct timespec* timestamp);
 
 private:
   unsigned int _port;
+  PacketDriverConfig _config;
+  unsigned int _dropped_packets;
+  bool _received;
+  bool _receiving;
   char _rx_buffer[1500];
-  boost::asio::io_service _io_service;
+  char _control_buffer[256];
+  PacketCallback _packet_callback;
+  boost::asio::io_service* _io_service;
+  boost::shared_ptr<boost::asio::io_service> _owned_io_service;
   boost::shared_ptr<boost::asio::ip::udp::socket> _socket;
 };
 
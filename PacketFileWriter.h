@@ -138,6 +138,13 @@ public:
   }
 
   bool WritePacket(const unsigned char* data, unsigned int dataLength)
+  {
+    struct timeval currentTime;
+    gettimeofday(&currentTime, NULL);
+    return this->WritePacket(data, dataLength, currentTime);
+  }
+
+  bool WritePacket(const unsigned char* data, unsigned int dataLength, const struct timeval& timestamp)
   {
     if (!this->PCAPFile)
       {
@@ -149,9 +156,7 @@ public:
       return false;
       }
 
-    struct timeval currentTime;
-    gettimeofday(&currentTime, NULL);
-    this->PacketHeader.ts = currentTime;
+    this->PacketHeader.ts = timestamp;
 
     memcpy(this->PacketBuffer + 42, data, dataLength);
 
@@ -0,0 +1,297 @@
+// Velodyne HDL Packet Recorder
+// Nick Rypkema (rypkema@mit.edu), MIT 2017
+// shared library to keep the last seconds of raw packets in memory and dump them to pcap when triggered
+
+#include <iostream>
+#include <cstring>
+#include <vector>
+
+#include "PacketRecorder.h"
+#include "PacketFileWriter.h"
+#include <boost/bind.hpp>
+
+namespace
+{
+// a dump following the stream gives up once no packet has arrived for this long
+const double RECORDER_STALL_SECONDS = 1.0;
+const unsigned int RECORDER_POLL_MS = 2;
+
+double ToSeconds(const struct timespec& time)
+{
+  return time.tv_sec + time.tv_nsec/1e9;
+}
+
+double MonotonicSeconds()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return ToSeconds(now);
+}
+}
+
+PacketRecorder::PacketRecorder(double window_seconds, unsigned int packets_per_second)
+{
+  _window = window_seconds;
+  _num_slots = static_cast<unsigned int>(window_seconds*packets_per_second) + 1;
+  _slots.reset(new Slot[_num_slots]);
+  for (unsigned int i = 0; i < _num_slots; i++) {
+    _slots[i].sequence = 0;
+    _slots[i].length = 0;
+  }
+  _recorded = 0;
+  _rejected = 0;
+  _dumping = false;
+  _stop = false;
+  _thread.reset(new boost::thread(boost::bind(&PacketRecorder::DumpThread, this)));
+}
+
+PacketRecorder::~PacketRecorder()
+{
+  {
+    boost::mutex::scoped_lock lock(_mutex);
+    _stop = true;
+  }
+  _condition.notify_all();
+  _thread->join();
+}
+
+void PacketRecorder::Record(const char* data, unsigned int data_length, const struct timespec& timestamp)
+{
+  if (data_length > sizeof(_slots[0].data)) {
+    _rejected.fetch_add(1, boost::memory_order_relaxed);
+    return;
+  }
+
+  uint64_t index = _recorded.load(boost::memory_order_relaxed);
+  Slot& slot = _slots[index % _num_slots];
+  slot.sequence.store(2*index + 1, boost::memory_order_relaxed);
+  boost::atomic_thread_fence(boost::memory_order_release);
+  slot.timestamp = timestamp;
+  slot.length = data_length;
+  memcpy(slot.data, data, data_length);
+  slot.sequence.store(2*index + 2, boost::memory_order_release);
+  _recorded.store(index + 1, boost::memory_order_release);
+}
+
+bool PacketRecorder::ReadSlot(uint64_t index, char* data, unsigned int* length, struct timespec* timestamp)
+{
+  const Slot& slot = _slots[index % _num_slots];
+  uint64_t sequence = 2*index + 2;
+  if (slot.sequence.load(boost::memory_order_acquire) != sequence) {
+    return(false);
+  }
+  *timestamp = slot.timestamp;
+  *length = slot.length;
+  memcpy(data, slot.data, *length);
+  boost::atomic_thread_fence(boost::memory_order_acquire);
+  return (slot.sequence.load(boost::memory_order_relaxed) == sequence);
+}
+
+bool PacketRecorder::Trigger(const std::string& filename, double post_seconds)
+{
+  DumpRequest request;
+  request.filename = filename;
+  request.post_seconds = post_seconds;
+  request.window_written = false;
+  request.num_packets = 0;
+  request.num_lost = 0;
+  request.trigger_index = _recorded.load(boost::memory_order_acquire);
+  clock_gettime(CLOCK_REALTIME, &request.trigger_time);
+  if (request.trigger_index > 0) {
+    // only taken if the slot was not overwritten while it was read, else the wall clock stands in
+    char data[sizeof(_slots[0].data)];
+    unsigned int length;
+    struct timespec timestamp;
+    if (ReadSlot(request.trigger_index - 1, data, &length, &timestamp)) {
+      request.trigger_time = timestamp;
+    }
+  }
+
+  {
+    boost::mutex::scoped_lock lock(_mutex);
+    if (_requests.size() >= RECORDER_MAX_PENDING_DUMPS) {
+      std::cout << "PacketRecorder: Warning, too many pending dumps, not writing " << filename << std::endl;
+      return(false);
+    }
+    _requests.push_back(request);
+    _dumping = true;
+  }
+  _condition.notify_one();
+  return(true);
+}
+
+void PacketRecorder::SetDumpCallback(const DumpCallback& callback)
+{
+  boost::mutex::scoped_lock lock(_mutex);
+  _callback = callback;
+}
+
+bool PacketRecorder::IsDumping()
+{
+  return _dumping;
+}
+
+uint64_t PacketRecorder::GetNumberOfRecorded()
+{
+  return _recorded.load(boost::memory_order_relaxed);
+}
+
+uint64_t PacketRecorder::GetNumberOfRejected()
+{
+  return _rejected.load(boost::memory_order_relaxed);
+}
+
+void PacketRecorder::DumpThread()
+{
+  while (true) {
+    DumpRequest* request;
+    {
+      boost::mutex::scoped_lock lock(_mutex);
+      while (_requests.empty() && !_stop) {
+        _condition.wait(lock);
+      }
+      if (_stop) {
+        return;
+      }
+      // Trigger only pushes to the back, which leaves a reference to the front valid
+      request = &_requests.front();
+    }
+
+    Dump(request);
+
+    boost::mutex::scoped_lock lock(_mutex);
+    _requests.pop_front();
+    _dumping = !_requests.empty();
+  }
+}
+
+void PacketRecorder::WriteWindow(DumpRequest* request)
+{
+  request->window_written = true;
+  request->writer.reset(new vtkPacketFileWriter());
+  if (!request->writer->Open(request->filename)) {
+    std::cout << "PacketRecorder: Error, could not open " << request->filename << ": " << request->writer->GetLastError() << std::endl;
+    request->writer.reset();
+    return;
+  }
+
+  char data[sizeof(_slots[0].data)];
+  unsigned int length;
+  struct timespec timestamp;
+  struct timeval packet_time;
+  double trigger_time = ToSeconds(request->trigger_time);
+
+  // the oldest slots may be overwritten while we get to them
+  uint64_t index = (request->trigger_index > _num_slots) ? request->trigger_index - _num_slots : 0;
+  for (; index < request->trigger_index; index++) {
+    if (!ReadSlot(index, data, &length, &timestamp)) {
+      request->num_lost++;
+      continue;
+    }
+    if (ToSeconds(timestamp) < trigger_time - _window) {
+      continue;
+    }
+    packet_time.tv_sec = timestamp.tv_sec;
+    packet_time.tv_usec = timestamp.tv_nsec/1000;
+    if (request->writer->WritePacket(reinterpret_cast<const unsigned char*>(data), length, packet_time)) {
+      request->num_packets++;
+    }
+  }
+}
+
+void PacketRecorder::WritePendingWindows()
+{
+  std::vector<DumpRequest*> pending;
+  {
+    boost::mutex::scoped_lock lock(_mutex);
+    for (size_t i = 1; i < _requests.size(); i++) {
+      if (!_requests[i].window_written) {
+        pending.push_back(&_requests[i]);
+      }
+    }
+  }
+  // the dump thread is the only one to touch these fields, so the lock is not needed to write them
+  for (size_t i = 0; i < pending.size(); i++) {
+    WriteWindow(pending[i]);
+  }
+}
+
+void PacketRecorder::Dump(DumpRequest* request)
+{
+  if (!request->window_written) {
+    WriteWindow(request);
+  }
+  if (!request->writer) {
+    // still reported, so a caller waiting on the callback learns the trigger failed
+    NotifyDump(*request);
+    return;
+  }
+
+  char data[sizeof(_slots[0].data)];
+  unsigned int length;
+  struct timespec timestamp;
+  struct timeval packet_time;
+  double trigger_time = ToSeconds(request->trigger_time);
+
+  // follow the stream until post_seconds of packets have gone by
+  uint64_t index = request->trigger_index;
+  double last_arrival = MonotonicSeconds();
+  while (request->post_seconds > 0) {
+    {
+      boost::mutex::scoped_lock lock(_mutex);
+      if (_stop) {
+        break;
+      }
+    }
+    WritePendingWindows();
+    uint64_t recorded = _recorded.load(boost::memory_order_acquire);
+    if (index >= recorded) {
+      if (MonotonicSeconds() - last_arrival > RECORDER_STALL_SECONDS) {
+        break;
+      }
+      boost::this_thread::sleep(boost::posix_time::milliseconds(RECORDER_POLL_MS));
+      continue;
+    }
+    if (recorded - index > _num_slots) {
+      request->num_lost += recorded - _num_slots - index;
+      index = recorded - _num_slots;
+    }
+    last_arrival = MonotonicSeconds();
+    for (; index < recorded; index++) {
+      if (!ReadSlot(index, data, &length, &timestamp)) {
+        request->num_lost++;
+        continue;
+      }
+      if (ToSeconds(timestamp) > trigger_time + request->post_seconds) {
+        break;
+      }
+      packet_time.tv_sec = timestamp.tv_sec;
+      packet_time.tv_usec = timestamp.tv_nsec/1000;
+      if (request->writer->WritePacket(reinterpret_cast<const unsigned char*>(data), length, packet_time)) {
+        request->num_packets++;
+      }
+    }
+    if (index < recorded) {
+      break;
+    }
+  }
+  request->writer->Close();
+  request->writer.reset();
+
+  if (request->num_lost) {
+    std::cout << "PacketRecorder: Warning, " << request->num_lost << " packets were overwritten before they were written to " << request->filename << std::endl;
+  }
+  NotifyDump(*request);
+}
+
+void PacketRecorder::NotifyDump(const DumpRequest& request)
+{
+  DumpCallback callback;
+  {
+    boost::mutex::scoped_lock lock(_mutex);
+    callback = _callback;
+  }
+  if (callback) {
+    callback(request.filename, request.num_packets, request.num_lost);
+  }
+}
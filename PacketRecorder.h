@@ -0,0 +1,93 @@
+// Velodyne HDL Packet Recorder
+// Nick Rypkema (rypkema@mit.edu), MIT 2017
+// shared library to keep the last seconds of raw packets in memory and dump them to pcap when triggered
+
+#ifndef PACKET_RECORDER_H_INCLUDED
+#define PACKET_RECORDER_H_INCLUDED
+
+#include <deque>
+#include <string>
+#include <time.h>
+#include <stdint.h>
+#include <boost/atomic.hpp>
+#include <boost/function.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/thread.hpp>
+
+// an HDL-32E sends ~1808 packets a second, an HDL-64E ~3472
+static unsigned int RECORDER_PACKETS_PER_SECOND = 1808;
+static unsigned int RECORDER_MAX_PENDING_DUMPS = 8;
+
+class vtkPacketFileWriter;
+
+// Record is called from the receive thread only and never blocks or allocates - each packet is copied
+// into a preallocated slot guarded by a sequence number. Dumps run on the recorder's own thread, which
+// detects (and counts as lost) any slot the receive thread overwrote while it was being copied. While
+// one dump follows the stream, the windows before any triggers queued behind it are written out as they
+// arrive, so a queued dump only waits for its packets after the trigger.
+class PacketRecorder
+{
+public:
+  typedef boost::function<void (const std::string& filename, uint64_t num_packets, uint64_t num_lost)> DumpCallback;
+
+public:
+  PacketRecorder(double window_seconds = 30, unsigned int packets_per_second = RECORDER_PACKETS_PER_SECOND);
+  virtual ~PacketRecorder();
+  // same signature as PacketDriver::PacketCallback, so it can be bound straight to StartReceive or PacketSource::Run
+  void Record(const char* data, unsigned int data_length, const struct timespec& timestamp);
+  // writes the window before the most recent packet, then keeps following the stream for post_seconds more,
+  // to filename in the background - returns false if too many dumps are already pending
+  bool Trigger(const std::string& filename, double post_seconds = 0);
+  // called from the dump thread once each dump is done - also when filename could not be opened, with no packets
+  void SetDumpCallback(const DumpCallback& callback);
+  bool IsDumping();
+  uint64_t GetNumberOfRecorded();
+  uint64_t GetNumberOfRejected(); // packets too large for a slot
+
+protected:
+  struct Slot
+  {
+    boost::atomic<uint64_t> sequence; // 2*index + 1 while packet index is written, 2*index + 2 once complete
+    struct timespec timestamp;
+    unsigned int length;
+    char data[1206];
+  };
+
+  struct DumpRequest
+  {
+    std::string filename;
+    uint64_t trigger_index;        // packets recorded when triggered
+    struct timespec trigger_time;  // receive time of the newest of them
+    double post_seconds;
+    boost::shared_ptr<vtkPacketFileWriter> writer; // NULL if filename could not be opened
+    bool window_written;
+    uint64_t num_packets;
+    uint64_t num_lost;
+  };
+
+  void DumpThread();
+  void Dump(DumpRequest* request);
+  void WriteWindow(DumpRequest* request);
+  void WritePendingWindows();
+  void NotifyDump(const DumpRequest& request);
+  bool ReadSlot(uint64_t index, char* data, unsigned int* length, struct timespec* timestamp);
+
+private:
+  double _window;
+  unsigned int _num_slots;
+  boost::scoped_array<Slot> _slots;
+  boost::atomic<uint64_t> _recorded;
+  boost::atomic<uint64_t> _rejected;
+  boost::atomic<bool> _dumping;
+  bool _stop;
+  std::deque<DumpRequest> _requests; // the front one is being dumped, only the dump thread pops
+  DumpCallback _callback;
+  boost::mutex _mutex; // guards _requests, _callback and _stop, never taken by Record
+  boost::condition_variable _condition;
+  boost::shared_ptr<boost::thread> _thread;
+};
+
+#endif // PACKET_RECORDER_H_INCLUDED
@@ -0,0 +1,308 @@
+// Velodyne HDL Packet Relay
+// Nick Rypkema (rypkema@mit.edu), MIT 2017
+// shared library to receive Velodyne packets once and republish them to local unicast or multicast destinations
+
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include "PacketRelay.h"
+
+namespace
+{
+const unsigned int RELAY_SLOT_SIZE = 1500;
+// how often Run checks for Stop while no packets arrive
+const int RELAY_POLL_TIMEOUT_MS = 100;
+}
+
+PacketRelay::PacketRelay()
+{
+  _receive_fd = -1;
+  _send_fd = -1;
+  _multicast_ttl = 1;
+  _multicast_interface.s_addr = htonl(INADDR_ANY);
+  _buffers.resize(PACKET_RELAY_BATCH*RELAY_SLOT_SIZE);
+  _lengths.resize(PACKET_RELAY_BATCH);
+  _num_queued = 0;
+  _running = false;
+  _num_received = 0;
+  _num_sent = 0;
+  _num_send_errors = 0;
+}
+
+PacketRelay::~PacketRelay()
+{
+  Close();
+  if (_send_fd >= 0) {
+    close(_send_fd);
+  }
+}
+
+bool PacketRelay::AddDestination(const std::string& address, unsigned int port)
+{
+  struct sockaddr_in destination;
+  memset(&destination, 0, sizeof(destination));
+  destination.sin_family = AF_INET;
+  destination.sin_port = htons(port);
+  if (inet_pton(AF_INET, address.c_str(), &destination.sin_addr) != 1) {
+    std::cout << "PacketRelay: Error, invalid destination address " << address << std::endl;
+    return(false);
+  }
+  _destinations.push_back(destination);
+  return(true);
+}
+
+void PacketRelay::ClearDestinations()
+{
+  _destinations.clear();
+}
+
+unsigned int PacketRelay::GetNumberOfDestinations()
+{
+  return _destinations.size();
+}
+
+void PacketRelay::SetMulticastTTL(int ttl)
+{
+  _multicast_ttl = ttl;
+  if (_send_fd >= 0) {
+    setsockopt(_send_fd, IPPROTO_IP, IP_MULTICAST_TTL, &_multicast_ttl, sizeof(_multicast_ttl));
+  }
+}
+
+bool PacketRelay::SetMulticastInterface(const std::string& address)
+{
+  if (inet_pton(AF_INET, address.c_str(), &_multicast_interface) != 1) {
+    std::cout << "PacketRelay: Error, invalid multicast interface address " << address << std::endl;
+    _multicast_interface.s_addr = htonl(INADDR_ANY);
+    return(false);
+  }
+  if (_send_fd >= 0) {
+    setsockopt(_send_fd, IPPROTO_IP, IP_MULTICAST_IF, &_multicast_interface, sizeof(_multicast_interface));
+  }
+  return(true);
+}
+
+bool PacketRelay::Open(unsigned int port, const PacketDriverConfig& config)
+{
+  Close();
+
+  _receive_fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (_receive_fd < 0) {
+    std::cout << "PacketRelay: Error creating socket - " << strerror(errno) << std::endl;
+    return(false);
+  }
+  ApplyReceiveSocketOptions(_receive_fd, config);
+
+  struct sockaddr_in local;
+  memset(&local, 0, sizeof(local));
+  local.sin_family = AF_INET;
+  local.sin_port = htons(port);
+  local.sin_addr.s_addr = htonl(INADDR_ANY);
+  // like PacketDriver, bound to the group when relaying a multicast stream
+  if (config.multicast_group.length() && inet_pton(AF_INET, config.multicast_group.c_str(), &local.sin_addr) != 1) {
+    std::cout << "PacketRelay: Error, invalid multicast group " << config.multicast_group << std::endl;
+    Close();
+    return(false);
+  }
+  if (bind(_receive_fd, reinterpret_cast<struct sockaddr*>(&local), sizeof(local)) != 0) {
+    std::cout << "PacketRelay: Error binding to port " << port << " - " << strerror(errno) << std::endl;
+    Close();
+    return(false);
+  }
+
+  std::cout << "PacketRelay: Success binding to port " << port << std::endl;
+  return(true);
+}
+
+void PacketRelay::Close()
+{
+  if (_receive_fd >= 0) {
+    close(_receive_fd);
+    _receive_fd = -1;
+  }
+}
+
+bool PacketRelay::OpenSendSocket()
+{
+  if (_send_fd >= 0) {
+    return(true);
+  }
+  _send_fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (_send_fd < 0) {
+    std::cout << "PacketRelay: Error creating send socket - " << strerror(errno) << std::endl;
+    return(false);
+  }
+  int enable = 1;
+  // relaying to the broadcast address, as the sensor itself does, needs permission
+  setsockopt(_send_fd, SOL_SOCKET, SO_BROADCAST, &enable, sizeof(enable));
+  setsockopt(_send_fd, IPPROTO_IP, IP_MULTICAST_TTL, &_multicast_ttl, sizeof(_multicast_ttl));
+  setsockopt(_send_fd, IPPROTO_IP, IP_MULTICAST_IF, &_multicast_interface, sizeof(_multicast_interface));
+  return(true);
+}
+
+bool PacketRelay::Run()
+{
+  if (_receive_fd < 0) {
+    std::cout << "PacketRelay: Error, Run called before Open" << std::endl;
+    return(false);
+  }
+  // Run and Relay share the batch, so only one of them may be filling it - anything Relay left queued goes first
+  Flush();
+  bool expected = false;
+  if (!_running.compare_exchange_strong(expected, true)) {
+    std::cout << "PacketRelay: Error, Run called while already running" << std::endl;
+    return(false);
+  }
+  if (!OpenSendSocket()) {
+    _running = false;
+    return(false);
+  }
+
+  std::vector<struct iovec> iovecs(PACKET_RELAY_BATCH);
+  std::vector<struct mmsghdr> messages(PACKET_RELAY_BATCH);
+  memset(&messages[0], 0, messages.size()*sizeof(struct mmsghdr));
+  for (unsigned int i = 0; i < PACKET_RELAY_BATCH; i++) {
+    iovecs[i].iov_base = &_buffers[i*RELAY_SLOT_SIZE];
+    iovecs[i].iov_len = RELAY_SLOT_SIZE;
+    messages[i].msg_hdr.msg_iov = &iovecs[i];
+    messages[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  while (_running) {
+    struct pollfd descriptor;
+    descriptor.fd = _receive_fd;
+    descriptor.events = POLLIN;
+    descriptor.revents = 0;
+    int ready = poll(&descriptor, 1, RELAY_POLL_TIMEOUT_MS);
+    if (ready <= 0) {
+      if (ready < 0 && errno != EINTR) {
+        std::cout << "PacketRelay: Error waiting for packets - " << strerror(errno) << std::endl;
+        _running = false;
+        return(false);
+      }
+      continue;
+    }
+
+    // everything queued so far, up to a batch, without waiting for more
+    int num_packets = recvmmsg(_receive_fd, &messages[0], PACKET_RELAY_BATCH, MSG_DONTWAIT, NULL);
+    if (num_packets < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+        continue;
+      }
+      std::cout << "PacketRelay: Error receiving packets - " << strerror(errno) << std::endl;
+      _running = false;
+      return(false);
+    }
+    for (int i = 0; i < num_packets; i++) {
+      _lengths[i] = messages[i].msg_len;
+    }
+    _num_received += num_packets;
+    SendBatch(num_packets);
+  }
+  return(true);
+}
+
+void PacketRelay::Stop()
+{
+  _running = false;
+}
+
+bool PacketRelay::Relay(const char* data, unsigned int data_length)
+{
+  if (_running) {
+    std::cout << "PacketRelay: Warning, Relay called while Run is relaying" << std::endl;
+    return(false);
+  }
+  if (data_length > RELAY_SLOT_SIZE) {
+    std::cout << "PacketRelay: Warning, packet of " << data_length << " bytes is too large to relay" << std::endl;
+    return(false);
+  }
+  memcpy(&_buffers[_num_queued*RELAY_SLOT_SIZE], data, data_length);
+  _lengths[_num_queued] = data_length;
+  _num_queued++;
+  _num_received++;
+  if (_num_queued == PACKET_RELAY_BATCH) {
+    return Flush();
+  }
+  return(true);
+}
+
+bool PacketRelay::Flush()
+{
+  if (!_num_queued) {
+    return(true);
+  }
+  if (_running) {
+    std::cout << "PacketRelay: Warning, Flush called while Run is relaying" << std::endl;
+    return(false);
+  }
+  if (!OpenSendSocket()) {
+    return(false);
+  }
+  bool success = SendBatch(_num_queued);
+  _num_queued = 0;
+  return(success);
+}
+
+bool PacketRelay::SendBatch(unsigned int num_packets)
+{
+  // packet by packet, each to every destination, so no destination runs a batch behind the others
+  unsigned int num_messages = num_packets*_destinations.size();
+  if (!num_messages) {
+    return(true);
+  }
+  _iovecs.resize(num_messages);
+  _messages.resize(num_messages);
+  memset(&_messages[0], 0, num_messages*sizeof(struct mmsghdr));
+  for (unsigned int i = 0; i < num_packets; i++) {
+    for (unsigned int d = 0; d < _destinations.size(); d++) {
+      unsigned int m = i*_destinations.size() + d;
+      _iovecs[m].iov_base = &_buffers[i*RELAY_SLOT_SIZE];
+      _iovecs[m].iov_len = _lengths[i];
+      _messages[m].msg_hdr.msg_name = &_destinations[d];
+      _messages[m].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+      _messages[m].msg_hdr.msg_iov = &_iovecs[m];
+      _messages[m].msg_hdr.msg_iovlen = 1;
+    }
+  }
+
+  unsigned int num_sent = 0;
+  unsigned int num_errors = 0;
+  while (num_sent + num_errors < num_messages) {
+    int sent = sendmmsg(_send_fd, &_messages[num_sent + num_errors], num_messages - num_sent - num_errors, 0);
+    if (sent < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      // sendmmsg stops at the first message that fails, skip it and carry on with the rest
+      if (!_num_send_errors) {
+        std::cout << "PacketRelay: Warning, could not send packet - " << strerror(errno) << std::endl;
+      }
+      num_errors++;
+      _num_send_errors++;
+      continue;
+    }
+    num_sent += sent;
+  }
+  _num_sent += num_sent;
+  return(num_errors == 0);
+}
+
+uint64_t PacketRelay::GetNumberOfReceived()
+{
+  return _num_received;
+}
+
+uint64_t PacketRelay::GetNumberOfSent()
+{
+  return _num_sent;
+}
+
+uint64_t PacketRelay::GetNumberOfSendErrors()
+{
+  return _num_send_errors;
+}
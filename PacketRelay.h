@@ -0,0 +1,71 @@
+// Velodyne HDL Packet Relay
+// Nick Rypkema (rypkema@mit.edu), MIT 2017
+// shared library to receive Velodyne packets once and republish them to local unicast or multicast destinations
+
+#ifndef PACKET_RELAY_H_INCLUDED
+#define PACKET_RELAY_H_INCLUDED
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <boost/atomic.hpp>
+#include "PacketDriver.h"
+
+// packets taken per recvmmsg, then sent on to every destination by one sendmmsg
+static unsigned int PACKET_RELAY_BATCH = 64;
+
+// Run receives whatever has arrived with one recvmmsg and forwards all of it to every destination with one
+// sendmmsg, so a burst costs two system calls rather than two per packet per destination and nothing waits
+// for a batch to fill. Packets received elsewhere can be fed to Relay instead. Send to a port no consumer
+// shares with the relay (or to a multicast group the relay has not joined), or packets come straight back.
+class PacketRelay
+{
+public:
+  PacketRelay();
+  virtual ~PacketRelay();
+  bool AddDestination(const std::string& address, unsigned int port = DATA_PORT); // unicast, broadcast or multicast
+  void ClearDestinations();
+  unsigned int GetNumberOfDestinations();
+  void SetMulticastTTL(int ttl);                          // 1 by default, so relayed packets stay on the local network
+  bool SetMulticastInterface(const std::string& address); // outgoing interface for multicast, otherwise the routing table's
+
+  // binds the receive socket with config's receive buffer, port sharing and multicast membership
+  bool Open(unsigned int port = DATA_PORT, const PacketDriverConfig& config = PacketDriverConfig());
+  void Close();
+  bool Run();  // relays until Stop (from another thread) or a receive error
+  void Stop();
+
+  // queues a packet received elsewhere, sent once PACKET_RELAY_BATCH are queued or on Flush - for a relay that
+  // is not Run, as the two share the batch: both refuse while Run is relaying, so start Run from the thread that
+  // calls Relay or only once it has stopped
+  bool Relay(const char* data, unsigned int data_length);
+  bool Flush();
+
+  uint64_t GetNumberOfReceived(); // packets received by Run or queued by Relay
+  uint64_t GetNumberOfSent();     // datagrams sent, a packet to each destination
+  uint64_t GetNumberOfSendErrors();
+
+protected:
+  bool OpenSendSocket();
+  bool SendBatch(unsigned int num_packets);
+
+private:
+  int _receive_fd;
+  int _send_fd;
+  int _multicast_ttl;
+  struct in_addr _multicast_interface;
+  std::vector<struct sockaddr_in> _destinations;
+  std::vector<char> _buffers;             // PACKET_RELAY_BATCH slots of 1500 bytes
+  std::vector<unsigned int> _lengths;
+  std::vector<struct iovec> _iovecs;
+  std::vector<struct mmsghdr> _messages;
+  unsigned int _num_queued;
+  boost::atomic<bool> _running;
+  boost::atomic<uint64_t> _num_received;
+  boost::atomic<uint64_t> _num_sent;
+  boost::atomic<uint64_t> _num_send_errors;
+};
+
+#endif // PACKET_RELAY_H_INCLUDED
@@ -0,0 +1,279 @@
+// Velodyne HDL Packet Ring Driver
+// Nick Rypkema (rypkema@mit.edu), MIT 2017
+// shared library to read Velodyne HDL packets straight out of a memory mapped AF_PACKET TPACKET_V3 ring (linux only)
+
+#include <cstring>
+#include <cerrno>
+#include <iostream>
+#include <poll.h>
+#include <unistd.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <linux/filter.h>
+
+#include "PacketRingDriver.h"
+#include "LatencyTrace.h"
+
+namespace
+{
+// ethernet (14) + ipv4 without options (20) + udp (8), the same 42 bytes vtkPacketFileReader skips
+const unsigned int ETHERNET_HEADER_SIZE = 14;
+const unsigned int UDP_HEADER_SIZE = 8;
+}
+
+PacketRingDriver::PacketRingDriver()
+{
+  _port = 0;
+  _fd = -1;
+  _ring = NULL;
+  _ring_size = 0;
+  _block_size = 0;
+  _block_nr = 0;
+  _block_index = 0;
+  _current_block = NULL;
+  _next_packet = NULL;
+  _packets_left = 0;
+}
+
+PacketRingDriver::~PacketRingDriver()
+{
+  Close();
+}
+
+bool PacketRingDriver::InitPacketRingDriver(const std::string& interface, unsigned int port)
+{
+  Close();
+  _interface = interface;
+  _port = port;
+
+  // protocol 0 receives nothing until bind, so no packet reaches the ring before the filter is attached
+  _fd = socket(AF_PACKET, SOCK_RAW, 0);
+  if (_fd < 0) {
+    _last_error = std::string("socket failed (needs CAP_NET_RAW) - ") + strerror(errno);
+    std::cout << "PacketRingDriver: Error opening packet socket - " << _last_error << std::endl;
+    return(false);
+  }
+
+  int version = TPACKET_V3;
+  if (setsockopt(_fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) != 0) {
+    _last_error = std::string("TPACKET_V3 not supported - ") + strerror(errno);
+    std::cout << "PacketRingDriver: Error - " << _last_error << std::endl;
+    Close();
+    return(false);
+  }
+
+  _block_size = RING_BLOCK_SIZE;
+  _block_nr = RING_BLOCK_NR;
+  struct tpacket_req3 req;
+  memset(&req, 0, sizeof(req));
+  req.tp_block_size = _block_size;
+  req.tp_block_nr = _block_nr;
+  req.tp_frame_size = 2048;
+  req.tp_frame_nr = (_block_size * _block_nr) / req.tp_frame_size;
+  req.tp_retire_blk_tov = RING_BLOCK_TIMEOUT_MS;
+  if (setsockopt(_fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) != 0) {
+    _last_error = std::string("PACKET_RX_RING failed - ") + strerror(errno);
+    std::cout << "PacketRingDriver: Error - " << _last_error << std::endl;
+    Close();
+    return(false);
+  }
+
+  _ring_size = static_cast<size_t>(_block_size) * _block_nr;
+  void* ring = mmap(NULL, _ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED, _fd, 0);
+  if (ring == MAP_FAILED) {
+    // MAP_LOCKED needs RLIMIT_MEMLOCK headroom, fall back to a pageable ring
+    ring = mmap(NULL, _ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+  }
+  if (ring == MAP_FAILED) {
+    _last_error = std::string("mmap failed - ") + strerror(errno);
+    std::cout << "PacketRingDriver: Error - " << _last_error << std::endl;
+    _ring_size = 0;
+    Close();
+    return(false);
+  }
+  _ring = static_cast<unsigned char*>(ring);
+
+  if (!AttachPortFilter(port)) {
+    std::cout << "PacketRingDriver: Error - " << _last_error << std::endl;
+    Close();
+    return(false);
+  }
+
+  struct sockaddr_ll address;
+  memset(&address, 0, sizeof(address));
+  address.sll_family = AF_PACKET;
+  address.sll_protocol = htons(ETH_P_IP);
+  address.sll_ifindex = interface.length() ? if_nametoindex(interface.c_str()) : 0;
+  if (interface.length() && address.sll_ifindex == 0) {
+    _last_error = "unknown interface " + interface;
+    std::cout << "PacketRingDriver: Error - " << _last_error << std::endl;
+    Close();
+    return(false);
+  }
+  if (bind(_fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0) {
+    _last_error = std::string("bind failed - ") + strerror(errno);
+    std::cout << "PacketRingDriver: Error - " << _last_error << std::endl;
+    Close();
+    return(false);
+  }
+
+  std::cout << "PacketRingDriver: Success opening packet ring on " << (interface.length() ? interface : "all interfaces") << ", port " << port << std::endl;
+  return(true);
+}
+
+bool PacketRingDriver::AttachPortFilter(unsigned int port)
+{
+  // equivalent of "ip and udp dst port <port> and not ip fragment", as generated by tcpdump -dd
+  struct sock_filter code[] = {
+    { 0x28, 0, 0, 0x0000000c },  // ldh [12]
+    { 0x15, 0, 8, 0x00000800 },  // jeq #ETH_P_IP, else reject
+    { 0x30, 0, 0, 0x00000017 },  // ldb [23]
+    { 0x15, 0, 6, 0x00000011 },  // jeq #IPPROTO_UDP, else reject
+    { 0x28, 0, 0, 0x00000014 },  // ldh [20]
+    { 0x45, 4, 0, 0x00001fff },  // jset #0x1fff (fragment offset), reject
+    { 0xb1, 0, 0, 0x0000000e },  // ldxb 4*([14]&0xf)
+    { 0x48, 0, 0, 0x00000010 },  // ldh [x + 16]
+    { 0x15, 0, 1, port },        // jeq #port, else reject
+    { 0x06, 0, 0, 0x00040000 },  // accept
+    { 0x06, 0, 0, 0x00000000 },  // reject
+  };
+  struct sock_fprog filter;
+  filter.len = sizeof(code) / sizeof(code[0]);
+  filter.filter = code;
+  if (setsockopt(_fd, SOL_SOCKET, SO_ATTACH_FILTER, &filter, sizeof(filter)) != 0) {
+    _last_error = std::string("SO_ATTACH_FILTER failed - ") + strerror(errno);
+    return(false);
+  }
+  return(true);
+}
+
+void PacketRingDriver::Close()
+{
+  _current_block = NULL;
+  _next_packet = NULL;
+  _packets_left = 0;
+  _block_index = 0;
+  if (_ring) {
+    munmap(_ring, _ring_size);
+    _ring = NULL;
+    _ring_size = 0;
+  }
+  if (_fd >= 0) {
+    close(_fd);
+    _fd = -1;
+  }
+}
+
+const std::string& PacketRingDriver::GetLastError()
+{
+  return _last_error;
+}
+
+void PacketRingDriver::ReleaseBlock()
+{
+  struct tpacket_block_desc* block = reinterpret_cast<struct tpacket_block_desc*>(_current_block);
+  __sync_synchronize();
+  block->hdr.bh1.block_status = TP_STATUS_KERNEL;
+  _block_index = (_block_index + 1) % _block_nr;
+  _current_block = NULL;
+  _next_packet = NULL;
+  _packets_left = 0;
+}
+
+bool PacketRingDriver::ParsePacket(const unsigned char* frame, PacketRingDriver::PacketView* view)
+{
+  const struct tpacket3_hdr* header = reinterpret_cast<const struct tpacket3_hdr*>(frame);
+  const unsigned char* ethernet = frame + header->tp_mac;
+  unsigned int captured = header->tp_snaplen;
+
+  if (captured < ETHERNET_HEADER_SIZE + 20 + UDP_HEADER_SIZE) {
+    return(false);
+  }
+  const unsigned char* ip = ethernet + ETHERNET_HEADER_SIZE;
+  unsigned int ip_header_size = (ip[0] & 0x0f) * 4;
+  if (ip_header_size < 20 || captured < ETHERNET_HEADER_SIZE + ip_header_size + UDP_HEADER_SIZE) {
+    return(false);
+  }
+  const unsigned char* udp = ip + ip_header_size;
+  unsigned int udp_length = (udp[4] << 8) | udp[5];
+  unsigned int available = captured - ETHERNET_HEADER_SIZE - ip_header_size;
+  if (udp_length < UDP_HEADER_SIZE || udp_length > available) {
+    return(false);
+  }
+
+  view->data = reinterpret_cast<const char*>(udp + UDP_HEADER_SIZE);
+  view->length = udp_length - UDP_HEADER_SIZE;
+  view->source_address = (ip[12] << 24) | (ip[13] << 16) | (ip[14] << 8) | ip[15];
+  view->source_port = (udp[0] << 8) | udp[1];
+  view->timestamp_sec = header->tp_sec;
+  view->timestamp_nsec = header->tp_nsec;
+#ifdef HDL_TRACE_ENABLED
+  // from the kernel queueing the packet into the ring to us dequeuing it
+  struct timespec enqueued;
+  enqueued.tv_sec = header->tp_sec;
+  enqueued.tv_nsec = header->tp_nsec;
+  HDL_TRACE_SINCE("ring dequeue", enqueued, view->length);
+#endif
+  return(true);
+}
+
+bool PacketRingDriver::GetPacketView(PacketRingDriver::PacketView* view, int timeout_ms)
+{
+  if (!_ring) {
+    return(false);
+  }
+
+  while (true) {
+    while (_packets_left > 0) {
+      const unsigned char* frame = _next_packet;
+      const struct tpacket3_hdr* header = reinterpret_cast<const struct tpacket3_hdr*>(frame);
+      _next_packet += header->tp_next_offset;
+      _packets_left--;
+      if (ParsePacket(frame, view)) {
+        return(true);
+      }
+    }
+
+    // the previous block's views are invalid from here on
+    if (_current_block) {
+      ReleaseBlock();
+    }
+
+    struct tpacket_block_desc* block = reinterpret_cast<struct tpacket_block_desc*>(_ring + static_cast<size_t>(_block_index) * _block_size);
+    __sync_synchronize();
+    if (!(block->hdr.bh1.block_status & TP_STATUS_USER)) {
+      struct pollfd pfd;
+      pfd.fd = _fd;
+      pfd.events = POLLIN | POLLERR;
+      pfd.revents = 0;
+      int ready = poll(&pfd, 1, timeout_ms);
+      if (ready < 0 && errno != EINTR) {
+        _last_error = std::string("poll failed - ") + strerror(errno);
+        return(false);
+      }
+      if (ready == 0) {
+        return(false);
+      }
+      continue;
+    }
+
+    _current_block = reinterpret_cast<unsigned char*>(block);
+    _next_packet = _current_block + block->hdr.bh1.offset_to_first_pkt;
+    _packets_left = block->hdr.bh1.num_pkts;
+  }
+}
+
+bool PacketRingDriver::GetPacket(std::string* data, unsigned int* data_length)
+{
+  PacketView view;
+  if (!GetPacketView(&view)) {
+    return(false);
+  }
+  data->assign(view.data, view.length);
+  *data_length = view.length;
+  return(true);
+}
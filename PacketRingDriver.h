@@ -0,0 +1,59 @@
+// Velodyne HDL Packet Ring Driver
+// Nick Rypkema (rypkema@mit.edu), MIT 2017
+// shared library to read Velodyne HDL packets straight out of a memory mapped AF_PACKET TPACKET_V3 ring (linux only)
+
+#ifndef PACKET_RING_DRIVER_H_INCLUDED
+#define PACKET_RING_DRIVER_H_INCLUDED
+
+#include <string>
+#include <stdint.h>
+
+// 16 x 1MB blocks hold ~13000 packets, about 7 seconds of a single HDL-32E
+static unsigned int RING_BLOCK_SIZE = 1 << 20;
+static unsigned int RING_BLOCK_NR = 16;
+static unsigned int RING_BLOCK_TIMEOUT_MS = 10;
+
+class PacketRingDriver
+{
+public:
+  // points straight into the ring - only valid until the next call to GetPacketView/GetPacket
+  struct PacketView
+  {
+    const char* data;
+    unsigned int length;
+    uint32_t source_address; // host byte order
+    unsigned short source_port;
+    unsigned int timestamp_sec;
+    unsigned int timestamp_nsec;
+  };
+
+public:
+  PacketRingDriver();
+  virtual ~PacketRingDriver();
+  bool InitPacketRingDriver(const std::string& interface, unsigned int port);
+  bool GetPacketView(PacketView* view, int timeout_ms = -1);
+  bool GetPacket(std::string* data, unsigned int* data_length);
+  void Close();
+  const std::string& GetLastError();
+
+protected:
+  bool AttachPortFilter(unsigned int port);
+  void ReleaseBlock();
+  bool ParsePacket(const unsigned char* frame, PacketView* view);
+
+private:
+  std::string _interface;
+  std::string _last_error;
+  unsigned int _port;
+  int _fd;
+  unsigned char* _ring;
+  size_t _ring_size;
+  unsigned int _block_size;
+  unsigned int _block_nr;
+  unsigned int _block_index;
+  unsigned char* _current_block;
+  unsigned char* _next_packet;
+  unsigned int _packets_left;
+};
+
+#endif // PACKET_RING_DRIVER_H_INCLUDED
@@ -0,0 +1,315 @@
+// Velodyne HDL Packet Source
+// Nick Rypkema (rypkema@mit.edu), MIT 2017
+// shared library to read Velodyne packets from UDP, a pcap file or memory through one interface, with a packet driven clock
+
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <arpa/inet.h>
+
+#include "PacketSource.h"
+#include "PacketFileReader.h"
+
+namespace
+{
+// ethernet (14) + ipv4 (20) + udp (8) headers, as PacketFileReader assumes
+const unsigned int PCAP_HEADER_BYTES = 42;
+const unsigned int PCAP_UDP_DEST_PORT_OFFSET = 36;
+
+int64_t ToNanoseconds(const struct timespec& time)
+{
+  return static_cast<int64_t>(time.tv_sec)*1000000000LL + time.tv_nsec;
+}
+
+struct timespec FromNanoseconds(int64_t ns)
+{
+  struct timespec time;
+  time.tv_sec = ns/1000000000LL;
+  time.tv_nsec = ns%1000000000LL;
+  return time;
+}
+
+int64_t MonotonicNanoseconds()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return ToNanoseconds(now);
+}
+}
+
+PacketClock::PacketClock(bool is_virtual)
+{
+  _virtual = is_virtual;
+  _now = 0;
+}
+
+bool PacketClock::IsVirtual()
+{
+  return _virtual;
+}
+
+struct timespec PacketClock::Now()
+{
+  if (!_virtual) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return now;
+  }
+  return FromNanoseconds(_now.load(boost::memory_order_acquire));
+}
+
+double PacketClock::GetSeconds()
+{
+  struct timespec now = Now();
+  return now.tv_sec + now.tv_nsec/1e9;
+}
+
+void PacketClock::Advance(const struct timespec& time)
+{
+  int64_t ns = ToNanoseconds(time);
+  if (_virtual && ns > _now.load(boost::memory_order_relaxed)) {
+    _now.store(ns, boost::memory_order_release);
+  }
+}
+
+void PacketClock::Reset()
+{
+  _now = 0;
+}
+
+PacketSource::PacketSource(bool is_virtual) : _clock(is_virtual)
+{
+  _speed = 0;
+  _stop = false;
+  ResetPacing();
+}
+
+PacketSource::~PacketSource()
+{
+}
+
+bool PacketSource::GetPacket(std::string* data, unsigned int* data_length)
+{
+  struct timespec timestamp;
+  return GetPacket(data, data_length, &timestamp);
+}
+
+bool PacketSource::GetPacket(std::string* data, unsigned int* data_length, struct timespec* timestamp)
+{
+  const char* packet = NULL;
+  if (!NextPacket(&packet, data_length, timestamp)) {
+    return(false);
+  }
+  data->assign(packet, *data_length);
+  return(true);
+}
+
+uint64_t PacketSource::Run(const PacketCallback& callback, uint64_t max_packets)
+{
+  _stop = false;
+  uint64_t num_packets = 0;
+  const char* data = NULL;
+  unsigned int data_length = 0;
+  struct timespec timestamp;
+  while (!_stop && (max_packets == 0 || num_packets < max_packets) && NextPacket(&data, &data_length, &timestamp)) {
+    callback(data, data_length, timestamp);
+    num_packets++;
+  }
+  return num_packets;
+}
+
+void PacketSource::Stop()
+{
+  _stop = true;
+}
+
+void PacketSource::SetReplaySpeed(double speed)
+{
+  _speed = (speed > 0) ? speed : 0;
+  ResetPacing();
+}
+
+PacketClock& PacketSource::GetClock()
+{
+  return _clock;
+}
+
+void PacketSource::Deliver(const struct timespec& timestamp)
+{
+  if (_speed > 0) {
+    int64_t ns = ToNanoseconds(timestamp);
+    if (!_paced) {
+      _pace_start = MonotonicNanoseconds();
+      _pace_first = ns;
+      _paced = true;
+    }
+    struct timespec due = FromNanoseconds(_pace_start + static_cast<int64_t>((ns - _pace_first)/_speed));
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due, NULL) == EINTR) {
+    }
+  }
+  _clock.Advance(timestamp);
+}
+
+void PacketSource::ResetPacing()
+{
+  _paced = false;
+  _pace_start = 0;
+  _pace_first = 0;
+}
+
+UdpPacketSource::UdpPacketSource(unsigned int port, const PacketDriverConfig& config) : PacketSource(false)
+{
+  _driver.InitPacketDriver(port, config);
+}
+
+UdpPacketSource::~UdpPacketSource()
+{
+}
+
+bool UdpPacketSource::NextPacket(const char** data, unsigned int* data_length, struct timespec* timestamp)
+{
+  if (!_driver.GetPacket(&_buffer, data_length, timestamp)) {
+    return(false);
+  }
+  *data = _buffer.data();
+  return(true);
+}
+
+PacketDriver& UdpPacketSource::GetDriver()
+{
+  return _driver;
+}
+
+PcapPacketSource::PcapPacketSource() : PacketSource(true)
+{
+  _port = DATA_PORT;
+}
+
+PcapPacketSource::PcapPacketSource(const std::string& filename, unsigned int port) : PacketSource(true)
+{
+  _port = port;
+  Open(filename, port);
+}
+
+PcapPacketSource::~PcapPacketSource()
+{
+}
+
+bool PcapPacketSource::Open(const std::string& filename, unsigned int port)
+{
+  Close();
+  _reader.reset(new vtkPacketFileReader());
+  if (!_reader->Open(filename)) {
+    std::cout << "PcapPacketSource: Error, could not open " << filename << ": " << _reader->GetLastError() << std::endl;
+    _reader.reset();
+    return(false);
+  }
+  _port = port;
+  GetClock().Reset();
+  ResetPacing();
+  return(true);
+}
+
+bool PcapPacketSource::IsOpen()
+{
+  return (_reader && _reader->IsOpen());
+}
+
+void PcapPacketSource::Close()
+{
+  _reader.reset();
+}
+
+bool PcapPacketSource::NextPacket(const char** data, unsigned int* data_length, struct timespec* timestamp)
+{
+  if (!IsOpen()) {
+    return(false);
+  }
+
+  const unsigned char* packet = NULL;
+  unsigned int packet_length = 0;
+  double time_since_start = 0;
+  pcap_pkthdr* header = NULL;
+  while (_reader->NextPacket(packet, packet_length, time_since_start, &header)) {
+    // position packets and other udp traffic in the capture go to other ports
+    if (header->caplen <= PCAP_HEADER_BYTES) {
+      continue;
+    }
+    uint16_t dest_port;
+    memcpy(&dest_port, packet + PCAP_UDP_DEST_PORT_OFFSET, sizeof(dest_port));
+    if (ntohs(dest_port) != _port) {
+      continue;
+    }
+    *data = reinterpret_cast<const char*>(packet + PCAP_HEADER_BYTES);
+    *data_length = header->caplen - PCAP_HEADER_BYTES;
+    timestamp->tv_sec = header->ts.tv_sec;
+    timestamp->tv_nsec = header->ts.tv_usec*1000;
+    Deliver(*timestamp);
+    return(true);
+  }
+  return(false);
+}
+
+MemoryPacketSource::MemoryPacketSource() : PacketSource(true)
+{
+  _next = 0;
+}
+
+MemoryPacketSource::~MemoryPacketSource()
+{
+}
+
+void MemoryPacketSource::AddPacket(const char* data, unsigned int data_length, const struct timespec& timestamp)
+{
+  _offsets.push_back(_data.size());
+  _lengths.push_back(data_length);
+  _timestamps.push_back(timestamp);
+  _data.append(data, data_length);
+}
+
+uint64_t MemoryPacketSource::Load(PacketSource& source, uint64_t max_packets)
+{
+  uint64_t num_packets = 0;
+  const char* data = NULL;
+  unsigned int data_length = 0;
+  struct timespec timestamp;
+  while ((max_packets == 0 || num_packets < max_packets) && source.NextPacket(&data, &data_length, &timestamp)) {
+    AddPacket(data, data_length, timestamp);
+    num_packets++;
+  }
+  return num_packets;
+}
+
+void MemoryPacketSource::Clear()
+{
+  _data.clear();
+  _offsets.clear();
+  _lengths.clear();
+  _timestamps.clear();
+  Rewind();
+}
+
+void MemoryPacketSource::Rewind()
+{
+  _next = 0;
+  GetClock().Reset();
+  ResetPacing();
+}
+
+uint64_t MemoryPacketSource::GetNumberOfPackets()
+{
+  return _offsets.size();
+}
+
+bool MemoryPacketSource::NextPacket(const char** data, unsigned int* data_length, struct timespec* timestamp)
+{
+  if (_next >= _offsets.size()) {
+    return(false);
+  }
+  *data = _data.data() + _offsets[_next];
+  *data_length = _lengths[_next];
+  *timestamp = _timestamps[_next];
+  _next++;
+  Deliver(*timestamp);
+  return(true);
+}
@@ -0,0 +1,119 @@
+// Velodyne HDL Packet Source
+// Nick Rypkema (rypkema@mit.edu), MIT 2017
+// shared library to read Velodyne packets from UDP, a pcap file or memory through one interface, with a packet driven clock
+
+#ifndef PACKET_SOURCE_H_INCLUDED
+#define PACKET_SOURCE_H_INCLUDED
+
+#include <string>
+#include <vector>
+#include <time.h>
+#include <stdint.h>
+#include <boost/atomic.hpp>
+#include <boost/shared_ptr.hpp>
+#include "PacketDriver.h"
+
+class vtkPacketFileReader;
+
+// time as the packet consumer should see it - the wall clock for live sources, the timestamp of the
+// most recently delivered packet for recorded ones, so timeouts and rates follow the data however fast it replays
+class PacketClock
+{
+public:
+  PacketClock(bool is_virtual = false);
+  bool IsVirtual();
+  struct timespec Now();
+  double GetSeconds(); // Now() as seconds
+  void Advance(const struct timespec& time); // virtual clocks only, never moves backwards
+  void Reset();
+
+private:
+  bool _virtual;
+  boost::atomic<int64_t> _now; // nanoseconds
+};
+
+class PacketSource
+{
+public:
+  typedef PacketDriver::PacketCallback PacketCallback;
+
+public:
+  PacketSource(bool is_virtual);
+  virtual ~PacketSource();
+  // data stays valid until the next call, returns false once the source is exhausted or has failed
+  virtual bool NextPacket(const char** data, unsigned int* data_length, struct timespec* timestamp) = 0;
+  bool GetPacket(std::string* data, unsigned int* data_length);
+  bool GetPacket(std::string* data, unsigned int* data_length, struct timespec* timestamp);
+  // delivers packets until the source is exhausted, Stop is called or max_packets (0 for no limit) have gone by,
+  // returns the number delivered
+  uint64_t Run(const PacketCallback& callback, uint64_t max_packets = 0);
+  void Stop();
+  void SetReplaySpeed(double speed); // recorded sources only: 0 (the default) replays as fast as possible, 1 in real time
+  PacketClock& GetClock();
+
+protected:
+  void Deliver(const struct timespec& timestamp); // paces a recorded source and advances its clock
+  void ResetPacing();
+
+private:
+  PacketClock _clock;
+  double _speed;
+  bool _paced;
+  int64_t _pace_start;       // monotonic nanoseconds the first paced packet was delivered at
+  int64_t _pace_first;       // timestamp of the first paced packet
+  boost::atomic<bool> _stop;
+};
+
+// live packets from a PacketDriver, stamped by the kernel
+class UdpPacketSource : public PacketSource
+{
+public:
+  UdpPacketSource(unsigned int port = DATA_PORT, const PacketDriverConfig& config = PacketDriverConfig());
+  virtual ~UdpPacketSource();
+  virtual bool NextPacket(const char** data, unsigned int* data_length, struct timespec* timestamp);
+  PacketDriver& GetDriver();
+
+private:
+  PacketDriver _driver;
+  std::string _buffer;
+};
+
+// recorded packets from a pcap file, stamped with their capture time
+class PcapPacketSource : public PacketSource
+{
+public:
+  PcapPacketSource();
+  PcapPacketSource(const std::string& filename, unsigned int port = DATA_PORT);
+  virtual ~PcapPacketSource();
+  bool Open(const std::string& filename, unsigned int port = DATA_PORT); // only udp packets to port are delivered
+  bool IsOpen();
+  void Close();
+  virtual bool NextPacket(const char** data, unsigned int* data_length, struct timespec* timestamp);
+
+private:
+  boost::shared_ptr<vtkPacketFileReader> _reader;
+  unsigned int _port;
+};
+
+// packets held in memory, e.g. a pcap loaded once and replayed many times without touching the disk
+class MemoryPacketSource : public PacketSource
+{
+public:
+  MemoryPacketSource();
+  virtual ~MemoryPacketSource();
+  void AddPacket(const char* data, unsigned int data_length, const struct timespec& timestamp);
+  uint64_t Load(PacketSource& source, uint64_t max_packets = 0); // drains another source, returns packets added
+  void Clear();
+  void Rewind(); // restarts from the first packet, resetting the clock
+  uint64_t GetNumberOfPackets();
+  virtual bool NextPacket(const char** data, unsigned int* data_length, struct timespec* timestamp);
+
+private:
+  std::string _data;                // packets back to back
+  std::vector<uint64_t> _offsets;
+  std::vector<unsigned int> _lengths;
+  std::vector<struct timespec> _timestamps;
+  uint64_t _next;
+};
+
+#endif // PACKET_SOURCE_H_INCLUDED
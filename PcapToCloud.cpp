@@ -0,0 +1,99 @@
+// Velodyne HDL Pcap To Cloud
+// Nick Rypkema (rypkema@mit.edu), MIT 2017
+// executable to decode a pcap file and export its frames as binary PCD, binary PLY or LAS 1.4
+
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <sys/time.h>
+
+#include "PacketSource.h"
+#include "PacketDecoder.h"
+#include "FrameWriter.h"
+#include <boost/bind.hpp>
+
+namespace
+{
+struct Export
+{
+  PacketDecoder decoder;
+  FrameWriter writer;
+  std::string filename;
+  bool per_frame;
+  unsigned int num_frames;
+  bool ok;
+};
+
+void OnPacket(Export* job, const char* data, unsigned int data_length, const struct timespec&)
+{
+  job->decoder.DecodePacket(data, data_length);
+}
+
+void OnFrame(Export* job, const PacketDecoder::HDLFrame& frame)
+{
+  if (job->per_frame) {
+    // out.pcd becomes out_000000.pcd, out_000001.pcd, ...
+    size_t dot = job->filename.rfind('.');
+    char number[16];
+    snprintf(number, sizeof(number), "_%06u", job->num_frames);
+    job->ok = job->ok && job->writer.Open(job->filename.substr(0, dot) + number + job->filename.substr(dot));
+  }
+  job->ok = job->ok && job->writer.WriteFrame(frame);
+  if (job->per_frame) {
+    job->ok = job->ok && job->writer.Close();
+  }
+  job->num_frames++;
+}
+}
+
+int main(int argc, char* argv[])
+{
+  if (argc < 3) {
+    std::cout << "Usage: " << argv[0] << " <in.pcap> <out.pcd|out.ply|out.las> [--per-frame] [--corrections file.xml]" << std::endl;
+    std::cout << "Writes every frame into one file, or one file per frame with --per-frame" << std::endl;
+    return 1;
+  }
+
+  Export job;
+  job.filename = argv[2];
+  job.per_frame = false;
+  job.num_frames = 0;
+  job.ok = true;
+  for (int i = 3; i < argc; i++) {
+    if (strcmp(argv[i], "--per-frame") == 0) {
+      job.per_frame = true;
+    } else if (strcmp(argv[i], "--corrections") == 0 && i + 1 < argc) {
+      job.decoder.SetCorrectionsFile(argv[++i]);
+    }
+  }
+
+  FrameFormat format;
+  if (!FrameWriter::FormatFromFilename(job.filename, &format)) {
+    std::cout << "Unknown output format for " << job.filename << std::endl;
+    return 1;
+  }
+  PcapPacketSource source(argv[1]);
+  if (!source.IsOpen() || (!job.per_frame && !job.writer.Open(job.filename, format))) {
+    return 1;
+  }
+  job.decoder.SetFrameCallback(boost::bind(&OnFrame, &job, _1));
+
+  struct timeval start, end;
+  gettimeofday(&start, NULL);
+  source.Run(boost::bind(&OnPacket, &job, _1, _2, _3));
+  // the recording rarely ends on the cut angle - the last, partial rotation is exported like the first one
+  job.decoder.FlushFrame();
+  uint64_t num_points = job.writer.GetNumberOfPoints();
+  if (!job.per_frame) {
+    job.ok = job.writer.Close() && job.ok;
+  }
+  gettimeofday(&end, NULL);
+
+  double seconds = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec)/1e6;
+  std::cout << "Exported " << job.num_frames << " frames";
+  if (!job.per_frame) {
+    std::cout << " (" << num_points << " points)";
+  }
+  std::cout << " in " << seconds << "s" << std::endl;
+  return job.ok ? 0 : 1;
+}
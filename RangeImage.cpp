@@ -0,0 +1,411 @@
+// Velodyne HDL Range Image
+// Nick Rypkema (rypkema@mit.edu), MIT 2017
+// shared library to index a frame by laser ring and azimuth for fast neighbour queries and normal estimation
+
+#include <iostream>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "RangeImage.h"
+
+namespace
+{
+struct LaserAngle
+{
+  double angle;
+  unsigned int laser;
+  bool operator<(const LaserAngle& other) const
+  {
+    return (angle < other.angle) || (angle == other.angle && laser < other.laser);
+  }
+};
+
+// cyclic Jacobi sweeps on a symmetric 3x3 - eigenvalues on the diagonal of a, eigenvectors in the columns of v
+void EigenSymmetric3(double a[3][3], double v[3][3])
+{
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      v[i][j] = (i == j) ? 1 : 0;
+    }
+  }
+  for (int sweep = 0; sweep < 16; sweep++) {
+    double off = a[0][1]*a[0][1] + a[0][2]*a[0][2] + a[1][2]*a[1][2];
+    if (off < 1e-30) {
+      return;
+    }
+    for (int p = 0; p < 2; p++) {
+      for (int q = p + 1; q < 3; q++) {
+        if (a[p][q] == 0) {
+          continue;
+        }
+        double theta = (a[q][q] - a[p][p])/(2*a[p][q]);
+        double t = ((theta >= 0) ? 1 : -1)/(fabs(theta) + sqrt(theta*theta + 1));
+        double c = 1/sqrt(t*t + 1);
+        double s = t*c;
+        for (int k = 0; k < 3; k++) {
+          double akp = a[k][p], akq = a[k][q];
+          a[k][p] = c*akp - s*akq;
+          a[k][q] = s*akp + c*akq;
+        }
+        for (int k = 0; k < 3; k++) {
+          double apk = a[p][k], aqk = a[q][k];
+          a[p][k] = c*apk - s*aqk;
+          a[q][k] = s*apk + c*aqk;
+        }
+        for (int k = 0; k < 3; k++) {
+          double vkp = v[k][p], vkq = v[k][q];
+          v[k][p] = c*vkp - s*vkq;
+          v[k][q] = s*vkp + c*vkq;
+        }
+      }
+    }
+  }
+}
+}
+
+RangeImage::RangeImage(const HDLLaserCorrection* corrections, unsigned int azimuth_step)
+{
+  _step = std::max(1u, std::min(azimuth_step, 36000u));
+  _num_columns = (36000 + _step - 1)/_step;
+  _viewpoint[0] = _viewpoint[1] = _viewpoint[2] = 0;
+  _num_points = 0;
+  _x = _y = _z = _distance = NULL;
+  SetCorrections(corrections);
+}
+
+RangeImage::~RangeImage()
+{
+}
+
+void RangeImage::SetCorrections(const HDLLaserCorrection* corrections)
+{
+  _has_corrections = (corrections != NULL);
+  _max_offset = 0;
+  for (int i = 0; i < HDL_MAX_NUM_LASERS; i++) {
+    _laser_angle[i] = corrections ? HDL_Grabber_toRadians(corrections[i].verticalCorrection) : 0;
+    _column_offset[i] = corrections ? -static_cast<int>(floor(corrections[i].azimuthCorrection*100 + 0.5)) : 0;
+    if (corrections) {
+      _max_offset = std::max(_max_offset, sqrt(corrections[i].verticalOffsetCorrection*corrections[i].verticalOffsetCorrection +
+                                               corrections[i].horizontalOffsetCorrection*corrections[i].horizontalOffsetCorrection));
+    }
+  }
+  _row_lasers = 0;
+  _num_rows = 0;
+}
+
+// a 32 laser sensor leaves half the table unused, rows are only given to the lasers a frame has points from
+// so that neighbouring rows are neighbouring rings
+void RangeImage::AssignRows(uint64_t lasers)
+{
+  LaserAngle sorted[HDL_MAX_NUM_LASERS];
+  _num_rows = 0;
+  for (int i = 0; i < HDL_MAX_NUM_LASERS; i++) {
+    if (lasers & (1ULL << i)) {
+      sorted[_num_rows].angle = _laser_angle[i];
+      sorted[_num_rows].laser = i;
+      _num_rows++;
+    }
+  }
+  std::sort(sorted, sorted + _num_rows);
+  for (unsigned int row = 0; row < _num_rows; row++) {
+    _row_of_laser[sorted[row].laser] = row;
+    _row_angle[row] = sorted[row].angle;
+  }
+  _row_lasers = lasers;
+}
+
+void RangeImage::SetViewpoint(double x, double y, double z)
+{
+  _viewpoint[0] = x;
+  _viewpoint[1] = y;
+  _viewpoint[2] = z;
+}
+
+bool RangeImage::SetColumns(unsigned int num_points, const double* x, const double* y, const double* z,
+                            const unsigned char* laser_id, const unsigned short* azimuth, const double* distance)
+{
+  if (!_has_corrections) {
+    std::cout << "RangeImage: Error, no laser corrections set, use a decoder's GetLaserCorrections" << std::endl;
+    _num_points = 0;
+    return(false);
+  }
+  if (num_points && (!x || !y || !z || !laser_id || !azimuth)) {
+    std::cout << "RangeImage: Error, a frame needs its x, y, z, laser_id and azimuth columns" << std::endl;
+    _num_points = 0;
+    return(false);
+  }
+
+  _num_points = num_points;
+  _x = x;
+  _y = y;
+  _z = z;
+  _distance = distance;
+  _rows.resize(num_points);
+  _columns.resize(num_points);
+  _next.resize(num_points);
+  uint64_t lasers = 0;
+  for (unsigned int i = 0; i < num_points; i++) {
+    lasers |= 1ULL << (laser_id[i] % HDL_MAX_NUM_LASERS);
+  }
+  if (lasers != _row_lasers) {
+    AssignRows(lasers);
+  }
+  _cell_first.assign(_num_rows*_num_columns, -1);
+
+  // pushed to the front of their cell in reverse, so every cell lists its points in frame order
+  for (unsigned int i = num_points; i-- > 0;) {
+    unsigned int laser = laser_id[i] % HDL_MAX_NUM_LASERS;
+    int corrected = static_cast<int>(azimuth[i] % 36000) + _column_offset[laser];
+    corrected = (corrected % 36000 + 36000) % 36000;
+    unsigned int row = _row_of_laser[laser];
+    unsigned int column = corrected/_step;
+    _rows[i] = row;
+    _columns[i] = column;
+    int32_t& first = _cell_first[row*_num_columns + column];
+    _next[i] = first;
+    first = i;
+  }
+  return(true);
+}
+
+unsigned int RangeImage::GetNumberOfPoints()
+{
+  return _num_points;
+}
+
+unsigned int RangeImage::GetNumberOfRows()
+{
+  return _num_rows;
+}
+
+unsigned int RangeImage::GetNumberOfColumns()
+{
+  return _num_columns;
+}
+
+unsigned int RangeImage::GetRow(unsigned int point)
+{
+  return _rows[point];
+}
+
+unsigned int RangeImage::GetColumn(unsigned int point)
+{
+  return _columns[point];
+}
+
+int RangeImage::GetFirstPoint(unsigned int row, unsigned int column)
+{
+  if (row >= _num_rows || column >= _num_columns || _cell_first.empty()) {
+    return -1;
+  }
+  return _cell_first[row*_num_columns + column];
+}
+
+int RangeImage::GetNextPoint(unsigned int point)
+{
+  return _next[point];
+}
+
+double RangeImage::Range(unsigned int point) const
+{
+  if (_distance) {
+    return _distance[point];
+  }
+  double dx = _x[point] - _viewpoint[0];
+  double dy = _y[point] - _viewpoint[1];
+  double dz = _z[point] - _viewpoint[2];
+  return std::max(0.0, sqrt(dx*dx + dy*dy + dz*dz) - _max_offset);
+}
+
+unsigned int RangeImage::Gather(unsigned int point, double radius, std::vector<unsigned int>* indices,
+                                std::vector<double>* sq_distances, bool* everything) const
+{
+  indices->clear();
+  if (sq_distances) {
+    sq_distances->clear();
+  }
+  if (point >= _num_points) {
+    *everything = true;
+    return 0;
+  }
+
+  // a neighbour within radius of the point is within radius plus both laser origin offsets of it along the
+  // unoffset beams, which bounds the elevation and (in the horizontal plane) the azimuth between the two beams
+  double reach = radius + 2*_max_offset;
+  double range = Range(point);
+  unsigned int row = _rows[point];
+  double elevation = _row_angle[row];
+  double vertical = (reach < range) ? asin(reach/range) : M_PI;
+  double horizontal_range = range*cos(elevation);
+  int half_width = _num_columns;
+  if (reach < horizontal_range) {
+    half_width = static_cast<int>((asin(reach/horizontal_range)*18000/M_PI + 1)/_step) + 1; // +1 for rounding
+  }
+  bool all_columns = (2*half_width + 1 >= static_cast<int>(_num_columns));
+  if (all_columns) {
+    half_width = (_num_columns - 1)/2;
+  }
+
+  unsigned int row_begin = row, row_end = row + 1;
+  while (row_begin > 0 && elevation - _row_angle[row_begin - 1] <= vertical) {
+    row_begin--;
+  }
+  while (row_end < _num_rows && _row_angle[row_end] - elevation <= vertical) {
+    row_end++;
+  }
+  *everything = all_columns && row_begin == 0 && row_end == _num_rows;
+
+  double px = _x[point], py = _y[point], pz = _z[point];
+  double sq_radius = radius*radius;
+  int center = _columns[point];
+  int column_begin = center - half_width;
+  int column_end = all_columns ? column_begin + _num_columns : center + half_width + 1;
+  for (unsigned int r = row_begin; r < row_end; r++) {
+    const int32_t* cells = &_cell_first[r*_num_columns];
+    for (int c = column_begin; c < column_end; c++) {
+      int wrapped = (c < 0) ? c + _num_columns : (c >= static_cast<int>(_num_columns) ? c - _num_columns : c);
+      for (int32_t i = cells[wrapped]; i >= 0; i = _next[i]) {
+        double dx = _x[i] - px, dy = _y[i] - py, dz = _z[i] - pz;
+        double sq = dx*dx + dy*dy + dz*dz;
+        if (sq <= sq_radius) {
+          indices->push_back(i);
+          if (sq_distances) {
+            sq_distances->push_back(sq);
+          }
+        }
+      }
+    }
+  }
+  return indices->size();
+}
+
+unsigned int RangeImage::RadiusSearch(unsigned int point, double radius, std::vector<unsigned int>* indices,
+                                      std::vector<double>* sq_distances) const
+{
+  bool everything;
+  return Gather(point, radius, indices, sq_distances, &everything);
+}
+
+unsigned int RangeImage::NearestKSearch(unsigned int point, unsigned int k, std::vector<unsigned int>* indices,
+                                        std::vector<double>* sq_distances) const
+{
+  std::vector<double> sq;
+  indices->clear();
+  sq_distances->clear();
+  if (point >= _num_points || k == 0) {
+    return 0;
+  }
+
+  // start at about the spacing of k points around this one and double until k turn up - every point within
+  // the radius is found, so the k closest of them are the k closest overall
+  double spacing = std::max(Range(point), 1.0)*HDL_Grabber_toRadians(_step/100.0);
+  double radius = std::max(0.01, spacing*sqrt(static_cast<double>(k)));
+  bool everything = false;
+  while (Gather(point, radius, indices, &sq, &everything) < k && !everything) {
+    radius *= 2;
+  }
+
+  std::vector<std::pair<double, unsigned int> > found(indices->size());
+  for (size_t i = 0; i < found.size(); i++) {
+    found[i] = std::make_pair(sq[i], (*indices)[i]);
+  }
+  unsigned int n = std::min<size_t>(k, found.size());
+  std::partial_sort(found.begin(), found.begin() + n, found.end());
+  indices->resize(n);
+  sq_distances->resize(n);
+  for (unsigned int i = 0; i < n; i++) {
+    (*sq_distances)[i] = found[i].first;
+    (*indices)[i] = found[i].second;
+  }
+  return n;
+}
+
+void RangeImage::ComputeNormals(double radius, std::vector<float>* normal_x, std::vector<float>* normal_y,
+                                std::vector<float>* normal_z, std::vector<float>* curvature, unsigned int num_threads)
+{
+  normal_x->resize(_num_points);
+  normal_y->resize(_num_points);
+  normal_z->resize(_num_points);
+  if (curvature) {
+    curvature->resize(_num_points);
+  }
+  if (!_num_points) {
+    return;
+  }
+
+  if (num_threads == 0) {
+    num_threads = std::max(1u, boost::thread::hardware_concurrency());
+  }
+  num_threads = std::min(num_threads, _num_points);
+  float* curvatures = curvature ? &(*curvature)[0] : NULL;
+  if (num_threads == 1) {
+    ComputeNormalsRange(radius, 0, _num_points, &(*normal_x)[0], &(*normal_y)[0], &(*normal_z)[0], curvatures);
+    return;
+  }
+
+  boost::thread_group threads;
+  unsigned int per_thread = (_num_points + num_threads - 1)/num_threads;
+  for (unsigned int begin = 0; begin < _num_points; begin += per_thread) {
+    unsigned int end = std::min(_num_points, begin + per_thread);
+    threads.create_thread(boost::bind(&RangeImage::ComputeNormalsRange, this, radius, begin, end,
+                                      &(*normal_x)[0], &(*normal_y)[0], &(*normal_z)[0], curvatures));
+  }
+  threads.join_all();
+}
+
+void RangeImage::ComputeNormalsRange(double radius, unsigned int begin, unsigned int end, float* normal_x,
+                                     float* normal_y, float* normal_z, float* curvature)
+{
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  std::vector<unsigned int> indices;
+  for (unsigned int i = begin; i < end; i++) {
+    unsigned int n = RadiusSearch(i, radius, &indices);
+    if (n < 3) {
+      normal_x[i] = normal_y[i] = normal_z[i] = nan;
+      if (curvature) {
+        curvature[i] = nan;
+      }
+      continue;
+    }
+
+    // moments about the query point keep the covariance well conditioned far from the sensor
+    double px = _x[i], py = _y[i], pz = _z[i];
+    double sx = 0, sy = 0, sz = 0, sxx = 0, sxy = 0, sxz = 0, syy = 0, syz = 0, szz = 0;
+    for (unsigned int j = 0; j < n; j++) {
+      unsigned int index = indices[j];
+      double dx = _x[index] - px, dy = _y[index] - py, dz = _z[index] - pz;
+      sx += dx; sy += dy; sz += dz;
+      sxx += dx*dx; sxy += dx*dy; sxz += dx*dz;
+      syy += dy*dy; syz += dy*dz; szz += dz*dz;
+    }
+    double mx = sx/n, my = sy/n, mz = sz/n;
+    double a[3][3], v[3][3];
+    a[0][0] = sxx/n - mx*mx; a[0][1] = sxy/n - mx*my; a[0][2] = sxz/n - mx*mz;
+    a[1][1] = syy/n - my*my; a[1][2] = syz/n - my*mz; a[2][2] = szz/n - mz*mz;
+    a[1][0] = a[0][1]; a[2][0] = a[0][2]; a[2][1] = a[1][2];
+    EigenSymmetric3(a, v);
+
+    int smallest = 0;
+    for (int k = 1; k < 3; k++) {
+      if (a[k][k] < a[smallest][smallest]) {
+        smallest = k;
+      }
+    }
+    double nx = v[0][smallest], ny = v[1][smallest], nz = v[2][smallest];
+    if (nx*(_viewpoint[0] - px) + ny*(_viewpoint[1] - py) + nz*(_viewpoint[2] - pz) < 0) {
+      nx = -nx;
+      ny = -ny;
+      nz = -nz;
+    }
+    normal_x[i] = nx;
+    normal_y[i] = ny;
+    normal_z[i] = nz;
+    if (curvature) {
+      double sum = a[0][0] + a[1][1] + a[2][2];
+      curvature[i] = (sum > 0) ? std::max(0.0, a[smallest][smallest])/sum : 0;
+    }
+  }
+}
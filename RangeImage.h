@@ -0,0 +1,99 @@
+// Velodyne HDL Range Image
+// Nick Rypkema (rypkema@mit.edu), MIT 2017
+// shared library to index a frame by laser ring and azimuth for fast neighbour queries and normal estimation
+
+#ifndef RANGE_IMAGE_H_INCLUDED
+#define RANGE_IMAGE_H_INCLUDED
+
+#include <vector>
+#include <stdint.h>
+#include "PacketDecoder.h"
+
+// azimuth step of one column, in hundredths of a degree - ~0.16 degrees between firings at 10Hz
+static unsigned int RANGE_IMAGE_AZIMUTH_STEP = 20;
+
+// Rows are the lasers present in the frame sorted by their vertical correction, columns the (azimuth corrected) firing angle, and
+// every cell lists the points that fell in it, so indexing a frame is one pass over its points. A ball of
+// radius r around a point at range d spans at most asin(r/d) in elevation and azimuth, which bounds the
+// cells a query visits - queries are exact up to the small elevation shift of the lasers' vertical offsets.
+// The window ignores the HDL-64E two-point distance corrections (distCorrectionX/Y), which move x and y by
+// their difference from distCorrection (typically centimetres) but leave the distance column alone. Without
+// a distance column the range is measured from x, y and z to the viewpoint - with an extrinsic set on the
+// decoder those are in the vehicle frame, so set the viewpoint to the sensor's mounting position.
+// The frame (x, y, z, laser_id, azimuth and, if decoded, distance) must outlive the queries.
+class RangeImage
+{
+public:
+  RangeImage(const HDLLaserCorrection* corrections = NULL, unsigned int azimuth_step = RANGE_IMAGE_AZIMUTH_STEP);
+  virtual ~RangeImage();
+  void SetCorrections(const HDLLaserCorrection* corrections); // a decoder's GetLaserCorrections, before SetFrame
+  void SetViewpoint(double x, double y, double z);            // normals are flipped to face it, the sensor by default
+
+  template <typename Frame>
+  bool SetFrame(const Frame& frame)
+  {
+    unsigned int n = frame.x.size();
+    if (frame.laser_id.size() != n || frame.azimuth.size() != n) {
+      return(false);
+    }
+    return SetColumns(n, n ? &frame.x[0] : NULL, n ? &frame.y[0] : NULL, n ? &frame.z[0] : NULL,
+                      n ? &frame.laser_id[0] : NULL, n ? &frame.azimuth[0] : NULL,
+                      frame.distance.size() == n && n ? &frame.distance[0] : NULL);
+  }
+
+  // distance may be NULL, the range is then taken from x, y and z
+  bool SetColumns(unsigned int num_points, const double* x, const double* y, const double* z,
+                  const unsigned char* laser_id, const unsigned short* azimuth, const double* distance);
+
+  unsigned int GetNumberOfPoints();
+  unsigned int GetNumberOfRows();
+  unsigned int GetNumberOfColumns();
+  unsigned int GetRow(unsigned int point);
+  unsigned int GetColumn(unsigned int point);
+  int GetFirstPoint(unsigned int row, unsigned int column); // -1 for an empty cell
+  int GetNextPoint(unsigned int point);                     // next point in the same cell, -1 at the end
+
+  // neighbours of a frame point, the point itself included - safe to call from several threads at once
+  unsigned int RadiusSearch(unsigned int point, double radius, std::vector<unsigned int>* indices,
+                            std::vector<double>* sq_distances = NULL) const;
+  unsigned int NearestKSearch(unsigned int point, unsigned int k, std::vector<unsigned int>* indices,
+                              std::vector<double>* sq_distances) const;
+
+  // plane fit to the neighbours within radius of every point, split across num_threads (0 for one per core) -
+  // points with fewer than 3 neighbours get a NaN normal
+  void ComputeNormals(double radius, std::vector<float>* normal_x, std::vector<float>* normal_y,
+                      std::vector<float>* normal_z, std::vector<float>* curvature, unsigned int num_threads = 0);
+
+protected:
+  double Range(unsigned int point) const;
+  void AssignRows(uint64_t lasers);
+  // every point within radius, everything is set when the window already spanned the whole image
+  unsigned int Gather(unsigned int point, double radius, std::vector<unsigned int>* indices,
+                      std::vector<double>* sq_distances, bool* everything) const;
+  void ComputeNormalsRange(double radius, unsigned int begin, unsigned int end, float* normal_x, float* normal_y,
+                           float* normal_z, float* curvature);
+
+private:
+  bool _has_corrections;
+  unsigned int _step;
+  unsigned int _num_columns;
+  double _laser_angle[HDL_MAX_NUM_LASERS]; // radians
+  uint64_t _row_lasers;                    // bit per laser with a row
+  unsigned int _num_rows;
+  unsigned int _row_of_laser[HDL_MAX_NUM_LASERS];
+  double _row_angle[HDL_MAX_NUM_LASERS];
+  int _column_offset[HDL_MAX_NUM_LASERS];  // hundredths of a degree, from the azimuth correction
+  double _max_offset;                      // largest laser origin offset, widens every window by twice it
+  double _viewpoint[3];
+  unsigned int _num_points;
+  const double* _x;
+  const double* _y;
+  const double* _z;
+  const double* _distance;
+  std::vector<uint16_t> _rows;       // per point
+  std::vector<uint16_t> _columns;    // per point
+  std::vector<int32_t> _cell_first;  // per cell, row major
+  std::vector<int32_t> _next;        // per point, the cell's list
+};
+
+#endif // RANGE_IMAGE_H_INCLUDED
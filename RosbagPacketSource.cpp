@@ -0,0 +1,461 @@
+// Velodyne HDL Rosbag Packet Source
+// Nick Rypkema (rypkema@mit.edu), MIT 2017
+// shared library to read velodyne_msgs/VelodyneScan packets straight out of a ROS1 bag (v2.0) file, without ROS
+
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <bzlib.h>
+
+#include "RosbagPacketSource.h"
+
+namespace
+{
+const char ROSBAG_MAGIC[] = "#ROSBAG V2.0\n";
+const unsigned int ROSBAG_MAGIC_LENGTH = 13;
+const char ROSBAG_OP_MESSAGE_DATA = 0x02;
+const char ROSBAG_OP_CHUNK = 0x05;
+const char ROSBAG_OP_CONNECTION = 0x07;
+const char VELODYNE_SCAN_TYPE[] = "velodyne_msgs/VelodyneScan";
+// a velodyne_msgs/VelodynePacket is its stamp (secs, nsecs) followed by a fixed uint8[1206]
+const unsigned int VELODYNE_PACKET_SIZE = 1206;
+const unsigned int VELODYNE_STAMPED_PACKET_SIZE = 8 + VELODYNE_PACKET_SIZE;
+const uint32_t LZ4_FRAME_MAGIC = 0x184D2204;
+// a chunk's size field is trusted for its decompression buffer only up to this - rosbag writes 768KB chunks
+const uint32_t ROSBAG_MAX_CHUNK_SIZE = 256 << 20;
+
+uint32_t ReadUint32(const char* data)
+{
+  uint32_t value;
+  memcpy(&value, data, sizeof(value));
+  return value;
+}
+
+// name=value fields, each prefixed by its length - values are binary
+bool ParseFields(const char* data, uint32_t length, std::map<std::string, std::string>* fields)
+{
+  fields->clear();
+  uint32_t offset = 0;
+  while (offset + 4 <= length) {
+    uint32_t field_length = ReadUint32(data + offset);
+    offset += 4;
+    if (field_length > length - offset) {
+      return(false);
+    }
+    const char* field = data + offset;
+    const char* equals = static_cast<const char*>(memchr(field, '=', field_length));
+    if (equals == NULL) {
+      return(false);
+    }
+    (*fields)[std::string(field, equals)] = std::string(equals + 1, field + field_length);
+    offset += field_length;
+  }
+  return (offset == length);
+}
+
+char Op(const std::map<std::string, std::string>& fields)
+{
+  std::map<std::string, std::string>::const_iterator it = fields.find("op");
+  return (it != fields.end() && it->second.size() == 1) ? it->second[0] : 0;
+}
+
+bool Uint32Field(const std::map<std::string, std::string>& fields, const char* name, uint32_t* value)
+{
+  std::map<std::string, std::string>::const_iterator it = fields.find(name);
+  if (it == fields.end() || it->second.size() != 4) {
+    return(false);
+  }
+  *value = ReadUint32(it->second.data());
+  return(true);
+}
+
+// decodes one lz4 block onto the end of out, earlier output serving as the window for linked blocks
+bool Lz4DecompressBlock(const unsigned char* src, size_t src_length, std::string* out, size_t max_length)
+{
+  const unsigned char* ip = src;
+  const unsigned char* end = src + src_length;
+  while (ip < end) {
+    unsigned int token = *ip++;
+    size_t literals = token >> 4;
+    if (literals == 15) {
+      unsigned char byte;
+      do {
+        if (ip >= end) {
+          return(false);
+        }
+        byte = *ip++;
+        literals += byte;
+      } while (byte == 255);
+    }
+    if (literals > static_cast<size_t>(end - ip) || out->size() + literals > max_length) {
+      return(false);
+    }
+    out->append(reinterpret_cast<const char*>(ip), literals);
+    ip += literals;
+    if (ip == end) {
+      break; // the last sequence is literals only
+    }
+
+    if (end - ip < 2) {
+      return(false);
+    }
+    size_t offset = ip[0] | (ip[1] << 8);
+    ip += 2;
+    size_t match = token & 0x0f;
+    if (match == 15) {
+      unsigned char byte;
+      do {
+        if (ip >= end) {
+          return(false);
+        }
+        byte = *ip++;
+        match += byte;
+      } while (byte == 255);
+    }
+    match += 4;
+    if (offset == 0 || offset > out->size() || out->size() + match > max_length) {
+      return(false);
+    }
+    // matches may overlap the bytes they produce, so copy forwards one at a time
+    size_t from = out->size() - offset;
+    for (size_t i = 0; i < match; i++) {
+      out->push_back((*out)[from + i]);
+    }
+  }
+  return(true);
+}
+
+// the lz4 frame format, as written by roslz4
+bool Lz4DecompressFrames(const char* data, size_t length, std::string* out, size_t max_length)
+{
+  const unsigned char* src = reinterpret_cast<const unsigned char*>(data);
+  size_t offset = 0;
+  while (offset < length) {
+    if (length - offset < 7 || ReadUint32(data + offset) != LZ4_FRAME_MAGIC) {
+      return(false);
+    }
+    unsigned char flags = src[offset + 4];
+    if ((flags >> 6) != 1) {
+      return(false);
+    }
+    bool block_checksum = flags & 0x10;
+    bool content_size = flags & 0x08;
+    bool content_checksum = flags & 0x04;
+    bool dictionary = flags & 0x01;
+    size_t header_length = 6 + (content_size ? 8 : 0) + (dictionary ? 4 : 0) + 1; // magic, FLG, BD, options, HC
+    if (header_length > length - offset) {
+      return(false);
+    }
+    offset += header_length;
+
+    while (true) {
+      if (length - offset < 4) {
+        return(false);
+      }
+      uint32_t block_size = ReadUint32(data + offset);
+      offset += 4;
+      if (block_size == 0) {
+        break;
+      }
+      bool uncompressed = block_size & 0x80000000;
+      block_size &= 0x7fffffff;
+      size_t checksum_length = (block_checksum ? 4 : 0);
+      if (block_size + checksum_length > length - offset) {
+        return(false);
+      }
+      if (uncompressed) {
+        if (out->size() + block_size > max_length) {
+          return(false);
+        }
+        out->append(data + offset, block_size);
+      } else if (!Lz4DecompressBlock(src + offset, block_size, out, max_length)) {
+        return(false);
+      }
+      offset += block_size + checksum_length;
+    }
+    if (content_checksum) {
+      if (length - offset < 4) {
+        return(false);
+      }
+      offset += 4;
+    }
+  }
+  return(true);
+}
+}
+
+RosbagPacketSource::RosbagPacketSource() : PacketSource(true)
+{
+  _file = NULL;
+  Close();
+}
+
+RosbagPacketSource::RosbagPacketSource(const std::string& filename, const std::string& topic) : PacketSource(true)
+{
+  _file = NULL;
+  Open(filename, topic);
+}
+
+RosbagPacketSource::~RosbagPacketSource()
+{
+  Close();
+}
+
+bool RosbagPacketSource::Open(const std::string& filename, const std::string& topic)
+{
+  Close();
+  _file = fopen(filename.c_str(), "rb");
+  if (_file == NULL) {
+    return Fail("could not open " + filename + " - " + strerror(errno));
+  }
+  // reading whole chunks at a time, a larger stdio buffer mostly saves syscalls on the skipped index records
+  setvbuf(_file, NULL, _IOFBF, 1 << 20);
+  off_t file_size = -1;
+  if (fseeko(_file, 0, SEEK_END) == 0) {
+    file_size = ftello(_file);
+  }
+  if (file_size < 0 || fseeko(_file, 0, SEEK_SET) != 0) {
+    Close();
+    return Fail("could not seek in " + filename + " - " + strerror(errno));
+  }
+  _file_size = file_size;
+
+  char magic[ROSBAG_MAGIC_LENGTH];
+  if (fread(magic, 1, ROSBAG_MAGIC_LENGTH, _file) != ROSBAG_MAGIC_LENGTH || memcmp(magic, ROSBAG_MAGIC, ROSBAG_MAGIC_LENGTH) != 0) {
+    Close();
+    return Fail(filename + " is not a v2.0 rosbag");
+  }
+  _topic = topic;
+  GetClock().Reset();
+  ResetPacing();
+  return(true);
+}
+
+bool RosbagPacketSource::IsOpen()
+{
+  return (_file != NULL);
+}
+
+void RosbagPacketSource::Close()
+{
+  if (_file) {
+    fclose(_file);
+    _file = NULL;
+  }
+  _file_size = 0;
+  _connections.clear();
+  _record.clear();
+  _chunk.clear();
+  _chunk_offset = 0;
+  _scan = NULL;
+  _scan_packets = 0;
+  _scan_next = 0;
+  _num_scans = 0;
+}
+
+const std::string& RosbagPacketSource::GetLastError()
+{
+  return _last_error;
+}
+
+uint64_t RosbagPacketSource::GetNumberOfScans()
+{
+  return _num_scans;
+}
+
+uint64_t RosbagPacketSource::RemainingBytes()
+{
+  off_t position = ftello(_file);
+  return (position < 0 || static_cast<uint64_t>(position) > _file_size) ? 0 : _file_size - position;
+}
+
+bool RosbagPacketSource::Fail(const std::string& error)
+{
+  _last_error = error;
+  std::cout << "RosbagPacketSource: Error, " << error << std::endl;
+  return(false);
+}
+
+bool RosbagPacketSource::ReadRecord(RecordHeader* header, std::string* data)
+{
+  char length[4];
+  if (fread(length, 1, 4, _file) != 4) {
+    return(false); // end of the bag
+  }
+  uint32_t header_length = ReadUint32(length);
+  if (header_length > RemainingBytes()) {
+    return Fail("record header runs past the end of the bag");
+  }
+  std::string header_data(header_length, '\0');
+  if ((header_data.size() && fread(&header_data[0], 1, header_data.size(), _file) != header_data.size()) ||
+      !ParseFields(header_data.data(), header_data.size(), header) || fread(length, 1, 4, _file) != 4) {
+    return Fail("truncated or corrupt record header");
+  }
+
+  // the bag header, index and chunk info records are only needed for random access
+  uint32_t data_length = ReadUint32(length);
+  char op = Op(*header);
+  if (op != ROSBAG_OP_CHUNK && op != ROSBAG_OP_CONNECTION && op != ROSBAG_OP_MESSAGE_DATA) {
+    if (fseeko(_file, data_length, SEEK_CUR) != 0) {
+      return Fail("truncated record");
+    }
+    data->clear();
+    return(true);
+  }
+  if (data_length > RemainingBytes()) {
+    return Fail("record runs past the end of the bag");
+  }
+  data->resize(data_length);
+  if (data_length && fread(&(*data)[0], 1, data_length, _file) != data_length) {
+    return Fail("truncated record");
+  }
+  return(true);
+}
+
+bool RosbagPacketSource::NextChunkRecord(RecordHeader* header, const char** data, uint32_t* data_length)
+{
+  size_t available = _chunk.size() - _chunk_offset;
+  if (available < 4) {
+    return(false);
+  }
+  // both length fields, before either is trusted
+  if (available < 8) {
+    return Fail("truncated record in chunk");
+  }
+  const char* record = _chunk.data() + _chunk_offset;
+  uint32_t header_length = ReadUint32(record);
+  if (header_length > available - 8 || !ParseFields(record + 4, header_length, header)) {
+    return Fail("corrupt record in chunk");
+  }
+  *data_length = ReadUint32(record + 4 + header_length);
+  if (*data_length > available - 8 - header_length) {
+    return Fail("truncated record in chunk");
+  }
+  *data = record + 8 + header_length;
+  _chunk_offset += 8 + header_length + *data_length;
+  return(true);
+}
+
+bool RosbagPacketSource::LoadChunk(const RecordHeader& header, const std::string& data)
+{
+  uint32_t size;
+  RecordHeader::const_iterator compression = header.find("compression");
+  if (compression == header.end() || !Uint32Field(header, "size", &size)) {
+    return Fail("chunk without compression or size");
+  }
+
+  if (compression->second != "none" && size > ROSBAG_MAX_CHUNK_SIZE) {
+    return Fail("compressed chunk size too large");
+  }
+
+  _chunk_offset = 0;
+  if (compression->second == "none") {
+    _chunk = data;
+  } else if (compression->second == "bz2") {
+    _chunk.resize(size);
+    unsigned int decompressed = size;
+    if (BZ2_bzBuffToBuffDecompress(size ? &_chunk[0] : NULL, &decompressed, const_cast<char*>(data.data()), data.size(), 0, 0) != BZ_OK) {
+      return Fail("could not decompress bz2 chunk");
+    }
+    _chunk.resize(decompressed);
+  } else if (compression->second == "lz4") {
+    _chunk.clear();
+    _chunk.reserve(size);
+    if (!Lz4DecompressFrames(data.data(), data.size(), &_chunk, size)) {
+      return Fail("could not decompress lz4 chunk");
+    }
+  } else {
+    return Fail("unsupported chunk compression " + compression->second);
+  }
+  return(true);
+}
+
+void RosbagPacketSource::AddConnection(const RecordHeader& header, const char* data, uint32_t data_length)
+{
+  uint32_t connection;
+  RecordHeader fields;
+  RecordHeader::const_iterator topic = header.find("topic");
+  if (!Uint32Field(header, "conn", &connection) || topic == header.end() || !ParseFields(data, data_length, &fields)) {
+    return;
+  }
+  if (fields["type"] == VELODYNE_SCAN_TYPE && (_topic.empty() || topic->second == _topic)) {
+    _connections.insert(connection);
+  }
+}
+
+bool RosbagPacketSource::NextScan()
+{
+  RecordHeader header;
+  while (true) {
+    const char* data;
+    uint32_t data_length;
+    if (_chunk_offset < _chunk.size()) {
+      if (!NextChunkRecord(&header, &data, &data_length)) {
+        _chunk.clear();
+        _chunk_offset = 0;
+        continue;
+      }
+    } else {
+      if (!ReadRecord(&header, &_record)) {
+        return(false);
+      }
+      char op = Op(header);
+      if (op == ROSBAG_OP_CHUNK) {
+        if (!LoadChunk(header, _record)) {
+          _chunk.clear(); // skip the chunk rather than give up on the rest of the bag
+        }
+        continue;
+      }
+      data = _record.data();
+      data_length = _record.size();
+    }
+
+    char op = Op(header);
+    uint32_t connection;
+    if (op == ROSBAG_OP_CONNECTION) {
+      AddConnection(header, data, data_length);
+    } else if (op == ROSBAG_OP_MESSAGE_DATA && Uint32Field(header, "conn", &connection) && _connections.count(connection)) {
+      // std_msgs/Header (seq, stamp, frame_id) then the packet array
+      if (data_length < 16 || ReadUint32(data + 12) > data_length - 16) {
+        Fail("corrupt VelodyneScan message");
+        continue;
+      }
+      uint32_t offset = 16 + ReadUint32(data + 12);
+      if (data_length - offset < 4) {
+        Fail("corrupt VelodyneScan message");
+        continue;
+      }
+      _scan_packets = ReadUint32(data + offset);
+      if (_scan_packets > (data_length - offset - 4)/VELODYNE_STAMPED_PACKET_SIZE) {
+        Fail("truncated VelodyneScan message");
+        continue;
+      }
+      _scan = data + offset + 4;
+      _scan_next = 0;
+      _num_scans++;
+      return(true);
+    }
+  }
+}
+
+bool RosbagPacketSource::NextPacket(const char** data, unsigned int* data_length, struct timespec* timestamp)
+{
+  if (!IsOpen()) {
+    return(false);
+  }
+  while (_scan == NULL || _scan_next >= _scan_packets) {
+    _scan = NULL;
+    if (!NextScan()) {
+      return(false);
+    }
+  }
+
+  const char* packet = _scan + static_cast<size_t>(_scan_next)*VELODYNE_STAMPED_PACKET_SIZE;
+  _scan_next++;
+  timestamp->tv_sec = ReadUint32(packet);
+  timestamp->tv_nsec = ReadUint32(packet + 4);
+  *data = packet + 8;
+  *data_length = VELODYNE_PACKET_SIZE;
+  Deliver(*timestamp);
+  return(true);
+}
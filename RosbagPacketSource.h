@@ -0,0 +1,58 @@
+// Velodyne HDL Rosbag Packet Source
+// Nick Rypkema (rypkema@mit.edu), MIT 2017
+// shared library to read velodyne_msgs/VelodyneScan packets straight out of a ROS1 bag (v2.0) file, without ROS
+
+#ifndef ROSBAG_PACKET_SOURCE_H_INCLUDED
+#define ROSBAG_PACKET_SOURCE_H_INCLUDED
+
+#include <map>
+#include <set>
+#include <string>
+#include <cstdio>
+#include <stdint.h>
+#include "PacketSource.h"
+
+// Reads the bag front to back - records and chunks (uncompressed, bz2 or lz4) in file order, which is
+// the order they were recorded in - and delivers each packet of each scan stamped with its own
+// packet time. A recorded source, so it replays as fast as possible unless SetReplaySpeed is used.
+class RosbagPacketSource : public PacketSource
+{
+public:
+  RosbagPacketSource();
+  RosbagPacketSource(const std::string& filename, const std::string& topic = "");
+  virtual ~RosbagPacketSource();
+  // topic empty takes every velodyne_msgs/VelodyneScan connection in the bag
+  bool Open(const std::string& filename, const std::string& topic = "");
+  bool IsOpen();
+  void Close();
+  const std::string& GetLastError();
+  uint64_t GetNumberOfScans(); // scans read so far
+  virtual bool NextPacket(const char** data, unsigned int* data_length, struct timespec* timestamp);
+
+protected:
+  typedef std::map<std::string, std::string> RecordHeader;
+
+  bool ReadRecord(RecordHeader* header, std::string* data);
+  bool NextChunkRecord(RecordHeader* header, const char** data, uint32_t* data_length);
+  bool LoadChunk(const RecordHeader& header, const std::string& data);
+  void AddConnection(const RecordHeader& header, const char* data, uint32_t data_length);
+  bool NextScan();
+  uint64_t RemainingBytes();
+  bool Fail(const std::string& error);
+
+private:
+  FILE* _file;
+  uint64_t _file_size;             // record lengths are checked against it before anything is allocated
+  std::string _topic;
+  std::string _last_error;
+  std::set<uint32_t> _connections; // connection ids carrying the scans we want
+  std::string _record;             // data of the current top level record
+  std::string _chunk;              // decompressed records of the current chunk
+  size_t _chunk_offset;
+  const char* _scan;               // packets of the current scan
+  uint32_t _scan_packets;
+  uint32_t _scan_next;
+  uint64_t _num_scans;
+};
+
+#endif // ROSBAG_PACKET_SOURCE_H_INCLUDED
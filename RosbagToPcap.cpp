@@ -0,0 +1,49 @@
+// Velodyne HDL Rosbag To Pcap
+// Nick Rypkema (rypkema@mit.edu), MIT 2017
+// executable to convert the velodyne_msgs/VelodyneScan packets of a ROS1 bag to pcap, without ROS and at disk speed
+
+#include <iostream>
+#include <sys/time.h>
+
+#include "RosbagPacketSource.h"
+#include "PacketFileWriter.h"
+
+int main(int argc, char* argv[])
+{
+  if (argc < 3 || argc > 4) {
+    std::cout << "Usage: " << argv[0] << " <in.bag> <out.pcap> [topic]" << std::endl;
+    std::cout << "Converts every velodyne_msgs/VelodyneScan topic unless one is given" << std::endl;
+    return 1;
+  }
+
+  RosbagPacketSource source(argv[1], argc > 3 ? argv[3] : "");
+  if (!source.IsOpen()) {
+    return 1;
+  }
+  vtkPacketFileWriter writer;
+  if (!writer.Open(argv[2])) {
+    std::cout << "Failed to open " << argv[2] << ": " << writer.GetLastError() << std::endl;
+    return 1;
+  }
+
+  struct timeval start, end;
+  gettimeofday(&start, NULL);
+  const char* data;
+  unsigned int data_length;
+  struct timespec timestamp;
+  struct timeval packet_time;
+  uint64_t num_packets = 0;
+  while (source.NextPacket(&data, &data_length, &timestamp)) {
+    packet_time.tv_sec = timestamp.tv_sec;
+    packet_time.tv_usec = timestamp.tv_nsec/1000;
+    if (writer.WritePacket(reinterpret_cast<const unsigned char*>(data), data_length, packet_time)) {
+      num_packets++;
+    }
+  }
+  writer.Close();
+  gettimeofday(&end, NULL);
+
+  double seconds = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec)/1e6;
+  std::cout << "Wrote " << num_packets << " packets from " << source.GetNumberOfScans() << " scans in " << seconds << "s" << std::endl;
+  return 0;
+}
@@ -0,0 +1,265 @@
+// Velodyne HDL Segmentation
+// Nick Rypkema (rypkema@mit.edu), MIT 2017
+// shared library to label the ground and cluster the remaining points of a frame using its laser ring x azimuth structure
+
+#include <iostream>
+#include <cmath>
+#include <algorithm>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "Segmentation.h"
+
+Segmentation::Segmentation(const HDLLaserCorrection* corrections, unsigned int azimuth_step) :
+  _image(corrections, azimuth_step)
+{
+  _viewpoint[0] = _viewpoint[1] = _viewpoint[2] = 0;
+  _ground_height = -1.8;
+  _ground_tolerance = 0.15;
+  _max_slope = tan(HDL_Grabber_toRadians(10.0));
+  _cluster_tolerance = 0.5;
+  _min_cluster_size = 10;
+  _num_threads = 0;
+  _num_clusters = 0;
+  _num_ground = 0;
+  _num_points = 0;
+  _x = _y = _z = NULL;
+  _label = NULL;
+}
+
+Segmentation::~Segmentation()
+{
+}
+
+void Segmentation::SetCorrections(const HDLLaserCorrection* corrections)
+{
+  _image.SetCorrections(corrections);
+}
+
+void Segmentation::SetViewpoint(double x, double y, double z)
+{
+  _viewpoint[0] = x;
+  _viewpoint[1] = y;
+  _viewpoint[2] = z;
+  _image.SetViewpoint(x, y, z);
+}
+
+void Segmentation::SetGroundHeight(double z)
+{
+  _ground_height = z;
+}
+
+void Segmentation::SetGroundTolerance(double tolerance)
+{
+  _ground_tolerance = std::max(0.0, tolerance);
+}
+
+void Segmentation::SetMaxGroundSlope(double degrees)
+{
+  _max_slope = tan(HDL_Grabber_toRadians(std::max(0.0, std::min(degrees, 89.0))));
+}
+
+void Segmentation::SetClusterTolerance(double tolerance)
+{
+  _cluster_tolerance = std::max(0.0, tolerance);
+}
+
+void Segmentation::SetMinClusterSize(unsigned int min_size)
+{
+  _min_cluster_size = min_size;
+}
+
+void Segmentation::SetNumberOfThreads(unsigned int num_threads)
+{
+  _num_threads = num_threads;
+}
+
+unsigned int Segmentation::GetNumberOfClusters()
+{
+  return _num_clusters;
+}
+
+unsigned int Segmentation::GetNumberOfGroundPoints()
+{
+  return _num_ground;
+}
+
+RangeImage* Segmentation::GetRangeImage()
+{
+  return &_image;
+}
+
+bool Segmentation::SegmentColumns(unsigned int num_points, const double* x, const double* y, const double* z, int* label)
+{
+  _num_points = num_points;
+  _x = x;
+  _y = y;
+  _z = z;
+  _label = label;
+  _num_clusters = 0;
+  _num_ground = 0;
+  if (!num_points) {
+    return(true);
+  }
+
+  _parent.resize(num_points);
+  _size.assign(num_points, 1);
+  _cluster_id.assign(num_points, SEGMENT_NOISE);
+  for (unsigned int i = 0; i < num_points; i++) {
+    _parent[i] = i;
+  }
+
+  unsigned int num_sectors = _num_threads ? _num_threads : std::max(1u, boost::thread::hardware_concurrency());
+  num_sectors = std::min(num_sectors, _image.GetNumberOfColumns());
+  _crossing.resize(num_sectors);
+  RunSectors(num_sectors, true);
+  RunSectors(num_sectors, false);
+  for (unsigned int s = 0; s < num_sectors; s++) {
+    for (size_t e = 0; e < _crossing[s].size(); e++) {
+      Union(_crossing[s][e].first, _crossing[s][e].second);
+    }
+  }
+
+  for (unsigned int i = 0; i < num_points; i++) {
+    if (label[i] == SEGMENT_GROUND) {
+      _num_ground++;
+      continue;
+    }
+    int32_t root = Find(i);
+    if (_size[root] < _min_cluster_size) {
+      label[i] = SEGMENT_NOISE;
+      continue;
+    }
+    if (_cluster_id[root] == SEGMENT_NOISE) {
+      _cluster_id[root] = ++_num_clusters;
+    }
+    label[i] = _cluster_id[root];
+  }
+  return(true);
+}
+
+void Segmentation::RunSectors(unsigned int num_sectors, bool ground)
+{
+  unsigned int num_columns = _image.GetNumberOfColumns();
+  if (num_sectors == 1) {
+    if (ground) {
+      LabelGround(0, num_columns);
+    } else {
+      ClusterSector(0, num_columns, &_crossing[0]);
+    }
+    return;
+  }
+
+  boost::thread_group threads;
+  for (unsigned int s = 0; s < num_sectors; s++) {
+    unsigned int begin = s*num_columns/num_sectors;
+    unsigned int end = (s + 1)*num_columns/num_sectors;
+    if (ground) {
+      threads.create_thread(boost::bind(&Segmentation::LabelGround, this, begin, end));
+    } else {
+      threads.create_thread(boost::bind(&Segmentation::ClusterSector, this, begin, end, &_crossing[s]));
+    }
+  }
+  threads.join_all();
+}
+
+void Segmentation::LabelGround(unsigned int column_begin, unsigned int column_end)
+{
+  unsigned int num_rows = _image.GetNumberOfRows();
+  for (unsigned int column = column_begin; column < column_end; column++) {
+    // rows go up in elevation, so out along flat ground - each ground point becomes the base for the next.
+    // Only the first is allowed the tolerance, closely spaced rings could otherwise climb a wall.
+    double last_range = 0, last_z = _ground_height, tolerance = _ground_tolerance;
+    for (unsigned int row = 0; row < num_rows; row++) {
+      for (int i = _image.GetFirstPoint(row, column); i >= 0; i = _image.GetNextPoint(i)) {
+        double dx = _x[i] - _viewpoint[0], dy = _y[i] - _viewpoint[1];
+        double range = sqrt(dx*dx + dy*dy);
+        double step = std::max(0.0, range - last_range);
+        bool ground = fabs(_z[i] - last_z) <= _max_slope*step + tolerance &&
+                      fabs(_z[i] - _ground_height) <= _max_slope*range + _ground_tolerance;
+        if (ground) {
+          last_range = range;
+          last_z = _z[i];
+          tolerance = 0;
+        }
+        _label[i] = ground ? SEGMENT_GROUND : SEGMENT_NOISE;
+      }
+    }
+  }
+}
+
+void Segmentation::ClusterSector(unsigned int column_begin, unsigned int column_end,
+                                 std::vector<std::pair<int32_t, int32_t> >* crossing)
+{
+  crossing->clear();
+  int num_rows = _image.GetNumberOfRows();
+  int num_columns = _image.GetNumberOfColumns();
+  double sq_tolerance = _cluster_tolerance*_cluster_tolerance;
+  double columns_per_radian = 18000/M_PI/(36000.0/num_columns);
+
+  for (int column = column_begin; column < static_cast<int>(column_end); column++) {
+    for (int row = 0; row < num_rows; row++) {
+      for (int i = _image.GetFirstPoint(row, column); i >= 0; i = _image.GetNextPoint(i)) {
+        if (_label[i] == SEGMENT_GROUND) {
+          continue;
+        }
+
+        // the tolerance spans fewer columns the further the point is from the sensor
+        double dx = _x[i] - _viewpoint[0], dy = _y[i] - _viewpoint[1];
+        double range = sqrt(dx*dx + dy*dy);
+        int window = SEGMENT_MAX_COLUMN_WINDOW;
+        if (_cluster_tolerance < range) {
+          window = std::min<int>(window, static_cast<int>(asin(_cluster_tolerance/range)*columns_per_radian) + 1);
+        }
+
+        // forward neighbours only - the rest of the ring, then the rings above - so every pair is seen once
+        for (int r = row; r <= std::min(num_rows - 1, row + static_cast<int>(SEGMENT_ROW_WINDOW)); r++) {
+          for (int c = (r == row) ? column : column - window; c <= column + window; c++) {
+            int wrapped = (c + num_columns) % num_columns;
+            int j = _image.GetFirstPoint(r, wrapped);
+            if (r == row && c == column) {
+              j = _image.GetNextPoint(i);
+            }
+            for (; j >= 0; j = _image.GetNextPoint(j)) {
+              if (_label[j] == SEGMENT_GROUND) {
+                continue;
+              }
+              double ex = _x[j] - _x[i], ey = _y[j] - _y[i], ez = _z[j] - _z[i];
+              if (ex*ex + ey*ey + ez*ez > sq_tolerance) {
+                continue;
+              }
+              if (wrapped >= static_cast<int>(column_begin) && wrapped < static_cast<int>(column_end)) {
+                Union(i, j);
+              } else {
+                crossing->push_back(std::make_pair(i, j));
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+int32_t Segmentation::Find(int32_t point)
+{
+  while (_parent[point] != point) {
+    _parent[point] = _parent[_parent[point]];
+    point = _parent[point];
+  }
+  return point;
+}
+
+void Segmentation::Union(int32_t a, int32_t b)
+{
+  a = Find(a);
+  b = Find(b);
+  if (a == b) {
+    return;
+  }
+  if (_size[a] < _size[b]) {
+    std::swap(a, b);
+  }
+  _parent[b] = a;
+  _size[a] += _size[b];
+}
@@ -0,0 +1,87 @@
+// Velodyne HDL Segmentation
+// Nick Rypkema (rypkema@mit.edu), MIT 2017
+// shared library to label the ground and cluster the remaining points of a frame using its laser ring x azimuth structure
+
+#ifndef SEGMENTATION_H_INCLUDED
+#define SEGMENTATION_H_INCLUDED
+
+#include <vector>
+#include <stdint.h>
+#include "RangeImage.h"
+
+// frame->label values, clusters are numbered from 1 in order of their first point
+static const int SEGMENT_GROUND = -1;
+static const int SEGMENT_NOISE = 0; // in a cluster smaller than the minimum size
+
+// rings above a point searched for its cluster neighbours, so a ring with a missed return does not split an object
+static unsigned int SEGMENT_ROW_WINDOW = 2;
+// widest azimuth window (in columns) searched for cluster neighbours, reached by points close to the sensor
+static unsigned int SEGMENT_MAX_COLUMN_WINDOW = 16;
+
+// Ground: every azimuth column is walked from the lowest ring up, a point is ground while the slope from
+// the last ground point (starting from the ground under the sensor) stays under the maximum slope.
+// Clusters: union-find over the non-ground points, joining each point to those within the cluster
+// tolerance in the next columns of its ring and in the rings just above it.
+// Both passes split the image into azimuth sectors across threads, the unions crossing a sector
+// boundary are merged afterwards on the calling thread.
+class Segmentation
+{
+public:
+  Segmentation(const HDLLaserCorrection* corrections = NULL, unsigned int azimuth_step = RANGE_IMAGE_AZIMUTH_STEP);
+  virtual ~Segmentation();
+  void SetCorrections(const HDLLaserCorrection* corrections); // a decoder's GetLaserCorrections
+  void SetViewpoint(double x, double y, double z);            // sensor position, the origin unless an extrinsic is set
+  void SetGroundHeight(double z);                             // expected z of the ground under the sensor
+  void SetGroundTolerance(double tolerance);                  // metres a ground point may sit off the slope
+  void SetMaxGroundSlope(double degrees);
+  void SetClusterTolerance(double tolerance);                 // metres between neighbouring points of one cluster
+  void SetMinClusterSize(unsigned int min_size);
+  void SetNumberOfThreads(unsigned int num_threads);          // 0 for one per core
+  unsigned int GetNumberOfClusters();
+  unsigned int GetNumberOfGroundPoints();
+  RangeImage* GetRangeImage();                                // indexed on the last segmented frame
+
+  // fills frame->label with one value per point, the frame's x, y, z, laser_id and azimuth columns are required
+  template <typename Frame>
+  bool Segment(Frame* frame)
+  {
+    if (!_image.SetFrame(*frame)) {
+      return(false);
+    }
+    unsigned int n = _image.GetNumberOfPoints();
+    frame->label.resize(n);
+    return SegmentColumns(n, n ? &frame->x[0] : NULL, n ? &frame->y[0] : NULL, n ? &frame->z[0] : NULL,
+                          n ? &frame->label[0] : NULL);
+  }
+
+protected:
+  bool SegmentColumns(unsigned int num_points, const double* x, const double* y, const double* z, int* label);
+  void LabelGround(unsigned int column_begin, unsigned int column_end);
+  void ClusterSector(unsigned int column_begin, unsigned int column_end, std::vector<std::pair<int32_t, int32_t> >* crossing);
+  int32_t Find(int32_t point);
+  void Union(int32_t a, int32_t b);
+  void RunSectors(unsigned int num_sectors, bool ground);
+
+private:
+  RangeImage _image;
+  double _viewpoint[3];
+  double _ground_height;
+  double _ground_tolerance;
+  double _max_slope;          // tangent
+  double _cluster_tolerance;
+  unsigned int _min_cluster_size;
+  unsigned int _num_threads;
+  unsigned int _num_clusters;
+  unsigned int _num_ground;
+  unsigned int _num_points;
+  const double* _x;
+  const double* _y;
+  const double* _z;
+  int* _label;
+  std::vector<int32_t> _parent;
+  std::vector<uint32_t> _size;
+  std::vector<int32_t> _cluster_id; // per root
+  std::vector<std::vector<std::pair<int32_t, int32_t> > > _crossing; // per sector
+};
+
+#endif // SEGMENTATION_H_INCLUDED
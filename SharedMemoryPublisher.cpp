@@ -0,0 +1,206 @@
+// Velodyne HDL Shared Memory Publisher
+// Nick Rypkema (rypkema@mit.edu), MIT 2017
+// shared library to publish decoded frames or raw packet bundles into a POSIX shared memory ring
+
+#include <cstring>
+#include <new>
+#include <cerrno>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "SharedMemoryPublisher.h"
+#include "PacketBundler.h"
+
+namespace
+{
+// x, y, z, distance as doubles plus intensity, laser_id, azimuth, ms_from_top_of_hour
+const unsigned int SHARED_FRAME_BYTES_PER_POINT = 4*sizeof(double) + 2*sizeof(unsigned char) + sizeof(unsigned short) + sizeof(unsigned int);
+
+void CopyColumn(unsigned char* payload, SharedSlotHeader* slot, uint64_t* offset, int column, const void* data, size_t num_bytes)
+{
+  slot->column_offsets[column] = *offset;
+  if (num_bytes && data) {
+    memcpy(payload + *offset, data, num_bytes);
+  } else if (num_bytes) {
+    memset(payload + *offset, 0, num_bytes);
+  }
+  *offset = SharedRingAlign(*offset + num_bytes);
+}
+}
+
+SharedMemoryPublisher::SharedMemoryPublisher()
+{
+  _fd = -1;
+  _base = NULL;
+  _size = 0;
+  _header = NULL;
+}
+
+SharedMemoryPublisher::~SharedMemoryPublisher()
+{
+  Close();
+}
+
+bool SharedMemoryPublisher::Open(const std::string& name, unsigned int num_slots, unsigned int max_points)
+{
+  Close();
+
+  if (num_slots < 2) {
+    _last_error = "ring needs at least two slots";
+    return(false);
+  }
+
+  uint64_t frame_capacity = static_cast<uint64_t>(max_points)*SHARED_FRAME_BYTES_PER_POINT + SHARED_RING_NUM_COLUMNS*SHARED_RING_ALIGNMENT;
+  uint64_t bundle_capacity = static_cast<uint64_t>(HDL_MAX_PACKETS_PER_BUNDLE)*1206;
+  uint64_t slot_capacity = SharedRingAlign(frame_capacity > bundle_capacity ? frame_capacity : bundle_capacity);
+  uint64_t slot_stride = SharedSlotHeaderSize() + slot_capacity;
+  uint64_t size = SharedRingHeaderSize() + num_slots*slot_stride;
+
+  // start from a fresh segment rather than reusing an older ring's - subscribers still mapping the old one
+  // keep reading it (it is only freed once they unmap it) and see no new frames, SharedMemorySubscriber::IsStale
+  // tells them the name now refers to another segment so they can Open it again
+  shm_unlink(name.c_str());
+  _fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+  if (_fd < 0) {
+    _last_error = std::string("shm_open failed - ") + strerror(errno);
+    return(false);
+  }
+  if (ftruncate(_fd, size) != 0) {
+    _last_error = std::string("ftruncate failed - ") + strerror(errno);
+    Close();
+    shm_unlink(name.c_str());
+    return(false);
+  }
+  void* base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+  if (base == MAP_FAILED) {
+    _last_error = std::string("mmap failed - ") + strerror(errno);
+    Close();
+    shm_unlink(name.c_str());
+    return(false);
+  }
+
+  _name = name;
+  _base = static_cast<unsigned char*>(base);
+  _size = size;
+
+  for (unsigned int i = 0; i < num_slots; i++) {
+    SharedSlotHeader* slot = new (_base + SharedRingHeaderSize() + i*slot_stride) SharedSlotHeader();
+    slot->sequence.store(0, boost::memory_order_relaxed);
+  }
+
+  _header = new (_base) SharedRingHeader();
+  _header->num_slots = num_slots;
+  _header->reserved = 0;
+  _header->slot_stride = slot_stride;
+  _header->slot_capacity = slot_capacity;
+  _header->version = SHARED_RING_VERSION;
+  _header->write_sequence.store(0, boost::memory_order_relaxed);
+  // magic goes last, subscribers treat a segment without it as not yet initialised
+  boost::atomic_thread_fence(boost::memory_order_release);
+  _header->magic = SHARED_RING_MAGIC;
+
+  std::cout << "SharedMemoryPublisher: Success opening shared memory ring " << name << std::endl;
+  return(true);
+}
+
+bool SharedMemoryPublisher::IsOpen()
+{
+  return (_header != NULL);
+}
+
+void SharedMemoryPublisher::Close()
+{
+  if (_base) {
+    munmap(_base, _size);
+    _base = NULL;
+    _header = NULL;
+    _size = 0;
+  }
+  if (_fd >= 0) {
+    close(_fd);
+    _fd = -1;
+  }
+  if (_name.length()) {
+    shm_unlink(_name.c_str());
+    _name.clear();
+  }
+}
+
+const std::string& SharedMemoryPublisher::GetLastError()
+{
+  return _last_error;
+}
+
+uint64_t SharedMemoryPublisher::GetNumberOfPublished()
+{
+  return _header ? _header->write_sequence.load(boost::memory_order_relaxed) : 0;
+}
+
+SharedSlotHeader* SharedMemoryPublisher::BeginSlot(uint64_t* sequence)
+{
+  *sequence = _header->write_sequence.load(boost::memory_order_relaxed);
+  SharedSlotHeader* slot = reinterpret_cast<SharedSlotHeader*>(_base + SharedRingHeaderSize() + (*sequence % _header->num_slots)*_header->slot_stride);
+  slot->sequence.store(2*(*sequence) + 1, boost::memory_order_relaxed);
+  boost::atomic_thread_fence(boost::memory_order_release);
+  return slot;
+}
+
+void SharedMemoryPublisher::EndSlot(SharedSlotHeader* slot, uint64_t sequence)
+{
+  slot->sequence.store(2*sequence + 2, boost::memory_order_release);
+  _header->write_sequence.store(sequence + 1, boost::memory_order_release);
+}
+
+bool SharedMemoryPublisher::PublishBundle(const char* bundle, unsigned int bundle_length)
+{
+  if (!_header) {
+    return(false);
+  }
+  if (bundle_length > _header->slot_capacity) {
+    std::cout << "SharedMemoryPublisher: Warning, bundle does not fit in a ring slot" << std::endl;
+    return(false);
+  }
+
+  uint64_t sequence;
+  SharedSlotHeader* slot = BeginSlot(&sequence);
+  slot->type = SHARED_SLOT_BUNDLE;
+  slot->num_points = 0;
+  slot->length = bundle_length;
+  memcpy(reinterpret_cast<unsigned char*>(slot) + SharedSlotHeaderSize(), bundle, bundle_length);
+  EndSlot(slot, sequence);
+  return(true);
+}
+
+bool SharedMemoryPublisher::PublishColumns(unsigned int num_points, const double* x, const double* y, const double* z,
+                                           const unsigned char* intensity, const unsigned char* laser_id, const unsigned short* azimuth,
+                                           const double* distance, const unsigned int* ms_from_top_of_hour)
+{
+  if (!_header) {
+    return(false);
+  }
+  if (static_cast<uint64_t>(num_points)*SHARED_FRAME_BYTES_PER_POINT + SHARED_RING_NUM_COLUMNS*SHARED_RING_ALIGNMENT > _header->slot_capacity) {
+    std::cout << "SharedMemoryPublisher: Warning, frame does not fit in a ring slot" << std::endl;
+    return(false);
+  }
+
+  uint64_t sequence;
+  SharedSlotHeader* slot = BeginSlot(&sequence);
+  unsigned char* payload = reinterpret_cast<unsigned char*>(slot) + SharedSlotHeaderSize();
+  uint64_t offset = 0;
+  slot->type = SHARED_SLOT_FRAME;
+  slot->num_points = num_points;
+  CopyColumn(payload, slot, &offset, SHARED_COLUMN_X, x, num_points*sizeof(double));
+  CopyColumn(payload, slot, &offset, SHARED_COLUMN_Y, y, num_points*sizeof(double));
+  CopyColumn(payload, slot, &offset, SHARED_COLUMN_Z, z, num_points*sizeof(double));
+  CopyColumn(payload, slot, &offset, SHARED_COLUMN_INTENSITY, intensity, num_points*sizeof(unsigned char));
+  CopyColumn(payload, slot, &offset, SHARED_COLUMN_LASER_ID, laser_id, num_points*sizeof(unsigned char));
+  CopyColumn(payload, slot, &offset, SHARED_COLUMN_AZIMUTH, azimuth, num_points*sizeof(unsigned short));
+  CopyColumn(payload, slot, &offset, SHARED_COLUMN_DISTANCE, distance, num_points*sizeof(double));
+  CopyColumn(payload, slot, &offset, SHARED_COLUMN_MS_FROM_TOP_OF_HOUR, ms_from_top_of_hour, num_points*sizeof(unsigned int));
+  slot->length = offset;
+  EndSlot(slot, sequence);
+  return(true);
+}
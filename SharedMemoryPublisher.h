@@ -0,0 +1,63 @@
+// Velodyne HDL Shared Memory Publisher
+// Nick Rypkema (rypkema@mit.edu), MIT 2017
+// shared library to publish decoded frames or raw packet bundles into a POSIX shared memory ring
+
+#ifndef SHARED_MEMORY_PUBLISHER_H_INCLUDED
+#define SHARED_MEMORY_PUBLISHER_H_INCLUDED
+
+#include <string>
+#include <vector>
+#include "SharedMemoryRing.h"
+#include "PacketDecoder.h"
+
+// an HDL-64E spinning at 10Hz produces ~130k points per frame
+static unsigned int SHARED_RING_MAX_POINTS = 140000;
+static unsigned int SHARED_RING_NUM_SLOTS = 4;
+
+class SharedMemoryPublisher
+{
+public:
+  SharedMemoryPublisher();
+  virtual ~SharedMemoryPublisher();
+  bool Open(const std::string& name, unsigned int num_slots = SHARED_RING_NUM_SLOTS, unsigned int max_points = SHARED_RING_MAX_POINTS);
+  bool IsOpen();
+  void Close();
+  const std::string& GetLastError();
+  bool PublishBundle(const char* bundle, unsigned int bundle_length);
+  uint64_t GetNumberOfPublished();
+
+  // publishes any HDLFrame-like struct (PacketDecoder::HDLFrame, PacketBundleDecoder::HDLFrame)
+  template <typename Frame>
+  bool PublishFrame(const Frame& frame)
+  {
+    // columns left out by the decoder's column mask are empty and get published as zeros
+    unsigned int n = HDLFrameSize(frame);
+    return PublishColumns(n, ColumnData(frame.x), ColumnData(frame.y), ColumnData(frame.z),
+                          ColumnData(frame.intensity), ColumnData(frame.laser_id), ColumnData(frame.azimuth),
+                          ColumnData(frame.distance), ColumnData(frame.ms_from_top_of_hour));
+  }
+
+  bool PublishColumns(unsigned int num_points, const double* x, const double* y, const double* z,
+                      const unsigned char* intensity, const unsigned char* laser_id, const unsigned short* azimuth,
+                      const double* distance, const unsigned int* ms_from_top_of_hour);
+
+protected:
+  template <typename T>
+  static const T* ColumnData(const std::vector<T>& column)
+  {
+    return column.empty() ? NULL : &column[0];
+  }
+
+  SharedSlotHeader* BeginSlot(uint64_t* sequence);
+  void EndSlot(SharedSlotHeader* slot, uint64_t sequence);
+
+private:
+  std::string _name;
+  std::string _last_error;
+  int _fd;
+  unsigned char* _base;
+  uint64_t _size;
+  SharedRingHeader* _header;
+};
+
+#endif // SHARED_MEMORY_PUBLISHER_H_INCLUDED
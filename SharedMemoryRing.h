@@ -0,0 +1,76 @@
+// Velodyne HDL Shared Memory Ring
+// Nick Rypkema (rypkema@mit.edu), MIT 2017
+// layout of the POSIX shared memory ring shared by SharedMemoryPublisher and SharedMemorySubscriber
+
+#ifndef SHARED_MEMORY_RING_H_INCLUDED
+#define SHARED_MEMORY_RING_H_INCLUDED
+
+#include <stdint.h>
+#include <boost/atomic.hpp>
+#include <boost/static_assert.hpp>
+
+// the sequence counters live in memory mapped by several processes, so they must never fall back to a lock
+BOOST_STATIC_ASSERT(BOOST_ATOMIC_INT64_LOCK_FREE == 2);
+
+const uint32_t SHARED_RING_MAGIC = 0x48444c52; // "HDLR"
+const uint32_t SHARED_RING_VERSION = 1;
+const unsigned int SHARED_RING_ALIGNMENT = 64;
+const unsigned int SHARED_RING_NUM_COLUMNS = 8;
+
+enum SharedSlotType
+{
+  SHARED_SLOT_FRAME = 1,
+  SHARED_SLOT_BUNDLE = 2
+};
+
+// column order within a frame slot, each column starts on a cache line
+enum SharedFrameColumn
+{
+  SHARED_COLUMN_X = 0,
+  SHARED_COLUMN_Y,
+  SHARED_COLUMN_Z,
+  SHARED_COLUMN_INTENSITY,
+  SHARED_COLUMN_LASER_ID,
+  SHARED_COLUMN_AZIMUTH,
+  SHARED_COLUMN_DISTANCE,
+  SHARED_COLUMN_MS_FROM_TOP_OF_HOUR
+};
+
+struct SharedRingHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t num_slots;
+  uint32_t reserved;
+  uint64_t slot_stride;
+  uint64_t slot_capacity;
+  boost::atomic<uint64_t> write_sequence; // number of messages published so far
+};
+
+// message n lives in slot n % num_slots. sequence is 2n+1 while n is being written and 2n+2 once
+// it is complete, so readers can tell an in-progress or overwritten slot from the one they expect
+struct SharedSlotHeader
+{
+  boost::atomic<uint64_t> sequence;
+  uint32_t type;
+  uint32_t num_points;
+  uint64_t length;
+  uint64_t column_offsets[SHARED_RING_NUM_COLUMNS];
+};
+
+inline uint64_t SharedRingAlign(uint64_t size)
+{
+  return (size + SHARED_RING_ALIGNMENT - 1) & ~static_cast<uint64_t>(SHARED_RING_ALIGNMENT - 1);
+}
+
+inline uint64_t SharedRingHeaderSize()
+{
+  return SharedRingAlign(sizeof(SharedRingHeader));
+}
+
+inline uint64_t SharedSlotHeaderSize()
+{
+  return SharedRingAlign(sizeof(SharedSlotHeader));
+}
+
+#endif // SHARED_MEMORY_RING_H_INCLUDED
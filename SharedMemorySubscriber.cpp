@@ -0,0 +1,204 @@
+// Velodyne HDL Shared Memory Subscriber
+// Nick Rypkema (rypkema@mit.edu), MIT 2017
+// shared library to map frames or packet bundles published by SharedMemoryPublisher without copying
+
+#include <cstring>
+#include <cerrno>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "SharedMemorySubscriber.h"
+
+SharedMemorySubscriber::SharedMemorySubscriber()
+{
+  _fd = -1;
+  _device = 0;
+  _inode = 0;
+  _base = NULL;
+  _size = 0;
+  _header = NULL;
+  _next_sequence = 0;
+  _num_dropped = 0;
+}
+
+SharedMemorySubscriber::~SharedMemorySubscriber()
+{
+  Close();
+}
+
+bool SharedMemorySubscriber::Open(const std::string& name)
+{
+  Close();
+
+  _fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (_fd < 0) {
+    _last_error = std::string("shm_open failed - ") + strerror(errno);
+    return(false);
+  }
+  struct stat st;
+  if (fstat(_fd, &st) != 0 || static_cast<uint64_t>(st.st_size) < SharedRingHeaderSize()) {
+    _last_error = "shared memory ring is not initialised";
+    Close();
+    return(false);
+  }
+  void* base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, _fd, 0);
+  if (base == MAP_FAILED) {
+    _last_error = std::string("mmap failed - ") + strerror(errno);
+    Close();
+    return(false);
+  }
+  _base = static_cast<const unsigned char*>(base);
+  _size = st.st_size;
+  _name = name;
+  _device = st.st_dev;
+  _inode = st.st_ino;
+
+  const SharedRingHeader* header = reinterpret_cast<const SharedRingHeader*>(_base);
+  // slots are indexed modulo num_slots, and the size check is a division so a corrupt stride cannot overflow it
+  if (header->magic != SHARED_RING_MAGIC || header->version != SHARED_RING_VERSION || header->num_slots == 0 ||
+      header->slot_stride < SharedSlotHeaderSize() || header->slot_stride > (_size - SharedRingHeaderSize())/header->num_slots) {
+    _last_error = "shared memory ring is not initialised or has an unsupported version";
+    Close();
+    return(false);
+  }
+  boost::atomic_thread_fence(boost::memory_order_acquire);
+
+  _header = header;
+  _next_sequence = _header->write_sequence.load(boost::memory_order_acquire);
+  _num_dropped = 0;
+  return(true);
+}
+
+bool SharedMemorySubscriber::IsOpen()
+{
+  return (_header != NULL);
+}
+
+void SharedMemorySubscriber::Close()
+{
+  if (_base) {
+    munmap(const_cast<unsigned char*>(_base), _size);
+    _base = NULL;
+    _header = NULL;
+    _size = 0;
+  }
+  if (_fd >= 0) {
+    close(_fd);
+    _fd = -1;
+  }
+}
+
+bool SharedMemorySubscriber::IsStale()
+{
+  if (!_header) {
+    return(true);
+  }
+  int fd = shm_open(_name.c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    return(true);
+  }
+  struct stat st;
+  bool stale = (fstat(fd, &st) != 0 || st.st_dev != _device || st.st_ino != _inode);
+  close(fd);
+  return(stale);
+}
+
+const std::string& SharedMemorySubscriber::GetLastError()
+{
+  return _last_error;
+}
+
+uint64_t SharedMemorySubscriber::GetNumberOfDropped()
+{
+  return _num_dropped;
+}
+
+bool SharedMemorySubscriber::MapSequence(uint64_t sequence, SharedMemorySubscriber::SharedFrame* frame)
+{
+  const SharedSlotHeader* slot = reinterpret_cast<const SharedSlotHeader*>(_base + SharedRingHeaderSize() + (sequence % _header->num_slots)*_header->slot_stride);
+  uint64_t expected = 2*sequence + 2;
+  if (slot->sequence.load(boost::memory_order_acquire) != expected) {
+    return(false);
+  }
+
+  const char* payload = reinterpret_cast<const char*>(slot) + SharedSlotHeaderSize();
+  frame->sequence = sequence;
+  frame->type = static_cast<SharedSlotType>(slot->type);
+  frame->num_points = slot->num_points;
+  frame->x = reinterpret_cast<const double*>(payload + slot->column_offsets[SHARED_COLUMN_X]);
+  frame->y = reinterpret_cast<const double*>(payload + slot->column_offsets[SHARED_COLUMN_Y]);
+  frame->z = reinterpret_cast<const double*>(payload + slot->column_offsets[SHARED_COLUMN_Z]);
+  frame->intensity = reinterpret_cast<const unsigned char*>(payload + slot->column_offsets[SHARED_COLUMN_INTENSITY]);
+  frame->laser_id = reinterpret_cast<const unsigned char*>(payload + slot->column_offsets[SHARED_COLUMN_LASER_ID]);
+  frame->azimuth = reinterpret_cast<const unsigned short*>(payload + slot->column_offsets[SHARED_COLUMN_AZIMUTH]);
+  frame->distance = reinterpret_cast<const double*>(payload + slot->column_offsets[SHARED_COLUMN_DISTANCE]);
+  frame->ms_from_top_of_hour = reinterpret_cast<const unsigned int*>(payload + slot->column_offsets[SHARED_COLUMN_MS_FROM_TOP_OF_HOUR]);
+  frame->bundle = payload;
+  frame->bundle_length = static_cast<unsigned int>(slot->length);
+  frame->slot = slot;
+
+  bool sane = (slot->length <= _header->slot_capacity);
+  if (frame->type != SHARED_SLOT_BUNDLE) {
+    frame->bundle = NULL;
+    frame->bundle_length = 0;
+  }
+
+  // the header fields may have been torn by an overwrite while we were reading them
+  return sane && IsValid(*frame);
+}
+
+bool SharedMemorySubscriber::GetLatestFrame(SharedMemorySubscriber::SharedFrame* frame)
+{
+  if (!_header) {
+    return(false);
+  }
+
+  uint64_t write_sequence = _header->write_sequence.load(boost::memory_order_acquire);
+  if (write_sequence == 0 || write_sequence <= _next_sequence) {
+    return(false);
+  }
+
+  _num_dropped += write_sequence - 1 - _next_sequence;
+  _next_sequence = write_sequence;
+  if (!MapSequence(write_sequence - 1, frame)) {
+    _num_dropped++;
+    return(false);
+  }
+  return(true);
+}
+
+bool SharedMemorySubscriber::GetNextFrame(SharedMemorySubscriber::SharedFrame* frame)
+{
+  if (!_header) {
+    return(false);
+  }
+
+  while (true) {
+    uint64_t write_sequence = _header->write_sequence.load(boost::memory_order_acquire);
+    if (_next_sequence >= write_sequence) {
+      return(false);
+    }
+    // the slot of write_sequence - num_slots is the one the publisher writes next, skip it too
+    uint64_t oldest = (write_sequence >= _header->num_slots) ? write_sequence - _header->num_slots + 1 : 0;
+    if (_next_sequence < oldest) {
+      _num_dropped += oldest - _next_sequence;
+      _next_sequence = oldest;
+    }
+    if (MapSequence(_next_sequence++, frame)) {
+      return(true);
+    }
+    _num_dropped++;
+  }
+}
+
+bool SharedMemorySubscriber::IsValid(const SharedMemorySubscriber::SharedFrame& frame)
+{
+  if (!_header || frame.slot == NULL) {
+    return(false);
+  }
+  boost::atomic_thread_fence(boost::memory_order_acquire);
+  return (frame.slot->sequence.load(boost::memory_order_relaxed) == 2*frame.sequence + 2);
+}
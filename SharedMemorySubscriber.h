@@ -0,0 +1,65 @@
+// Velodyne HDL Shared Memory Subscriber
+// Nick Rypkema (rypkema@mit.edu), MIT 2017
+// shared library to map frames or packet bundles published by SharedMemoryPublisher without copying
+
+#ifndef SHARED_MEMORY_SUBSCRIBER_H_INCLUDED
+#define SHARED_MEMORY_SUBSCRIBER_H_INCLUDED
+
+#include <string>
+#include <sys/types.h>
+#include "SharedMemoryRing.h"
+
+class SharedMemorySubscriber
+{
+public:
+  // read-only view straight into the ring - check IsValid after using it, the publisher never waits for readers
+  struct SharedFrame
+  {
+    uint64_t sequence;
+    SharedSlotType type;
+    unsigned int num_points;
+    const double* x;
+    const double* y;
+    const double* z;
+    const unsigned char* intensity;
+    const unsigned char* laser_id;
+    const unsigned short* azimuth;
+    const double* distance;
+    const unsigned int* ms_from_top_of_hour;
+    const char* bundle;
+    unsigned int bundle_length;
+    const SharedSlotHeader* slot;
+  };
+
+public:
+  SharedMemorySubscriber();
+  virtual ~SharedMemorySubscriber();
+  bool Open(const std::string& name);
+  bool IsOpen();
+  void Close();
+  const std::string& GetLastError();
+  bool GetLatestFrame(SharedFrame* frame);
+  bool GetNextFrame(SharedFrame* frame);
+  bool IsValid(const SharedFrame& frame);
+  // true once the publisher has closed or restarted the ring, so the mapped segment will get no more frames
+  // and the name must be opened again - costs a system call, check it when frames stop arriving
+  bool IsStale();
+  uint64_t GetNumberOfDropped();
+
+protected:
+  bool MapSequence(uint64_t sequence, SharedFrame* frame);
+
+private:
+  std::string _last_error;
+  std::string _name;
+  dev_t _device;
+  ino_t _inode;
+  int _fd;
+  const unsigned char* _base;
+  uint64_t _size;
+  const SharedRingHeader* _header;
+  uint64_t _next_sequence;
+  uint64_t _num_dropped;
+};
+
+#endif // SHARED_MEMORY_SUBSCRIBER_H_INCLUDED
@@ -0,0 +1,257 @@
+// Velodyne HDL Python Bindings
+// Nick Rypkema (rypkema@mit.edu), MIT 2017
+// python extension module exposing the decoders and pcap reader, frame columns are numpy arrays sharing the C++ buffers
+
+#include <vector>
+#include <string>
+#include <boost/shared_ptr.hpp>
+#include <boost/python.hpp>
+#include <boost/python/numpy.hpp>
+
+#include "PacketDecoder.h"
+#include "PacketBundleDecoder.h"
+#include "PacketFileReader.h"
+
+namespace bp = boost::python;
+namespace np = boost::python::numpy;
+
+namespace
+{
+// releases the GIL for the lifetime of the object so other python threads run while we decode
+class ScopedGILRelease
+{
+public:
+  ScopedGILRelease() { _state = PyEval_SaveThread(); }
+  ~ScopedGILRelease() { PyEval_RestoreThread(_state); }
+
+private:
+  PyThreadState* _state;
+};
+
+// read-only view of any object exposing the buffer protocol (bytes, bytearray, numpy arrays, ...)
+class ScopedBuffer
+{
+public:
+  ScopedBuffer(bp::object data)
+  {
+    if (PyObject_GetBuffer(data.ptr(), &_view, PyBUF_SIMPLE) != 0) {
+      bp::throw_error_already_set();
+    }
+  }
+  ~ScopedBuffer() { PyBuffer_Release(&_view); }
+  const char* data() const { return static_cast<const char*>(_view.buf); }
+  unsigned int length() const { return static_cast<unsigned int>(_view.len); }
+
+private:
+  Py_buffer _view;
+};
+
+// numpy array over one HDLFrame column - the python frame object is the array's base, so the
+// vector stays alive for as long as any array referencing it does
+template <typename Frame, typename T, std::vector<T> Frame::*Column>
+np::ndarray FrameColumn(bp::object self)
+{
+  static const T empty = T();
+  Frame& frame = bp::extract<Frame&>(self);
+  const std::vector<T>& column = frame.*Column;
+  const T* data = column.empty() ? &empty : &column[0];
+  return np::from_data(data, np::dtype::get_builtin<T>(), bp::make_tuple(column.size()), bp::make_tuple(sizeof(T)), self);
+}
+
+template <typename Frame>
+size_t FrameLength(const Frame& frame)
+{
+  return HDLFrameSize(frame);
+}
+
+template <typename Frame>
+void ExposeFrame(const char* name)
+{
+  bp::class_<Frame, boost::shared_ptr<Frame> >(name)
+    .def("__len__", &FrameLength<Frame>)
+    .add_property("x", &FrameColumn<Frame, double, &Frame::x>)
+    .add_property("y", &FrameColumn<Frame, double, &Frame::y>)
+    .add_property("z", &FrameColumn<Frame, double, &Frame::z>)
+    .add_property("intensity", &FrameColumn<Frame, unsigned char, &Frame::intensity>)
+    .add_property("laser_id", &FrameColumn<Frame, unsigned char, &Frame::laser_id>)
+    .add_property("azimuth", &FrameColumn<Frame, unsigned short, &Frame::azimuth>)
+    .add_property("distance", &FrameColumn<Frame, double, &Frame::distance>)
+    .add_property("ms_from_top_of_hour", &FrameColumn<Frame, unsigned int, &Frame::ms_from_top_of_hour>);
+}
+
+template <typename Decoder>
+bp::object GetLatestFrame(Decoder& decoder)
+{
+  boost::shared_ptr<typename Decoder::HDLFrame> frame(new typename Decoder::HDLFrame());
+  if (decoder.GetLatestFrame(frame.get())) {
+    return bp::object(frame);
+  }
+  return bp::object();
+}
+
+void DecodePacket(PacketDecoder& decoder, bp::object data)
+{
+  ScopedBuffer buffer(data);
+  ScopedGILRelease release;
+  decoder.DecodePacket(buffer.data(), buffer.length());
+}
+
+void DecodeBundle(PacketBundleDecoder& decoder, bp::object bundle)
+{
+  ScopedBuffer buffer(bundle);
+  ScopedGILRelease release;
+  decoder.DecodeBundle(buffer.data(), buffer.length());
+}
+
+bool DecodeCompressedBundle(PacketBundleDecoder& decoder, bp::object compressed)
+{
+  ScopedBuffer buffer(compressed);
+  ScopedGILRelease release;
+  return decoder.DecodeCompressedBundle(buffer.data(), buffer.length());
+}
+
+// decodes a whole pcap file without returning to python between packets
+bp::list DecodePcap(PacketDecoder& decoder, const std::string& filename)
+{
+  if (decoder.HasFrameCallback()) {
+    PyErr_SetString(PyExc_RuntimeError, "decode_pcap needs a decoder without a frame callback, which would take the frames");
+    bp::throw_error_already_set();
+  }
+  std::vector<boost::shared_ptr<PacketDecoder::HDLFrame> > frames;
+  bool opened;
+  {
+    ScopedGILRelease release;
+    vtkPacketFileReader reader;
+    opened = reader.Open(filename);
+    const unsigned char* data = 0;
+    unsigned int data_length = 0;
+    double time_since_start = 0;
+    boost::shared_ptr<PacketDecoder::HDLFrame> frame(new PacketDecoder::HDLFrame());
+    while (opened && reader.NextPacket(data, data_length, time_since_start)) {
+      if (data_length != 1206) {
+        continue;
+      }
+      decoder.DecodePacket(reinterpret_cast<const char*>(data), data_length);
+      // at most one frame completes per packet, so nothing is lost by taking only the latest
+      if (decoder.GetLatestFrame(frame.get())) {
+        frames.push_back(frame);
+        frame.reset(new PacketDecoder::HDLFrame());
+      }
+    }
+    // the capture rarely ends on the cut angle - the last, partial rotation is returned like the first one
+    if (opened) {
+      decoder.FlushFrame();
+      if (decoder.GetLatestFrame(frame.get())) {
+        frames.push_back(frame);
+      }
+    }
+  }
+
+  if (!opened) {
+    PyErr_SetString(PyExc_IOError, ("could not open pcap file " + filename).c_str());
+    bp::throw_error_already_set();
+  }
+
+  bp::list result;
+  for (size_t i = 0; i < frames.size(); i++) {
+    result.append(frames[i]);
+  }
+  return result;
+}
+
+bool ReaderOpen(vtkPacketFileReader& reader, const std::string& filename)
+{
+  ScopedGILRelease release;
+  return reader.Open(filename);
+}
+
+bp::object ReaderNextPacket(vtkPacketFileReader& reader)
+{
+  const unsigned char* data = 0;
+  unsigned int data_length = 0;
+  double time_since_start = 0;
+  if (!reader.NextPacket(data, data_length, time_since_start)) {
+    return bp::object();
+  }
+  bp::object packet(bp::handle<>(PyBytes_FromStringAndSize(reinterpret_cast<const char*>(data), data_length)));
+  return bp::make_tuple(packet, time_since_start);
+}
+}
+
+BOOST_PYTHON_MODULE(velodyne_hdl)
+{
+  np::initialize();
+
+  bp::enum_<VoxelGrid::VoxelPolicy>("VoxelPolicy")
+    .value("CENTROID", VoxelGrid::VOXEL_CENTROID)
+    .value("FIRST_POINT", VoxelGrid::VOXEL_FIRST_POINT);
+
+  bp::enum_<HDLBinSelection>("BinSelection")
+    .value("MIN_RANGE", HDL_BIN_MIN_RANGE)
+    .value("MAX_INTENSITY", HDL_BIN_MAX_INTENSITY);
+
+  // column mask bits, or them together for set_column_mask
+  bp::scope().attr("COLUMN_XYZ") = static_cast<unsigned int>(HDL_COLUMN_XYZ);
+  bp::scope().attr("COLUMN_INTENSITY") = static_cast<unsigned int>(HDL_COLUMN_INTENSITY);
+  bp::scope().attr("COLUMN_LASER_ID") = static_cast<unsigned int>(HDL_COLUMN_LASER_ID);
+  bp::scope().attr("COLUMN_AZIMUTH") = static_cast<unsigned int>(HDL_COLUMN_AZIMUTH);
+  bp::scope().attr("COLUMN_DISTANCE") = static_cast<unsigned int>(HDL_COLUMN_DISTANCE);
+  bp::scope().attr("COLUMN_MS_FROM_TOP_OF_HOUR") = static_cast<unsigned int>(HDL_COLUMN_MS_FROM_TOP_OF_HOUR);
+  bp::scope().attr("COLUMN_ALL") = static_cast<unsigned int>(HDL_COLUMN_ALL);
+
+  ExposeFrame<PacketDecoder::HDLFrame>("PacketDecoderFrame");
+  ExposeFrame<PacketBundleDecoder::HDLFrame>("PacketBundleDecoderFrame");
+
+  bp::class_<PacketDecoder, boost::noncopyable>("PacketDecoder")
+    .def("set_max_number_of_frames", &PacketDecoder::SetMaxNumberOfFrames)
+    .def("set_corrections_file", &PacketDecoder::SetCorrectionsFile)
+    .def("set_extrinsic", static_cast<bool (PacketDecoder::*)(double, double, double, double, double, double)>(&PacketDecoder::SetExtrinsic),
+         (bp::arg("self"), bp::arg("x"), bp::arg("y"), bp::arg("z"), bp::arg("roll"), bp::arg("pitch"), bp::arg("yaw")))
+    .def("clear_extrinsic", &PacketDecoder::ClearExtrinsic)
+    .def("set_time_offset", &PacketDecoder::SetTimeOffset)
+    .def("set_intensity_calibration", &PacketDecoder::SetIntensityCalibration)
+    .def("set_column_mask", &PacketDecoder::SetColumnMask)
+    .def("get_column_mask", &PacketDecoder::GetColumnMask)
+    .def("set_voxel_grid", &PacketDecoder::SetVoxelGrid, (bp::arg("self"), bp::arg("leaf_size"), bp::arg("policy") = VoxelGrid::VOXEL_CENTROID))
+    .def("disable_voxel_grid", &PacketDecoder::DisableVoxelGrid)
+    .def("set_background_model", &PacketDecoder::SetBackgroundModel, (bp::arg("self"), bp::arg("adaptation_rate"), bp::arg("threshold") = 0.2))
+    .def("disable_background_model", &PacketDecoder::DisableBackgroundModel)
+    .def("set_decimation", &PacketDecoder::SetDecimation, (bp::arg("self"), bp::arg("firing_step"), bp::arg("laser_step") = 1))
+    .def("set_azimuth_binning", &PacketDecoder::SetAzimuthBinning, (bp::arg("self"), bp::arg("azimuth_bin"), bp::arg("selection") = HDL_BIN_MIN_RANGE))
+    .def("set_point_budget", &PacketDecoder::SetPointBudget)
+    .def("disable_decimation", &PacketDecoder::DisableDecimation)
+    .def("decode_packet", &DecodePacket)
+    .def("decode_pcap", &DecodePcap)
+    .def("clear_frames", &PacketDecoder::ClearFrames)
+    .def("get_latest_frame", &GetLatestFrame<PacketDecoder>);
+
+  bp::class_<PacketBundleDecoder, boost::noncopyable>("PacketBundleDecoder")
+    .def("set_max_number_of_frames", &PacketBundleDecoder::SetMaxNumberOfFrames)
+    .def("set_corrections_file", &PacketBundleDecoder::SetCorrectionsFile)
+    .def("set_extrinsic", static_cast<bool (PacketBundleDecoder::*)(double, double, double, double, double, double)>(&PacketBundleDecoder::SetExtrinsic),
+         (bp::arg("self"), bp::arg("x"), bp::arg("y"), bp::arg("z"), bp::arg("roll"), bp::arg("pitch"), bp::arg("yaw")))
+    .def("clear_extrinsic", &PacketBundleDecoder::ClearExtrinsic)
+    .def("set_time_offset", &PacketBundleDecoder::SetTimeOffset)
+    .def("set_intensity_calibration", &PacketBundleDecoder::SetIntensityCalibration)
+    .def("set_column_mask", &PacketBundleDecoder::SetColumnMask)
+    .def("get_column_mask", &PacketBundleDecoder::GetColumnMask)
+    .def("set_voxel_grid", &PacketBundleDecoder::SetVoxelGrid, (bp::arg("self"), bp::arg("leaf_size"), bp::arg("policy") = VoxelGrid::VOXEL_CENTROID))
+    .def("disable_voxel_grid", &PacketBundleDecoder::DisableVoxelGrid)
+    .def("set_background_model", &PacketBundleDecoder::SetBackgroundModel, (bp::arg("self"), bp::arg("adaptation_rate"), bp::arg("threshold") = 0.2))
+    .def("disable_background_model", &PacketBundleDecoder::DisableBackgroundModel)
+    .def("set_decimation", &PacketBundleDecoder::SetDecimation, (bp::arg("self"), bp::arg("firing_step"), bp::arg("laser_step") = 1))
+    .def("set_azimuth_binning", &PacketBundleDecoder::SetAzimuthBinning, (bp::arg("self"), bp::arg("azimuth_bin"), bp::arg("selection") = HDL_BIN_MIN_RANGE))
+    .def("set_point_budget", &PacketBundleDecoder::SetPointBudget)
+    .def("disable_decimation", &PacketBundleDecoder::DisableDecimation)
+    .def("decode_bundle", &DecodeBundle)
+    .def("decode_compressed_bundle", &DecodeCompressedBundle)
+    .def("clear_frames", &PacketBundleDecoder::ClearFrames)
+    .def("get_latest_frame", &GetLatestFrame<PacketBundleDecoder>);
+
+  bp::class_<vtkPacketFileReader, boost::noncopyable>("PacketFileReader")
+    .def("open", &ReaderOpen)
+    .def("is_open", &vtkPacketFileReader::IsOpen)
+    .def("close", &vtkPacketFileReader::Close)
+    .def("get_last_error", &vtkPacketFileReader::GetLastError, bp::return_value_policy<bp::copy_const_reference>())
+    .def("next_packet", &ReaderNextPacket);
+}
@@ -0,0 +1,111 @@
+// Velodyne HDL Voxel Grid
+// Nick Rypkema (rypkema@mit.edu), MIT 2017
+// shared library to voxel-downsample decoded points while a frame is being assembled
+
+#include <cmath>
+#include <iostream>
+
+#include "VoxelGrid.h"
+
+namespace
+{
+// 21 bits per axis, so +/-1048576 leaves around the sensor - ~1km at 1mm leaves
+const int64_t VOXEL_AXIS_OFFSET = 1 << 20;
+const int64_t VOXEL_AXIS_MASK = (1 << 21) - 1;
+const unsigned int VOXEL_INITIAL_CAPACITY = 16384;
+}
+
+VoxelGrid::VoxelGrid(double leaf_size, VoxelPolicy policy)
+{
+  _leaf_size = 0.1;
+  _inv_leaf_size = 10.0;
+  _policy = policy;
+  SetLeafSize(leaf_size);
+  _voxels.reserve(VOXEL_INITIAL_CAPACITY);
+  _index.reserve(VOXEL_INITIAL_CAPACITY);
+}
+
+VoxelGrid::~VoxelGrid()
+{
+
+}
+
+void VoxelGrid::SetLeafSize(double leaf_size)
+{
+  if (leaf_size <= 0) {
+    std::cout << "VoxelGrid: Warning, leaf size must be positive" << std::endl;
+    return;
+  }
+  _leaf_size = leaf_size;
+  _inv_leaf_size = 1.0 / leaf_size;
+  Clear();
+}
+
+void VoxelGrid::SetPolicy(VoxelPolicy policy)
+{
+  _policy = policy;
+  Clear();
+}
+
+double VoxelGrid::GetLeafSize() const
+{
+  return _leaf_size;
+}
+
+VoxelGrid::VoxelPolicy VoxelGrid::GetPolicy() const
+{
+  return _policy;
+}
+
+uint64_t VoxelGrid::VoxelKey(double x, double y, double z) const
+{
+  int64_t ix = static_cast<int64_t>(std::floor(x * _inv_leaf_size)) + VOXEL_AXIS_OFFSET;
+  int64_t iy = static_cast<int64_t>(std::floor(y * _inv_leaf_size)) + VOXEL_AXIS_OFFSET;
+  int64_t iz = static_cast<int64_t>(std::floor(z * _inv_leaf_size)) + VOXEL_AXIS_OFFSET;
+  return (static_cast<uint64_t>(ix & VOXEL_AXIS_MASK) << 42) |
+         (static_cast<uint64_t>(iy & VOXEL_AXIS_MASK) << 21) |
+         static_cast<uint64_t>(iz & VOXEL_AXIS_MASK);
+}
+
+void VoxelGrid::AddPoint(double x, double y, double z, unsigned char intensity, unsigned char laser_id, unsigned short azimuth, double distance, unsigned int timestamp)
+{
+  std::pair<boost::unordered_map<uint64_t, unsigned int>::iterator, bool> inserted =
+    _index.insert(std::make_pair(VoxelKey(x, y, z), static_cast<unsigned int>(_voxels.size())));
+
+  if (inserted.second) {
+    Voxel v;
+    v.x = x;
+    v.y = y;
+    v.z = z;
+    v.distance = distance;
+    v.intensity = intensity;
+    v.count = 1;
+    v.laser_id = laser_id;
+    v.azimuth = azimuth;
+    v.ms_from_top_of_hour = timestamp;
+    _voxels.push_back(v);
+    return;
+  }
+
+  if (_policy == VOXEL_CENTROID) {
+    Voxel& v = _voxels[inserted.first->second];
+    v.x += x;
+    v.y += y;
+    v.z += z;
+    v.distance += distance;
+    v.intensity += intensity;
+    v.count++;
+  }
+}
+
+unsigned int VoxelGrid::GetNumberOfVoxels() const
+{
+  return static_cast<unsigned int>(_voxels.size());
+}
+
+void VoxelGrid::Clear()
+{
+  // keep both the voxel storage and the hash buckets allocated for the next frame
+  _voxels.clear();
+  _index.clear();
+}
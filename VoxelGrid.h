@@ -0,0 +1,86 @@
+// Velodyne HDL Voxel Grid
+// Nick Rypkema (rypkema@mit.edu), MIT 2017
+// shared library to voxel-downsample decoded points while a frame is being assembled
+
+#ifndef VOXEL_GRID_H_INCLUDED
+#define VOXEL_GRID_H_INCLUDED
+
+#include <vector>
+#include <stdint.h>
+#include <boost/unordered_map.hpp>
+
+class VoxelGrid
+{
+public:
+  enum VoxelPolicy
+  {
+    VOXEL_CENTROID = 0,   // emit the mean position, distance and intensity of all points in a voxel
+    VOXEL_FIRST_POINT = 1 // emit the first point that landed in a voxel unchanged
+  };
+
+  struct Voxel
+  {
+    double x;
+    double y;
+    double z;
+    double distance;
+    unsigned int intensity;
+    unsigned int count;
+    unsigned char laser_id;
+    unsigned short azimuth;
+    unsigned int ms_from_top_of_hour;
+  };
+
+public:
+  VoxelGrid(double leaf_size, VoxelPolicy policy);
+  virtual ~VoxelGrid();
+  void SetLeafSize(double leaf_size);
+  void SetPolicy(VoxelPolicy policy);
+  double GetLeafSize() const;
+  VoxelPolicy GetPolicy() const;
+  void AddPoint(double x, double y, double z, unsigned char intensity, unsigned char laser_id, unsigned short azimuth, double distance, unsigned int timestamp);
+  unsigned int GetNumberOfVoxels() const;
+  void Clear();
+
+  // appends one point per occupied voxel to any HDLFrame-like struct and clears the grid
+  template <typename Frame>
+  void Flush(Frame* frame)
+  {
+    size_t n = frame->x.size() + _voxels.size();
+    frame->x.reserve(n);
+    frame->y.reserve(n);
+    frame->z.reserve(n);
+    frame->intensity.reserve(n);
+    frame->laser_id.reserve(n);
+    frame->azimuth.reserve(n);
+    frame->distance.reserve(n);
+    frame->ms_from_top_of_hour.reserve(n);
+
+    for (size_t i = 0; i < _voxels.size(); i++) {
+      const Voxel& v = _voxels[i];
+      double inv = (_policy == VOXEL_CENTROID) ? 1.0 / v.count : 1.0;
+      frame->x.push_back(v.x * inv);
+      frame->y.push_back(v.y * inv);
+      frame->z.push_back(v.z * inv);
+      frame->intensity.push_back(static_cast<unsigned char>(v.intensity * inv + 0.5));
+      frame->laser_id.push_back(v.laser_id);
+      frame->azimuth.push_back(v.azimuth);
+      frame->distance.push_back(v.distance * inv);
+      frame->ms_from_top_of_hour.push_back(v.ms_from_top_of_hour);
+    }
+
+    Clear();
+  }
+
+protected:
+  uint64_t VoxelKey(double x, double y, double z) const;
+
+private:
+  double _leaf_size;
+  double _inv_leaf_size;
+  VoxelPolicy _policy;
+  std::vector<Voxel> _voxels;
+  boost::unordered_map<uint64_t, unsigned int> _index;
+};
+
+#endif // VOXEL_GRID_H_INCLUDED
@@ -0,0 +1,28 @@
+#include <iostream>
+#include "PacketDriver.h"
+#include "PacketDecoder.h"
+
+int main()
+{
+  PacketDriver driver;
+  driver.InitPacketDriver(DATA_PORT);
+  PacketDecoder decoder;
+  decoder.SetCorrectionsFile("../32db.xml");
+  // a fixed sensor - learn the background over a few seconds and decode only what moves in front of it
+  decoder.SetBackgroundModel(0.02, 0.2);
+
+  std::string* data = new std::string();
+  unsigned int* dataLength = new unsigned int();
+  PacketDecoder::HDLFrame latest_frame;
+  while (true) {
+    driver.GetPacket(data, dataLength);
+    decoder.DecodePacket(data, dataLength);
+    if (decoder.GetLatestFrame(&latest_frame)) {
+      BackgroundModel* model = decoder.GetBackgroundModel();
+      std::cout << "Number of foreground points: " << latest_frame.x.size() << " (" << model->GetNumberOfBackground()
+                << " background returns removed so far)" << std::endl;
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,40 @@
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "PacketDriver.h"
+#include "PacketDecoder.h"
+
+using namespace std;
+
+int main()
+{
+  PacketDriver driver;
+  driver.InitPacketDriver(DATA_PORT);
+  PacketDecoder sensor_decoder;
+  sensor_decoder.SetCorrectionsFile("../32db.xml");
+  // sensor mounted 1.8m up and 0.5m forward of the vehicle origin, turned 90 degrees left, clock 2.5ms ahead
+  PacketDecoder vehicle_decoder;
+  vehicle_decoder.SetCorrectionsFile("../32db.xml");
+  if (!vehicle_decoder.SetExtrinsic(0.5, 0.0, 1.8, 0.0, 0.0, M_PI/2)) {
+    return 1;
+  }
+  vehicle_decoder.SetTimeOffset(-2500);
+
+  std::string* data = new std::string();
+  unsigned int* dataLength = new unsigned int();
+  PacketDecoder::HDLFrame sensor_frame;
+  PacketDecoder::HDLFrame vehicle_frame;
+  while (true) {
+    driver.GetPacket(data, dataLength);
+    sensor_decoder.DecodePacket(data, dataLength);
+    vehicle_decoder.DecodePacket(data, dataLength);
+    if (sensor_decoder.GetLatestFrame(&sensor_frame) && vehicle_decoder.GetLatestFrame(&vehicle_frame) && !sensor_frame.x.empty()) {
+      // expect vehicle (x, y, z) = (0.5 - y, x, 1.8 + z) of the sensor point, 2500us earlier
+      std::cout << "Sensor frame: (" << sensor_frame.x[0] << ", " << sensor_frame.y[0] << ", " << sensor_frame.z[0] << ") at " << sensor_frame.ms_from_top_of_hour[0]
+                << ", vehicle frame: (" << vehicle_frame.x[0] << ", " << vehicle_frame.y[0] << ", " << vehicle_frame.z[0] << ") at " << vehicle_frame.ms_from_top_of_hour[0] << std::endl;
+    }
+  }
+
+  return 0;
+}
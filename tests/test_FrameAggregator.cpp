@@ -0,0 +1,53 @@
+#include <iostream>
+#include "PacketDriver.h"
+#include "PacketDecoder.h"
+#include "FrameAggregator.h"
+#include <boost/bind.hpp>
+#include <boost/asio.hpp>
+
+using namespace std;
+
+FrameAggregator aggregator(FrameAggregator::ALIGN_CUT_ANGLE);
+
+void OnPacket(unsigned int sensor, const char* data, unsigned int data_length, const struct timespec&)
+{
+  aggregator.DecodePacket(sensor, data, data_length);
+}
+
+void OnMergedFrame(const FrameAggregator::MergedFrame& frame)
+{
+  std::cout << "Merged frame " << frame.index << ", number of points: " << frame.points.x.size() << ", sensors: 0x" << std::hex << frame.sensor_mask << std::dec;
+  FrameAggregator::SensorStatus status;
+  for (unsigned int i = 0; aggregator.GetSensorStatus(i, &status); i++) {
+    std::cout << ", sensor " << i << " skew " << status.last_arrival_skew << "us";
+  }
+  std::cout << std::endl;
+}
+
+int main()
+{
+  // two sensors, the second streaming to the next port up, both received and merged on one thread
+  boost::asio::io_service io_service;
+  PacketDriver driver0(io_service);
+  PacketDriver driver1(io_service);
+  driver0.InitPacketDriver(DATA_PORT);
+  driver1.InitPacketDriver(DATA_PORT+1);
+
+  PacketDecoder decoder0;
+  PacketDecoder decoder1;
+  decoder0.SetCorrectionsFile("../32db.xml");
+  decoder1.SetCorrectionsFile("../32db.xml");
+  decoder1.SetExtrinsic(0.0, 1.0, 0.0, 0.0, 0.0, M_PI);
+
+  aggregator.SetCutAngle(18000);
+  aggregator.Reserve(2*70000);
+  aggregator.AddSensor(&decoder0);
+  aggregator.AddSensor(&decoder1);
+  aggregator.SetMergedFrameCallback(&OnMergedFrame);
+
+  driver0.StartReceive(boost::bind(&OnPacket, 0, _1, _2, _3));
+  driver1.StartReceive(boost::bind(&OnPacket, 1, _1, _2, _3));
+  io_service.run();
+
+  return 0;
+}
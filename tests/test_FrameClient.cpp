@@ -0,0 +1,32 @@
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include "FrameClient.h"
+#include <boost/thread/thread.hpp>
+
+using namespace std;
+
+int main(int argc, char* argv[])
+{
+  // usage: test_FrameClient [host [port]] - asks for xyz and intensity within 20m, compressed
+  std::string host = (argc > 1) ? argv[1] : "127.0.0.1";
+  unsigned short port = (argc > 2) ? atoi(argv[2]) : FRAME_STREAM_PORT;
+
+  FrameClient client;
+  client.SetColumns(HDL_COLUMN_XYZ | HDL_COLUMN_INTENSITY);
+  client.SetRegionOfInterest(-20, -20, -5, 20, 20, 5);
+  client.SetCompression(true);
+  while (!client.Connect(host, port)) {
+    boost::this_thread::sleep(boost::posix_time::seconds(1));
+  }
+
+  PacketDecoder::HDLFrame frame;
+  uint64_t sequence;
+  while (client.GetNextFrame(&frame, &sequence)) {
+    std::cout << "Frame " << sequence << ": " << frame.x.size() << " points, " << client.GetNumberOfMissed() << " missed, "
+              << client.GetNumberOfBytesReceived() << " bytes received" << std::endl;
+  }
+  std::cout << "Disconnected" << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,57 @@
+#include <iostream>
+#include "PacketDriver.h"
+#include "PacketDecoder.h"
+#include "FrameQueue.h"
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+using namespace std;
+
+FrameQueue<PacketDecoder::HDLFrame> queue(4, FRAME_QUEUE_DROP_OLDEST);
+LatestFrameSlot<PacketDecoder::HDLFrame> latest;
+
+void OnFrame(const PacketDecoder::HDLFrame& frame)
+{
+  queue.Push(frame);
+  latest.Publish(frame);
+}
+
+void DecodeLoop()
+{
+  PacketDriver driver;
+  driver.InitPacketDriver(DATA_PORT);
+  PacketDecoder decoder;
+  decoder.SetCorrectionsFile("../32db.xml");
+  decoder.SetFrameCallback(&OnFrame);
+
+  std::string* data = new std::string();
+  unsigned int* dataLength = new unsigned int();
+  while (true) {
+    driver.GetPacket(data, dataLength);
+    decoder.DecodePacket(data, dataLength);
+  }
+}
+
+int main()
+{
+  boost::thread decode_thread(&DecodeLoop);
+
+  // a deliberately slow consumer - the queue keeps the 4 newest frames and counts what it evicts
+  PacketDecoder::HDLFrame frame;
+  while (true) {
+    if (queue.Pop(&frame, 1000)) {
+      std::cout << "Number of points: " << frame.x.size() << ", queued: " << queue.GetSize()
+                << ", dropped: " << queue.GetNumberOfDropped(FRAME_QUEUE_DROP_OLDEST) << std::endl;
+      boost::this_thread::sleep(boost::posix_time::milliseconds(250));
+    } else {
+      std::cout << "No frame for a second" << std::endl;
+    }
+
+    const PacketDecoder::HDLFrame* newest = latest.AcquireLatest();
+    if (newest) {
+      std::cout << "Latest frame points: " << newest->x.size() << ", overwritten: " << latest.GetNumberOfOverwritten() << std::endl;
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,37 @@
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include "PacketDriver.h"
+#include "PacketDecoder.h"
+#include "FrameServer.h"
+
+using namespace std;
+
+int main()
+{
+  PacketDriver driver;
+  driver.InitPacketDriver(DATA_PORT);
+  PacketDecoder decoder;
+  decoder.SetCorrectionsFile("../32db.xml");
+  FrameServer server;
+  if (!server.Start(FRAME_STREAM_PORT)) {
+    return 1;
+  }
+
+  std::string* data = new std::string();
+  unsigned int* dataLength = new unsigned int();
+  PacketDecoder::HDLFrame latest_frame;
+  while (true) {
+    driver.GetPacket(data, dataLength);
+    decoder.DecodePacket(data, dataLength);
+    if (decoder.GetLatestFrame(&latest_frame)) {
+      // never blocks, a slow subscriber only loses its own oldest queued frames
+      server.PublishFrame(latest_frame);
+      std::cout << "Published frame " << server.GetNumberOfPublished() << " with " << latest_frame.x.size() << " points to "
+                << server.GetNumberOfSubscribers() << " subscribers, " << server.GetNumberOfDropped() << " dropped, "
+                << server.GetNumberOfBytesSent() << " bytes sent" << std::endl;
+    }
+  }
+
+  return 0;
+}
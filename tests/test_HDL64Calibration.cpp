@@ -0,0 +1,44 @@
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include "PacketDriver.h"
+#include "PacketDecoder.h"
+
+using namespace std;
+
+int main()
+{
+  PacketDriver driver;
+  driver.InitPacketDriver(DATA_PORT);
+  // a synthetic HDL-64E calibration with the two-point distance (distCorrectionX/Y) and focal intensity terms set,
+  // not a real sensor's - replace it with the db.xml shipped with the sensor
+  PacketDecoder decoder;
+  decoder.SetCorrectionsFile("../tests/synthetic_64db.xml");
+  PacketDecoder raw_decoder;
+  raw_decoder.SetCorrectionsFile("../tests/synthetic_64db.xml");
+  raw_decoder.SetIntensityCalibration(false);
+  if (!decoder.GetIntensityTable()) {
+    std::cout << "No intensity calibration in ../tests/synthetic_64db.xml" << std::endl;
+  }
+
+  std::string* data = new std::string();
+  unsigned int* dataLength = new unsigned int();
+  PacketDecoder::HDLFrame frame;
+  PacketDecoder::HDLFrame raw_frame;
+  while (true) {
+    driver.GetPacket(data, dataLength);
+    decoder.DecodePacket(data, dataLength);
+    raw_decoder.DecodePacket(data, dataLength);
+    if (decoder.GetLatestFrame(&frame) && raw_decoder.GetLatestFrame(&raw_frame) && !frame.intensity.empty()) {
+      double calibrated = 0, raw = 0;
+      for (unsigned int i = 0; i < frame.intensity.size(); i++) {
+        calibrated += frame.intensity[i];
+        raw += raw_frame.intensity[i];
+      }
+      std::cout << "Number of points: " << frame.x.size() << ", mean intensity " << raw/raw_frame.intensity.size()
+                << " raw, " << calibrated/frame.intensity.size() << " calibrated" << std::endl;
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,65 @@
+#include <iostream>
+#include "PacketDriver.h"
+#include "PacketBundler.h"
+#include "PacketBundleDecoder.h"
+#include "FrameQueue.h"
+#include "LatencyTrace.h"
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+
+using namespace std;
+
+// build with cmake -DHDL_TRACE=ON, run for a few seconds of streaming, then open trace.json in
+// chrome://tracing or ui.perfetto.dev to see each packet's socket, bundle, queue and decode time per thread
+
+FrameQueue<std::string> bundles(4);
+
+void OnFrame(const PacketBundleDecoder::HDLFrame& frame)
+{
+  std::cout << "Number of points: " << frame.x.size() << std::endl;
+}
+
+void DecodeThread()
+{
+  LatencyTrace::SetThreadName("decoder");
+  PacketBundleDecoder decoder;
+  decoder.SetFrameCallback(&OnFrame);
+  std::string bundle;
+  while (bundles.Pop(&bundle)) {
+    decoder.DecodeBundle(bundle.data(), bundle.size());
+  }
+}
+
+int main()
+{
+  if (!LatencyTrace::IsEnabled()) {
+    std::cout << "Trace points were compiled out, rebuild with -DHDL_TRACE=ON" << std::endl;
+  }
+  LatencyTrace::SetThreadName("receive");
+
+  PacketDriver driver;
+  driver.InitPacketDriver(DATA_PORT);
+  PacketBundler bundler;
+  boost::thread decode_thread(&DecodeThread);
+
+  std::string data;
+  unsigned int data_length;
+  PacketBundler::BundleView bundle;
+  unsigned int num_bundles = 0;
+  while (num_bundles < 100) {
+    driver.GetPacket(&data, &data_length);
+    bundler.BundlePacket(&data, &data_length);
+    if (bundler.AcquireLatestBundle(&bundle)) {
+      bundles.Push(std::string(bundle.data, bundle.length));
+      bundler.ReleaseBundle(&bundle);
+      num_bundles++;
+    }
+  }
+
+  bundles.Close();
+  decode_thread.join();
+  LatencyTrace::ExportChromeTrace("trace.json");
+  std::cout << "Wrote trace.json" << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,44 @@
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include "PacketDriver.h"
+#include "PacketBundler.h"
+#include "PacketBundleDecoder.h"
+#include "LazyFrame.h"
+
+using namespace std;
+
+int main()
+{
+  PacketDriver driver;
+  driver.InitPacketDriver(DATA_PORT);
+  PacketBundler bundler;
+  PacketBundleDecoder bundleDecoder;
+  bundleDecoder.SetCorrectionsFile("../32db.xml");
+
+  std::string* data = new std::string();
+  unsigned int* dataLength = new unsigned int();
+  PacketBundler::BundleView latest_bundle;
+  LazyFrame frame;
+  while (true) {
+    driver.GetPacket(data, dataLength);
+    bundler.BundlePacket(data, dataLength);
+    if (bundler.AcquireLatestBundle(&latest_bundle)) {
+      // only the lasers and columns looked at below are ever decoded
+      frame.Reset(&bundleDecoder, latest_bundle.data, latest_bundle.length);
+      frame.SetLaserRange(0, 7);
+      frame.SetAzimuthRange(31500, 4500);
+      const std::vector<double>& distance = frame.GetDistance();
+      double closest = 0;
+      for (unsigned int i = 0; i < distance.size(); i++) {
+        if (closest == 0 || distance[i] < closest) {
+          closest = distance[i];
+        }
+      }
+      std::cout << "Points ahead on lasers 0-7: " << distance.size() << ", closest: " << closest << std::endl;
+      bundler.ReleaseBundle(&latest_bundle);
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,40 @@
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include "PacketDriver.h"
+#include "PacketBundler.h"
+#include "PacketBundleCodec.h"
+#include "PacketBundleDecoder.h"
+#include <boost/shared_ptr.hpp>
+
+using namespace std;
+
+int main()
+{
+  PacketDriver driver;
+  driver.InitPacketDriver(DATA_PORT);
+  PacketBundler bundler;
+  PacketBundleCodec codec;
+  PacketBundleDecoder bundleDecoder;
+
+  std::string* data = new std::string();
+  unsigned int* dataLength = new unsigned int();
+  PacketBundler::BundleView latest_bundle;
+  std::string compressed;
+  PacketBundleDecoder::HDLFrame latest_frame;
+  while (true) {
+    driver.GetPacket(data, dataLength);
+    bundler.BundlePacket(data, dataLength);
+    if (bundler.AcquireLatestBundle(&latest_bundle)) {
+      codec.CompressBundle(latest_bundle.data, latest_bundle.length, &compressed);
+      std::cout << "Bundle length: " << latest_bundle.length << ", compressed: " << compressed.size() << std::endl;
+      bundler.ReleaseBundle(&latest_bundle);
+      bundleDecoder.DecodeCompressedBundle(compressed.data(), compressed.size());
+      if (bundleDecoder.GetLatestFrame(&latest_frame)) {
+        std::cout << "Number of points: " << latest_frame.x.size() << std::endl;
+      }
+    }
+  }
+
+  return 0;
+}
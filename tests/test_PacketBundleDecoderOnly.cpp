@@ -0,0 +1,36 @@
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include "PacketDriver.h"
+#include "PacketBundler.h"
+#include "PacketBundleDecoder.h"
+
+using namespace std;
+
+// linked against both PacketDecoder and PacketBundleDecoder (PacketDecoder first), but only a bundle decoder is
+// ever built - the azimuth table must still be there when the bundle decoder reaches it
+int main()
+{
+  PacketDriver driver;
+  driver.InitPacketDriver(DATA_PORT);
+  PacketBundler bundler;
+  PacketBundleDecoder bundleDecoder;
+
+  std::string* data = new std::string();
+  unsigned int* dataLength = new unsigned int();
+  std::string latest_bundle;
+  unsigned int latest_bundle_length;
+  PacketBundleDecoder::HDLFrame latest_frame;
+  while (true) {
+    driver.GetPacket(data, dataLength);
+    bundler.BundlePacket(data, dataLength);
+    if (bundler.GetLatestBundle(&latest_bundle, &latest_bundle_length)) {
+      bundleDecoder.DecodeBundle(&latest_bundle, &latest_bundle_length);
+      if (bundleDecoder.GetLatestFrame(&latest_frame)) {
+        std::cout << "Number of points: " << latest_frame.x.size() << std::endl;
+      }
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,37 @@
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include "PacketDriver.h"
+#include "PacketBundler.h"
+#include "PacketBundleDecoder.h"
+
+using namespace std;
+
+int main()
+{
+  PacketDriver driver;
+  driver.InitPacketDriver(DATA_PORT);
+  PacketBundler bundler;
+  PacketBundleDecoder bundleDecoder;
+
+  std::string* data = new std::string();
+  unsigned int* dataLength = new unsigned int();
+  PacketBundler::BundleView latest_bundle;
+  PacketBundleDecoder::HDLFrame latest_frame;
+  while (true) {
+    driver.GetPacket(data, dataLength);
+    bundler.BundlePacket(data, dataLength);
+    // decoded straight out of the bundler's slot rather than copied out of it first
+    if (bundler.AcquireLatestBundle(&latest_bundle)) {
+      std::cout << "Bundle length: " << latest_bundle.length << std::endl;
+      std::cout << "Bundle number of packets: " << (latest_bundle.length/1206) << std::endl;
+      bundleDecoder.DecodeBundle(latest_bundle.data, latest_bundle.length);
+      bundler.ReleaseBundle(&latest_bundle);
+      if (bundleDecoder.GetLatestFrame(&latest_frame)) {
+        std::cout << "Number of points: " << latest_frame.x.size() << std::endl;
+      }
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,27 @@
+#include <iostream>
+#include "PacketDriver.h"
+#include "PacketDecoder.h"
+
+int main()
+{
+  PacketDriver driver;
+  driver.InitPacketDriver(DATA_PORT);
+  PacketDecoder decoder;
+  decoder.SetCorrectionsFile("../32db.xml");
+  // a coarse view for a visualizer - each laser's closest return per degree, never more than 10000 points
+  decoder.SetAzimuthBinning(100, HDL_BIN_MIN_RANGE);
+  decoder.SetPointBudget(10000);
+
+  std::string* data = new std::string();
+  unsigned int* dataLength = new unsigned int();
+  PacketDecoder::HDLFrame latest_frame;
+  while (true) {
+    driver.GetPacket(data, dataLength);
+    decoder.DecodePacket(data, dataLength);
+    if (decoder.GetLatestFrame(&latest_frame)) {
+      std::cout << "Number of decimated points: " << latest_frame.x.size() << std::endl;
+    }
+  }
+
+  return 0;
+}
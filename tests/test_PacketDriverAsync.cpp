@@ -0,0 +1,59 @@
+#include <iostream>
+#include "PacketDriver.h"
+#include "PacketDecoder.h"
+#include <boost/bind.hpp>
+#include <boost/asio.hpp>
+
+using namespace std;
+
+PacketDecoder decoder;
+unsigned int num_packets = 0;
+unsigned int num_sectors = 0;
+
+void OnPacket(const char* data, unsigned int data_length, const struct timespec&)
+{
+  num_packets++;
+  decoder.DecodePacket(data, data_length);
+}
+
+void OnSector(const PacketDecoder::HDLFrame&, unsigned int, unsigned int)
+{
+  num_sectors++;
+}
+
+void OnFrame(const PacketDecoder::HDLFrame& frame)
+{
+  std::cout << "Number of points: " << frame.x.size() << ", sectors: " << num_sectors << std::endl;
+  num_sectors = 0;
+}
+
+void OnTimer(boost::asio::deadline_timer* timer, const boost::system::error_code& error)
+{
+  if (error) {
+    return;
+  }
+  std::cout << "Packets in the last second: " << num_packets << std::endl;
+  num_packets = 0;
+  timer->expires_at(timer->expires_at() + boost::posix_time::seconds(1));
+  timer->async_wait(boost::bind(&OnTimer, timer, boost::asio::placeholders::error));
+}
+
+int main()
+{
+  // the driver and a timer share one reactor thread, more sensors or sockets could be added the same way
+  boost::asio::io_service io_service;
+
+  PacketDriver driver(io_service);
+  driver.InitPacketDriver(DATA_PORT);
+  decoder.SetCorrectionsFile("../32db.xml");
+  decoder.SetSectorCallback(9000, &OnSector);
+  decoder.SetFrameCallback(&OnFrame);
+  driver.StartReceive(&OnPacket);
+
+  boost::asio::deadline_timer timer(io_service, boost::posix_time::seconds(1));
+  timer.async_wait(boost::bind(&OnTimer, &timer, boost::asio::placeholders::error));
+
+  io_service.run();
+
+  return 0;
+}
@@ -0,0 +1,32 @@
+#include <iostream>
+#include <iomanip>
+#include <stdio.h>
+#include <stdlib.h>
+#include "PacketDriver.h"
+
+using namespace std;
+
+int main()
+{
+  PacketDriverConfig config;
+  // ~4MB absorbs a second of HDL-64E, packets are stamped by the kernel on arrival
+  config.receive_buffer_size = 4*1024*1024;
+  config.kernel_timestamps = true;
+  config.cpu_affinity = 1;
+  PacketDriver driver;
+  driver.InitPacketDriver(DATA_PORT, config);
+  // this thread receives, so it takes the affinity and priority
+  driver.ConfigureReceiveThread();
+
+  std::string* data = new std::string();
+  unsigned int* dataLength = new unsigned int();
+  struct timespec timestamp;
+  while (true) {
+    driver.GetPacket(data, dataLength, &timestamp);
+    std::cout << "Length of packet: " << (*data).length() << ", received at: " << timestamp.tv_sec << "."
+              << std::setw(9) << std::setfill('0') << timestamp.tv_nsec << std::setfill(' ')
+              << ", dropped so far: " << driver.GetNumberOfDroppedPackets() << std::endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,29 @@
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include "PacketDriver.h"
+
+using namespace std;
+
+int main(int argc, char* argv[])
+{
+  // usage: test_PacketDriverShared [multicast group] - a consumer alongside test_PacketRelay (or any other process
+  // that sets reuse_port): binds port 2368 together with them, or with a group joins what the relay republishes
+  PacketDriverConfig config;
+  config.reuse_port = true;
+  if (argc > 1) {
+    config.multicast_group = argv[1];
+  }
+  PacketDriver driver;
+  driver.InitPacketDriver(DATA_PORT, config);
+
+  std::string* data = new std::string();
+  unsigned int* dataLength = new unsigned int();
+  while (true) {
+    driver.GetPacket(data, dataLength);
+    std::cout << "Length of packet: " << (*data).length() << std::endl;
+  }
+
+  return 0;
+}
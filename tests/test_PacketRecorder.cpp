@@ -0,0 +1,47 @@
+#include <iostream>
+#include "PacketDriver.h"
+#include "PacketDecoder.h"
+#include "PacketRecorder.h"
+
+using namespace std;
+
+void OnDump(const std::string& filename, uint64_t num_packets, uint64_t num_lost)
+{
+  std::cout << "Wrote " << num_packets << " packets to " << filename << " (" << num_lost << " lost)" << std::endl;
+}
+
+int main()
+{
+  PacketDriver driver;
+  driver.InitPacketDriver(DATA_PORT);
+  PacketDecoder decoder;
+  decoder.SetCorrectionsFile("../32db.xml");
+  // keep the last 10 seconds, the recorder costs one memcpy per packet on this thread
+  PacketRecorder recorder(10);
+  recorder.SetDumpCallback(&OnDump);
+
+  std::string data;
+  unsigned int data_length;
+  struct timespec timestamp;
+  PacketDecoder::HDLFrame latest_frame;
+  unsigned int num_frames = 0;
+  unsigned int last_size = 0;
+  while (true) {
+    driver.GetPacket(&data, &data_length, &timestamp);
+    recorder.Record(data.data(), data_length, timestamp);
+    decoder.DecodePacket(&data, &data_length);
+    if (decoder.GetLatestFrame(&latest_frame)) {
+      num_frames++;
+      unsigned int size = latest_frame.x.size();
+      std::cout << "Number of points: " << size << std::endl;
+      // a frame with under half the points of the one before stands in for an incident - dump the
+      // 10 seconds before it and 2 seconds after, without holding up reception
+      if (last_size && size < last_size/2) {
+        recorder.Trigger("incident.pcap", 2);
+      }
+      last_size = size;
+    }
+  }
+
+  return 0;
+}
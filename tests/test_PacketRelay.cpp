@@ -0,0 +1,29 @@
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include "PacketRelay.h"
+
+using namespace std;
+
+int main(int argc, char* argv[])
+{
+  // usage: test_PacketRelay [multicast group] - receives port 2368 once, sharing it with any other consumer that
+  // sets reuse_port, and republishes every packet to the group (239.255.0.1 by default) on port 2368 and to local
+  // port 2369, for consumers that cannot share the socket
+  std::string group = (argc > 1) ? argv[1] : "239.255.0.1";
+  PacketDriverConfig config;
+  config.receive_buffer_size = 4*1024*1024;
+  config.reuse_port = true;
+
+  PacketRelay relay;
+  relay.AddDestination(group, DATA_PORT);
+  relay.AddDestination("127.0.0.1", DATA_PORT + 1);
+  if (!relay.Open(DATA_PORT, config)) {
+    return 1;
+  }
+  relay.Run();
+  std::cout << "Relayed " << relay.GetNumberOfReceived() << " packets as " << relay.GetNumberOfSent() << " datagrams" << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,35 @@
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <arpa/inet.h>
+#include "PacketRingDriver.h"
+#include "PacketDecoder.h"
+
+using namespace std;
+
+int main(int argc, char* argv[])
+{
+  std::string interface = (argc > 1) ? argv[1] : "";
+  PacketRingDriver driver;
+  if (!driver.InitPacketRingDriver(interface, 2368)) {
+    return 1;
+  }
+  PacketDecoder decoder;
+  decoder.SetCorrectionsFile("../32db.xml");
+
+  PacketRingDriver::PacketView packet;
+  PacketDecoder::HDLFrame latest_frame;
+  while (true) {
+    if (!driver.GetPacketView(&packet)) {
+      continue;
+    }
+    decoder.DecodePacket(packet.data, packet.length);
+    if (decoder.GetLatestFrame(&latest_frame)) {
+      struct in_addr source;
+      source.s_addr = htonl(packet.source_address);
+      std::cout << "Number of points: " << latest_frame.x.size() << " from " << inet_ntoa(source) << std::endl;
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,59 @@
+#include <iostream>
+#include <cstdlib>
+#include <sys/time.h>
+#include "PacketSource.h"
+#include "PacketDecoder.h"
+#include <boost/shared_ptr.hpp>
+
+using namespace std;
+
+// the consumer only sees a PacketSource, so the same code runs live or on a recording at full speed
+PacketDecoder decoder;
+PacketClock* source_clock = NULL;
+unsigned int num_frames = 0;
+
+void OnPacket(const char* data, unsigned int data_length, const struct timespec&)
+{
+  decoder.DecodePacket(data, data_length);
+}
+
+void OnFrame(const PacketDecoder::HDLFrame& frame)
+{
+  num_frames++;
+  std::cout.precision(15);
+  std::cout << "Number of points: " << frame.x.size() << ", clock: " << source_clock->GetSeconds() << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+  // usage: test_PacketSource [file.pcap [replay speed, 0 for as fast as possible]]
+  boost::shared_ptr<PacketSource> source;
+  if (argc > 1) {
+    boost::shared_ptr<PcapPacketSource> pcap(new PcapPacketSource(argv[1]));
+    if (!pcap->IsOpen()) {
+      return 1;
+    }
+    // load the whole capture up front so the disk is not part of the measurement
+    boost::shared_ptr<MemoryPacketSource> memory(new MemoryPacketSource());
+    memory->Load(*pcap);
+    memory->SetReplaySpeed(argc > 2 ? atof(argv[2]) : 0);
+    source = memory;
+  } else {
+    source.reset(new UdpPacketSource(DATA_PORT));
+  }
+  source_clock = &source->GetClock();
+
+  decoder.SetCorrectionsFile("../32db.xml");
+  decoder.SetFrameCallback(&OnFrame);
+
+  struct timeval start, end;
+  gettimeofday(&start, NULL);
+  uint64_t num_packets = source->Run(&OnPacket);
+  gettimeofday(&end, NULL);
+
+  double seconds = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec)/1e6;
+  std::cout << num_packets << " packets, " << num_frames << " frames in " << seconds << "s ("
+            << num_packets/seconds << " packets/s)" << std::endl;
+
+  return 0;
+}
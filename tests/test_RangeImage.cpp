@@ -0,0 +1,39 @@
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include "PacketDriver.h"
+#include "PacketDecoder.h"
+#include "RangeImage.h"
+
+int main()
+{
+  PacketDriver driver;
+  driver.InitPacketDriver(DATA_PORT);
+  PacketDecoder decoder;
+  decoder.SetCorrectionsFile("../32db.xml");
+  RangeImage image(decoder.GetLaserCorrections());
+
+  std::string* data = new std::string();
+  unsigned int* dataLength = new unsigned int();
+  PacketDecoder::HDLFrame latest_frame;
+  std::vector<unsigned int> indices;
+  std::vector<double> sq_distances;
+  std::vector<float> nx, ny, nz, curvature;
+  while (true) {
+    driver.GetPacket(data, dataLength);
+    decoder.DecodePacket(data, dataLength);
+    if (decoder.GetLatestFrame(&latest_frame) && image.SetFrame(latest_frame) && image.GetNumberOfPoints()) {
+      image.ComputeNormals(0.3, &nx, &ny, &nz, &curvature);
+      unsigned int valid = 0;
+      for (unsigned int i = 0; i < nx.size(); i++) {
+        valid += !std::isnan(nx[i]);
+      }
+      unsigned int middle = image.GetNumberOfPoints()/2;
+      image.NearestKSearch(middle, 8, &indices, &sq_distances);
+      std::cout << "Number of points: " << image.GetNumberOfPoints() << ", with normals: " << valid
+                << ", 8th neighbour of point " << middle << " at " << sqrt(sq_distances.back()) << "m" << std::endl;
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,40 @@
+#include <iostream>
+#include "RosbagPacketSource.h"
+#include "PacketDecoder.h"
+
+using namespace std;
+
+// decodes a bag directly, no pcap conversion or ROS needed
+PacketDecoder decoder;
+RosbagPacketSource* source = NULL;
+
+void OnPacket(const char* data, unsigned int data_length, const struct timespec&)
+{
+  decoder.DecodePacket(data, data_length);
+}
+
+void OnFrame(const PacketDecoder::HDLFrame& frame)
+{
+  std::cout.precision(15);
+  std::cout << "Number of points: " << frame.x.size() << ", bag time: " << source->GetClock().GetSeconds() << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+  if (argc < 2) {
+    std::cout << "Usage: " << argv[0] << " <in.bag> [topic]" << std::endl;
+    return 1;
+  }
+  RosbagPacketSource bag(argv[1], argc > 2 ? argv[2] : "");
+  if (!bag.IsOpen()) {
+    return 1;
+  }
+  source = &bag;
+
+  decoder.SetCorrectionsFile("../32db.xml");
+  decoder.SetFrameCallback(&OnFrame);
+  uint64_t num_packets = bag.Run(&OnPacket);
+  std::cout << num_packets << " packets from " << bag.GetNumberOfScans() << " scans" << std::endl;
+
+  return 0;
+}
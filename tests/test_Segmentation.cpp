@@ -0,0 +1,29 @@
+#include <iostream>
+#include "PacketDriver.h"
+#include "PacketDecoder.h"
+#include "Segmentation.h"
+
+int main()
+{
+  PacketDriver driver;
+  driver.InitPacketDriver(DATA_PORT);
+  PacketDecoder decoder;
+  decoder.SetCorrectionsFile("../32db.xml");
+  Segmentation segmentation(decoder.GetLaserCorrections());
+  segmentation.SetGroundHeight(-1.8);
+  segmentation.SetClusterTolerance(0.5);
+
+  std::string* data = new std::string();
+  unsigned int* dataLength = new unsigned int();
+  PacketDecoder::HDLFrame latest_frame;
+  while (true) {
+    driver.GetPacket(data, dataLength);
+    decoder.DecodePacket(data, dataLength);
+    if (decoder.GetLatestFrame(&latest_frame) && segmentation.Segment(&latest_frame)) {
+      std::cout << "Number of points: " << latest_frame.x.size() << ", ground: " << segmentation.GetNumberOfGroundPoints()
+                << ", clusters: " << segmentation.GetNumberOfClusters() << std::endl;
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,36 @@
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include "PacketDriver.h"
+#include "PacketDecoder.h"
+#include "SharedMemoryPublisher.h"
+#include <boost/shared_ptr.hpp>
+
+using namespace std;
+
+int main()
+{
+  PacketDriver driver;
+  driver.InitPacketDriver(DATA_PORT);
+  PacketDecoder decoder;
+  decoder.SetCorrectionsFile("../32db.xml");
+  SharedMemoryPublisher publisher;
+  if (!publisher.Open("/velodyne_frames")) {
+    std::cerr << "Could not open shared memory ring - " << publisher.GetLastError() << std::endl;
+    return 1;
+  }
+
+  std::string* data = new std::string();
+  unsigned int* dataLength = new unsigned int();
+  PacketDecoder::HDLFrame latest_frame;
+  while (true) {
+    driver.GetPacket(data, dataLength);
+    decoder.DecodePacket(data, dataLength);
+    if (decoder.GetLatestFrame(&latest_frame)) {
+      publisher.PublishFrame(latest_frame);
+      std::cout << "Published frame " << publisher.GetNumberOfPublished() << " with " << latest_frame.x.size() << " points" << std::endl;
+    }
+  }
+
+  return 0;
+}
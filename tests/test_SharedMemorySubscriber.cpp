@@ -0,0 +1,47 @@
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include "SharedMemorySubscriber.h"
+#include <boost/thread/thread.hpp>
+
+using namespace std;
+
+int main()
+{
+  SharedMemorySubscriber subscriber;
+  while (!subscriber.Open("/velodyne_frames")) {
+    std::cout << "Waiting for shared memory ring - " << subscriber.GetLastError() << std::endl;
+    boost::this_thread::sleep(boost::posix_time::seconds(1));
+  }
+
+  SharedMemorySubscriber::SharedFrame frame;
+  unsigned int idle = 0;
+  while (true) {
+    if (subscriber.GetNextFrame(&frame)) {
+      idle = 0;
+      double max_distance = 0;
+      for (unsigned int i = 0; i < frame.num_points; i++) {
+        max_distance = (frame.distance[i] > max_distance) ? frame.distance[i] : max_distance;
+      }
+      if (subscriber.IsValid(frame)) {
+        std::cout << "Frame " << frame.sequence << ": " << frame.num_points << " points, max distance " << max_distance << std::endl;
+      } else {
+        std::cout << "Frame " << frame.sequence << " was overwritten while reading" << std::endl;
+      }
+    } else {
+      boost::this_thread::sleep(boost::posix_time::milliseconds(5));
+      // no frames for a second, follow the publisher if it restarted with a new ring
+      if (++idle == 200) {
+        idle = 0;
+        if (subscriber.IsStale()) {
+          std::cout << "Shared memory ring was closed or restarted, reopening" << std::endl;
+          while (!subscriber.Open("/velodyne_frames")) {
+            boost::this_thread::sleep(boost::posix_time::seconds(1));
+          }
+        }
+      }
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,31 @@
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include "PacketDriver.h"
+#include "PacketDecoder.h"
+#include <boost/shared_ptr.hpp>
+#include<deque>
+
+using namespace std;
+
+int main()
+{
+  PacketDriver driver;
+  driver.InitPacketDriver(DATA_PORT);
+  PacketDecoder decoder;
+  decoder.SetCorrectionsFile("../32db.xml");
+  decoder.SetVoxelGrid(0.2, VoxelGrid::VOXEL_CENTROID);
+
+  std::string* data = new std::string();
+  unsigned int* dataLength = new unsigned int();
+  PacketDecoder::HDLFrame latest_frame;
+  while (true) {
+    driver.GetPacket(data, dataLength);
+    decoder.DecodePacket(data, dataLength);
+    if (decoder.GetLatestFrame(&latest_frame)) {
+      std::cout << "Number of voxel-downsampled points: " << latest_frame.x.size() << std::endl;
+    }
+  }
+
+  return 0;
+}
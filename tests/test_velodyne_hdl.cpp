@@ -0,0 +1,47 @@
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <Python.h>
+#include <boost/python.hpp>
+#include "PacketDriver.h"
+
+using namespace std;
+
+namespace bp = boost::python;
+
+int main()
+{
+  PacketDriver driver;
+  driver.InitPacketDriver(DATA_PORT);
+
+  // the module is built next to this executable
+  Py_Initialize();
+  try {
+    bp::import("sys").attr("path").attr("insert")(0, ".");
+    bp::object velodyne_hdl = bp::import("velodyne_hdl");
+    bp::object decoder = velodyne_hdl.attr("PacketDecoder")();
+    decoder.attr("set_corrections_file")("../32db.xml");
+
+    std::string* data = new std::string();
+    unsigned int* dataLength = new unsigned int();
+    while (true) {
+      driver.GetPacket(data, dataLength);
+      bp::object packet(bp::handle<>(PyBytes_FromStringAndSize(data->data(), *dataLength)));
+      decoder.attr("decode_packet")(packet);
+      bp::object frame = decoder.attr("get_latest_frame")();
+      if (!frame.is_none()) {
+        // the columns are numpy views of the frame's vectors, not copies
+        bp::object x = frame.attr("x");
+        bool owns_data = bp::extract<bool>(x.attr("flags").attr("owndata"));
+        double max_distance = bp::extract<double>(frame.attr("distance").attr("max")());
+        std::cout << "Number of points: " << bp::len(frame) << ", max distance " << max_distance
+                  << (owns_data ? ", columns copied" : ", columns shared") << std::endl;
+      }
+    }
+  } catch (const bp::error_already_set&) {
+    PyErr_Print();
+    return 1;
+  }
+
+  return 0;
+}